@@ -0,0 +1,32 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/audit_context.h"
+
+namespace pathauditor {
+
+absl::StatusOr<const char *> AuditContext::CStr(absl::string_view s) {
+  const char *copy = arena_.CopyString(s);
+  if (copy == nullptr) {
+    return absl::ResourceExhaustedError("Audit context is out of memory");
+  }
+  return copy;
+}
+
+AuditContext &AuditContext::ForCurrentThread() {
+  static thread_local AuditContext context;
+  return context;
+}
+
+}  // namespace pathauditor
@@ -0,0 +1,68 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_AUDIT_CONTEXT_H_
+#define PATHAUDITOR_AUDIT_CONTEXT_H_
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "pathauditor/util/arena.h"
+
+namespace pathauditor {
+
+// Scratch memory for the audits on the current thread. What an audit needs
+// while it checks an event, like NUL terminated copies of the paths, comes
+// from the arena of the context instead of the heap and is given back when
+// the audit returns.
+class AuditContext {
+ public:
+  // Frees what was allocated from the context of the current thread during
+  // its lifetime. Scopes can nest.
+  class Scope {
+   public:
+    Scope()
+        : context_(AuditContext::ForCurrentThread()),
+          mark_(context_.arena_.GetMark()) {}
+    ~Scope() { context_.arena_.Rewind(mark_); }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+    AuditContext &context() { return context_; }
+
+   private:
+    AuditContext &context_;
+    Arena::Mark mark_;
+  };
+
+  AuditContext() = default;
+
+  AuditContext(const AuditContext &) = delete;
+  AuditContext &operator=(const AuditContext &) = delete;
+
+  Arena &arena() { return arena_; }
+
+  // Returns s as a NUL terminated string that can be passed to syscalls. The
+  // copy lives until the enclosing Scope ends.
+  absl::StatusOr<const char *> CStr(absl::string_view s);
+
+  static AuditContext &ForCurrentThread();
+
+ private:
+  Arena arena_;
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_AUDIT_CONTEXT_H_
@@ -0,0 +1,333 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Audits the events that processes running with libpath_auditor.so and
+// PATHAUDITOR_DAEMON_DIR put into their rings, see event_ring.h.
+// Needs to run as root to access the rings and fds of other processes.
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+#include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_join.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "pathauditor/daemon/ring_reader.h"
+#include "pathauditor/daemon/snapshot_process_information.h"
+#include "pathauditor/daemon/worker_pool.h"
+#include "pathauditor/event_ring.h"
+#include "pathauditor/file_event.h"
+#include "pathauditor/mount_namespace_cache.h"
+#include "pathauditor/path_audit_result.h"
+#include "pathauditor/pathauditor.h"
+#include "pathauditor/process_information.h"
+#include "pathauditor/util/flag.h"
+#include "pathauditor/watched_prefix_cache.h"
+
+ABSL_FLAG(string, ring_dir, "/run/pathauditor",
+          "Directory in which the audited processes announce their rings. "
+          "Created as a sticky, world writable directory if missing.");
+ABSL_FLAG(int32_t, workers, 0,
+          "Number of threads auditing events. 0 means one per CPU.");
+ABSL_FLAG(int32_t, poll_interval_ms, 1,
+          "How long a worker sleeps when there are no events to audit.");
+ABSL_FLAG(int32_t, scan_interval_ms, 100,
+          "How often the ring directory is scanned for new rings.");
+ABSL_FLAG(int32_t, stats_interval_s, 60,
+          "How often the worker statistics are logged. 0 disables them.");
+ABSL_FLAG(bool, watch_prefixes, true,
+          "Remember the directories that walks went through and use inotify "
+          "to notice when they change, see WatchedPrefixCache.");
+
+namespace pathauditor {
+namespace {
+
+// Events audited from one ring before moving on to the next one. Also the
+// smallest batch that idle workers steal from other shards.
+constexpr size_t kDrainBatch = 64;
+
+void LogInsecureAccess(const RingReader &ring, const RingFileEvent &raw,
+                       const FileEvent &event, const PathAuditResult &result) {
+  syslog(LOG_WARNING,
+         "InsecureAccess: function %s, pid %d, cmdline %s, syscall_nr %d, "
+         "args %s, path args %s, unsafe element %s",
+         std::string(RingFileEventFunctionName(raw)).c_str(), ring.pid(),
+         ring.cmdline().c_str(), event.syscall_nr,
+         absl::StrJoin(event.args, ", ").c_str(),
+         absl::StrJoin(event.path_args, ", ").c_str(),
+         DescribePathAuditResult(result).c_str());
+}
+
+void LogError(const RingReader &ring, const absl::Status &status) {
+  syslog(LOG_WARNING, "Cannot audit pid %d: %s", ring.pid(),
+         std::string(status.message()).c_str());
+}
+
+void Audit(const RingReader &ring, const RingFileEvent &raw) {
+  absl::StatusOr<FileEvent> event = DecodeRingFileEvent(raw);
+  if (!event.ok()) {
+    LogError(ring, event.status());
+    return;
+  }
+  // Events can still be queued after the process exited. Resolving them in its
+  // mount namespace is better than giving up, resolving them in ours is not.
+  RemoteProcessInformation remote(
+      &ring.fds(), RingFileEventCwd(raw), absl::nullopt,
+      /*fallback=*/ring.fds().mount_namespace() != nullptr);
+  SnapshotProcessInformation proc_info(
+      remote, absl::MakeConstSpan(raw.fds, raw.fd_count));
+  absl::StatusOr<PathAuditResult> result =
+      ExplainFileEventIsUserControlled(proc_info, *event);
+  if (!result.ok()) {
+    LogError(ring, result.status());
+  } else if (result->user_controlled) {
+    LogInsecureAccess(ring, raw, *event, *result);
+  }
+
+  // The events are queued before the call, so everything after this one sees
+  // the new directory if the call succeeds.
+  switch (event->syscall_nr) {
+    case SYS_chdir:
+      ring.fds().InvalidateCwd();
+      break;
+    case SYS_chroot:
+      ring.fds().InvalidateRoot();
+      break;
+  }
+}
+
+// Removes the announcement of a ring we're done with, unless the process
+// exec'ed and replaced it.
+void RemoveAnnouncement(int ring_dir_fd, const RingReader &ring) {
+  std::string name = std::to_string(ring.pid());
+  struct stat sb;
+  if (fstatat(ring_dir_fd, name.c_str(), &sb, AT_SYMLINK_NOFOLLOW) == 0 &&
+      sb.st_ino == ring.announcement_ino()) {
+    unlinkat(ring_dir_fd, name.c_str(), 0);
+  }
+}
+
+// The events of one process for the WorkerPool.
+class RingSource : public WorkSource {
+ public:
+  // own_prefixes is the prefix cache for our mount namespace, if any.
+  RingSource(int ring_dir_fd, std::unique_ptr<RingReader> ring,
+             WatchedPrefixCache *own_prefixes)
+      : ring_dir_fd_(ring_dir_fd),
+        ring_(std::move(ring)),
+        own_prefixes_(own_prefixes) {}
+
+  ~RingSource() override { RemoveAnnouncement(ring_dir_fd_, *ring_); }
+
+  size_t Process(size_t max_items) override {
+    const RingReader &ring = *ring_;
+    // Whether the process switched namespaces and what changed in the watched
+    // directories is picked up once per batch instead of on every walk.
+    ring.fds().RefreshMountNamespace();
+    const MountNamespace *mount_namespace = ring.fds().mount_namespace();
+    if (mount_namespace == nullptr || mount_namespace->is_own()) {
+      if (own_prefixes_ != nullptr) {
+        own_prefixes_->Poll();
+      }
+    } else if (mount_namespace->watched_prefixes() != nullptr) {
+      mount_namespace->watched_prefixes()->Poll();
+    }
+    return ring_->Drain(
+        [&ring](const RingFileEvent &event) { Audit(ring, event); },
+        max_items);
+  }
+
+  size_t Pending() const override { return ring_->Pending(); }
+
+  bool Finished() const override { return !ring_->ProcessAlive(); }
+
+ private:
+  const int ring_dir_fd_;
+  std::unique_ptr<RingReader> ring_;
+  WatchedPrefixCache *const own_prefixes_;
+};
+
+// Logs the queue depth and steal counts of every worker. Runs forever.
+void LogStats(const WorkerPool &pool, std::chrono::seconds interval) {
+  while (true) {
+    std::this_thread::sleep_for(interval);
+    std::vector<WorkerStats> stats = pool.Stats();
+    for (size_t i = 0; i < stats.size(); i++) {
+      syslog(LOG_INFO,
+             "Worker %zu: rings %zu, queue depth %zu, audited %" PRIu64
+             ", steals %" PRIu64 ", stolen %" PRIu64,
+             i, stats[i].sources, stats[i].queue_depth, stats[i].processed,
+             stats[i].steals, stats[i].stolen);
+    }
+  }
+}
+
+// Opens the ring directory or creates it. Refuses to use it if it's not ours or
+// if other users could delete or replace announcements.
+absl::StatusOr<int> OpenRingDir(const std::string &path) {
+  if (mkdir(path.c_str(), 01733) == 0) {
+    chmod(path.c_str(), 01733);
+  } else if (errno != EEXIST) {
+    return absl::FailedPreconditionError("Could not create the ring dir");
+  }
+  int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd == -1) {
+    return absl::FailedPreconditionError("Could not open the ring dir");
+  }
+  struct stat sb;
+  if (fstat(fd, &sb) == -1 || sb.st_uid != geteuid() ||
+      !(sb.st_mode & S_ISVTX)) {
+    close(fd);
+    return absl::FailedPreconditionError(
+        "The ring dir needs to be owned by us and sticky");
+  }
+  return fd;
+}
+
+// Looks for new announcements and hands the rings to the workers. Runs
+// forever. The directory is rescanned whenever a file is moved into it and
+// every scan_interval in case we missed an event.
+void ScanRingDir(const std::string &ring_dir_path, int ring_dir_fd,
+                 WorkerPool &pool, MountNamespaceCache &namespaces,
+                 WatchedPrefixCache *own_prefixes,
+                 std::chrono::milliseconds scan_interval) {
+  int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd == -1 ||
+      inotify_add_watch(inotify_fd, ring_dir_path.c_str(), IN_MOVED_TO) ==
+          -1) {
+    LOG(ERROR) << "Could not watch the ring dir, falling back to polling";
+  }
+  DIR *dir = fdopendir(dup(ring_dir_fd));
+  if (dir == nullptr) {
+    LOG(ERROR) << "Could not list the ring dir";
+    return;
+  }
+
+  // The announcements we've looked at, by pid.
+  absl::flat_hash_map<pid_t, ino_t> known;
+  while (true) {
+    rewinddir(dir);
+    absl::flat_hash_map<pid_t, ino_t> seen;
+    while (struct dirent *entry = readdir(dir)) {
+      pid_t pid;
+      if (!absl::SimpleAtoi(entry->d_name, &pid) || pid <= 0) {
+        continue;
+      }
+      seen[pid] = entry->d_ino;
+      auto it = known.find(pid);
+      if (it != known.end() && it->second == entry->d_ino) {
+        continue;
+      }
+      absl::StatusOr<std::unique_ptr<RingReader>> ring =
+          RingReader::Open(ring_dir_fd, pid, &namespaces);
+      if (!ring.ok()) {
+        if (absl::IsNotFound(ring.status())) {
+          // The process exited before we noticed it.
+          unlinkat(ring_dir_fd, entry->d_name, 0);
+        } else {
+          syslog(LOG_WARNING, "Ignoring ring of pid %d: %s", pid,
+                 std::string(ring.status().message()).c_str());
+        }
+        continue;
+      }
+      // Keyed by pid so that the ring of an exec'ed process supersedes the old
+      // one and the events of a process are audited by the same worker.
+      pool.Add(pid, absl::make_unique<RingSource>(ring_dir_fd, *std::move(ring),
+                                                  own_prefixes));
+    }
+    known.swap(seen);
+
+    struct pollfd pfd = {inotify_fd, POLLIN, 0};
+    if (inotify_fd != -1 &&
+        poll(&pfd, 1, static_cast<int>(scan_interval.count())) > 0) {
+      char events[4096];
+      while (read(inotify_fd, events, sizeof(events)) > 0) {
+      }
+    } else if (inotify_fd == -1) {
+      std::this_thread::sleep_for(scan_interval);
+    }
+  }
+}
+
+}  // namespace
+}  // namespace pathauditor
+
+int main(int argc, char **argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  openlog("pathauditor-daemon", LOG_PID, LOG_DAEMON);
+
+  absl::StatusOr<int> ring_dir_fd =
+      pathauditor::OpenRingDir(absl::GetFlag(FLAGS_ring_dir));
+  if (!ring_dir_fd.ok()) {
+    LOG(ERROR) << ring_dir_fd.status().message();
+    return 1;
+  }
+
+  int workers = absl::GetFlag(FLAGS_workers);
+  if (workers <= 0) {
+    workers = std::max(1u, std::thread::hardware_concurrency());
+  }
+  pathauditor::WatchedPrefixCache *own_prefixes = nullptr;
+  if (absl::GetFlag(FLAGS_watch_prefixes)) {
+    absl::StatusOr<std::unique_ptr<pathauditor::WatchedPrefixCache>> cache =
+        pathauditor::WatchedPrefixCache::Create();
+    if (cache.ok()) {
+      // Lives until exit, the workers are never stopped.
+      own_prefixes = cache->release();
+      pathauditor::SetWatchedPrefixCache(own_prefixes);
+    } else {
+      LOG(WARNING) << "Not caching prefixes: " << cache.status().message();
+    }
+  }
+
+  // Processes in the same container share their root and prefix cache.
+  pathauditor::MountNamespaceCache namespaces(
+      absl::GetFlag(FLAGS_watch_prefixes));
+
+  pathauditor::WorkerPool pool(
+      workers, pathauditor::kDrainBatch,
+      std::chrono::milliseconds(absl::GetFlag(FLAGS_poll_interval_ms)));
+  if (absl::GetFlag(FLAGS_stats_interval_s) > 0) {
+    std::thread(pathauditor::LogStats, std::cref(pool),
+                std::chrono::seconds(absl::GetFlag(FLAGS_stats_interval_s)))
+        .detach();
+  }
+
+  pathauditor::ScanRingDir(
+      absl::GetFlag(FLAGS_ring_dir), *ring_dir_fd, pool, namespaces,
+      own_prefixes,
+      std::chrono::milliseconds(absl::GetFlag(FLAGS_scan_interval_ms)));
+  return 1;
+}
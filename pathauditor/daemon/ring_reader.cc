@@ -0,0 +1,192 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/daemon/ring_reader.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "pathauditor/util/cleanup.h"
+#include "pathauditor/util/status_macros.h"
+
+#ifndef F_GET_SEALS
+#define F_GET_SEALS 1034
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#endif
+
+namespace pathauditor {
+
+namespace {
+
+constexpr int kRequiredSeals = F_SEAL_SHRINK | F_SEAL_GROW;
+
+// Opens a regular file relative to dir_fd and returns its stat in sb. The
+// directory can be writable by others, so this neither follows symlinks nor
+// blocks on a FIFO that was swapped in.
+absl::StatusOr<int> OpenRegularFile(int dir_fd, const char *name,
+                                    struct stat *sb) {
+  int fd = openat(dir_fd, name, O_RDONLY | O_NONBLOCK | O_NOFOLLOW | O_CLOEXEC);
+  if (fd == -1) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Could not open \"", name, "\""));
+  }
+  if (fstat(fd, sb) == -1 || !S_ISREG(sb->st_mode)) {
+    close(fd);
+    return absl::FailedPreconditionError(
+        absl::StrCat("\"", name, "\" is not a regular file"));
+  }
+  return fd;
+}
+
+// Reads at most max_len bytes from fd.
+absl::StatusOr<std::string> ReadSmallFile(int fd, const char *name,
+                                          size_t max_len) {
+  std::string content(max_len, '\0');
+  ssize_t bytes = read(fd, &content[0], content.size());
+  if (bytes == -1) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Could not read \"", name, "\""));
+  }
+  content.resize(bytes);
+  return content;
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<RingReader>> RingReader::Open(
+    int ring_dir_fd, pid_t pid, MountNamespaceCache *namespaces) {
+  std::string name = absl::StrCat(pid);
+  struct stat announcement;
+  absl::StatusOr<int> announcement_fd =
+      OpenRegularFile(ring_dir_fd, name.c_str(), &announcement);
+  if (!announcement_fd.ok()) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("No ring announced for pid ", pid));
+  }
+  auto close_announcement_fd = MakeCleanup(
+      [&announcement_fd]() { close(*announcement_fd); });
+
+  PATHAUDITOR_ASSIGN_OR_RETURN(std::unique_ptr<ProcFdCache> fds,
+                               ProcFdCache::Open(pid, namespaces));
+  int proc_fd = fds->proc_fd();
+  struct stat proc_sb;
+  if (fstat(proc_fd, &proc_sb) == -1) {
+    return absl::NotFoundError(absl::StrCat("Process ", pid, " is gone"));
+  }
+  // Otherwise anyone could make us read another process' memfds.
+  if (proc_sb.st_uid != announcement.st_uid) {
+    return absl::PermissionDeniedError(absl::StrCat(
+        "Ring announcement for pid ", pid, " is owned by uid ",
+        announcement.st_uid, " but the process by uid ", proc_sb.st_uid));
+  }
+
+  // The fd number is all that's in the announcement.
+  PATHAUDITOR_ASSIGN_OR_RETURN(
+      std::string content, ReadSmallFile(*announcement_fd, name.c_str(), 16));
+  int ring_fd_nr;
+  if (!absl::SimpleAtoi(absl::StripAsciiWhitespace(content), &ring_fd_nr) ||
+      ring_fd_nr < 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Malformed ring announcement for pid ", pid));
+  }
+
+  // The fd could be anything, e.g. a tty, and opening devices can have side
+  // effects. Look at it through an O_PATH fd first and only open it for real
+  // once it's a regular file, then check the seals before opening it
+  // read-write. Going through our own fd keeps the process from swapping the
+  // file in between.
+  int path_fd = openat(proc_fd, absl::StrCat("fd/", ring_fd_nr).c_str(),
+                       O_PATH | O_CLOEXEC);
+  if (path_fd == -1) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Could not open the ring of pid ", pid));
+  }
+  auto close_path_fd = MakeCleanup([path_fd]() { close(path_fd); });
+  absl::Status not_a_ring = absl::InvalidArgumentError(
+      absl::StrCat("fd ", ring_fd_nr, " of pid ", pid, " is not a ring"));
+  struct stat ring_sb;
+  if (fstat(path_fd, &ring_sb) == -1 || !S_ISREG(ring_sb.st_mode) ||
+      ring_sb.st_size != sizeof(EventRing)) {
+    return not_a_ring;
+  }
+  std::string reopen_path = absl::StrCat("/proc/self/fd/", path_fd);
+
+  // Without the seals the process could truncate the memfd and we would get
+  // a SIGBUS when accessing the mapping. Only memfds have seals.
+  int read_fd = open(reopen_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (read_fd == -1) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Could not open the ring of pid ", pid));
+  }
+  int seals = fcntl(read_fd, F_GET_SEALS);
+  close(read_fd);
+  if (seals == -1 || (seals & kRequiredSeals) != kRequiredSeals) {
+    return not_a_ring;
+  }
+
+  int ring_fd = open(reopen_path.c_str(), O_RDWR | O_CLOEXEC);
+  if (ring_fd == -1) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Could not open the ring of pid ", pid));
+  }
+  auto close_ring_fd = MakeCleanup([ring_fd]() { close(ring_fd); });
+
+  void *mem = mmap(nullptr, sizeof(EventRing), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, ring_fd, 0);
+  if (mem == MAP_FAILED) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Could not map the ring of pid ", pid));
+  }
+  EventRing *ring = static_cast<EventRing *>(mem);
+  if (ring->magic != kEventRingMagic || ring->version != kEventRingVersion ||
+      ring->size != sizeof(EventRing)) {
+    munmap(mem, sizeof(EventRing));
+    return absl::InvalidArgumentError(
+        absl::StrCat("Unsupported ring format for pid ", pid));
+  }
+
+  std::string cmdline = "(unknown)";
+  struct stat cmdline_sb;
+  absl::StatusOr<int> cmdline_fd =
+      OpenRegularFile(proc_fd, "cmdline", &cmdline_sb);
+  if (cmdline_fd.ok()) {
+    cmdline = ReadSmallFile(*cmdline_fd, "cmdline", 1024).value_or(cmdline);
+    close(*cmdline_fd);
+  }
+  std::replace(cmdline.begin(), cmdline.end(), '\0', ' ');
+
+  return std::unique_ptr<RingReader>(new RingReader(
+      std::move(fds), ring, announcement.st_ino, std::move(cmdline)));
+}
+
+RingReader::RingReader(std::unique_ptr<ProcFdCache> fds, EventRing *ring,
+                       ino_t announcement_ino, std::string cmdline)
+    : fds_(std::move(fds)),
+      ring_(ring),
+      announcement_ino_(announcement_ino),
+      cmdline_(std::move(cmdline)),
+      scratch_(new RingFileEvent()) {}
+
+RingReader::~RingReader() { munmap(ring_, sizeof(EventRing)); }
+
+}  // namespace pathauditor
@@ -0,0 +1,93 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_DAEMON_RING_READER_H_
+#define PATHAUDITOR_DAEMON_RING_READER_H_
+
+#include <sys/types.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "pathauditor/event_ring.h"
+#include "pathauditor/mount_namespace_cache.h"
+#include "pathauditor/proc_fd_cache.h"
+
+namespace pathauditor {
+
+// The daemon side of the EventRing of a single process.
+class RingReader {
+ public:
+  // Opens the ring announced by pid in the ring directory. Fails if the
+  // announcement is not owned by the same user as the process or if the fd it
+  // names is not a sealed ring. namespaces is passed on to ProcFdCache::Open.
+  static absl::StatusOr<std::unique_ptr<RingReader>> Open(
+      int ring_dir_fd, pid_t pid, MountNamespaceCache *namespaces = nullptr);
+
+  ~RingReader();
+
+  RingReader(const RingReader &) = delete;
+  RingReader &operator=(const RingReader &) = delete;
+
+  // Pops up to max_events events and calls fn(const RingFileEvent &) for each
+  // of them. The events are copied out of the shared memory first, so fn
+  // doesn't race with the producer. Returns the number of events popped.
+  template <typename F>
+  size_t Drain(F &&fn, size_t max_events) {
+    size_t count = 0;
+    while (count < max_events &&
+           ring_->queue.TryPop([this](const RingFileEvent &event) {
+             *scratch_ = event;
+           })) {
+      fn(static_cast<const RingFileEvent &>(*scratch_));
+      count++;
+    }
+    return count;
+  }
+
+  // The number of events waiting in the ring. The ring is writable by the
+  // process, so this is only a hint.
+  size_t Pending() const {
+    return std::min(ring_->queue.Size(), ring_->queue.Capacity());
+  }
+
+  // Whether the process still exists. Immune to pid reuse since it's based on
+  // a handle to the process.
+  bool ProcessAlive() const { return fds_->ProcessAlive(); }
+
+  pid_t pid() const { return fds_->pid(); }
+  // The cached fds of the process. Like the ring itself, these must only be
+  // used by one thread at a time.
+  ProcFdCache &fds() const { return *fds_; }
+  const std::string &cmdline() const { return cmdline_; }
+  // Identifies the announcement, a new one means that the process exec'ed.
+  ino_t announcement_ino() const { return announcement_ino_; }
+
+ private:
+  RingReader(std::unique_ptr<ProcFdCache> fds, EventRing *ring,
+             ino_t announcement_ino, std::string cmdline);
+
+  std::unique_ptr<ProcFdCache> fds_;
+  EventRing *ring_;
+  ino_t announcement_ino_;
+  std::string cmdline_;
+  std::unique_ptr<RingFileEvent> scratch_;
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_DAEMON_RING_READER_H_
@@ -0,0 +1,45 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/daemon/snapshot_process_information.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "absl/strings/str_cat.h"
+#include "pathauditor/util/status_macros.h"
+
+namespace pathauditor {
+
+absl::StatusOr<int> SnapshotProcessInformation::DupDirFileDescriptor(
+    int fd, int open_flags) const {
+  PATHAUDITOR_ASSIGN_OR_RETURN(int new_fd,
+                               process_.DupDirFileDescriptor(fd, open_flags));
+  for (const RingFdSnapshot &snapshot : fds_) {
+    if (snapshot.fd != fd) {
+      continue;
+    }
+    struct stat sb;
+    if (fstat(new_fd, &sb) == -1 || sb.st_dev != snapshot.dev ||
+        sb.st_ino != snapshot.ino) {
+      close(new_fd);
+      return absl::FailedPreconditionError(
+          absl::StrCat("fd ", fd, " changed since the call"));
+    }
+    break;
+  }
+  return new_fd;
+}
+
+}  // namespace pathauditor
@@ -0,0 +1,57 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_DAEMON_SNAPSHOT_PROCESS_INFORMATION_H_
+#define PATHAUDITOR_DAEMON_SNAPSHOT_PROCESS_INFORMATION_H_
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "pathauditor/event_ring.h"
+#include "pathauditor/process_information.h"
+
+namespace pathauditor {
+
+// Looks up file descriptors in a process that made a call a while ago. Fails
+// if a directory fd doesn't refer to the same directory as at the time of the
+// call anymore.
+class SnapshotProcessInformation : public ProcessInformation {
+ public:
+  // Neither argument is owned.
+  SnapshotProcessInformation(const ProcessInformation &process,
+                             absl::Span<const RingFdSnapshot> fds)
+      : process_(process), fds_(fds) {}
+
+  absl::StatusOr<int> DupDirFileDescriptor(int fd,
+                                           int open_flags) const override;
+  absl::StatusOr<int> CwdFileDescriptor(int open_flags) const override {
+    return process_.CwdFileDescriptor(open_flags);
+  }
+  absl::StatusOr<int> RootFileDescriptor(int open_flags) const override {
+    return process_.RootFileDescriptor(open_flags);
+  }
+  bool SharesMountNamespace() const override {
+    return process_.SharesMountNamespace();
+  }
+  WatchedPrefixCache *WatchedPrefixes() const override {
+    return process_.WatchedPrefixes();
+  }
+
+ private:
+  const ProcessInformation &process_;
+  absl::Span<const RingFdSnapshot> fds_;
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_DAEMON_SNAPSHOT_PROCESS_INFORMATION_H_
@@ -0,0 +1,236 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/daemon/worker_pool.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
+
+namespace pathauditor {
+
+// A shard of the pool. The owning thread adds and removes sources, every
+// thread can process them while holding a reader lock on mu_.
+class WorkerPool::Worker {
+ public:
+  void AddSource(uint64_t key, std::unique_ptr<WorkSource> source) {
+    absl::MutexLock lock(&new_sources_mu_);
+    new_sources_.push_back({key, std::move(source)});
+  }
+
+  // Moves the sources added since the last call into the shard.
+  void AdoptNewSources() {
+    std::vector<std::pair<uint64_t, std::unique_ptr<WorkSource>>> new_sources;
+    {
+      absl::MutexLock lock(&new_sources_mu_);
+      new_sources.swap(new_sources_);
+    }
+    if (new_sources.empty()) {
+      return;
+    }
+    absl::WriterMutexLock lock(&mu_);
+    for (auto &key_and_source : new_sources) {
+      for (std::unique_ptr<Entry> &entry : entries_) {
+        if (entry->key == key_and_source.first) {
+          entry->superseded = true;
+        }
+      }
+      auto entry = absl::make_unique<Entry>();
+      entry->key = key_and_source.first;
+      entry->source = std::move(key_and_source.second);
+      entries_.push_back(std::move(entry));
+    }
+    sources_.store(entries_.size(), std::memory_order_relaxed);
+  }
+
+  // One pass over the own shard. Returns the number of processed items.
+  size_t ProcessOwnSources(size_t batch_size) {
+    size_t processed = 0;
+    size_t depth = 0;
+    bool any_done = false;
+    {
+      absl::ReaderMutexLock lock(&mu_);
+      for (std::unique_ptr<Entry> &entry : entries_) {
+        size_t count;
+        if (TryProcess(*entry, batch_size, &count)) {
+          processed += count;
+          any_done |= entry->done;
+        }
+        depth += entry->source->Pending();
+      }
+    }
+    queue_depth_.store(depth, std::memory_order_relaxed);
+    processed_.fetch_add(processed, std::memory_order_relaxed);
+    if (any_done) {
+      RemoveDoneSources();
+    }
+    return processed;
+  }
+
+  // Processes one batch of a source that nobody is working on. Called by other
+  // workers.
+  size_t StealBatch(size_t batch_size) {
+    absl::ReaderMutexLock lock(&mu_);
+    for (std::unique_ptr<Entry> &entry : entries_) {
+      size_t count;
+      if (entry->source->Pending() > 0 &&
+          TryProcess(*entry, batch_size, &count) && count > 0) {
+        stolen_.fetch_add(1, std::memory_order_relaxed);
+        return count;
+      }
+    }
+    return 0;
+  }
+
+  void CountSteal(size_t processed) {
+    steals_.fetch_add(1, std::memory_order_relaxed);
+    processed_.fetch_add(processed, std::memory_order_relaxed);
+  }
+
+  size_t queue_depth() const {
+    return queue_depth_.load(std::memory_order_relaxed);
+  }
+
+  WorkerStats Stats() const {
+    return {sources_.load(std::memory_order_relaxed),
+            queue_depth_.load(std::memory_order_relaxed),
+            processed_.load(std::memory_order_relaxed),
+            steals_.load(std::memory_order_relaxed),
+            stolen_.load(std::memory_order_relaxed)};
+  }
+
+ private:
+  struct Entry {
+    uint64_t key;
+    std::unique_ptr<WorkSource> source;
+    // Held by the thread that is processing the source.
+    std::atomic<bool> claimed{false};
+    // A newer source with the same key exists. Only changed under the writer
+    // lock.
+    bool superseded = false;
+    // The source is empty and can be dropped. Only changed while claimed.
+    bool done = false;
+  };
+
+  // Returns false if another thread is processing the entry.
+  static bool TryProcess(Entry &entry, size_t batch_size, size_t *processed) {
+    if (entry.claimed.exchange(true, std::memory_order_acquire)) {
+      return false;
+    }
+    bool finished = entry.source->Finished();
+    *processed = entry.done ? 0 : entry.source->Process(batch_size);
+    if (*processed == 0 && (finished || entry.superseded)) {
+      entry.done = true;
+    }
+    entry.claimed.store(false, std::memory_order_release);
+    return true;
+  }
+
+  void RemoveDoneSources() {
+    absl::WriterMutexLock lock(&mu_);
+    entries_.erase(std::remove_if(entries_.begin(), entries_.end(),
+                                  [](const std::unique_ptr<Entry> &entry) {
+                                    return entry->done;
+                                  }),
+                   entries_.end());
+    sources_.store(entries_.size(), std::memory_order_relaxed);
+  }
+
+  absl::Mutex new_sources_mu_;
+  std::vector<std::pair<uint64_t, std::unique_ptr<WorkSource>>> new_sources_
+      ABSL_GUARDED_BY(new_sources_mu_);
+
+  // Writers are the owning thread only.
+  absl::Mutex mu_;
+  std::vector<std::unique_ptr<Entry>> entries_ ABSL_GUARDED_BY(mu_);
+
+  std::atomic<size_t> sources_{0};
+  std::atomic<size_t> queue_depth_{0};
+  std::atomic<uint64_t> processed_{0};
+  std::atomic<uint64_t> steals_{0};
+  std::atomic<uint64_t> stolen_{0};
+};
+
+WorkerPool::WorkerPool(size_t workers, size_t batch_size,
+                       std::chrono::milliseconds idle_sleep)
+    : batch_size_(std::max<size_t>(batch_size, 1)), idle_sleep_(idle_sleep) {
+  workers = std::max<size_t>(workers, 1);
+  for (size_t i = 0; i < workers; i++) {
+    workers_.push_back(absl::make_unique<Worker>());
+  }
+  for (size_t i = 0; i < workers; i++) {
+    threads_.emplace_back(&WorkerPool::Run, this, i);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  stopping_.store(true, std::memory_order_relaxed);
+  for (std::thread &thread : threads_) {
+    thread.join();
+  }
+}
+
+void WorkerPool::Add(uint64_t key, std::unique_ptr<WorkSource> source) {
+  workers_[key % workers_.size()]->AddSource(key, std::move(source));
+}
+
+std::vector<WorkerStats> WorkerPool::Stats() const {
+  std::vector<WorkerStats> stats;
+  stats.reserve(workers_.size());
+  for (const std::unique_ptr<Worker> &worker : workers_) {
+    stats.push_back(worker->Stats());
+  }
+  return stats;
+}
+
+void WorkerPool::Run(size_t index) {
+  Worker &worker = *workers_[index];
+  while (!stopping_.load(std::memory_order_relaxed)) {
+    worker.AdoptNewSources();
+    size_t processed = worker.ProcessOwnSources(batch_size_);
+    if (processed == 0) {
+      processed = Steal(index);
+    }
+    if (processed == 0) {
+      std::this_thread::sleep_for(idle_sleep_);
+    }
+  }
+}
+
+size_t WorkerPool::Steal(size_t thief) {
+  // Leave short queues to their owner, it will get to them on its next pass
+  // and has the warmer caches.
+  Worker *victim = nullptr;
+  size_t max_depth = batch_size_ - 1;
+  for (size_t i = 0; i < workers_.size(); i++) {
+    size_t depth = workers_[i]->queue_depth();
+    if (i != thief && depth > max_depth) {
+      victim = workers_[i].get();
+      max_depth = depth;
+    }
+  }
+  if (victim == nullptr) {
+    return 0;
+  }
+  size_t processed = victim->StealBatch(batch_size_);
+  if (processed > 0) {
+    workers_[thief]->CountSteal(processed);
+  }
+  return processed;
+}
+
+}  // namespace pathauditor
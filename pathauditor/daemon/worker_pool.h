@@ -0,0 +1,100 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_DAEMON_WORKER_POOL_H_
+#define PATHAUDITOR_DAEMON_WORKER_POOL_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace pathauditor {
+
+// A stream of work items that have to be handled in order, e.g. the events in
+// the ring of one process.
+class WorkSource {
+ public:
+  virtual ~WorkSource() = default;
+
+  // Handles up to max_items items and returns how many it handled. Never called
+  // concurrently for the same source, but not always on the same thread.
+  virtual size_t Process(size_t max_items) = 0;
+  // An estimate of the number of waiting items. Can be called at any time.
+  virtual size_t Pending() const = 0;
+  // Whether new items can still show up. Checked before Process, so a source
+  // is only dropped after its last items have been handled.
+  virtual bool Finished() const = 0;
+};
+
+struct WorkerStats {
+  // The number of sources in the shard of the worker.
+  size_t sources;
+  // The items waiting in those sources as of the last pass over them.
+  size_t queue_depth;
+  uint64_t processed;
+  // Batches this worker took from other shards.
+  uint64_t steals;
+  // Batches other workers took from this shard.
+  uint64_t stolen;
+};
+
+// Runs WorkSources on a fixed number of threads. Every worker owns a shard and
+// sources are assigned to shards by their key, so that e.g. all rings of a pid
+// are audited by the same thread and its caches stay warm.
+// A worker that has nothing to do in its own shard steals a batch from the
+// shard with the longest queue. It only takes sources that aren't being
+// processed at the moment, so the items of a source are still handled in
+// order and by one thread at a time.
+// Adding a source with the same key as an existing one supersedes the old
+// one, it will be dropped as soon as it's empty.
+class WorkerPool {
+ public:
+  // Starts the worker threads. batch_size is the number of items processed
+  // from a source before moving on to the next one.
+  WorkerPool(size_t workers, size_t batch_size,
+             std::chrono::milliseconds idle_sleep);
+  // Stops and joins the workers.
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  void Add(uint64_t key, std::unique_ptr<WorkSource> source);
+
+  // One entry per worker.
+  std::vector<WorkerStats> Stats() const;
+
+  size_t worker_count() const { return workers_.size(); }
+
+ private:
+  class Worker;
+
+  void Run(size_t index);
+  // Processes a batch from another shard. Returns the number of items.
+  size_t Steal(size_t thief);
+
+  const size_t batch_size_;
+  const std::chrono::milliseconds idle_sleep_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+  std::atomic<bool> stopping_{false};
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_DAEMON_WORKER_POOL_H_
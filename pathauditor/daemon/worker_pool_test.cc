@@ -0,0 +1,140 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/daemon/worker_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/memory/memory.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Gt;
+
+// Counts down from a number of items. Optionally sleeps in Process to keep its
+// worker busy.
+class FakeSource : public WorkSource {
+ public:
+  FakeSource(std::atomic<size_t> *pending, std::chrono::milliseconds delay,
+             std::atomic<bool> *destroyed = nullptr)
+      : pending_(pending), delay_(delay), destroyed_(destroyed) {}
+
+  ~FakeSource() override {
+    if (destroyed_ != nullptr) {
+      destroyed_->store(true);
+    }
+  }
+
+  size_t Process(size_t max_items) override {
+    EXPECT_FALSE(busy_.exchange(true)) << "Processed concurrently";
+    std::this_thread::sleep_for(delay_);
+    size_t count = 0;
+    while (count < max_items && pending_->load() > 0) {
+      pending_->fetch_sub(1);
+      count++;
+    }
+    busy_.store(false);
+    return count;
+  }
+
+  size_t Pending() const override { return pending_->load(); }
+
+  bool Finished() const override { return false; }
+
+ private:
+  std::atomic<size_t> *pending_;
+  std::chrono::milliseconds delay_;
+  std::atomic<bool> *destroyed_;
+  std::atomic<bool> busy_{false};
+};
+
+bool WaitFor(std::function<bool()> condition) {
+  for (int i = 0; i < 5000; i++) {
+    if (condition()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return false;
+}
+
+TEST(WorkerPoolTest, ProcessesAllSources) {
+  std::atomic<size_t> pending[8];
+  WorkerPool pool(4, 16, std::chrono::milliseconds(1));
+  for (size_t i = 0; i < 8; i++) {
+    pending[i] = 1000;
+    pool.Add(i, absl::make_unique<FakeSource>(&pending[i],
+                                              std::chrono::milliseconds(0)));
+  }
+
+  // The counters are updated after the batch, so wait for them rather than
+  // for the sources.
+  auto processed = [&pool]() {
+    uint64_t processed = 0;
+    for (const WorkerStats &stats : pool.Stats()) {
+      processed += stats.processed;
+    }
+    return processed;
+  };
+  EXPECT_TRUE(WaitFor([&processed]() { return processed() == 8000; }));
+  for (std::atomic<size_t> &p : pending) {
+    EXPECT_THAT(p.load(), Eq(0));
+  }
+}
+
+TEST(WorkerPoolTest, IdleWorkersStealFromBusyShards) {
+  std::atomic<size_t> slow_pending{1000000};
+  std::atomic<size_t> backlog{10000};
+  WorkerPool pool(2, 8, std::chrono::milliseconds(1));
+  // Both land on worker 0, which will be stuck in the slow source most of the
+  // time.
+  pool.Add(0, absl::make_unique<FakeSource>(&slow_pending,
+                                            std::chrono::milliseconds(20)));
+  pool.Add(2, absl::make_unique<FakeSource>(&backlog,
+                                            std::chrono::milliseconds(0)));
+
+  EXPECT_TRUE(WaitFor([&backlog]() { return backlog.load() == 0; }));
+  std::vector<WorkerStats> stats = pool.Stats();
+  EXPECT_THAT(stats[0].sources, Eq(2));
+  EXPECT_THAT(stats[0].stolen, Gt(0));
+  EXPECT_THAT(stats[1].steals, Gt(0));
+  EXPECT_THAT(stats[1].sources, Eq(0));
+}
+
+TEST(WorkerPoolTest, DropsSupersededSourceOnceEmpty) {
+  std::atomic<size_t> old_pending{100};
+  std::atomic<size_t> new_pending{0};
+  std::atomic<bool> old_destroyed{false};
+  std::atomic<bool> new_destroyed{false};
+  WorkerPool pool(1, 16, std::chrono::milliseconds(1));
+  pool.Add(7, absl::make_unique<FakeSource>(
+                  &old_pending, std::chrono::milliseconds(0), &old_destroyed));
+  pool.Add(7, absl::make_unique<FakeSource>(
+                  &new_pending, std::chrono::milliseconds(0), &new_destroyed));
+
+  EXPECT_TRUE(WaitFor([&old_destroyed]() { return old_destroyed.load(); }));
+  EXPECT_THAT(old_pending.load(), Eq(0));
+  EXPECT_FALSE(new_destroyed.load());
+  EXPECT_THAT(pool.Stats()[0].sources, Eq(1));
+}
+
+}  // namespace
+}  // namespace pathauditor
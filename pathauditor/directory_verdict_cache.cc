@@ -0,0 +1,102 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/directory_verdict_cache.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <tuple>
+
+#include "absl/hash/hash.h"
+
+namespace pathauditor {
+
+namespace {
+
+uid_t GetEuid() { return syscall(SYS_geteuid); }
+
+size_t RoundUpToPowerOfTwo(size_t n) {
+  size_t result = 1;
+  while (result < n) {
+    result <<= 1;
+  }
+  return result;
+}
+
+}  // namespace
+
+DirectoryVerdictCache::DirectoryVerdictCache(size_t capacity)
+    : entries_(RoundUpToPowerOfTwo(capacity)), euid_(GetEuid()) {}
+
+DirectoryVerdictCache::Entry &DirectoryVerdictCache::Slot(dev_t dev,
+                                                          ino_t ino) {
+  size_t hash =
+      absl::Hash<std::tuple<dev_t, ino_t>>()(std::make_tuple(dev, ino));
+  return entries_[hash & (entries_.size() - 1)];
+}
+
+void DirectoryVerdictCache::SetEuid(uid_t euid) {
+  if (euid != euid_) {
+    Clear();
+    euid_ = euid;
+  }
+}
+
+absl::optional<DirectoryVerdict> DirectoryVerdictCache::Lookup(
+    const struct stat &sb) {
+  const Entry &entry = Slot(sb.st_dev, sb.st_ino);
+  if (!entry.valid || entry.dev != sb.st_dev || entry.ino != sb.st_ino ||
+      entry.mode != sb.st_mode || entry.uid != sb.st_uid ||
+      entry.gid != sb.st_gid || entry.ctime.tv_sec != sb.st_ctim.tv_sec ||
+      entry.ctime.tv_nsec != sb.st_ctim.tv_nsec) {
+    misses_++;
+    return absl::nullopt;
+  }
+  hits_++;
+  return entry.verdict;
+}
+
+void DirectoryVerdictCache::Insert(const struct stat &sb,
+                                   DirectoryVerdict verdict) {
+  Entry &entry = Slot(sb.st_dev, sb.st_ino);
+  entry.valid = true;
+  entry.dev = sb.st_dev;
+  entry.ino = sb.st_ino;
+  entry.mode = sb.st_mode;
+  entry.uid = sb.st_uid;
+  entry.gid = sb.st_gid;
+  entry.ctime = sb.st_ctim;
+  entry.verdict = verdict;
+}
+
+void DirectoryVerdictCache::Invalidate(dev_t dev, ino_t ino) {
+  Entry &entry = Slot(dev, ino);
+  if (entry.valid && entry.dev == dev && entry.ino == ino) {
+    entry.valid = false;
+  }
+}
+
+void DirectoryVerdictCache::Clear() {
+  for (Entry &entry : entries_) {
+    entry.valid = false;
+  }
+}
+
+DirectoryVerdictCache &DirectoryVerdictCache::ForCurrentThread() {
+  static thread_local DirectoryVerdictCache cache;
+  return cache;
+}
+
+}  // namespace pathauditor
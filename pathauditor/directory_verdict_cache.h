@@ -0,0 +1,101 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_DIRECTORY_VERDICT_CACHE_H_
+#define PATHAUDITOR_DIRECTORY_VERDICT_CACHE_H_
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/optional.h"
+
+namespace pathauditor {
+
+// What a directory tells us about the entries inside of it, independent of
+// which entry we're looking at.
+enum class DirectoryVerdict : uint8_t {
+  // No entry in the directory can be replaced by an unprivileged user, e.g.
+  // the directory is immutable, in proc or root owned and not writable.
+  kSafe,
+  // Any entry in the directory can be replaced unless the entry itself is
+  // immutable.
+  kUserControlled,
+  // The directory is writable but sticky. It depends on the owner of the
+  // entry if it can be replaced.
+  kSticky,
+};
+
+// A bounded cache of DirectoryVerdicts. The entries are keyed by the inode
+// and the fields of the stat buffer that the verdict is based on. Changing the
+// owner, mode or immutable flag of a directory also updates its ctime, so a
+// stale entry will simply not match anymore.
+// The cache is direct mapped: inserting into an occupied slot evicts the old
+// entry. It's not thread-safe, use one instance per thread.
+class DirectoryVerdictCache {
+ public:
+  static constexpr size_t kDefaultCapacity = 256;
+
+  // The capacity will be rounded up to the next power of two.
+  explicit DirectoryVerdictCache(size_t capacity = kDefaultCapacity);
+
+  DirectoryVerdictCache(const DirectoryVerdictCache &) = delete;
+  DirectoryVerdictCache &operator=(const DirectoryVerdictCache &) = delete;
+
+  // Verdicts depend on the effective uid. Drops all entries if euid is not the
+  // one they were computed for. Call this once before using the cache.
+  void SetEuid(uid_t euid);
+
+  // Returns the cached verdict for the directory described by sb, if any.
+  absl::optional<DirectoryVerdict> Lookup(const struct stat &sb);
+  void Insert(const struct stat &sb, DirectoryVerdict verdict);
+
+  // Drops the entry for the given inode.
+  void Invalidate(dev_t dev, ino_t ino);
+  // Drops all entries.
+  void Clear();
+
+  size_t capacity() const { return entries_.size(); }
+  uint64_t hits() const { return hits_; }
+  uint64_t misses() const { return misses_; }
+
+  // The cache used by PathIsUserControlled on the current thread.
+  static DirectoryVerdictCache &ForCurrentThread();
+
+ private:
+  struct Entry {
+    bool valid = false;
+    dev_t dev;
+    ino_t ino;
+    mode_t mode;
+    uid_t uid;
+    gid_t gid;
+    struct timespec ctime;
+    DirectoryVerdict verdict;
+  };
+
+  Entry &Slot(dev_t dev, ino_t ino);
+
+  std::vector<Entry> entries_;
+  uid_t euid_;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_DIRECTORY_VERDICT_CACHE_H_
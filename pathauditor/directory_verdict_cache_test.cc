@@ -0,0 +1,97 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/directory_verdict_cache.h"
+
+#include <sys/stat.h>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Optional;
+
+struct stat DirStat(ino_t ino) {
+  struct stat sb = {};
+  sb.st_dev = 1;
+  sb.st_ino = ino;
+  sb.st_mode = S_IFDIR | 0755;
+  sb.st_ctim.tv_sec = 1000;
+  return sb;
+}
+
+TEST(DirectoryVerdictCacheTest, ReturnsInsertedVerdict) {
+  DirectoryVerdictCache cache;
+  struct stat sb = DirStat(2);
+  EXPECT_THAT(cache.Lookup(sb), Eq(absl::nullopt));
+  cache.Insert(sb, DirectoryVerdict::kSticky);
+  EXPECT_THAT(cache.Lookup(sb), Optional(DirectoryVerdict::kSticky));
+  EXPECT_THAT(cache.hits(), Eq(1));
+  EXPECT_THAT(cache.misses(), Eq(1));
+}
+
+TEST(DirectoryVerdictCacheTest, AttributeChangeMisses) {
+  DirectoryVerdictCache cache;
+  struct stat sb = DirStat(2);
+  cache.Insert(sb, DirectoryVerdict::kSafe);
+
+  struct stat chmodded = sb;
+  chmodded.st_mode |= S_IWOTH;
+  chmodded.st_ctim.tv_nsec = 1;
+  EXPECT_THAT(cache.Lookup(chmodded), Eq(absl::nullopt));
+
+  struct stat chowned = sb;
+  chowned.st_uid = 1000;
+  EXPECT_THAT(cache.Lookup(chowned), Eq(absl::nullopt));
+}
+
+TEST(DirectoryVerdictCacheTest, Invalidate) {
+  DirectoryVerdictCache cache;
+  struct stat sb = DirStat(2);
+  cache.Insert(sb, DirectoryVerdict::kSafe);
+  cache.Invalidate(sb.st_dev, sb.st_ino);
+  EXPECT_THAT(cache.Lookup(sb), Eq(absl::nullopt));
+}
+
+TEST(DirectoryVerdictCacheTest, EuidChangeClears) {
+  DirectoryVerdictCache cache;
+  struct stat sb = DirStat(2);
+  cache.SetEuid(0);
+  cache.Insert(sb, DirectoryVerdict::kSafe);
+  cache.SetEuid(0);
+  EXPECT_THAT(cache.Lookup(sb), Optional(DirectoryVerdict::kSafe));
+  cache.SetEuid(1000);
+  EXPECT_THAT(cache.Lookup(sb), Eq(absl::nullopt));
+}
+
+TEST(DirectoryVerdictCacheTest, IsBounded) {
+  DirectoryVerdictCache cache(3);
+  EXPECT_THAT(cache.capacity(), Eq(4));
+  for (ino_t ino = 0; ino < 100; ino++) {
+    cache.Insert(DirStat(ino), DirectoryVerdict::kSafe);
+  }
+  int cached = 0;
+  for (ino_t ino = 0; ino < 100; ino++) {
+    if (cache.Lookup(DirStat(ino)).has_value()) {
+      cached++;
+    }
+  }
+  EXPECT_LE(cached, 4);
+}
+
+}  // namespace
+}  // namespace pathauditor
@@ -0,0 +1,118 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/event_ring.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "pathauditor/syscall_policy.h"
+
+namespace pathauditor {
+
+absl::Span<const size_t> DirFdArgs(int syscall_nr) {
+  const SyscallPolicy *policy = FindSyscallPolicy(syscall_nr);
+  if (policy == nullptr) {
+    return {};
+  }
+  return absl::MakeConstSpan(policy->dirfd_args, policy->dirfd_arg_count);
+}
+
+void EncodeRingFileEvent(const FileEventView &event, const char *function_name,
+                         RingFileEvent *out) {
+  out->syscall_nr = event.syscall_nr;
+  out->arg_count = std::min(event.args.size(), RingFileEvent::kMaxArgs);
+  std::copy_n(event.args.begin(), out->arg_count, out->args);
+
+  bool relative_path = false;
+  out->path_arg_count =
+      std::min(event.path_args.size(), RingFileEvent::kMaxPathArgs);
+  for (size_t i = 0; i < out->path_arg_count; i++) {
+    absl::string_view path = event.path_args[i];
+    out->path_arg_lens[i] =
+        path.copy(out->path_args[i], sizeof(out->path_args[i]) - 1);
+    out->path_args[i][out->path_arg_lens[i]] = 0;
+    if (!path.empty() && path[0] != '/') {
+      relative_path = true;
+    }
+  }
+
+  out->fd_count = 0;
+  for (size_t idx : DirFdArgs(event.syscall_nr)) {
+    if (idx >= out->arg_count) {
+      continue;
+    }
+    int fd = static_cast<int>(out->args[idx]);
+    struct stat sb;
+    if (fd == AT_FDCWD || fstat(fd, &sb) == -1) {
+      continue;
+    }
+    out->fds[out->fd_count++] = {fd, 0, static_cast<uint64_t>(sb.st_dev),
+                                 static_cast<uint64_t>(sb.st_ino)};
+  }
+
+  out->cwd_len = 0;
+  if (relative_path) {
+    // The raw syscall, since the libc wrapper might allocate.
+    if (syscall(SYS_getcwd, out->cwd, sizeof(out->cwd)) > 0) {
+      out->cwd_len = strnlen(out->cwd, sizeof(out->cwd) - 1);
+    }
+  }
+  out->cwd[out->cwd_len] = 0;
+
+  size_t name_len = strnlen(function_name, sizeof(out->function_name) - 1);
+  memcpy(out->function_name, function_name, name_len);
+  out->function_name[name_len] = 0;
+}
+
+absl::StatusOr<FileEvent> DecodeRingFileEvent(const RingFileEvent &event) {
+  if (event.arg_count > RingFileEvent::kMaxArgs ||
+      event.path_arg_count > RingFileEvent::kMaxPathArgs ||
+      event.fd_count > RingFileEvent::kMaxFds ||
+      event.cwd_len >= sizeof(event.cwd)) {
+    return absl::InvalidArgumentError("malformed ring event");
+  }
+  if (strnlen(event.function_name, sizeof(event.function_name)) ==
+      sizeof(event.function_name)) {
+    return absl::InvalidArgumentError("unterminated function name");
+  }
+
+  std::vector<uint64_t> args(event.args, event.args + event.arg_count);
+  std::vector<std::string> path_args;
+  for (size_t i = 0; i < event.path_arg_count; i++) {
+    if (event.path_arg_lens[i] >= sizeof(event.path_args[i])) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("path arg ", i, " too long"));
+    }
+    path_args.emplace_back(event.path_args[i], event.path_arg_lens[i]);
+  }
+  return FileEvent(event.syscall_nr, args, path_args);
+}
+
+absl::string_view RingFileEventCwd(const RingFileEvent &event) {
+  return absl::string_view(event.cwd, event.cwd_len);
+}
+
+absl::string_view RingFileEventFunctionName(const RingFileEvent &event) {
+  return absl::string_view(event.function_name);
+}
+
+}  // namespace pathauditor
@@ -0,0 +1,103 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The shared memory format used to hand FileEvents from an audited process to
+// pathauditor-daemon.
+//
+// Every process creates one sealed memfd holding an EventRing and announces it
+// by writing the fd number into a file named after its pid in the ring
+// directory. The daemon opens the memfd through /proc/<pid>/fd.
+// The daemon must not trust anything in the ring: it copies events out of the
+// ring before looking at them and validates them with DecodeRingFileEvent.
+
+#ifndef PATHAUDITOR_EVENT_RING_H_
+#define PATHAUDITOR_EVENT_RING_H_
+
+#include <limits.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "pathauditor/file_event.h"
+#include "pathauditor/util/mpsc_queue.h"
+
+namespace pathauditor {
+
+constexpr uint32_t kEventRingMagic = 0x50415231;  // "PAR1"
+constexpr uint32_t kEventRingVersion = 1;
+
+// The identity of a directory fd at the time of the call. The daemon looks the
+// fd up again through /proc and compares them, in case it was closed or
+// replaced in the meantime.
+struct RingFdSnapshot {
+  int32_t fd;
+  uint32_t reserved;
+  uint64_t dev;
+  uint64_t ino;
+};
+
+struct RingFileEvent {
+  static constexpr size_t kMaxArgs = 6;
+  static constexpr size_t kMaxPathArgs = 2;
+  static constexpr size_t kMaxFds = 2;
+  static constexpr size_t kMaxFunctionName = 32;
+
+  int32_t syscall_nr;
+  uint32_t arg_count;
+  uint64_t args[kMaxArgs];
+  uint32_t path_arg_count;
+  uint32_t path_arg_lens[kMaxPathArgs];
+  char path_args[kMaxPathArgs][PATH_MAX];
+  uint32_t fd_count;
+  RingFdSnapshot fds[kMaxFds];
+  // Only filled in if one of the paths is relative, 0 otherwise.
+  uint32_t cwd_len;
+  char cwd[PATH_MAX];
+  char function_name[kMaxFunctionName];
+};
+
+struct EventRing {
+  static constexpr size_t kCapacity = 64;
+
+  uint32_t magic;
+  uint32_t version;
+  uint64_t size;
+  BoundedMpscQueue<RingFileEvent, kCapacity> queue;
+};
+
+// The argument indices that hold directory fds for the given syscall.
+absl::Span<const size_t> DirFdArgs(int syscall_nr);
+
+// Copies the event into out. Paths that don't fit are truncated. Takes
+// snapshots of the directory fds and the cwd if needed, which costs an fstat
+// per fd and a getcwd.
+void EncodeRingFileEvent(const FileEventView &event, const char *function_name,
+                         RingFileEvent *out);
+
+// Checks that all counts and lengths in the event are in bounds and returns
+// the contained FileEvent.
+absl::StatusOr<FileEvent> DecodeRingFileEvent(const RingFileEvent &event);
+
+// The fields of an event that are not part of the FileEvent. Only valid after
+// DecodeRingFileEvent succeeded.
+absl::string_view RingFileEventCwd(const RingFileEvent &event);
+absl::string_view RingFileEventFunctionName(const RingFileEvent &event);
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_EVENT_RING_H_
@@ -0,0 +1,91 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/event_ring.h"
+
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <memory>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "pathauditor/util/status_matchers.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+
+TEST(EventRingTest, EncodeDecodeRoundTrip) {
+  int dir_fd = open("/", O_RDONLY | O_DIRECTORY);
+  ASSERT_NE(dir_fd, -1);
+  uint64_t args[] = {static_cast<uint64_t>(dir_fd), 0, O_RDONLY, 0};
+  absl::string_view path_args[] = {"relative/path"};
+  FileEventView view(SYS_openat, args, path_args);
+
+  auto raw = absl::make_unique<RingFileEvent>();
+  EncodeRingFileEvent(view, "openat", raw.get());
+  close(dir_fd);
+
+  EXPECT_THAT(raw->fd_count, Eq(1));
+  EXPECT_THAT(raw->fds[0].fd, Eq(dir_fd));
+  EXPECT_THAT(RingFileEventFunctionName(*raw), Eq("openat"));
+  // The path is relative, so the cwd was recorded.
+  EXPECT_FALSE(RingFileEventCwd(*raw).empty());
+
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(FileEvent event,
+                                               DecodeRingFileEvent(*raw));
+  EXPECT_THAT(event.syscall_nr, Eq(SYS_openat));
+  EXPECT_THAT(event.args, ElementsAre(dir_fd, 0, O_RDONLY, 0));
+  EXPECT_THAT(event.path_args, ElementsAre("relative/path"));
+}
+
+TEST(EventRingTest, DecodeRejectsOutOfBoundsLengths) {
+  auto raw = absl::make_unique<RingFileEvent>();
+  absl::string_view path_args[] = {"/etc/passwd"};
+  EncodeRingFileEvent(FileEventView(SYS_open, {}, path_args), "open",
+                      raw.get());
+  EXPECT_THAT(raw->cwd_len, Eq(0));
+
+  RingFileEvent bad = *raw;
+  bad.path_arg_lens[0] = PATH_MAX;
+  EXPECT_THAT(DecodeRingFileEvent(bad).status().code(),
+              Eq(absl::StatusCode::kInvalidArgument));
+
+  bad = *raw;
+  bad.arg_count = RingFileEvent::kMaxArgs + 1;
+  EXPECT_THAT(DecodeRingFileEvent(bad).status().code(),
+              Eq(absl::StatusCode::kInvalidArgument));
+
+  bad = *raw;
+  memset(bad.function_name, 'a', sizeof(bad.function_name));
+  EXPECT_THAT(DecodeRingFileEvent(bad).status().code(),
+              Eq(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(EventRingTest, DirFdArgs) {
+  EXPECT_THAT(DirFdArgs(SYS_openat), ElementsAre(0));
+  EXPECT_THAT(DirFdArgs(SYS_symlinkat), ElementsAre(1));
+  EXPECT_THAT(DirFdArgs(SYS_renameat), ElementsAre(0, 2));
+  EXPECT_TRUE(DirFdArgs(SYS_open).empty());
+}
+
+}  // namespace
+}  // namespace pathauditor
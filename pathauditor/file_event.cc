@@ -35,4 +35,20 @@ absl::StatusOr<std::string> FileEvent::PathArg(size_t idx) const {
   return path_args[idx];
 }
 
+absl::StatusOr<uint64_t> FileEventView::Arg(size_t idx) const {
+  if (idx >= args.size()) {
+    return absl::OutOfRangeError(
+        absl::StrCat("Index ", idx, " out of range (size ", args.size(), ")."));
+  }
+  return args[idx];
+}
+
+absl::StatusOr<absl::string_view> FileEventView::PathArg(size_t idx) const {
+  if (idx >= path_args.size()) {
+    return absl::OutOfRangeError(absl::StrCat(
+        "Index ", idx, " out of range (size ", path_args.size(), ")."));
+  }
+  return path_args[idx];
+}
+
 }  // namespace pathauditor
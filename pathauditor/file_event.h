@@ -22,6 +22,8 @@
 #include "absl/status/statusor.h"
 #include "absl/strings/str_join.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "pathauditor/syscall_policy.h"
 
 namespace pathauditor {
 
@@ -39,7 +41,36 @@ struct FileEvent {
   absl::StatusOr<std::string> PathArg(size_t idx) const;
 };
 
-inline std::ostream& operator<<(std::ostream& os, FileEvent e) {
+// A non-owning version of the FileEvent. It doesn't allocate and is meant to
+// be created on the stack, e.g. in the libc hooks. The referenced arguments
+// need to outlive the view.
+// The policy is looked up when the view is created, which happens at compile
+// time if the syscall number is a constant.
+struct FileEventView {
+  FileEventView(int syscall_nr, absl::Span<const uint64_t> args,
+                absl::Span<const absl::string_view> path_args)
+      : syscall_nr(syscall_nr),
+        args(args),
+        path_args(path_args),
+        policy(FindSyscallPolicy(syscall_nr)) {}
+
+  int syscall_nr;
+  absl::Span<const uint64_t> args;
+  absl::Span<const absl::string_view> path_args;
+  // nullptr for syscalls the auditor doesn't know.
+  const SyscallPolicy *policy;
+
+  absl::StatusOr<uint64_t> Arg(size_t idx) const;
+  absl::StatusOr<absl::string_view> PathArg(size_t idx) const;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const FileEvent& e) {
+  return os << "syscall_nr: " << e.syscall_nr << ", args: ["
+            << absl::StrJoin(e.args, ", ") << "], "
+            << "path_args: [" << absl::StrJoin(e.path_args, ", ") << "]";
+}
+
+inline std::ostream& operator<<(std::ostream& os, const FileEventView& e) {
   return os << "syscall_nr: " << e.syscall_nr << ", args: ["
             << absl::StrJoin(e.args, ", ") << "], "
             << "path_args: [" << absl::StrJoin(e.path_args, ", ") << "]";
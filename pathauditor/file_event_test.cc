@@ -53,5 +53,24 @@ TEST(FileEventTest, NegativeIndex) {
   EXPECT_THAT(event.PathArg(-1), StatusIs(absl::StatusCode::kOutOfRange));
 }
 
+TEST(FileEventViewTest, ArgumentAccess) {
+  uint64_t args[] = {10, 20};
+  absl::string_view path_args[] = {"/foo", "/bar"};
+  FileEventView event(SYS_open, args, path_args);
+  EXPECT_THAT(event.syscall_nr, Eq(SYS_open));
+  EXPECT_THAT(event.Arg(0), IsOkAndHolds(10));
+  EXPECT_THAT(event.Arg(1), IsOkAndHolds(20));
+  EXPECT_THAT(event.PathArg(0), IsOkAndHolds("/foo"));
+  EXPECT_THAT(event.PathArg(1), IsOkAndHolds("/bar"));
+  EXPECT_THAT(event.Arg(2), StatusIs(absl::StatusCode::kOutOfRange));
+  EXPECT_THAT(event.PathArg(2), StatusIs(absl::StatusCode::kOutOfRange));
+}
+
+TEST(FileEventViewTest, EmptyArguments) {
+  FileEventView event(SYS_open, {}, {});
+  EXPECT_THAT(event.Arg(0), StatusIs(absl::StatusCode::kOutOfRange));
+  EXPECT_THAT(event.PathArg(0), StatusIs(absl::StatusCode::kOutOfRange));
+}
+
 }  // namespace
 }  // namespace pathauditor
@@ -0,0 +1,188 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/libc/audit_sampler.h"
+
+#include <time.h>
+
+#include <algorithm>
+
+#include "absl/base/attributes.h"
+#include "absl/base/optimization.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+
+namespace pathauditor {
+
+namespace {
+
+constexpr int64_t kNanosPerSecond = 1000000000;
+
+absl::StatusOr<uint32_t> ParseCount(absl::string_view name,
+                                    absl::string_view value, bool allow_zero) {
+  uint32_t count;
+  if (!absl::SimpleAtoi(value, &count) || (count == 0 && !allow_zero)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("invalid ", name, ": \"", value, "\""));
+  }
+  return count;
+}
+
+int64_t MonotonicNanos() {
+  // The coarse clock is served from the vDSO without a syscall. Its
+  // resolution is good enough for a per-second limit.
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  return ts.tv_sec * kNanosPerSecond + ts.tv_nsec;
+}
+
+ABSL_CONST_INIT AuditSampler process_sampler;
+
+}  // namespace
+
+bool SamplingPolicy::AuditsEverything() const {
+  if (default_period != 1 || audits_per_second != 0) {
+    return false;
+  }
+  return std::all_of(periods.begin(), periods.end(),
+                     [](const std::pair<std::string, uint32_t> &period) {
+                       return period.second == 1;
+                     });
+}
+
+uint32_t SamplingPolicy::PeriodFor(absl::string_view function_name) const {
+  for (const auto &period : periods) {
+    if (period.first == function_name) {
+      return period.second;
+    }
+  }
+  return default_period;
+}
+
+absl::StatusOr<SamplingPolicy> SamplingPolicy::Parse(
+    absl::string_view default_period, absl::string_view periods,
+    absl::string_view audits_per_second) {
+  SamplingPolicy policy;
+  if (!default_period.empty()) {
+    auto period = ParseCount("sample rate", default_period, false);
+    if (!period.ok()) {
+      return period.status();
+    }
+    policy.default_period = *period;
+  }
+  for (absl::string_view entry : absl::StrSplit(periods, ',', absl::SkipEmpty())) {
+    std::pair<absl::string_view, absl::string_view> key_value =
+        absl::StrSplit(entry, absl::MaxSplits('=', 1));
+    if (key_value.first.empty()) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("invalid sample rate entry: \"", entry, "\""));
+    }
+    auto period = ParseCount(absl::StrCat("sample rate for ", key_value.first),
+                             key_value.second, false);
+    if (!period.ok()) {
+      return period.status();
+    }
+    policy.periods.emplace_back(std::string(key_value.first), *period);
+  }
+  if (!audits_per_second.empty()) {
+    auto rate = ParseCount("audits per second", audits_per_second, true);
+    if (!rate.ok()) {
+      return rate.status();
+    }
+    policy.audits_per_second = *rate;
+  }
+  return policy;
+}
+
+bool TokenBucket::TryTake(uint32_t per_second, int64_t now_ns) {
+  int64_t refilled_until = refilled_until_ns_.load(std::memory_order_relaxed);
+  if (refilled_until == 0) {
+    // Start with a full bucket.
+    if (refilled_until_ns_.compare_exchange_strong(refilled_until, now_ns)) {
+      tokens_.fetch_add(per_second, std::memory_order_relaxed);
+    }
+  } else if (now_ns > refilled_until) {
+    int64_t new_tokens =
+        (now_ns - refilled_until) * per_second / kNanosPerSecond;
+    // Only account for the time that produced whole tokens, so that frequent
+    // calls don't lose the fractions.
+    if (new_tokens > 0 &&
+        refilled_until_ns_.compare_exchange_strong(
+            refilled_until,
+            refilled_until + new_tokens * kNanosPerSecond / per_second)) {
+      int64_t tokens = tokens_.load(std::memory_order_relaxed);
+      while (!tokens_.compare_exchange_weak(
+          tokens, std::min<int64_t>(tokens + new_tokens, per_second),
+          std::memory_order_relaxed)) {
+      }
+    }
+  }
+
+  int64_t tokens = tokens_.load(std::memory_order_relaxed);
+  while (tokens > 0) {
+    if (tokens_.compare_exchange_weak(tokens, tokens - 1,
+                                      std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void AuditSampler::SetPolicy(const SamplingPolicy *policy) {
+  policy_.store(policy, std::memory_order_release);
+}
+
+bool AuditSampler::IsFirstOccurrence(
+    const void *caller, absl::Span<const absl::string_view> paths) {
+  void *const frames[] = {const_cast<void *>(caller)};
+  return seen_.Record(ViolationDedupTable::Key(frames, 0, paths)) == 1;
+}
+
+bool AuditSampler::TakeToken() {
+  const SamplingPolicy *current = policy();
+  if (current == nullptr || current->audits_per_second == 0) {
+    return true;
+  }
+  return bucket_.TryTake(current->audits_per_second, MonotonicNanos());
+}
+
+AuditSampler &AuditSampler::ForProcess() { return process_sampler; }
+
+bool HookSampler::ShouldAudit(AuditSampler &process, const void *caller,
+                              absl::Span<const absl::string_view> paths) {
+  const SamplingPolicy *policy = process.policy();
+  if (ABSL_PREDICT_TRUE(policy == nullptr)) {
+    return true;
+  }
+
+  uint32_t period = period_.load(std::memory_order_relaxed);
+  if (ABSL_PREDICT_FALSE(period == 0)) {
+    period = policy->PeriodFor(function_name_);
+    period_.store(period, std::memory_order_relaxed);
+  }
+  if (period == 1 && policy->audits_per_second == 0) {
+    return true;
+  }
+
+  if (process.IsFirstOccurrence(caller, paths)) {
+    return true;
+  }
+  if (calls_.fetch_add(1, std::memory_order_relaxed) % period != 0) {
+    return false;
+  }
+  return process.TakeToken();
+}
+
+}  // namespace pathauditor
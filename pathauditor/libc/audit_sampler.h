@@ -0,0 +1,134 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_LIBC_AUDIT_SAMPLER_H_
+#define PATHAUDITOR_LIBC_AUDIT_SAMPLER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "pathauditor/libc/violation_dedup.h"
+
+namespace pathauditor {
+
+// Configures which calls get audited. By default all of them are.
+struct SamplingPolicy {
+  // Audit one in default_period calls of every hook.
+  uint32_t default_period = 1;
+  // Overrides default_period for single hooks, keyed by function name.
+  std::vector<std::pair<std::string, uint32_t>> periods;
+  // Upper bound on the sampled audits per second across the process, 0 means
+  // no limit.
+  uint32_t audits_per_second = 0;
+
+  // Whether every call gets audited.
+  bool AuditsEverything() const;
+  uint32_t PeriodFor(absl::string_view function_name) const;
+
+  // Parses the settings, empty strings keep the defaults.
+  // default_period and audits_per_second are plain numbers, periods is a comma
+  // separated list of function=period pairs, e.g. "open=100,execve=1".
+  static absl::StatusOr<SamplingPolicy> Parse(absl::string_view default_period,
+                                              absl::string_view periods,
+                                              absl::string_view audits_per_second);
+};
+
+// A token bucket that holds up to one second worth of tokens. All-zero is a
+// valid state, the bucket is filled on first use.
+class TokenBucket {
+ public:
+  constexpr TokenBucket() = default;
+
+  TokenBucket(const TokenBucket &) = delete;
+  TokenBucket &operator=(const TokenBucket &) = delete;
+
+  // Takes a token if there is one. now_ns is a monotonic timestamp.
+  bool TryTake(uint32_t per_second, int64_t now_ns);
+
+ private:
+  std::atomic<int64_t> tokens_{0};
+  // The time up to which tokens have been added. 0 if the bucket was never
+  // used.
+  std::atomic<int64_t> refilled_until_ns_{0};
+};
+
+// The sampling state shared by all hooks of the process.
+class AuditSampler {
+ public:
+  constexpr AuditSampler() = default;
+
+  AuditSampler(const AuditSampler &) = delete;
+  AuditSampler &operator=(const AuditSampler &) = delete;
+
+  // Until a policy is set, everything gets audited. The policy is not owned
+  // and can't be changed once set.
+  void SetPolicy(const SamplingPolicy *policy);
+  const SamplingPolicy *policy() const {
+    return policy_.load(std::memory_order_acquire);
+  }
+
+  // Returns true the first time a call site is seen with these paths. Once the
+  // table is full, nothing counts as new anymore.
+  bool IsFirstOccurrence(const void *caller,
+                         absl::Span<const absl::string_view> paths);
+
+  // Applies the audits_per_second limit.
+  bool TakeToken();
+
+  static AuditSampler &ForProcess();
+
+ private:
+  std::atomic<const SamplingPolicy *> policy_{nullptr};
+  ViolationDedupTable seen_;
+  TokenBucket bucket_;
+};
+
+// The sampling state of a single hook. Meant to be constant initialized as a
+// static in the hook.
+class HookSampler {
+ public:
+  constexpr explicit HookSampler(const char *function_name)
+      : function_name_(function_name) {}
+
+  HookSampler(const HookSampler &) = delete;
+  HookSampler &operator=(const HookSampler &) = delete;
+
+  const char *function_name() const { return function_name_; }
+
+  // Where StatsWriter keeps the index of the hook on the stats page.
+  std::atomic<uint32_t> *stats_index() { return &stats_index_; }
+
+  // Decides if this call should be audited. The first call from a call site
+  // with a given path is always audited, the others are sampled according to
+  // the policy of the process sampler.
+  bool ShouldAudit(AuditSampler &process, const void *caller,
+                   absl::Span<const absl::string_view> paths);
+
+ private:
+  const char *function_name_;
+  // Looked up from the policy on first use, 0 until then.
+  std::atomic<uint32_t> period_{0};
+  std::atomic<uint64_t> calls_{0};
+  std::atomic<uint32_t> stats_index_{0};
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_LIBC_AUDIT_SAMPLER_H_
@@ -0,0 +1,110 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/libc/audit_sampler.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "pathauditor/util/status_matchers.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::Eq;
+using ::testing::IsFalse;
+using ::testing::IsTrue;
+
+constexpr int64_t kSecond = 1000000000;
+
+TEST(SamplingPolicyTest, Parse) {
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      SamplingPolicy policy,
+      SamplingPolicy::Parse("10", "open=100,execve=1", "50"));
+  EXPECT_THAT(policy.PeriodFor("open"), Eq(100));
+  EXPECT_THAT(policy.PeriodFor("execve"), Eq(1));
+  EXPECT_THAT(policy.PeriodFor("chmod"), Eq(10));
+  EXPECT_THAT(policy.audits_per_second, Eq(50));
+  EXPECT_THAT(policy.AuditsEverything(), IsFalse());
+
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      SamplingPolicy defaults, SamplingPolicy::Parse("", "", ""));
+  EXPECT_THAT(defaults.AuditsEverything(), IsTrue());
+}
+
+TEST(SamplingPolicyTest, ParseErrors) {
+  EXPECT_THAT(SamplingPolicy::Parse("0", "", "").status().code(),
+              Eq(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(SamplingPolicy::Parse("", "open", "").status().code(),
+              Eq(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(SamplingPolicy::Parse("", "=5", "").status().code(),
+              Eq(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(SamplingPolicy::Parse("", "", "many").status().code(),
+              Eq(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(TokenBucketTest, RefillsOverTime) {
+  TokenBucket bucket;
+  int64_t now = 100 * kSecond;
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(bucket.TryTake(4, now));
+  }
+  EXPECT_FALSE(bucket.TryTake(4, now));
+
+  // One token every 250ms, partial intervals carry over.
+  EXPECT_FALSE(bucket.TryTake(4, now + kSecond / 8));
+  EXPECT_TRUE(bucket.TryTake(4, now + kSecond / 4));
+  EXPECT_FALSE(bucket.TryTake(4, now + kSecond / 4));
+
+  // Never more than one second worth of tokens.
+  now += 10 * kSecond;
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(bucket.TryTake(4, now));
+  }
+  EXPECT_FALSE(bucket.TryTake(4, now));
+}
+
+TEST(HookSamplerTest, SamplesRepeatedCalls) {
+  static AuditSampler process;
+  SamplingPolicy policy;
+  policy.default_period = 3;
+  process.SetPolicy(&policy);
+
+  static HookSampler sampler("open");
+  int caller;
+  absl::string_view paths[] = {"/tmp/foo"};
+  int audited = 0;
+  for (int i = 0; i < 10; i++) {
+    if (sampler.ShouldAudit(process, &caller, paths)) {
+      audited++;
+    }
+  }
+  // The first call is new, then every third of the remaining nine.
+  EXPECT_THAT(audited, Eq(4));
+
+  absl::string_view other_paths[] = {"/tmp/bar"};
+  EXPECT_TRUE(sampler.ShouldAudit(process, &caller, other_paths));
+}
+
+TEST(HookSamplerTest, AuditsEverythingWithoutPolicy) {
+  static AuditSampler process;
+  static HookSampler sampler("open");
+  int caller;
+  absl::string_view paths[] = {"/tmp/foo"};
+  for (int i = 0; i < 10; i++) {
+    EXPECT_TRUE(sampler.ShouldAudit(process, &caller, paths));
+  }
+}
+
+}  // namespace
+}  // namespace pathauditor
@@ -0,0 +1,192 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/libc/daemon_client.h"
+
+#include <fcntl.h>
+#include <linux/memfd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "pathauditor/util/cleanup.h"
+
+namespace pathauditor {
+
+namespace {
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#endif
+
+// The instance that the fork handler operates on.
+std::atomic<DaemonClient *> fork_handler_client = {nullptr};
+
+}  // namespace
+
+void DaemonClient::Enable(const char *ring_dir) {
+  absl::MutexLock lock(&mu_);
+  snprintf(ring_dir_, sizeof(ring_dir_), "%s", ring_dir);
+  DaemonClient *expected = nullptr;
+  if (fork_handler_client.compare_exchange_strong(expected, this)) {
+    pthread_atfork(&DaemonClient::BeforeFork, &DaemonClient::AfterForkInParent,
+                   &DaemonClient::AfterForkInChild);
+  }
+  enabled_.store(true, std::memory_order_release);
+}
+
+void DaemonClient::BeforeFork() {
+  DaemonClient *client = fork_handler_client.load();
+  client->mu_.Lock();
+}
+
+void DaemonClient::AfterForkInParent() {
+  DaemonClient *client = fork_handler_client.load();
+  client->mu_.Unlock();
+}
+
+void DaemonClient::AfterForkInChild() {
+  // The ring is mapped with MADV_DONTFORK, so it's gone in the child. The
+  // child gets its own ring on the next event.
+  DaemonClient *client = fork_handler_client.load();
+  client->ring_.store(nullptr, std::memory_order_relaxed);
+  client->failed_.store(false, std::memory_order_relaxed);
+  client->mu_.Unlock();
+}
+
+bool DaemonClient::Send(const FileEventView &event,
+                        const char *function_name) {
+  EventRing *ring = GetOrCreateRing();
+  if (ring == nullptr) {
+    return false;
+  }
+  return ring->queue.TryPush([&](RingFileEvent &slot) {
+    EncodeRingFileEvent(event, function_name, &slot);
+  });
+}
+
+void DaemonClient::WaitUntilDrained(int timeout_ms) {
+  EventRing *ring = ring_.load(std::memory_order_acquire);
+  if (ring == nullptr) {
+    return;
+  }
+  constexpr int kPollIntervalUs = 500;
+  for (int waited_us = 0;
+       ring->queue.Size() > 0 && waited_us < timeout_ms * 1000;
+       waited_us += kPollIntervalUs) {
+    usleep(kPollIntervalUs);
+  }
+}
+
+EventRing *DaemonClient::GetOrCreateRing() {
+  EventRing *ring = ring_.load(std::memory_order_acquire);
+  if (ring || failed_.load(std::memory_order_relaxed)) {
+    return ring;
+  }
+  absl::MutexLock lock(&mu_);
+  ring = ring_.load(std::memory_order_relaxed);
+  if (ring == nullptr && !failed_.load(std::memory_order_relaxed)) {
+    ring = CreateRing();
+    if (ring) {
+      ring_.store(ring, std::memory_order_release);
+    } else {
+      failed_.store(true, std::memory_order_relaxed);
+    }
+  }
+  return ring;
+}
+
+EventRing *DaemonClient::CreateRing() {
+  int fd = syscall(SYS_memfd_create, "pathauditor_ring",
+                   MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd == -1) {
+    return nullptr;
+  }
+  // The daemon maps the ring too. Sealing the size keeps us from truncating
+  // it under the daemon's feet.
+  if (ftruncate(fd, sizeof(EventRing)) == -1 ||
+      fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1) {
+    close(fd);
+    return nullptr;
+  }
+  void *mem = mmap(nullptr, sizeof(EventRing), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+  if (mem == MAP_FAILED) {
+    close(fd);
+    return nullptr;
+  }
+  madvise(mem, sizeof(EventRing), MADV_DONTFORK);
+
+  // The memfd is zero filled, which is an empty queue.
+  EventRing *ring = static_cast<EventRing *>(mem);
+  ring->magic = kEventRingMagic;
+  ring->version = kEventRingVersion;
+  ring->size = sizeof(EventRing);
+
+  // The fd stays open so that the daemon can find the ring through
+  // /proc/<pid>/fd.
+  if (!Announce(fd)) {
+    munmap(mem, sizeof(EventRing));
+    close(fd);
+    return nullptr;
+  }
+  return ring;
+}
+
+bool DaemonClient::Announce(int ring_fd) {
+  // Raw syscalls throughout, we don't want to audit ourselves.
+  int dir_fd = syscall(SYS_open, ring_dir_,
+                       O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (dir_fd == -1) {
+    return false;
+  }
+  auto close_dir_fd = MakeCleanup([dir_fd]() { close(dir_fd); });
+
+  pid_t pid = syscall(SYS_getpid);
+  char name[32];
+  char tmp_name[40];
+  snprintf(name, sizeof(name), "%d", pid);
+  snprintf(tmp_name, sizeof(tmp_name), ".%d.tmp", pid);
+
+  // The directory is shared with other users, don't follow or reuse anything
+  // that's already there.
+  syscall(SYS_unlinkat, dir_fd, tmp_name, 0);
+  int tmp_fd =
+      syscall(SYS_openat, dir_fd, tmp_name,
+              O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0644);
+  if (tmp_fd == -1) {
+    return false;
+  }
+  char content[16];
+  int len = snprintf(content, sizeof(content), "%d\n", ring_fd);
+  bool written = write(tmp_fd, content, len) == len;
+  close(tmp_fd);
+
+  // Replaces the announcement of the image we were exec'ed from, if any.
+  if (!written ||
+      syscall(SYS_renameat, dir_fd, tmp_name, dir_fd, name) == -1) {
+    syscall(SYS_unlinkat, dir_fd, tmp_name, 0);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace pathauditor
@@ -0,0 +1,74 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_LIBC_DAEMON_CLIENT_H_
+#define PATHAUDITOR_LIBC_DAEMON_CLIENT_H_
+
+#include <limits.h>
+#include <sys/types.h>
+
+#include <atomic>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "pathauditor/event_ring.h"
+#include "pathauditor/file_event.h"
+
+namespace pathauditor {
+
+// Hands events to pathauditor-daemon instead of auditing them in process. The
+// ring is created on the first event, and again in the child after a fork. If
+// that fails, the client stays disabled for the rest of the process.
+// There should only be one instance per process since it registers fork
+// handlers.
+class DaemonClient {
+ public:
+  constexpr DaemonClient() : mu_(absl::kConstInit) {}
+
+  DaemonClient(const DaemonClient &) = delete;
+  DaemonClient &operator=(const DaemonClient &) = delete;
+
+  // Rings are announced in ring_dir, which the daemon is watching. Call this
+  // once at startup, before any events are sent.
+  void Enable(const char *ring_dir);
+  bool enabled() const { return enabled_.load(std::memory_order_acquire); }
+
+  // Queues the event for the daemon. Returns false if the ring is full or
+  // couldn't be created, in which case the event should be audited in process.
+  bool Send(const FileEventView &event, const char *function_name);
+
+  // Waits up to timeout_ms for the daemon to drain the ring. The ring goes
+  // away on exec or exit, so this should be called before either.
+  void WaitUntilDrained(int timeout_ms);
+
+ private:
+  static void BeforeFork();
+  static void AfterForkInParent();
+  static void AfterForkInChild();
+
+  EventRing *GetOrCreateRing();
+  EventRing *CreateRing() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  bool Announce(int ring_fd) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  std::atomic<bool> enabled_{false};
+  std::atomic<EventRing *> ring_{nullptr};
+  // Set if creating the ring failed, so that we don't retry on every event.
+  std::atomic<bool> failed_{false};
+  absl::Mutex mu_;
+  char ring_dir_[PATH_MAX] = {};
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_LIBC_DAEMON_CLIENT_H_
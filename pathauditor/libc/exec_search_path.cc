@@ -0,0 +1,211 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/libc/exec_search_path.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "pathauditor/audit_context.h"
+#include "pathauditor/file_event.h"
+#include "pathauditor/pathauditor.h"
+#include "pathauditor/process_information.h"
+#include "pathauditor/util/cleanup.h"
+#include "pathauditor/util/path.h"
+#include "pathauditor/util/status_macros.h"
+
+namespace pathauditor {
+
+namespace {
+
+// The PATH that execvp uses if the variable is unset.
+std::string DefaultPath() {
+  size_t len = confstr(_CS_PATH, nullptr, 0);
+  if (len == 0) {
+    return "/bin:/usr/bin";
+  }
+  std::string path(len, '\0');
+  confstr(_CS_PATH, &path[0], len);
+  path.resize(len - 1);
+  return path;
+}
+
+// Like for the safe prefixes, a directory is safe if nobody else can create
+// entries in it.
+absl::StatusOr<bool> DirectoryIsUserControlled(absl::string_view dir) {
+  return PathIsUserControlled(SameProcessInformation(),
+                              JoinPath(dir, "pathauditor_probe"));
+}
+
+bool SameDirectory(const struct stat &a, const struct stat &b) {
+  return a.st_dev == b.st_dev && a.st_ino == b.st_ino &&
+         a.st_ctim.tv_sec == b.st_ctim.tv_sec &&
+         a.st_ctim.tv_nsec == b.st_ctim.tv_nsec;
+}
+
+}  // namespace
+
+std::vector<std::string> ExecSearchPath::SplitPath(const char *path_env) {
+  std::vector<std::string> dirs;
+  for (absl::string_view dir :
+       absl::StrSplit(path_env ? path_env : DefaultPath(), ':')) {
+    // An empty entry is the current directory.
+    dirs.emplace_back(dir.empty() ? "." : dir);
+  }
+  return dirs;
+}
+
+std::vector<std::string> ExecSearchPath::Candidates(const char *path_env,
+                                                    absl::string_view file) {
+  std::vector<std::string> candidates;
+  for (const std::string &dir : SplitPath(path_env)) {
+    candidates.push_back(JoinPath(dir, file));
+    if (access(candidates.back().c_str(), X_OK) == 0) {
+      break;
+    }
+  }
+  return candidates;
+}
+
+ExecSearchPath::Table *ExecSearchPath::Build(const char *path_env) {
+  Table *table = new Table();
+  table->path_env = path_env ? path_env : DefaultPath();
+  for (std::string &path : SplitPath(table->path_env.c_str())) {
+    Directory dir{std::move(path), Directory::Verdict::kCheckEveryTime,
+                  absl::nullopt};
+    // Relative entries depend on the working directory.
+    if (!dir.path.empty() && dir.path[0] == '/') {
+      // Taken before the walk: if the directory gets replaced after this,
+      // the searches notice and walk it again.
+      struct stat sb;
+      // Not stat: before glibc 2.33 that's not a symbol the hook could
+      // forward to, and this runs inside the hooks anyway.
+      if (fstatat(AT_FDCWD, dir.path.c_str(), &sb, 0) == 0 &&
+          S_ISDIR(sb.st_mode)) {
+        dir.sb = sb;
+      }
+      absl::StatusOr<bool> user_controlled =
+          DirectoryIsUserControlled(dir.path);
+      if (user_controlled.ok()) {
+        dir.verdict = *user_controlled ? Directory::Verdict::kUserControlled
+                                       : Directory::Verdict::kSafe;
+      }
+    }
+    table->dirs.push_back(std::move(dir));
+  }
+  return table;
+}
+
+const ExecSearchPath::Table *ExecSearchPath::GetTable(const char *path_env) {
+  Table *table = table_.load(std::memory_order_acquire);
+  if (table != nullptr &&
+      table->path_env == (path_env ? path_env : DefaultPath())) {
+    return table;
+  }
+  Table *new_table = Build(path_env);
+  // The old table is leaked, see table_.
+  table_.store(new_table, std::memory_order_release);
+  return new_table;
+}
+
+void ExecSearchPath::Precompute(const char *path_env) {
+  if (table_.load(std::memory_order_acquire) == nullptr) {
+    return;
+  }
+  GetTable(path_env);
+}
+
+absl::StatusOr<absl::optional<std::string>> ExecSearchPath::FindUserControlled(
+    const char *path_env, absl::string_view file) {
+  const Table *table = GetTable(path_env);
+  AuditContext::Scope scope;
+  PATHAUDITOR_ASSIGN_OR_RETURN(const char *file_name,
+                               scope.context().CStr(file));
+  for (const Directory &dir : table->dirs) {
+    std::string candidate = JoinPath(dir.path, file);
+    switch (dir.verdict) {
+      case Directory::Verdict::kUserControlled:
+        return candidate;
+      case Directory::Verdict::kCheckEveryTime: {
+        absl::string_view path_args[] = {candidate};
+        uint64_t args[] = {0, 0, 0};
+        PATHAUDITOR_ASSIGN_OR_RETURN(
+            bool user_controlled,
+            FileEventIsUserControlled(
+                SameProcessInformation(),
+                FileEventView(SYS_execve, args, path_args)));
+        if (user_controlled) {
+          return candidate;
+        }
+        if (access(candidate.c_str(), X_OK) == 0) {
+          return absl::nullopt;
+        }
+        break;
+      }
+      case Directory::Verdict::kSafe: {
+        int fd = open(dir.path.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (fd == -1) {
+          // Nobody could create it when it was walked.
+          break;
+        }
+        auto close_fd = MakeCleanup([fd]() { close(fd); });
+        struct stat sb;
+        if (fstat(fd, &sb) == -1) {
+          return absl::FailedPreconditionError(
+              absl::StrCat("Could not stat ", dir.path));
+        }
+        if (!dir.sb.has_value() || !SameDirectory(sb, *dir.sb)) {
+          PATHAUDITOR_ASSIGN_OR_RETURN(bool user_controlled,
+                                       DirectoryIsUserControlled(dir.path));
+          if (user_controlled) {
+            return candidate;
+          }
+        }
+        // Most directories before the right one don't have the file.
+        struct stat file_sb;
+        if (fstatat(fd, file_name, &file_sb,
+                    AT_SYMLINK_NOFOLLOW) == -1) {
+          break;
+        }
+        // The directory is safe, only the file itself and where it points to
+        // are left.
+        absl::string_view path_args[] = {file};
+        uint64_t args[] = {static_cast<uint64_t>(fd), 0, 0, 0, 0};
+        PATHAUDITOR_ASSIGN_OR_RETURN(
+            bool user_controlled,
+            FileEventIsUserControlled(
+                SameProcessInformation(),
+                FileEventView(SYS_execveat, args, path_args)));
+        if (user_controlled) {
+          return candidate;
+        }
+        if (faccessat(fd, file_name, X_OK, 0) == 0) {
+          return absl::nullopt;
+        }
+        break;
+      }
+    }
+  }
+  return absl::nullopt;
+}
+
+}  // namespace pathauditor
@@ -0,0 +1,90 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_LIBC_EXEC_SEARCH_PATH_H_
+#define PATHAUDITOR_LIBC_EXEC_SEARCH_PATH_H_
+
+#include <sys/stat.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+
+namespace pathauditor {
+
+// Audits the PATH search of execvp and execlp. A file name without a slash is
+// looked up in every PATH directory until one has an executable file of that
+// name, so every directory up to that one needs to be safe: a user who can
+// create entries in an earlier directory decides what runs.
+//
+// Walking every directory on every call would make the search as expensive as
+// a handful of audited opens. Instead the directories of a PATH value are
+// walked once, and later searches only check that a directory is still the
+// one that was walked and look at the file in it. Like the safe prefixes,
+// the directories above a PATH directory are only checked once per PATH value.
+class ExecSearchPath {
+ public:
+  constexpr ExecSearchPath() = default;
+
+  ExecSearchPath(const ExecSearchPath &) = delete;
+  ExecSearchPath &operator=(const ExecSearchPath &) = delete;
+
+  // Returns the first path that execvp(file) could run with the given PATH
+  // value and that a user could have replaced, nullopt if there is none.
+  // path_env is nullptr if PATH is unset. file must not contain a slash.
+  absl::StatusOr<absl::optional<std::string>> FindUserControlled(
+      const char *path_env, absl::string_view file);
+
+  // Walks the directories of the PATH value if that hasn't happened yet, but
+  // only if there was a search before. Searches in processes forked after this
+  // don't need to walk them again, and processes that never search don't walk
+  // them at all.
+  void Precompute(const char *path_env);
+
+  // The paths that execvp(file) tries, up to the first executable one.
+  static std::vector<std::string> Candidates(const char *path_env,
+                                             absl::string_view file);
+
+ private:
+  struct Directory {
+    enum class Verdict { kSafe, kUserControlled, kCheckEveryTime };
+
+    std::string path;
+    Verdict verdict;
+    // What the directory looked like when it was walked. Not set if it didn't
+    // exist.
+    absl::optional<struct stat> sb;
+  };
+
+  struct Table {
+    std::string path_env;
+    std::vector<Directory> dirs;
+  };
+
+  static std::vector<std::string> SplitPath(const char *path_env);
+  static Table *Build(const char *path_env);
+  const Table *GetTable(const char *path_env);
+
+  // The table of the last PATH value. Tables are never freed, a thread might
+  // still be using one after it got replaced. Processes rarely change PATH.
+  std::atomic<Table *> table_{nullptr};
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_LIBC_EXEC_SEARCH_PATH_H_
@@ -0,0 +1,173 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/libc/exec_search_path.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+#include "pathauditor/pathauditor.h"
+#include "pathauditor/util/status_matchers.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::Ne;
+using ::testing::Optional;
+
+class ExecSearchPathTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir_template[] = "/tmp/exec_search_path_test.XXXXXX";
+    ASSERT_THAT(mkdtemp(dir_template), Ne(nullptr));
+    dir_ = dir_template;
+    ASSERT_THAT(chmod(dir_.c_str(), 0755), Eq(0));
+    for (const char *sub : {"/safe", "/other", "/open"}) {
+      ASSERT_THAT(mkdir((dir_ + sub).c_str(), 0755), Eq(0));
+    }
+    ASSERT_THAT(chmod((dir_ + "/open").c_str(), 0777), Eq(0));
+  }
+
+  void TearDown() override {
+    for (const char *sub : {"/safe", "/other", "/open"}) {
+      unlink((dir_ + sub + "/tool").c_str());
+      rmdir((dir_ + sub).c_str());
+    }
+    rmdir(dir_.c_str());
+  }
+
+  void CreateTool(const std::string &sub, mode_t mode = 0755) {
+    std::string path = dir_ + sub + "/tool";
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, mode);
+    ASSERT_THAT(fd, Ne(-1));
+    close(fd);
+    ASSERT_THAT(chmod(path.c_str(), mode), Eq(0));
+  }
+
+  std::string Path(std::initializer_list<const char *> subs) {
+    std::string path;
+    for (const char *sub : subs) {
+      absl::StrAppend(&path, path.empty() ? "" : ":", dir_, sub);
+    }
+    return path;
+  }
+
+  std::string dir_;
+  ExecSearchPath search_path_;
+};
+
+TEST_F(ExecSearchPathTest, CandidatesStopAtFirstExecutable) {
+  CreateTool("/other");
+  EXPECT_THAT(
+      ExecSearchPath::Candidates(Path({"/safe", "/other", "/open"}).c_str(),
+                                 "tool"),
+      ElementsAre(dir_ + "/safe/tool", dir_ + "/other/tool"));
+  EXPECT_THAT(ExecSearchPath::Candidates(":/nonexistent", "tool"),
+              ElementsAre("./tool", "/nonexistent/tool"));
+}
+
+TEST_F(ExecSearchPathTest, SafeDirectories) {
+  CreateTool("/other");
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      absl::optional<std::string> insecure,
+      search_path_.FindUserControlled(Path({"/safe", "/other"}).c_str(),
+                                      "tool"));
+  EXPECT_THAT(insecure, Eq(absl::nullopt));
+}
+
+TEST_F(ExecSearchPathTest, UserControlledDirectoryBeforeTheFile) {
+  CreateTool("/other");
+  std::string path = Path({"/safe", "/open", "/other"});
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      absl::optional<std::string> insecure,
+      search_path_.FindUserControlled(path.c_str(), "tool"));
+  EXPECT_THAT(insecure, Optional(dir_ + "/open/tool"));
+}
+
+TEST_F(ExecSearchPathTest, DirectoriesAfterTheFileDontMatter) {
+  CreateTool("/safe");
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      absl::optional<std::string> insecure,
+      search_path_.FindUserControlled(Path({"/safe", "/open"}).c_str(),
+                                      "tool"));
+  EXPECT_THAT(insecure, Eq(absl::nullopt));
+}
+
+TEST_F(ExecSearchPathTest, UserWritableFile) {
+  CreateTool("/other", 0777);
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      absl::optional<std::string> insecure,
+      search_path_.FindUserControlled(Path({"/safe", "/other"}).c_str(),
+                                      "tool"));
+  EXPECT_THAT(insecure, Optional(dir_ + "/other/tool"));
+}
+
+TEST_F(ExecSearchPathTest, NoticesChangedDirectory) {
+  CreateTool("/other");
+  std::string path = Path({"/safe", "/other"});
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      absl::optional<std::string> insecure,
+      search_path_.FindUserControlled(path.c_str(), "tool"));
+  EXPECT_THAT(insecure, Eq(absl::nullopt));
+
+  // Same PATH value, so the table is reused.
+  ASSERT_THAT(chmod((dir_ + "/safe").c_str(), 0777), Eq(0));
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      insecure, search_path_.FindUserControlled(path.c_str(), "tool"));
+  EXPECT_THAT(insecure, Optional(dir_ + "/safe/tool"));
+}
+
+TEST_F(ExecSearchPathTest, NewPathValue) {
+  CreateTool("/other");
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      absl::optional<std::string> insecure,
+      search_path_.FindUserControlled(Path({"/other"}).c_str(), "tool"));
+  EXPECT_THAT(insecure, Eq(absl::nullopt));
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      insecure,
+      search_path_.FindUserControlled(Path({"/open", "/other"}).c_str(),
+                                      "tool"));
+  EXPECT_THAT(insecure, Optional(dir_ + "/open/tool"));
+}
+
+TEST_F(ExecSearchPathTest, PrecomputesOnlyAfterASearch) {
+  CreateTool("/other");
+  uint64_t calls = ThreadFileSystemCallCount();
+  search_path_.Precompute(Path({"/safe", "/other"}).c_str());
+  EXPECT_THAT(ThreadFileSystemCallCount() - calls, Eq(0));
+
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      absl::optional<std::string> insecure,
+      search_path_.FindUserControlled(Path({"/other"}).c_str(), "tool"));
+  EXPECT_THAT(insecure, Eq(absl::nullopt));
+  calls = ThreadFileSystemCallCount();
+  search_path_.Precompute(Path({"/safe", "/other"}).c_str());
+  EXPECT_THAT(ThreadFileSystemCallCount() - calls, Ne(0));
+  // Already walked.
+  calls = ThreadFileSystemCallCount();
+  search_path_.Precompute(Path({"/safe", "/other"}).c_str());
+  EXPECT_THAT(ThreadFileSystemCallCount() - calls, Eq(0));
+}
+
+}  // namespace
+}  // namespace pathauditor
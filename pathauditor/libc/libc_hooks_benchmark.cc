@@ -0,0 +1,146 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Calls libc file functions in a loop. It doesn't link the path auditor, run
+// it once as is and once with the library preloaded to get the overhead:
+//
+//   libc_hooks_benchmark
+//   LD_PRELOAD=libpath_auditor.so libc_hooks_benchmark
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "benchmark/benchmark.h"
+
+namespace {
+
+// A file in a root owned directory and one a few levels deeper.
+constexpr const char kShallowPath[] = "/etc/passwd";
+constexpr const char kDeepPath[] = "/usr/share/common-licenses/Apache-2.0";
+
+const char *PathForRange(int64_t range) {
+  return range == 0 ? kShallowPath : kDeepPath;
+}
+
+// Returns false and skips the benchmark if path doesn't exist on this system.
+bool SetUp(benchmark::State &state, const char *path) {
+  // The preload library exports open, check if it's the one we're calling.
+  Dl_info info;
+  void *open_fn = dlsym(RTLD_DEFAULT, "open");
+  bool preloaded = open_fn && dladdr(open_fn, &info) && info.dli_fname &&
+                   strstr(info.dli_fname, "path_auditor");
+  state.SetLabel(preloaded ? "preloaded" : "native");
+
+  if (access(path, R_OK) != 0) {
+    state.SkipWithError("benchmark file doesn't exist");
+    return false;
+  }
+  return true;
+}
+
+void BM_OpenClose(benchmark::State &state) {
+  const char *path = PathForRange(state.range(0));
+  if (!SetUp(state, path)) {
+    return;
+  }
+  for (auto _ : state) {
+    int fd = open(path, O_RDONLY);
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+}
+BENCHMARK(BM_OpenClose)->Arg(0)->Arg(1);
+
+void BM_FopenFclose(benchmark::State &state) {
+  const char *path = PathForRange(state.range(0));
+  if (!SetUp(state, path)) {
+    return;
+  }
+  for (auto _ : state) {
+    FILE *f = fopen(path, "r");
+    if (f) {
+      fclose(f);
+    }
+  }
+}
+BENCHMARK(BM_FopenFclose)->Arg(0)->Arg(1);
+
+void BM_Stat(benchmark::State &state) {
+  const char *path = PathForRange(state.range(0));
+  if (!SetUp(state, path)) {
+    return;
+  }
+  struct stat sb;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(stat(path, &sb));
+  }
+}
+BENCHMARK(BM_Stat)->Arg(0)->Arg(1);
+
+void BM_Access(benchmark::State &state) {
+  const char *path = PathForRange(state.range(0));
+  if (!SetUp(state, path)) {
+    return;
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(access(path, R_OK));
+  }
+}
+BENCHMARK(BM_Access)->Arg(0)->Arg(1);
+
+// Searches PATH in the child, the parent has already walked its directories
+// after the first iteration.
+void BM_ForkExecvp(benchmark::State &state) {
+  if (!SetUp(state, "/bin/true")) {
+    return;
+  }
+  char *const argv[] = {const_cast<char *>("true"), nullptr};
+  for (auto _ : state) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      execvp("true", argv);
+      _exit(127);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+  }
+}
+BENCHMARK(BM_ForkExecvp)->UseRealTime();
+
+// Build systems and package managers stat and open a lot of files in the same
+// directories.
+void BM_StatHeavyLoop(benchmark::State &state) {
+  if (!SetUp(state, kDeepPath)) {
+    return;
+  }
+  struct stat sb;
+  for (auto _ : state) {
+    for (int i = 0; i < 10; i++) {
+      benchmark::DoNotOptimize(stat(kDeepPath, &sb));
+    }
+    int fd = open(kDeepPath, O_RDONLY);
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+}
+BENCHMARK(BM_StatHeavyLoop);
+
+}  // namespace
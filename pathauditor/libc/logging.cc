@@ -19,39 +19,36 @@
 #include <sys/syscall.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <cstdio>
 #include <cstdlib>
-#include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
-#include "absl/debugging/stacktrace.h"
+#include "absl/base/attributes.h"
+#include "absl/base/optimization.h"
 #include "absl/debugging/symbolize.h"
-#include "absl/strings/str_format.h"
+#include "absl/types/span.h"
+#include "pathauditor/libc/report_sink.h"
+#include "pathauditor/libc/reporter.h"
 
 namespace {
 
 static const size_t kCmdlineMax = 1024;
-static const size_t kMaxStackFrames = 20;
 static const size_t kMaxSymbolLen = 64;
 
-static const std::string &GetCmdline() {
-  static std::string cmdline;
-
-  if (!cmdline.empty()) {
-    return cmdline;
-  }
-
-  int fd = syscall(SYS_open, "/proc/self/cmdline", O_RDONLY);
+// Reads /proc/self/cmdline, with the arguments separated by spaces.
+static std::string ReadCmdline() {
+  int fd = syscall(SYS_open, "/proc/self/cmdline", O_RDONLY | O_CLOEXEC);
   if (fd == -1) {
-    cmdline = "(unknown)";
-    return cmdline;
+    return "(unknown)";
   }
   char cmdline_buf[kCmdlineMax];
   ssize_t bytes = read(fd, cmdline_buf, sizeof(cmdline_buf) - 1);
   close(fd);
   if (bytes == -1) {
-    cmdline = "(unknown)";
-    return cmdline;
+    return "(unknown)";
   }
   cmdline_buf[bytes] = 0;
 
@@ -62,58 +59,143 @@ static const std::string &GetCmdline() {
       cmdline_buf[i] = ' ';
     }
   }
-  cmdline = cmdline_buf;
-
-  return cmdline;
+  return cmdline_buf;
 }
 
-static int GetUid() { return syscall(SYS_getuid); }
+// The cmdline is only read once a report needs it, most processes never get
+// there. Concurrent first callers race to publish theirs, the losers delete
+// their copy, so this neither locks nor runs at load time.
+ABSL_CONST_INIT std::atomic<const std::string *> cmdline{nullptr};
 
-static std::string CurrentStackTrace() {
-  void *stack_trace[kMaxStackFrames];
-  int frame_cnt = absl::GetStackTrace(stack_trace, kMaxStackFrames, 2);
+static const std::string &GetCmdline() {
+  const std::string *current = cmdline.load(std::memory_order_acquire);
+  if (ABSL_PREDICT_TRUE(current != nullptr)) {
+    return *current;
+  }
+  // Leaked on purpose, reports can still be written by destructors.
+  const std::string *read_cmdline = new std::string(ReadCmdline());
+  if (cmdline.compare_exchange_strong(current, read_cmdline,
+                                      std::memory_order_acq_rel,
+                                      std::memory_order_acquire)) {
+    return *read_cmdline;
+  }
+  delete read_cmdline;
+  return *current;
+}
 
-  std::vector<std::string> stack_trace_lines;
-  for (int i = 0; i < frame_cnt; i++) {
+static std::vector<std::string> Symbolize(absl::Span<void *const> frames) {
+  std::vector<std::string> symbols;
+  symbols.reserve(frames.size());
+  for (void *frame : frames) {
     char tmp[kMaxSymbolLen] = "";
-    const char *symbol = "(unknown)";
-    if (absl::Symbolize(stack_trace[i], tmp, sizeof(tmp))) {
-      symbol = tmp;
+    symbols.emplace_back(absl::Symbolize(frame, tmp, sizeof(tmp)) ? tmp
+                                                                  : "(unknown)");
+  }
+  return symbols;
+}
+
+static void OpenLogOnce() {
+  static const bool opened = (openlog("pathauditor", LOG_PID, 0), true);
+  (void)opened;
+}
+
+// PATHAUDITOR_REPORT_SINKS, read when the library is loaded. The sinks
+// themselves are only created with the first report.
+const char *report_sinks_spec = nullptr;
+
+__attribute__((constructor)) static void LoadReportSinksSpec() {
+  report_sinks_spec = std::getenv("PATHAUDITOR_REPORT_SINKS");
+}
+
+// Only used by the reporter's consumers, which it serializes.
+std::vector<std::unique_ptr<pathauditor::ReportSink>> *report_sinks = nullptr;
+
+static std::vector<std::unique_ptr<pathauditor::ReportSink>> &ReportSinks() {
+  if (report_sinks == nullptr) {
+    std::vector<absl::Status> errors;
+    // Leaked on purpose, reports can still be written by destructors.
+    report_sinks = new std::vector<std::unique_ptr<pathauditor::ReportSink>>(
+        pathauditor::OpenReportSinks(
+            report_sinks_spec ? report_sinks_spec : "syslog", &errors));
+    for (const absl::Status &error : errors) {
+      pathauditor::LogError(error);
     }
-    stack_trace_lines.push_back(absl::StrCat(
-        "  ", absl::Hex(stack_trace[i], absl::kZeroPad12), " ", symbol));
   }
+  return *report_sinks;
+}
+
+// Runs on the reporter thread or in FlushInsecureAccessReports.
+static void DeliverReport(const pathauditor::InsecureAccessReport &report) {
+  std::vector<absl::string_view> path_arg_views(
+      report.path_args, report.path_args + report.path_arg_count);
+  absl::Span<void *const> frames(report.frames, report.frame_count);
+  std::vector<std::string> symbols = Symbolize(frames);
+
+  pathauditor::ViolationRecord record;
+  record.function_name = report.function_name;
+  record.syscall_nr = report.syscall_nr;
+  record.uid = report.uid;
+  record.pid = syscall(SYS_getpid);
+  record.timestamp_ns = report.timestamp_ns;
+  record.args = absl::MakeConstSpan(report.args, report.arg_count);
+  record.path_args = path_arg_views;
+  record.cmdline = GetCmdline();
+  record.frames = frames;
+  record.symbols = symbols;
+  record.occurrences = report.occurrences;
+  record.reason = report.reason;
+  if (report.reason != pathauditor::UnsafeReason::kNone) {
+    record.unsafe_path_index = report.unsafe_path_index;
+    record.component_index = report.component_index;
+    record.component = report.component;
+    record.directory_dev = report.directory_dev;
+    record.directory_ino = report.directory_ino;
+  }
+  for (const std::unique_ptr<pathauditor::ReportSink> &sink : ReportSinks()) {
+    sink->Write(record);
+  }
+}
 
-  return absl::StrJoin(stack_trace_lines, "\n");
+static void DeliverDropped(uint64_t dropped) {
+  for (const std::unique_ptr<pathauditor::ReportSink> &sink : ReportSinks()) {
+    sink->Dropped(dropped);
+  }
 }
 
+static void FlushReportSinks() {
+  for (const std::unique_ptr<pathauditor::ReportSink> &sink : ReportSinks()) {
+    sink->Flush();
+  }
+}
+
+ABSL_CONST_INIT pathauditor::AsyncReporter reporter(&DeliverReport,
+                                                    &DeliverDropped,
+                                                    &FlushReportSinks);
+
+// Deliver whatever is still queued when the process exits normally.
+__attribute__((destructor)) static void FlushAtExit() { reporter.Flush(); }
+
 }  // namespace
 
 namespace pathauditor {
 
-void LogInsecureAccess(const FileEvent &event, const char *function_name) {
+void LogInsecureAccess(const FileEventView &event, const char *function_name,
+                       const PathAuditResult *result) {
   // for testing that functions get audited
   const char *env_p = std::getenv("PATHAUDITOR_TEST");
   if (env_p) {
-    std::cerr << "AUDITING:" << function_name << std::endl;
+    fprintf(stderr, "AUDITING:%s\n", function_name);
     return;
   }
 
-  openlog("pathauditor", LOG_PID, 0);
-
-  std::string args = absl::StrJoin(event.args, ", ");
-  std::string path_args = absl::StrJoin(event.path_args, ", ");
-  std::string event_info = absl::StrFormat(
-      "function %s, cmdline %s, syscall_nr %d, args %s, path args %s, uid %d, "
-      "stack trace:\n%s",
-      function_name, GetCmdline(), event.syscall_nr, args, path_args, GetUid(),
-      CurrentStackTrace());
-
-  syslog(LOG_WARNING, "InsecureAccess: %s", event_info.c_str());
+  // Start the stack trace at the caller, like the synchronous version did.
+  reporter.Report(event, function_name, 1, result);
 }
 
+void FlushInsecureAccessReports() { reporter.Flush(); }
+
 void LogError(const absl::Status &status) {
-  openlog("pathauditor", LOG_PID, 0);
+  OpenLogOnce();
   syslog(LOG_WARNING, "Cannot audit: %s",
          std::string(status.message()).c_str());
 }
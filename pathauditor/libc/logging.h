@@ -17,10 +17,20 @@
 
 #include "absl/status/status.h"
 #include "pathauditor/file_event.h"
+#include "pathauditor/path_audit_result.h"
 
 namespace pathauditor {
 
-void LogInsecureAccess(const FileEvent &event, const char *function_name);
+// Queues a report of the insecure access. It's written to the sinks in
+// PATHAUDITOR_REPORT_SINKS asynchronously, syslog by default. See
+// AsyncReporter and OpenReportSink. result is the outcome of the audit, if
+// the caller has it, so that the report names the unsafe element.
+void LogInsecureAccess(const FileEventView &event, const char *function_name,
+                       const PathAuditResult *result = nullptr);
+
+// Writes all queued reports to the sinks before returning. Needs to be called
+// before the process image is replaced.
+void FlushInsecureAccessReports();
 
 void LogError(const absl::Status &status);
 
@@ -12,24 +12,48 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <dirent.h>
 #include <dlfcn.h>
+#include <fcntl.h>
 #include <stdarg.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <cstdint>
-#include <iostream>
+#include <cstdlib>
+#include <cstring>
 #include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
+#include "absl/base/optimization.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "pathauditor/directory_verdict_cache.h"
 #include "pathauditor/file_event.h"
+#include "pathauditor/libc/audit_sampler.h"
+#include "pathauditor/libc/daemon_client.h"
+#include "pathauditor/libc/exec_search_path.h"
 #include "pathauditor/libc/logging.h"
+#include "pathauditor/libc/reentrancy_guard.h"
+#include "pathauditor/libc/stats_writer.h"
+#include "pathauditor/libc/trace_writer.h"
+#include "pathauditor/path_audit_result.h"
 #include "pathauditor/pathauditor.h"
 #include "pathauditor/process_information.h"
+#include "pathauditor/safe_prefix_trie.h"
+#include "pathauditor/shared_verdict_cache.h"
+#include "pathauditor/util/cleanup.h"
+#include "pathauditor/util/path.h"
 #include "pathauditor/util/status_macros.h"
 
 typedef int (*orig_open_type)(const char *file, int oflag, ...);
@@ -66,7 +90,8 @@ typedef int (*orig_unlinkat_type)(int dirfd, const char *name, int flags);
 typedef int (*orig_remove_type)(const char *filename);
 typedef int (*orig_rmdir_type)(const char *path);
 typedef int (*orig_mount_type)(const char *special_file, const char *dir,
-                               const char *fstype, unsigned rwflag, void *data);
+                               const char *fstype, unsigned long rwflag,
+                               const void *data);
 typedef int (*orig_umount_type)(const char *special_file);
 typedef int (*orig_umount2_type)(const char *special_file, int flags);
 typedef int (*orig_rename_type)(const char *oldpath, const char *newpath);
@@ -81,9 +106,114 @@ typedef int (*orig_fchmodat_type)(int fd, const char *file, mode_t mode,
                                   int flag);
 typedef int (*orig_fchownat_type)(int fd, const char *file, uid_t owner,
                                   gid_t group, int flag);
+typedef int (*orig_stat_type)(const char *file, struct stat *buf);
+typedef int (*orig_lstat_type)(const char *file, struct stat *buf);
+typedef int (*orig_stat64_type)(const char *file, struct stat64 *buf);
+typedef int (*orig_lstat64_type)(const char *file, struct stat64 *buf);
+typedef int (*orig_xstat_type)(int ver, const char *file, struct stat *buf);
+typedef int (*orig_lxstat_type)(int ver, const char *file, struct stat *buf);
+typedef int (*orig_xstat64_type)(int ver, const char *file,
+                                 struct stat64 *buf);
+typedef int (*orig_lxstat64_type)(int ver, const char *file,
+                                  struct stat64 *buf);
+typedef int (*orig_access_type)(const char *name, int type);
+typedef int (*orig_faccessat_type)(int fd, const char *file, int type,
+                                   int flag);
+typedef ssize_t (*orig_readlink_type)(const char *path, char *buf, size_t len);
+typedef DIR *(*orig_opendir_type)(const char *name);
+typedef int (*orig_renameat2_type)(int olddirfd, const char *oldpath,
+                                   int newdirfd, const char *newpath,
+                                   unsigned int flags);
 
 namespace {
 
+// Pointer to the next definition of a libc function, i.e. the one we're
+// wrapping. dlsym takes the loader lock, so we only resolve it once, on first
+// use: most processes call a handful of the hooks, resolving all of them when
+// the library is loaded would make every process start slower. Threads that
+// race on the first call resolve the same pointer.
+template <typename F>
+class OriginalFunction {
+ public:
+  constexpr explicit OriginalFunction(const char *name)
+      : name_(name), fn_(nullptr) {}
+
+  void Resolve() {
+    fn_.store(reinterpret_cast<F>(dlsym(RTLD_NEXT, name_)),
+              std::memory_order_release);
+  }
+
+  F Get() {
+    F fn = fn_.load(std::memory_order_acquire);
+    if (ABSL_PREDICT_FALSE(fn == nullptr)) {
+      Resolve();
+      fn = fn_.load(std::memory_order_acquire);
+    }
+    return fn;
+  }
+
+ private:
+  const char *name_;
+  std::atomic<F> fn_;
+};
+
+struct OriginalFunctions {
+  OriginalFunction<orig_open_type> open{"open"};
+  OriginalFunction<orig_open64_type> open64{"open64"};
+  OriginalFunction<orig_openat_type> openat{"openat"};
+  OriginalFunction<orig_openat64_type> openat64{"openat64"};
+  OriginalFunction<orig_creat_type> creat{"creat"};
+  OriginalFunction<orig_creat64_type> creat64{"creat64"};
+  OriginalFunction<orig_chdir_type> chdir{"chdir"};
+  OriginalFunction<orig_chmod_type> chmod{"chmod"};
+  OriginalFunction<orig_chown_type> chown{"chown"};
+  OriginalFunction<orig_execv_type> execv{"execv"};
+  OriginalFunction<orig_execve_type> execve{"execve"};
+  OriginalFunction<orig_execle_type> execle{"execle"};
+  OriginalFunction<orig_execvp_type> execvp{"execvp"};
+  OriginalFunction<orig_execlp_type> execlp{"execlp"};
+  OriginalFunction<orig_fopen_type> fopen{"fopen"};
+  OriginalFunction<orig_fopen64_type> fopen64{"fopen64"};
+  OriginalFunction<orig_freopen_type> freopen{"freopen"};
+  OriginalFunction<orig_freopen64_type> freopen64{"freopen64"};
+  OriginalFunction<orig_truncate_type> truncate{"truncate"};
+  OriginalFunction<orig_truncate64_type> truncate64{"truncate64"};
+  OriginalFunction<orig_mkdir_type> mkdir{"mkdir"};
+  OriginalFunction<orig_mkdirat_type> mkdirat{"mkdirat"};
+  OriginalFunction<orig_link_type> link{"link"};
+  OriginalFunction<orig_linkat_type> linkat{"linkat"};
+  OriginalFunction<orig_unlink_type> unlink{"unlink"};
+  OriginalFunction<orig_unlinkat_type> unlinkat{"unlinkat"};
+  OriginalFunction<orig_remove_type> remove{"remove"};
+  OriginalFunction<orig_rmdir_type> rmdir{"rmdir"};
+  OriginalFunction<orig_mount_type> mount{"mount"};
+  OriginalFunction<orig_umount_type> umount{"umount"};
+  OriginalFunction<orig_umount2_type> umount2{"umount2"};
+  OriginalFunction<orig_rename_type> rename{"rename"};
+  OriginalFunction<orig_renameat_type> renameat{"renameat"};
+  OriginalFunction<orig_symlink_type> symlink{"symlink"};
+  OriginalFunction<orig_symlinkat_type> symlinkat{"symlinkat"};
+  OriginalFunction<orig_lchown_type> lchown{"lchown"};
+  OriginalFunction<orig_chroot_type> chroot{"chroot"};
+  OriginalFunction<orig_fchmodat_type> fchmodat{"fchmodat"};
+  OriginalFunction<orig_fchownat_type> fchownat{"fchownat"};
+  OriginalFunction<orig_stat_type> stat{"stat"};
+  OriginalFunction<orig_lstat_type> lstat{"lstat"};
+  OriginalFunction<orig_stat64_type> stat64{"stat64"};
+  OriginalFunction<orig_lstat64_type> lstat64{"lstat64"};
+  OriginalFunction<orig_xstat_type> xstat{"__xstat"};
+  OriginalFunction<orig_lxstat_type> lxstat{"__lxstat"};
+  OriginalFunction<orig_xstat64_type> xstat64{"__xstat64"};
+  OriginalFunction<orig_lxstat64_type> lxstat64{"__lxstat64"};
+  OriginalFunction<orig_access_type> access{"access"};
+  OriginalFunction<orig_faccessat_type> faccessat{"faccessat"};
+  OriginalFunction<orig_readlink_type> readlink{"readlink"};
+  OriginalFunction<orig_opendir_type> opendir{"opendir"};
+  OriginalFunction<orig_renameat2_type> renameat2{"renameat2"};
+};
+
+ABSL_CONST_INIT OriginalFunctions originals;
+
 std::atomic<bool> mallocInitialized = {false};
 
 __attribute__((constructor))
@@ -92,34 +222,378 @@ void ensureMallocInitialized() {
   mallocInitialized.store(true, std::memory_order_release);
 }
 
+// glibc only exports stat and lstat since 2.33. Before that they were inline
+// wrappers around __xstat and __lxstat, and there's no next definition to call.
+// fstatat works with either version.
+int OriginalStat(const char *file, struct stat *buf) {
+  orig_stat_type fn = originals.stat.Get();
+  return fn != nullptr ? fn(file, buf) : fstatat(AT_FDCWD, file, buf, 0);
+}
+
+int OriginalLstat(const char *file, struct stat *buf) {
+  orig_lstat_type fn = originals.lstat.Get();
+  return fn != nullptr ? fn(file, buf)
+                       : fstatat(AT_FDCWD, file, buf, AT_SYMLINK_NOFOLLOW);
+}
+
 }  // namespace
 
 namespace pathauditor {
 
-// boolean var to avoid sanitizing function calls made while handling another
-// call;  otherwise results in infinite recursion
-ABSL_CONST_INIT thread_local bool sanitizing = false;
+ABSL_CONST_INIT DaemonClient daemon_client;
 
-void LibcFileEventIsUserControlled(const FileEvent &file_event,
-                                   const char *function_name) {
-  if (sanitizing) {
+ABSL_CONST_INIT TraceWriter trace_writer;
+
+ABSL_CONST_INIT StatsWriter stats_writer;
+
+ABSL_CONST_INIT ExecSearchPath exec_search_path;
+
+// How long exec and exit wait for the daemon to pick up the queued events.
+constexpr int kDaemonDrainTimeoutMs = 250;
+
+void FlushPendingEvents() {
+  // Delivering the reports opens files, e.g. to symbolize the stack traces.
+  ReentrancyGuard guard;
+  FlushInsecureAccessReports();
+  if (daemon_client.enabled()) {
+    daemon_client.WaitUntilDrained(kDaemonDrainTimeoutMs);
+  }
+  if (trace_writer.enabled()) {
+    trace_writer.Trim();
+  }
+}
+
+__attribute__((destructor)) void FlushDaemonEventsAtExit() {
+  if (daemon_client.enabled()) {
+    daemon_client.WaitUntilDrained(kDaemonDrainTimeoutMs);
+  }
+}
+
+__attribute__((destructor)) void CloseCaptureLog() {
+  if (trace_writer.enabled()) {
+    trace_writer.Close();
+  }
+}
+
+// Captures the event, sends it to the daemon or audits it right away.
+void AuditFileEvent(const FileEventView &file_event, HookSampler &sampler,
+                    const HookStats &stats) {
+  // In capture mode the event is only recorded, pathauditor-replay audits it
+  // later.
+  if (trace_writer.enabled()) {
+    trace_writer.Append(file_event);
+    stats.Count(&HookCounters::captured);
     return;
   }
-  sanitizing = true;
 
-  absl::StatusOr<bool> result =
-      FileEventIsUserControlled(SameProcessInformation(), file_event);
+  // In daemon mode the daemon audits the event, unless it can't keep up.
+  if (daemon_client.enabled() &&
+      daemon_client.Send(file_event, sampler.function_name())) {
+    stats.Count(&HookCounters::sent_to_daemon);
+    return;
+  }
+
+  uint64_t file_system_calls = 0;
+  uint64_t cache_hits = 0;
+  uint64_t cache_misses = 0;
+  if (stats.active()) {
+    const DirectoryVerdictCache &cache =
+        DirectoryVerdictCache::ForCurrentThread();
+    file_system_calls = ThreadFileSystemCallCount();
+    cache_hits = cache.hits();
+    cache_misses = cache.misses();
+  }
+
+  absl::StatusOr<PathAuditResult> result =
+      ExplainFileEventIsUserControlled(SameProcessInformation(), file_event);
   if (!result.ok()) {
     LogError(result.status());
-  } else if (*result) {
-    LogInsecureAccess(file_event, function_name);
+    stats.CountError(result.status().code());
+  } else if (result->user_controlled) {
+    LogInsecureAccess(file_event, sampler.function_name(), &*result);
+    stats.Count(&HookCounters::insecure);
+  }
+
+  if (stats.active()) {
+    const DirectoryVerdictCache &cache =
+        DirectoryVerdictCache::ForCurrentThread();
+    stats.Count(&HookCounters::audited_inline);
+    stats.Count(&HookCounters::file_system_calls,
+                ThreadFileSystemCallCount() - file_system_calls);
+    stats.Count(&HookCounters::verdict_cache_hits, cache.hits() - cache_hits);
+    stats.Count(&HookCounters::verdict_cache_misses,
+                cache.misses() - cache_misses);
+  }
+}
+
+// caller is the return address of the hook, it's used to always audit the
+// first call from every call site when sampling.
+void LibcFileEventIsUserControlled(const FileEventView &file_event,
+                                   HookSampler &sampler, const void *caller) {
+  if (sanitizing) {
+    return;
+  }
+  // Set before anything that may take a lock: absl::Mutex itself can open
+  // files on its slow path, and auditing those would re-enter it.
+  sanitizing = true;
+  auto stop_sanitizing = MakeCleanup([]() { sanitizing = false; });
+  HookStats stats;
+  if (stats_writer.enabled()) {
+    stats = stats_writer.ForHook(sampler.function_name(),
+                                 sampler.stats_index());
+    stats.Count(&HookCounters::calls);
+  }
+  // Calls that only name an entry of a directory, e.g. unlinkat(dirfd, name),
+  // can't be redirected. Skipping them here also keeps them out of the
+  // sampling budget and the daemon's ring.
+  if (ClassifyFileEvent(file_event) == FileEventClass::kSafe) {
+    stats.Count(&HookCounters::skipped);
+    return;
+  }
+  if (!sampler.ShouldAudit(AuditSampler::ForProcess(), caller,
+                           file_event.path_args)) {
+    return;
+  }
+
+  uint64_t start_ns = stats.Now();
+  AuditFileEvent(file_event, sampler, stats);
+  stats.Count(&HookCounters::audits);
+  stats.RecordLatency(start_ns);
+}
+
+// execvp and execlp search PATH for file names without a slash. All PATH
+// candidates up to the one that runs need to be safe.
+void LibcExecSearchIsUserControlled(const char *file, HookSampler &sampler,
+                                    const void *caller) {
+  if (std::strchr(file, '/') != nullptr) {
+    absl::string_view path_args[] = {file};
+    uint64_t args[] = {0, 0, 0};
+    LibcFileEventIsUserControlled(FileEventView(SYS_execve, args, path_args),
+                                  sampler, caller);
+    return;
+  }
+  if (sanitizing || *file == '\0') {
+    return;
+  }
+  sanitizing = true;
+  auto stop_sanitizing = MakeCleanup([]() { sanitizing = false; });
+  HookStats stats;
+  if (stats_writer.enabled()) {
+    stats = stats_writer.ForHook(sampler.function_name(),
+                                 sampler.stats_index());
+    stats.Count(&HookCounters::calls);
+  }
+  absl::string_view file_args[] = {file};
+  if (!sampler.ShouldAudit(AuditSampler::ForProcess(), caller, file_args)) {
+    return;
   }
 
+  uint64_t start_ns = stats.Now();
+  const char *path_env = std::getenv("PATH");
+  if (trace_writer.enabled() || daemon_client.enabled()) {
+    // Whoever audits the events doesn't know our PATH, so every candidate
+    // becomes an execve event of its own.
+    for (const std::string &candidate :
+         ExecSearchPath::Candidates(path_env, file)) {
+      absl::string_view path_args[] = {candidate};
+      uint64_t args[] = {0, 0, 0};
+      AuditFileEvent(FileEventView(SYS_execve, args, path_args), sampler,
+                     stats);
+    }
+  } else {
+    uint64_t file_system_calls = ThreadFileSystemCallCount();
+    absl::StatusOr<absl::optional<std::string>> insecure =
+        exec_search_path.FindUserControlled(path_env, file);
+    if (!insecure.ok()) {
+      LogError(insecure.status());
+      stats.CountError(insecure.status().code());
+    } else if (insecure->has_value()) {
+      absl::string_view path_args[] = {**insecure};
+      uint64_t args[] = {0, 0, 0};
+      LogInsecureAccess(FileEventView(SYS_execve, args, path_args),
+                        sampler.function_name());
+      stats.Count(&HookCounters::insecure);
+    }
+    stats.Count(&HookCounters::audited_inline);
+    stats.Count(&HookCounters::file_system_calls,
+                ThreadFileSystemCallCount() - file_system_calls);
+  }
+  stats.Count(&HookCounters::audits);
+  stats.RecordLatency(start_ns);
+}
+
+// Walks the PATH directories before fork, so that a child that calls execvp
+// doesn't have to. This only costs the first fork with every PATH value, and
+// nothing in processes that never called execvp or execlp themselves.
+void PrecomputeExecSearchPath() {
+  if (sanitizing || trace_writer.enabled() || daemon_client.enabled()) {
+    return;
+  }
+  sanitizing = true;
+  exec_search_path.Precompute(std::getenv("PATH"));
   sanitizing = false;
 }
 
+__attribute__((constructor)) void LoadExecSearchPath() {
+  pthread_atfork(PrecomputeExecSearchPath, nullptr, nullptr);
+}
+
+// Reads the safe prefixes from the PATHAUDITOR_SAFE_PREFIXES list and the
+// PATHAUDITOR_SAFE_PREFIXES_FILE file. Every prefix is ignored if an
+// unprivileged user could replace it or create entries directly inside of it.
+// Deeper levels of the tree are not checked.
+__attribute__((constructor)) void LoadSafePathPrefixes() {
+  const char *list = std::getenv("PATHAUDITOR_SAFE_PREFIXES");
+  const char *file = std::getenv("PATHAUDITOR_SAFE_PREFIXES_FILE");
+  if (!list && !file) {
+    return;
+  }
+
+  sanitizing = true;
+
+  std::string prefixes;
+  if (list) {
+    absl::StrAppend(&prefixes, list, "\n");
+  }
+  if (file) {
+    int fd = syscall(SYS_open, file, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+      LogError(absl::NotFoundError(
+          absl::StrCat("cannot open safe prefix file ", file)));
+    } else {
+      char buf[4096];
+      ssize_t bytes;
+      while ((bytes = read(fd, buf, sizeof(buf))) > 0) {
+        prefixes.append(buf, bytes);
+      }
+      close(fd);
+    }
+  }
+
+  // Leaked on purpose, it's used until the process exits.
+  SafePrefixTrie *trie = new SafePrefixTrie();
+  for (absl::string_view prefix : SafePrefixTrie::SplitPrefixList(prefixes)) {
+    // The entry doesn't need to exist, a missing one is user controlled
+    // unless nobody can create it.
+    absl::StatusOr<bool> user_controlled = PathIsUserControlled(
+        SameProcessInformation(), JoinPath(prefix, "pathauditor_probe"));
+    if (!user_controlled.ok()) {
+      LogError(user_controlled.status());
+      continue;
+    }
+    if (*user_controlled) {
+      LogError(absl::FailedPreconditionError(
+          absl::StrCat("ignoring user controlled safe prefix ", prefix)));
+      continue;
+    }
+    absl::Status status = trie->Insert(prefix);
+    if (!status.ok()) {
+      LogError(status);
+    }
+  }
+  SetSafePathPrefixes(trie);
+
+  sanitizing = false;
+}
+
+// Shares the directory verdicts with other processes through the cache file
+// in PATHAUDITOR_SHARED_VERDICT_CACHE, see SharedVerdictCache. The file is
+// ignored if an unprivileged user could replace it.
+__attribute__((constructor)) void LoadSharedVerdictCache() {
+  const char *path = std::getenv("PATHAUDITOR_SHARED_VERDICT_CACHE");
+  if (!path || !*path) {
+    return;
+  }
+
+  sanitizing = true;
+  auto stop_sanitizing = MakeCleanup([]() { sanitizing = false; });
+
+  absl::StatusOr<bool> user_controlled =
+      PathIsUserControlled(SameProcessInformation(), path);
+  if (!user_controlled.ok()) {
+    LogError(user_controlled.status());
+    return;
+  }
+  if (*user_controlled) {
+    LogError(absl::FailedPreconditionError(
+        absl::StrCat("ignoring user controlled shared verdict cache ", path)));
+    return;
+  }
+  absl::StatusOr<std::unique_ptr<SharedVerdictCache>> cache =
+      SharedVerdictCache::Open(path);
+  if (!cache.ok()) {
+    LogError(cache.status());
+    return;
+  }
+  // Leaked on purpose, it's used until the process exits.
+  SetSharedVerdictCache(cache->release());
+}
+
+// Hands events to pathauditor-daemon if PATHAUDITOR_DAEMON_DIR is set.
+__attribute__((constructor)) void LoadDaemonMode() {
+  const char *ring_dir = std::getenv("PATHAUDITOR_DAEMON_DIR");
+  if (ring_dir && *ring_dir) {
+    daemon_client.Enable(ring_dir);
+  }
+}
+
+// Keeps hook stats on a page in PATHAUDITOR_STATS_DIR, see stats_page.h.
+__attribute__((constructor)) void LoadStatsMode() {
+  const char *stats_dir = std::getenv("PATHAUDITOR_STATS_DIR");
+  if (stats_dir && *stats_dir) {
+    stats_writer.Enable(stats_dir);
+  }
+}
+
+// Writes the events to capture logs in PATHAUDITOR_CAPTURE_DIR instead of
+// auditing them. Takes precedence over daemon mode.
+__attribute__((constructor)) void LoadCaptureMode() {
+  const char *log_dir = std::getenv("PATHAUDITOR_CAPTURE_DIR");
+  if (log_dir && *log_dir) {
+    trace_writer.Enable(log_dir);
+  }
+}
+
+// Reads the sampling policy from PATHAUDITOR_SAMPLE_RATE (audit one in N
+// calls of every hook), PATHAUDITOR_SAMPLE_RATES (per hook, e.g.
+// "open=100,execve=1") and PATHAUDITOR_AUDITS_PER_SECOND.
+__attribute__((constructor)) void LoadSamplingPolicy() {
+  const char *default_period = std::getenv("PATHAUDITOR_SAMPLE_RATE");
+  const char *periods = std::getenv("PATHAUDITOR_SAMPLE_RATES");
+  const char *audits_per_second = std::getenv("PATHAUDITOR_AUDITS_PER_SECOND");
+  if (!default_period && !periods && !audits_per_second) {
+    return;
+  }
+  absl::StatusOr<SamplingPolicy> policy = SamplingPolicy::Parse(
+      default_period ? default_period : "", periods ? periods : "",
+      audits_per_second ? audits_per_second : "");
+  if (!policy.ok()) {
+    LogError(policy.status());
+    return;
+  }
+  if (policy->AuditsEverything()) {
+    return;
+  }
+  // Leaked on purpose, it's used until the process exits.
+  AuditSampler::ForProcess().SetPolicy(new SamplingPolicy(*std::move(policy)));
+}
+
 }  // namespace pathauditor
 
+namespace {
+
+// The stat family in all its variants is audited the same way.
+void AuditStat(const char *file, bool follow, pathauditor::HookSampler &sampler,
+               const void *caller) {
+  absl::string_view path_args[] = {file};
+  uint64_t args[] = {0, 0};
+  pathauditor::FileEventView file_event(follow ? SYS_stat : SYS_lstat, args,
+                                        path_args);
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler, caller);
+}
+
+}  // namespace
+
 extern "C" {
 int open(const char *file, int oflag, ...) {
   mode_t mode = 0;
@@ -134,15 +608,15 @@ int open(const char *file, int oflag, ...) {
     return syscall(SYS_open, file, oflag, mode);
   }
 
-  std::vector<std::string> path_args = {file};
-  std::vector<uint64_t> args = {0, static_cast<uint64_t>(oflag), mode};
-  pathauditor::FileEvent file_event(SYS_open, args, path_args);
+  absl::string_view path_args[] = {file};
+  uint64_t args[] = {0, static_cast<uint64_t>(oflag), mode};
+  pathauditor::FileEventView file_event(SYS_open, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "open");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("open");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_open_type orig_open;
-  orig_open = reinterpret_cast<orig_open_type>(dlsym(RTLD_NEXT, "open"));
-  return orig_open(file, oflag, mode);
+  return originals.open.Get()(file, oflag, mode);
 }
 
 int open64(const char *file, int oflag, ...) {
@@ -154,14 +628,14 @@ int open64(const char *file, int oflag, ...) {
     va_end(args);
   }
 
-  std::vector<std::string> path_args = {file};
-  std::vector<uint64_t> args = {0, static_cast<uint64_t>(oflag), mode};
-  pathauditor::FileEvent file_event(SYS_open, args, path_args);
+  absl::string_view path_args[] = {file};
+  uint64_t args[] = {0, static_cast<uint64_t>(oflag), mode};
+  pathauditor::FileEventView file_event(SYS_open, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "open64");
-  orig_open64_type orig_open64;
-  orig_open64 = reinterpret_cast<orig_open64_type>(dlsym(RTLD_NEXT, "open64"));
-  return orig_open64(file, oflag, mode);
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("open64");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
+  return originals.open64.Get()(file, oflag, mode);
 }
 
 int openat(int dirfd, const char *file, int oflag, ...) {
@@ -173,15 +647,15 @@ int openat(int dirfd, const char *file, int oflag, ...) {
     va_end(args);
   }
 
-  std::vector<std::string> path_args = {file};
-  std::vector<uint64_t> args = {static_cast<uint64_t>(dirfd), 0,
-                              static_cast<uint64_t>(oflag), mode};
-  pathauditor::FileEvent file_event(SYS_openat, args, path_args);
+  absl::string_view path_args[] = {file};
+  uint64_t args[] = {static_cast<uint64_t>(dirfd), 0,
+                     static_cast<uint64_t>(oflag), mode};
+  pathauditor::FileEventView file_event(SYS_openat, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "openat");
-  orig_openat_type orig_openat;
-  orig_openat = reinterpret_cast<orig_openat_type>(dlsym(RTLD_NEXT, "openat"));
-  return orig_openat(dirfd, file, oflag, mode);
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("openat");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
+  return originals.openat.Get()(dirfd, file, oflag, mode);
 }
 
 int openat64(int dirfd, const char *file, int oflag, ...) {
@@ -193,119 +667,115 @@ int openat64(int dirfd, const char *file, int oflag, ...) {
     va_end(args);
   }
 
-  std::vector<std::string> path_args = {file};
-  std::vector<uint64_t> args = {static_cast<uint64_t>(dirfd), 0,
-                              static_cast<uint64_t>(oflag), mode};
-  pathauditor::FileEvent file_event(SYS_openat, args, path_args);
+  absl::string_view path_args[] = {file};
+  uint64_t args[] = {static_cast<uint64_t>(dirfd), 0,
+                     static_cast<uint64_t>(oflag), mode};
+  pathauditor::FileEventView file_event(SYS_openat, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "openat64");
-  orig_openat64_type orig_openat64;
-  orig_openat64 =
-      reinterpret_cast<orig_openat64_type>(dlsym(RTLD_NEXT, "openat64"));
-  return orig_openat64(dirfd, file, oflag, mode);
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("openat64");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
+  return originals.openat64.Get()(dirfd, file, oflag, mode);
 }
 
 int creat(const char *file, mode_t mode) {
-  std::vector<std::string> path_args = {file};
+  absl::string_view path_args[] = {file};
   uint64_t flags = O_CREAT | O_WRONLY | O_TRUNC;
-  std::vector<uint64_t> args = {0, flags, mode};
-  pathauditor::FileEvent file_event(SYS_open, args, path_args);
+  uint64_t args[] = {0, flags, mode};
+  pathauditor::FileEventView file_event(SYS_open, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "creat");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("creat");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_creat_type orig_creat;
-  orig_creat = reinterpret_cast<orig_creat_type>(dlsym(RTLD_NEXT, "creat"));
-  return orig_creat(file, mode);
+  return originals.creat.Get()(file, mode);
 }
 
 int creat64(const char *file, mode_t mode) {
-  std::vector<std::string> path_args = {file};
+  absl::string_view path_args[] = {file};
   uint64_t flags = O_CREAT | O_WRONLY | O_TRUNC;
-  std::vector<uint64_t> args = {0, flags, mode};
-  pathauditor::FileEvent file_event(SYS_open, args, path_args);
+  uint64_t args[] = {0, flags, mode};
+  pathauditor::FileEventView file_event(SYS_open, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "creat64");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("creat64");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_creat64_type orig_creat64;
-  orig_creat64 =
-      reinterpret_cast<orig_creat64_type>(dlsym(RTLD_NEXT, "creat64"));
-  return orig_creat64(file, mode);
+  return originals.creat64.Get()(file, mode);
 }
 
 int chdir(const char *path) {
-  std::vector<std::string> path_args = {path};
-  std::vector<uint64_t> args = {0};
-  pathauditor::FileEvent file_event(SYS_chdir, args, path_args);
+  absl::string_view path_args[] = {path};
+  uint64_t args[] = {0};
+  pathauditor::FileEventView file_event(SYS_chdir, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "chdir");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("chdir");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_chdir_type orig_chdir;
-  orig_chdir = reinterpret_cast<orig_chdir_type>(dlsym(RTLD_NEXT, "chdir"));
-  return orig_chdir(path);
+  return originals.chdir.Get()(path);
 }
 
 int chmod(const char *file, mode_t mode) {
-  std::vector<std::string> path_args = {file};
-  std::vector<uint64_t> args = {0, mode};
-  pathauditor::FileEvent file_event(SYS_chmod, args, path_args);
+  absl::string_view path_args[] = {file};
+  uint64_t args[] = {0, mode};
+  pathauditor::FileEventView file_event(SYS_chmod, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "chmod");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("chmod");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_chmod_type orig_chmod;
-  orig_chmod = reinterpret_cast<orig_chmod_type>(dlsym(RTLD_NEXT, "chmod"));
-  return orig_chmod(file, mode);
+  return originals.chmod.Get()(file, mode);
 }
 
 int fchmodat(int fd, const char *file, mode_t mode, int flag) {
-  std::vector<std::string> path_args = {file};
-  std::vector<uint64_t> args = {static_cast<uint64_t>(fd), 0, mode,
-                              static_cast<uint64_t>(flag)};
-  pathauditor::FileEvent file_event(SYS_fchmodat, args, path_args);
+  absl::string_view path_args[] = {file};
+  uint64_t args[] = {static_cast<uint64_t>(fd), 0, mode,
+                     static_cast<uint64_t>(flag)};
+  pathauditor::FileEventView file_event(SYS_fchmodat, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "fchmodat");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("fchmodat");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_fchmodat_type orig_fchmodat;
-  orig_fchmodat =
-      reinterpret_cast<orig_fchmodat_type>(dlsym(RTLD_NEXT, "fchmodat"));
-  return orig_fchmodat(fd, file, mode, flag);
+  return originals.fchmodat.Get()(fd, file, mode, flag);
 }
 
 int chown(const char *file, uid_t owner, gid_t group) {
-  std::vector<std::string> path_args = {file};
-  std::vector<uint64_t> args = {0, owner, group};
-  pathauditor::FileEvent file_event{SYS_chown, args, path_args};
+  absl::string_view path_args[] = {file};
+  uint64_t args[] = {0, owner, group};
+  pathauditor::FileEventView file_event(SYS_chown, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "chown");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("chown");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_chown_type orig_chown;
-  orig_chown = reinterpret_cast<orig_chown_type>(dlsym(RTLD_NEXT, "chown"));
-  return orig_chown(file, owner, group);
+  return originals.chown.Get()(file, owner, group);
 }
 
 int lchown(const char *file, uid_t owner, gid_t group) {
-  std::vector<std::string> path_args = {file};
-  std::vector<uint64_t> args = {0, owner, group};
-  pathauditor::FileEvent file_event{SYS_lchown, args, path_args};
+  absl::string_view path_args[] = {file};
+  uint64_t args[] = {0, owner, group};
+  pathauditor::FileEventView file_event(SYS_lchown, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "lchown");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("lchown");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_lchown_type orig_lchown;
-  orig_lchown = reinterpret_cast<orig_lchown_type>(dlsym(RTLD_NEXT, "lchown"));
-  return orig_lchown(file, owner, group);
+  return originals.lchown.Get()(file, owner, group);
 }
 
 int fchownat(int fd, const char *file, uid_t owner, gid_t group, int flag) {
-  std::vector<std::string> path_args = {file};
-  std::vector<uint64_t> args = {static_cast<uint64_t>(fd), 0, owner, group,
-                              static_cast<uint64_t>(flag)};
-  pathauditor::FileEvent file_event{SYS_fchownat, args, path_args};
+  absl::string_view path_args[] = {file};
+  uint64_t args[] = {static_cast<uint64_t>(fd), 0, owner, group,
+                     static_cast<uint64_t>(flag)};
+  pathauditor::FileEventView file_event(SYS_fchownat, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "fchownat");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("fchownat");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_fchownat_type orig_fchownat;
-  orig_fchownat =
-      reinterpret_cast<orig_fchownat_type>(dlsym(RTLD_NEXT, "fchownat"));
-  return orig_fchownat(fd, file, owner, group, flag);
+  return originals.fchownat.Get()(fd, file, owner, group, flag);
 }
 
 int execl(const char *path, const char *arg, ...) {
@@ -321,362 +791,544 @@ int execl(const char *path, const char *arg, ...) {
   } while (va_arg != nullptr);
   va_end(va_args);
 
-  std::vector<std::string> path_args = {path};
-  std::vector<uint64_t> args = {0, reinterpret_cast<uint64_t>(&argv[0]), 0};
-  pathauditor::FileEvent file_event{SYS_execve, args, path_args};
-  pathauditor::LibcFileEventIsUserControlled(file_event, "execl");
+  absl::string_view path_args[] = {path};
+  uint64_t args[] = {0, reinterpret_cast<uint64_t>(&argv[0]), 0};
+  pathauditor::FileEventView file_event(SYS_execve, args, path_args);
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("execl");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
+  pathauditor::FlushPendingEvents();
   // cannot call execl with variable args; call execve instead
-  orig_execve_type orig_execve;
-  orig_execve = reinterpret_cast<orig_execve_type>(dlsym(RTLD_NEXT, "execve"));
-  return orig_execve(path, &argv[0], nullptr);
+  return originals.execve.Get()(path, &argv[0], nullptr);
 }
 
 int execv(const char *path, char *const argv[]) {
-  std::vector<std::string> path_args = {path};
-  std::vector<uint64_t> args = {0, reinterpret_cast<uint64_t>(argv), 0};
-  pathauditor::FileEvent file_event{SYS_execve, args, path_args};
+  absl::string_view path_args[] = {path};
+  uint64_t args[] = {0, reinterpret_cast<uint64_t>(argv), 0};
+  pathauditor::FileEventView file_event(SYS_execve, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "execv");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("execv");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_execv_type orig_execv;
-  orig_execv = reinterpret_cast<orig_execv_type>(dlsym(RTLD_NEXT, "execv"));
-  return orig_execv(path, argv);
+  pathauditor::FlushPendingEvents();
+  return originals.execv.Get()(path, argv);
 }
 
 int execve(const char *path, char *const argv[], char *const envp[]) {
-  std::vector<std::string> path_args = {path};
-  std::vector<uint64_t> args = {0, reinterpret_cast<uint64_t>(argv),
-                              reinterpret_cast<uint64_t>(envp)};
-  pathauditor::FileEvent file_event{SYS_execve, args, path_args};
+  absl::string_view path_args[] = {path};
+  uint64_t args[] = {0, reinterpret_cast<uint64_t>(argv),
+                     reinterpret_cast<uint64_t>(envp)};
+  pathauditor::FileEventView file_event(SYS_execve, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "execve");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("execve");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_execve_type orig_execve;
-  orig_execve = reinterpret_cast<orig_execve_type>(dlsym(RTLD_NEXT, "execve"));
-  return orig_execve(path, argv, envp);
+  pathauditor::FlushPendingEvents();
+  return originals.execve.Get()(path, argv, envp);
 }
 
 int execle(const char *path, const char *arg, ...) {
   // same as execl but last argument is envp
-  orig_execle_type orig_execle;
-  orig_execle = reinterpret_cast<orig_execle_type>(dlsym(RTLD_NEXT, "execle"));
-  return orig_execle(path, arg);
+  pathauditor::FlushPendingEvents();
+  return originals.execle.Get()(path, arg);
 }
 
 int execvp(const char *file, char *const argv[]) {
-  // complicated handling of PATH env var
-  orig_execvp_type orig_execvp;
-  orig_execvp = reinterpret_cast<orig_execvp_type>(dlsym(RTLD_NEXT, "execvp"));
-  return orig_execvp(file, argv);
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("execvp");
+  pathauditor::LibcExecSearchIsUserControlled(file, sampler,
+                                              __builtin_return_address(0));
+
+  pathauditor::FlushPendingEvents();
+  return originals.execvp.Get()(file, argv);
 }
 
 int execlp(const char *file, const char *arg, ...) {
-  // complicated handling of PATH env var
-  orig_execlp_type orig_execlp;
-  orig_execlp = reinterpret_cast<orig_execlp_type>(dlsym(RTLD_NEXT, "execlp"));
-  return orig_execlp(file, arg);
+  std::vector<char *> argv;
+  argv.push_back(const_cast<char *>(arg));
+
+  va_list va_args;
+  va_start(va_args, arg);
+  char *va_arg;
+  do {
+    va_arg = va_arg(va_args, char *);
+    argv.push_back(va_arg);
+  } while (va_arg != nullptr);
+  va_end(va_args);
+
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("execlp");
+  pathauditor::LibcExecSearchIsUserControlled(file, sampler,
+                                              __builtin_return_address(0));
+
+  pathauditor::FlushPendingEvents();
+  // cannot call execlp with variable args; call execvp instead
+  return originals.execvp.Get()(file, &argv[0]);
 }
 
 FILE *fopen(const char *filename, const char *modes) {
-  std::vector<std::string> path_args = {filename};
+  absl::string_view path_args[] = {filename};
   // the mode doesn't matter for pathauditor
-  std::vector<uint64_t> args = {0, O_RDONLY};
-  pathauditor::FileEvent file_event(SYS_open, args, path_args);
+  uint64_t args[] = {0, O_RDONLY};
+  pathauditor::FileEventView file_event(SYS_open, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "fopen");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("fopen");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_fopen_type orig_fopen;
-  orig_fopen = reinterpret_cast<orig_fopen_type>(dlsym(RTLD_NEXT, "fopen"));
-  return orig_fopen(filename, modes);
+  return originals.fopen.Get()(filename, modes);
 }
 
 FILE *fopen64(const char *filename, const char *modes) {
-  std::vector<std::string> path_args = {filename};
-  std::vector<uint64_t> args = {
+  absl::string_view path_args[] = {filename};
+  uint64_t args[] = {
       0, O_RDONLY};  // the mode doesn't matter for pathauditor
-  pathauditor::FileEvent file_event(SYS_open, args, path_args);
+  pathauditor::FileEventView file_event(SYS_open, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "fopen64");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("fopen64");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_fopen64_type orig_fopen64;
-  orig_fopen64 =
-      reinterpret_cast<orig_fopen64_type>(dlsym(RTLD_NEXT, "fopen64"));
-  return orig_fopen64(filename, modes);
+  return originals.fopen64.Get()(filename, modes);
 }
 
 FILE *freopen(const char *filename, const char *modes, FILE *stream) {
-  std::vector<std::string> path_args = {filename};
-  std::vector<uint64_t> args = {
+  absl::string_view path_args[] = {filename};
+  uint64_t args[] = {
       0, O_RDONLY};  // the mode doesn't matter for pathauditor
-  pathauditor::FileEvent file_event(SYS_open, args, path_args);
+  pathauditor::FileEventView file_event(SYS_open, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "freopen");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("freopen");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_freopen_type orig_freopen;
-  orig_freopen =
-      reinterpret_cast<orig_freopen_type>(dlsym(RTLD_NEXT, "freopen"));
-  return orig_freopen(filename, modes, stream);
+  return originals.freopen.Get()(filename, modes, stream);
 }
 
 FILE *freopen64(const char *filename, const char *modes, FILE *stream) {
-  std::vector<std::string> path_args = {filename};
-  std::vector<uint64_t> args = {
+  absl::string_view path_args[] = {filename};
+  uint64_t args[] = {
       0, O_RDONLY};  // the mode doesn't matter for pathauditor
-  pathauditor::FileEvent file_event(SYS_open, args, path_args);
+  pathauditor::FileEventView file_event(SYS_open, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "fopen64");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("freopen64");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_freopen64_type orig_freopen64;
-  orig_freopen64 =
-      reinterpret_cast<orig_freopen64_type>(dlsym(RTLD_NEXT, "freopen64"));
-  return orig_freopen64(filename, modes, stream);
+  return originals.freopen64.Get()(filename, modes, stream);
 }
 
 int truncate(const char *file, off_t length) {
-  std::vector<std::string> path_args = {file};
-  std::vector<uint64_t> args = {0, static_cast<uint64_t>(length)};
-  pathauditor::FileEvent file_event(SYS_truncate, args, path_args);
+  absl::string_view path_args[] = {file};
+  uint64_t args[] = {0, static_cast<uint64_t>(length)};
+  pathauditor::FileEventView file_event(SYS_truncate, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "truncate");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("truncate");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_truncate_type orig_truncate;
-  orig_truncate =
-      reinterpret_cast<orig_truncate_type>(dlsym(RTLD_NEXT, "truncate"));
-  return orig_truncate(file, length);
+  return originals.truncate.Get()(file, length);
 }
 
 int truncate64(const char *file, off64_t length) {
-  std::vector<std::string> path_args = {file};
-  std::vector<uint64_t> args = {0, static_cast<uint64_t>(length)};
-  pathauditor::FileEvent file_event(SYS_truncate, args, path_args);
-
-  pathauditor::LibcFileEventIsUserControlled(file_event, "truncate64");
-  orig_truncate64_type orig_truncate64;
-  orig_truncate64 =
-      reinterpret_cast<orig_truncate64_type>(dlsym(RTLD_NEXT, "truncate64"));
-  return orig_truncate64(file, length);
+  absl::string_view path_args[] = {file};
+  uint64_t args[] = {0, static_cast<uint64_t>(length)};
+  pathauditor::FileEventView file_event(SYS_truncate, args, path_args);
+
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("truncate64");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
+  return originals.truncate64.Get()(file, length);
 }
 
 int mkdir(const char *path, mode_t mode) {
-  std::vector<std::string> path_args = {path};
-  std::vector<uint64_t> args = {0, mode};
-  pathauditor::FileEvent file_event{SYS_mkdir, args, path_args};
+  absl::string_view path_args[] = {path};
+  uint64_t args[] = {0, mode};
+  pathauditor::FileEventView file_event(SYS_mkdir, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "mkdir");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("mkdir");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_mkdir_type orig_mkdir;
-  orig_mkdir = reinterpret_cast<orig_mkdir_type>(dlsym(RTLD_NEXT, "mkdir"));
-  return orig_mkdir(path, mode);
+  return originals.mkdir.Get()(path, mode);
 }
 
 int mkdirat(int fd, const char *path, mode_t mode) {
-  std::vector<std::string> path_args = {path};
-  std::vector<uint64_t> args = {static_cast<uint64_t>(fd), 0, mode};
-  pathauditor::FileEvent file_event{SYS_mkdirat, args, path_args};
+  absl::string_view path_args[] = {path};
+  uint64_t args[] = {static_cast<uint64_t>(fd), 0, mode};
+  pathauditor::FileEventView file_event(SYS_mkdirat, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "mkdirat");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("mkdirat");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_mkdirat_type orig_mkdirat;
-  orig_mkdirat =
-      reinterpret_cast<orig_mkdirat_type>(dlsym(RTLD_NEXT, "mkdirat"));
-  return orig_mkdirat(fd, path, mode);
+  return originals.mkdirat.Get()(fd, path, mode);
 }
 
 int link(const char *from, const char *to) {
-  std::vector<std::string> path_args = {from, to};
-  std::vector<uint64_t> args = {};
-  pathauditor::FileEvent file_event{SYS_link, args, path_args};
+  absl::string_view path_args[] = {from, to};
+  pathauditor::FileEventView file_event(SYS_link, {}, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "link");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("link");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_link_type orig_link;
-  orig_link = reinterpret_cast<orig_link_type>(dlsym(RTLD_NEXT, "link"));
-  return orig_link(from, to);
+  return originals.link.Get()(from, to);
 }
 
 int linkat(int fromfd, const char *from, int tofd, const char *to, int flags) {
-  std::vector<std::string> path_args = {from, to};
-  std::vector<uint64_t> args = {static_cast<uint64_t>(fromfd), 0,
-                              static_cast<uint64_t>(tofd), 0,
-                              static_cast<uint64_t>(flags)};
-  pathauditor::FileEvent file_event{SYS_linkat, args, path_args};
+  absl::string_view path_args[] = {from, to};
+  uint64_t args[] = {static_cast<uint64_t>(fromfd), 0,
+                     static_cast<uint64_t>(tofd), 0,
+                     static_cast<uint64_t>(flags)};
+  pathauditor::FileEventView file_event(SYS_linkat, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "linkat");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("linkat");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_linkat_type orig_linkat;
-  orig_linkat = reinterpret_cast<orig_linkat_type>(dlsym(RTLD_NEXT, "linkat"));
-  return orig_linkat(fromfd, from, tofd, to, flags);
+  return originals.linkat.Get()(fromfd, from, tofd, to, flags);
 }
 
 int unlink(const char *name) {
-  std::vector<std::string> path_args = {name};
-  std::vector<uint64_t> args = {0};
-  pathauditor::FileEvent file_event{SYS_unlink, args, path_args};
+  absl::string_view path_args[] = {name};
+  uint64_t args[] = {0};
+  pathauditor::FileEventView file_event(SYS_unlink, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "unlink");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("unlink");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_unlink_type orig_unlink;
-  orig_unlink = reinterpret_cast<orig_unlink_type>(dlsym(RTLD_NEXT, "unlink"));
-  return orig_unlink(name);
+  return originals.unlink.Get()(name);
 }
 
 int unlinkat(int dirfd, const char *name, int flags) {
-  std::vector<std::string> path_args = {name};
-  std::vector<uint64_t> args = {static_cast<uint64_t>(dirfd), 0,
-                              static_cast<uint64_t>(flags)};
-  pathauditor::FileEvent file_event{SYS_unlinkat, args, path_args};
+  absl::string_view path_args[] = {name};
+  uint64_t args[] = {static_cast<uint64_t>(dirfd), 0,
+                     static_cast<uint64_t>(flags)};
+  pathauditor::FileEventView file_event(SYS_unlinkat, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "unlinkat");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("unlinkat");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_unlinkat_type orig_unlinkat;
-  orig_unlinkat =
-      reinterpret_cast<orig_unlinkat_type>(dlsym(RTLD_NEXT, "unlinkat"));
-  return orig_unlinkat(dirfd, name, flags);
+  return originals.unlinkat.Get()(dirfd, name, flags);
 }
 
 int remove(const char *filename) {
-  std::vector<std::string> path_args = {filename};
+  absl::string_view path_args[] = {filename};
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("remove");
 
   struct stat stat_buf;
   // different behaviour if directory/regular file
-  if (stat(filename, &stat_buf)) {
-    std::cerr << "cannot stat " << filename << "\n";
+  if (OriginalStat(filename, &stat_buf)) {
+    fprintf(stderr, "cannot stat %s\n", filename);
   } else {
     if (S_ISDIR(stat_buf.st_mode)) {
-      std::vector<uint64_t> args = {static_cast<uint64_t>(AT_FDCWD), 0,
-                                  AT_REMOVEDIR};
-      pathauditor::FileEvent file_event{SYS_unlinkat, args, path_args};
-      pathauditor::LibcFileEventIsUserControlled(file_event, "remove");
+      uint64_t args[] = {static_cast<uint64_t>(AT_FDCWD), 0,
+                         AT_REMOVEDIR};
+      pathauditor::FileEventView file_event(SYS_unlinkat, args, path_args);
+      pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                                 __builtin_return_address(0));
     } else {
-      std::vector<uint64_t> args = {0};
-      pathauditor::FileEvent file_event{SYS_unlink, args, path_args};
-      pathauditor::LibcFileEventIsUserControlled(file_event, "remove");
+      uint64_t args[] = {0};
+      pathauditor::FileEventView file_event(SYS_unlink, args, path_args);
+      pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                                 __builtin_return_address(0));
     }
   }
 
-  orig_remove_type orig_remove;
-  orig_remove = reinterpret_cast<orig_remove_type>(dlsym(RTLD_NEXT, "remove"));
-  return orig_remove(filename);
+  return originals.remove.Get()(filename);
 }
 
 int rmdir(const char *path) {
-  std::vector<std::string> path_args = {path};
-  std::vector<uint64_t> args = {static_cast<uint64_t>(AT_FDCWD), 0, AT_REMOVEDIR};
-  pathauditor::FileEvent file_event{SYS_unlinkat, args, path_args};
+  absl::string_view path_args[] = {path};
+  uint64_t args[] = {static_cast<uint64_t>(AT_FDCWD), 0, AT_REMOVEDIR};
+  pathauditor::FileEventView file_event(SYS_unlinkat, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "rmdir");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("rmdir");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_rmdir_type orig_rmdir;
-  orig_rmdir = reinterpret_cast<orig_rmdir_type>(dlsym(RTLD_NEXT, "rmdir"));
-  return orig_rmdir(path);
+  return originals.rmdir.Get()(path);
 }
 
 int mount(const char *special_file, const char *dir, const char *fstype,
-          unsigned rwflag, void *data) {
+          unsigned long rwflag, const void *data) {
   if (special_file == nullptr) {
     special_file = "";
   }
-  std::vector<std::string> path_args = {special_file, dir};
-  std::vector<uint64_t> args = {0, 0, reinterpret_cast<uint64_t>(fstype),
-                              static_cast<uint64_t>(rwflag),
-                              reinterpret_cast<uint64_t>(data)};
-  pathauditor::FileEvent file_event{SYS_mount, args, path_args};
+  absl::string_view path_args[] = {special_file, dir};
+  uint64_t args[] = {0, 0, reinterpret_cast<uint64_t>(fstype),
+                     static_cast<uint64_t>(rwflag),
+                     reinterpret_cast<uint64_t>(data)};
+  pathauditor::FileEventView file_event(SYS_mount, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "mount");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("mount");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_mount_type orig_mount;
-  orig_mount = reinterpret_cast<orig_mount_type>(dlsym(RTLD_NEXT, "mount"));
-  return orig_mount(special_file, dir, fstype, rwflag, data);
+  return originals.mount.Get()(special_file, dir, fstype, rwflag, data);
 }
 
 int umount(const char *special_file) {
-  std::vector<std::string> path_args = {special_file};
-  std::vector<uint64_t> args = {0, 0};
-  pathauditor::FileEvent file_event{SYS_umount2, args, path_args};
+  absl::string_view path_args[] = {special_file};
+  uint64_t args[] = {0, 0};
+  pathauditor::FileEventView file_event(SYS_umount2, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "umount");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("umount");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_umount_type orig_umount;
-  orig_umount = reinterpret_cast<orig_umount_type>(dlsym(RTLD_NEXT, "umount"));
-  return orig_umount(special_file);
+  return originals.umount.Get()(special_file);
 }
 
 int umount2(const char *special_file, int flags) {
-  std::vector<std::string> path_args = {special_file};
-  std::vector<uint64_t> args = {0, static_cast<uint64_t>(flags)};
-  pathauditor::FileEvent file_event{SYS_umount2, args, path_args};
+  absl::string_view path_args[] = {special_file};
+  uint64_t args[] = {0, static_cast<uint64_t>(flags)};
+  pathauditor::FileEventView file_event(SYS_umount2, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "umount2");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("umount2");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_umount2_type orig_umount2;
-  orig_umount2 =
-      reinterpret_cast<orig_umount2_type>(dlsym(RTLD_NEXT, "umount2"));
-  return orig_umount2(special_file, flags);
+  return originals.umount2.Get()(special_file, flags);
 }
 
 int rename(const char *oldpath, const char *newpath) {
-  std::vector<std::string> path_args = {oldpath, newpath};
-  std::vector<uint64_t> args = {};
-  pathauditor::FileEvent file_event{SYS_rename, args, path_args};
+  absl::string_view path_args[] = {oldpath, newpath};
+  pathauditor::FileEventView file_event(SYS_rename, {}, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "rename");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("rename");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_rename_type orig_rename;
-  orig_rename = reinterpret_cast<orig_rename_type>(dlsym(RTLD_NEXT, "rename"));
-  return orig_rename(oldpath, newpath);
+  return originals.rename.Get()(oldpath, newpath);
 }
 
 int renameat(int olddirfd, const char *oldpath, int newdirfd,
              const char *newpath) {
-  std::vector<std::string> path_args = {oldpath, newpath};
-  std::vector<uint64_t> args = {static_cast<uint64_t>(olddirfd), 0,
-                              static_cast<uint64_t>(newdirfd), 0};
-  pathauditor::FileEvent file_event{SYS_renameat, args, path_args};
+  absl::string_view path_args[] = {oldpath, newpath};
+  uint64_t args[] = {static_cast<uint64_t>(olddirfd), 0,
+                     static_cast<uint64_t>(newdirfd), 0};
+  pathauditor::FileEventView file_event(SYS_renameat, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "renameat");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("renameat");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_renameat_type orig_renameat;
-  orig_renameat =
-      reinterpret_cast<orig_renameat_type>(dlsym(RTLD_NEXT, "renameat"));
-  return orig_renameat(olddirfd, oldpath, newdirfd, newpath);
+  return originals.renameat.Get()(olddirfd, oldpath, newdirfd, newpath);
 }
 
 int symlink(const char *from, const char *to) {
-  std::vector<std::string> path_args = {from, to};
-  std::vector<uint64_t> args = {};
-  pathauditor::FileEvent file_event{SYS_symlink, args, path_args};
+  absl::string_view path_args[] = {from, to};
+  pathauditor::FileEventView file_event(SYS_symlink, {}, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "symlink");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("symlink");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_symlink_type orig_symlink;
-  orig_symlink =
-      reinterpret_cast<orig_symlink_type>(dlsym(RTLD_NEXT, "symlink"));
-  return orig_symlink(from, to);
+  return originals.symlink.Get()(from, to);
 }
 
 int symlinkat(const char *from, int newdirfd, const char *to) {
-  std::vector<std::string> path_args = {from, to};
-  std::vector<uint64_t> args = {0, static_cast<uint64_t>(newdirfd), 0};
-  pathauditor::FileEvent file_event{SYS_symlinkat, args, path_args};
+  absl::string_view path_args[] = {from, to};
+  uint64_t args[] = {0, static_cast<uint64_t>(newdirfd), 0};
+  pathauditor::FileEventView file_event(SYS_symlinkat, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "symlinkat");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("symlinkat");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_symlinkat_type orig_symlinkat;
-  orig_symlinkat =
-      reinterpret_cast<orig_symlinkat_type>(dlsym(RTLD_NEXT, "symlinkat"));
-  return orig_symlinkat(from, newdirfd, to);
+  return originals.symlinkat.Get()(from, newdirfd, to);
 }
 
 int chroot(const char *path) {
-  std::vector<std::string> path_args = {path};
-  std::vector<uint64_t> args = {0};
-  pathauditor::FileEvent file_event{SYS_chroot, args, path_args};
+  absl::string_view path_args[] = {path};
+  uint64_t args[] = {0};
+  pathauditor::FileEventView file_event(SYS_chroot, args, path_args);
+
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("chroot");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
+
+  return originals.chroot.Get()(path);
+}
+
+int renameat2(int olddirfd, const char *oldpath, int newdirfd,
+              const char *newpath, unsigned int flags) {
+  absl::string_view path_args[] = {oldpath, newpath};
+  uint64_t args[] = {static_cast<uint64_t>(olddirfd), 0,
+                     static_cast<uint64_t>(newdirfd), 0, flags};
+  pathauditor::FileEventView file_event(SYS_renameat2, args, path_args);
+
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("renameat2");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
+
+  return originals.renameat2.Get()(olddirfd, oldpath, newdirfd, newpath,
+                                   flags);
+}
+
+int stat(const char *file, struct stat *buf) {
+  if (!mallocInitialized.load(std::memory_order_acquire)) {
+    return fstatat(AT_FDCWD, file, buf, 0);
+  }
+
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("stat");
+  AuditStat(file, true, sampler, __builtin_return_address(0));
+
+  return OriginalStat(file, buf);
+}
+
+int lstat(const char *file, struct stat *buf) {
+  if (!mallocInitialized.load(std::memory_order_acquire)) {
+    return fstatat(AT_FDCWD, file, buf, AT_SYMLINK_NOFOLLOW);
+  }
+
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("lstat");
+  AuditStat(file, false, sampler, __builtin_return_address(0));
+
+  return OriginalLstat(file, buf);
+}
+
+int stat64(const char *file, struct stat64 *buf) {
+  if (!mallocInitialized.load(std::memory_order_acquire)) {
+    return fstatat64(AT_FDCWD, file, buf, 0);
+  }
+
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("stat64");
+  AuditStat(file, true, sampler, __builtin_return_address(0));
+
+  orig_stat64_type fn = originals.stat64.Get();
+  return fn != nullptr ? fn(file, buf) : fstatat64(AT_FDCWD, file, buf, 0);
+}
+
+int lstat64(const char *file, struct stat64 *buf) {
+  if (!mallocInitialized.load(std::memory_order_acquire)) {
+    return fstatat64(AT_FDCWD, file, buf, AT_SYMLINK_NOFOLLOW);
+  }
+
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("lstat64");
+  AuditStat(file, false, sampler, __builtin_return_address(0));
+
+  orig_lstat64_type fn = originals.lstat64.Get();
+  return fn != nullptr ? fn(file, buf)
+                       : fstatat64(AT_FDCWD, file, buf, AT_SYMLINK_NOFOLLOW);
+}
+
+// Binaries built against glibc before 2.33 call these instead of stat and
+// lstat. Newer versions still export them for those binaries.
+int __xstat(int ver, const char *file, struct stat *buf) {
+  if (!mallocInitialized.load(std::memory_order_acquire)) {
+    return fstatat(AT_FDCWD, file, buf, 0);
+  }
+
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("__xstat");
+  AuditStat(file, true, sampler, __builtin_return_address(0));
+
+  orig_xstat_type fn = originals.xstat.Get();
+  return fn != nullptr ? fn(ver, file, buf) : fstatat(AT_FDCWD, file, buf, 0);
+}
+
+int __lxstat(int ver, const char *file, struct stat *buf) {
+  if (!mallocInitialized.load(std::memory_order_acquire)) {
+    return fstatat(AT_FDCWD, file, buf, AT_SYMLINK_NOFOLLOW);
+  }
+
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("__lxstat");
+  AuditStat(file, false, sampler, __builtin_return_address(0));
+
+  orig_lxstat_type fn = originals.lxstat.Get();
+  return fn != nullptr ? fn(ver, file, buf)
+                       : fstatat(AT_FDCWD, file, buf, AT_SYMLINK_NOFOLLOW);
+}
+
+int __xstat64(int ver, const char *file, struct stat64 *buf) {
+  if (!mallocInitialized.load(std::memory_order_acquire)) {
+    return fstatat64(AT_FDCWD, file, buf, 0);
+  }
+
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("__xstat64");
+  AuditStat(file, true, sampler, __builtin_return_address(0));
+
+  orig_xstat64_type fn = originals.xstat64.Get();
+  return fn != nullptr ? fn(ver, file, buf)
+                       : fstatat64(AT_FDCWD, file, buf, 0);
+}
+
+int __lxstat64(int ver, const char *file, struct stat64 *buf) {
+  if (!mallocInitialized.load(std::memory_order_acquire)) {
+    return fstatat64(AT_FDCWD, file, buf, AT_SYMLINK_NOFOLLOW);
+  }
+
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("__lxstat64");
+  AuditStat(file, false, sampler, __builtin_return_address(0));
+
+  orig_lxstat64_type fn = originals.lxstat64.Get();
+  return fn != nullptr ? fn(ver, file, buf)
+                       : fstatat64(AT_FDCWD, file, buf, AT_SYMLINK_NOFOLLOW);
+}
+
+int access(const char *name, int type) {
+  if (!mallocInitialized.load(std::memory_order_acquire)) {
+    return syscall(SYS_access, name, type);
+  }
+
+  absl::string_view path_args[] = {name};
+  uint64_t args[] = {0, static_cast<uint64_t>(type)};
+  pathauditor::FileEventView file_event(SYS_access, args, path_args);
+
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("access");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
+
+  return originals.access.Get()(name, type);
+}
+
+int faccessat(int fd, const char *file, int type, int flag) {
+  absl::string_view path_args[] = {file};
+  uint64_t args[] = {static_cast<uint64_t>(fd), 0,
+                     static_cast<uint64_t>(type),
+                     static_cast<uint64_t>(flag)};
+  // Like glibc, only use faccessat2 if there are flags.
+#ifdef SYS_faccessat2
+  int syscall_nr = flag == 0 ? SYS_faccessat : SYS_faccessat2;
+#else
+  int syscall_nr = SYS_faccessat;
+#endif
+  pathauditor::FileEventView file_event(
+      syscall_nr, absl::MakeConstSpan(args, flag == 0 ? 3 : 4), path_args);
+
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("faccessat");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
+
+  return originals.faccessat.Get()(fd, file, type, flag);
+}
+
+ssize_t readlink(const char *path, char *buf, size_t len) {
+  absl::string_view path_args[] = {path};
+  uint64_t args[] = {0, 0, len};
+  pathauditor::FileEventView file_event(SYS_readlink, args, path_args);
+
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("readlink");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
+
+  return originals.readlink.Get()(path, buf, len);
+}
+
+DIR *opendir(const char *name) {
+  absl::string_view path_args[] = {name};
+  uint64_t args[] = {0, O_RDONLY | O_DIRECTORY};
+  pathauditor::FileEventView file_event(SYS_open, args, path_args);
 
-  pathauditor::LibcFileEventIsUserControlled(file_event, "chroot");
+  ABSL_CONST_INIT static pathauditor::HookSampler sampler("opendir");
+  pathauditor::LibcFileEventIsUserControlled(file_event, sampler,
+                                             __builtin_return_address(0));
 
-  orig_chroot_type orig_chroot;
-  orig_chroot = reinterpret_cast<orig_chroot_type>(dlsym(RTLD_NEXT, "chroot"));
-  return orig_chroot(path);
+  return originals.opendir.Get()(name);
 }
 }
@@ -0,0 +1,138 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Loads libpath_auditor.so next to the test instead of preloading it, so the
+// hooks only run when they're called through dlsym.
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "pathauditor/stats_page.h"
+#include "pathauditor/util/status_matchers.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::Eq;
+using ::testing::IsSupersetOf;
+using ::testing::Ne;
+using ::testing::UnorderedElementsAreArray;
+
+constexpr const char kLibrary[] = "pathauditor/libc/libpath_auditor.so";
+
+typedef FILE *(*fopen_type)(const char *filename, const char *modes);
+typedef FILE *(*freopen_type)(const char *filename, const char *modes,
+                              FILE *stream);
+
+// Reads the only stats page in dir.
+std::string ReadStatsPage(const std::string &dir) {
+  std::string page;
+  DIR *d = opendir(dir.c_str());
+  if (d == nullptr) {
+    return page;
+  }
+  while (struct dirent *entry = readdir(d)) {
+    if (!absl::EndsWith(entry->d_name, ".pastats")) {
+      continue;
+    }
+    int fd = open(absl::StrCat(dir, "/", entry->d_name).c_str(), O_RDONLY);
+    if (fd == -1) {
+      break;
+    }
+    page.resize(kStatsPageSize);
+    size_t size = 0;
+    ssize_t bytes;
+    while (size < page.size() &&
+           (bytes = read(fd, &page[size], page.size() - size)) > 0) {
+      size += bytes;
+    }
+    page.resize(size);
+    close(fd);
+    break;
+  }
+  closedir(d);
+  return page;
+}
+
+TEST(PathAuditorLibcTest, HooksCountUnderTheirOwnNames) {
+  char dir_template[] = "/tmp/path_auditor_libc_test.XXXXXX";
+  ASSERT_THAT(mkdtemp(dir_template), Ne(nullptr));
+  std::string dir = dir_template;
+  std::string file = dir + "/file";
+  close(open(file.c_str(), O_WRONLY | O_CREAT, 0644));
+
+  // The constructors of the library read the environment.
+  ASSERT_THAT(setenv("PATHAUDITOR_STATS_DIR", dir.c_str(), 1), Eq(0));
+  void *library = dlopen(kLibrary, RTLD_NOW | RTLD_LOCAL);
+  ASSERT_THAT(library, Ne(nullptr)) << dlerror();
+  unsetenv("PATHAUDITOR_STATS_DIR");
+
+  // Hooks of functions that forward to the same call are easy to mix up.
+  std::vector<std::string> names = {"fopen", "fopen64", "freopen",
+                                    "freopen64"};
+  for (const char *name : {"fopen", "fopen64"}) {
+    auto hook = reinterpret_cast<fopen_type>(dlsym(library, name));
+    ASSERT_THAT(hook, Ne(nullptr)) << name;
+    FILE *f = hook(file.c_str(), "r");
+    ASSERT_THAT(f, Ne(nullptr)) << name;
+    fclose(f);
+  }
+  for (const char *name : {"freopen", "freopen64"}) {
+    auto hook = reinterpret_cast<freopen_type>(dlsym(library, name));
+    ASSERT_THAT(hook, Ne(nullptr)) << name;
+    FILE *f = fopen(file.c_str(), "r");
+    ASSERT_THAT(f, Ne(nullptr));
+    f = hook(file.c_str(), "r", f);
+    ASSERT_THAT(f, Ne(nullptr)) << name;
+    fclose(f);
+  }
+
+  std::string page = ReadStatsPage(dir);
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(StatsPageTotals totals,
+                                               SumStatsPage(page));
+  std::vector<std::string> hooks;
+  for (const HookTotals &hook : totals.hooks) {
+    hooks.push_back(hook.name);
+  }
+  // Every hook has its own entry, so no name may show up twice.
+  std::vector<std::string> unique = hooks;
+  std::sort(unique.begin(), unique.end());
+  unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+  EXPECT_THAT(hooks, UnorderedElementsAreArray(unique));
+  EXPECT_THAT(hooks, IsSupersetOf(names));
+
+  // The library stays loaded, it's not made to be unloaded. Remove the file
+  // and the stats page.
+  DIR *d = opendir(dir.c_str());
+  while (struct dirent *entry = readdir(d)) {
+    unlink(absl::StrCat(dir, "/", entry->d_name).c_str());
+  }
+  closedir(d);
+  rmdir(dir.c_str());
+}
+
+}  // namespace
+}  // namespace pathauditor
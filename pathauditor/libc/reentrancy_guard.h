@@ -0,0 +1,41 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_LIBC_REENTRANCY_GUARD_H_
+#define PATHAUDITOR_LIBC_REENTRANCY_GUARD_H_
+
+namespace pathauditor {
+
+// Set while the library does its own work on the current thread, e.g. auditing
+// a call or delivering reports. The hooks don't audit the calls made in the
+// meantime, otherwise the auditor would audit and report itself.
+extern thread_local bool sanitizing;
+
+// Sets sanitizing for its lifetime and restores the previous value
+// afterwards.
+class ReentrancyGuard {
+ public:
+  ReentrancyGuard() : previous_(sanitizing) { sanitizing = true; }
+  ~ReentrancyGuard() { sanitizing = previous_; }
+
+  ReentrancyGuard(const ReentrancyGuard &) = delete;
+  ReentrancyGuard &operator=(const ReentrancyGuard &) = delete;
+
+ private:
+  const bool previous_;
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_LIBC_REENTRANCY_GUARD_H_
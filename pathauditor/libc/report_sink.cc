@@ -0,0 +1,580 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/libc/report_sink.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
+#include "pathauditor/pathauditor.h"
+#include "pathauditor/process_information.h"
+
+namespace pathauditor {
+
+namespace {
+
+void AppendJsonString(std::string *out, absl::string_view str) {
+  out->push_back('"');
+  for (char c : str) {
+    switch (c) {
+      case '"':
+        out->append("\\\"");
+        break;
+      case '\\':
+        out->append("\\\\");
+        break;
+      case '\n':
+        out->append("\\n");
+        break;
+      case '\t':
+        out->append("\\t");
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          absl::StrAppendFormat(out, "\\u%04x", c);
+        } else {
+          out->push_back(c);
+        }
+    }
+  }
+  out->push_back('"');
+}
+
+template <typename T>
+void AppendValue(std::string *out, const T &value) {
+  out->append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+void AppendString(std::string *out, absl::string_view str) {
+  AppendValue(out, static_cast<uint32_t>(str.size()));
+  out->append(str.data(), str.size());
+}
+
+absl::Status DecodeString(absl::Span<const char> record, size_t *pos,
+                          std::string *out) {
+  uint32_t len;
+  if (record.size() - *pos < sizeof(len)) {
+    return absl::InvalidArgumentError("Truncated string in a record");
+  }
+  memcpy(&len, record.data() + *pos, sizeof(len));
+  *pos += sizeof(len);
+  if (record.size() - *pos < len) {
+    return absl::InvalidArgumentError("Truncated string in a record");
+  }
+  out->assign(record.data() + *pos, len);
+  *pos += len;
+  return absl::OkStatus();
+}
+
+// Writes all of iov to fd. SIGPIPE is blocked while doing so and one that the
+// write raised is discarded, the audited process might not ignore it.
+bool WriteAll(int fd, absl::Span<iovec> iov) {
+  sigset_t sigpipe, old_mask, pending;
+  sigemptyset(&sigpipe);
+  sigaddset(&sigpipe, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &sigpipe, &old_mask);
+  sigpending(&pending);
+  bool was_pending = sigismember(&pending, SIGPIPE);
+
+  bool ok = true;
+  while (!iov.empty()) {
+    ssize_t written = writev(fd, iov.data(),
+                             std::min<size_t>(iov.size(), IOV_MAX));
+    if (written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      ok = false;
+      break;
+    }
+    // Skip what was written, the last iovec might be written partially.
+    size_t remaining = written;
+    while (!iov.empty() && remaining >= iov.front().iov_len) {
+      remaining -= iov.front().iov_len;
+      iov.remove_prefix(1);
+    }
+    if (remaining > 0) {
+      iov.front().iov_base = static_cast<char *>(iov.front().iov_base) +
+                             remaining;
+      iov.front().iov_len -= remaining;
+    }
+  }
+
+  if (!ok && errno == EPIPE && !was_pending) {
+    struct timespec no_wait = {0, 0};
+    sigtimedwait(&sigpipe, nullptr, &no_wait);
+  }
+  pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+  return ok;
+}
+
+uint64_t RealtimeNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+absl::StatusOr<int> ParseFd(absl::string_view target) {
+  int fd;
+  if (!absl::SimpleAtoi(target, &fd) || fd < 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("invalid report sink fd \"", target, "\""));
+  }
+  return fd;
+}
+
+}  // namespace
+
+std::string EncodeJsonLine(const ViolationRecord &record) {
+  std::string out = "{\"function\":";
+  AppendJsonString(&out, record.function_name);
+  absl::StrAppend(&out, ",\"syscall_nr\":", record.syscall_nr, ",\"args\":[",
+                  absl::StrJoin(record.args, ","), "],\"path_args\":[");
+  for (size_t i = 0; i < record.path_args.size(); i++) {
+    if (i > 0) {
+      out.push_back(',');
+    }
+    AppendJsonString(&out, record.path_args[i]);
+  }
+  out.push_back(']');
+  if (record.reason != UnsafeReason::kNone) {
+    absl::StrAppend(&out, ",\"unsafe\":{\"path\":", record.unsafe_path_index,
+                    ",\"component_index\":", record.component_index,
+                    ",\"component\":");
+    AppendJsonString(&out, record.component);
+    absl::StrAppend(&out, ",\"reason\":\"", UnsafeReasonName(record.reason),
+                    "\",\"directory\":{\"dev\":", record.directory_dev,
+                    ",\"ino\":", record.directory_ino, "}}");
+  }
+  absl::StrAppend(&out, ",\"uid\":", record.uid, ",\"pid\":", record.pid,
+                  ",\"timestamp_ns\":", record.timestamp_ns, ",\"cmdline\":");
+  AppendJsonString(&out, record.cmdline);
+  absl::StrAppend(&out, ",\"occurrences\":", record.occurrences,
+                  ",\"stack\":[");
+  for (size_t i = 0; i < record.frames.size(); i++) {
+    absl::StrAppendFormat(&out, "%s{\"address\":\"%p\",\"symbol\":",
+                          i > 0 ? "," : "", record.frames[i]);
+    AppendJsonString(&out, i < record.symbols.size() ? record.symbols[i] : "");
+    out.push_back('}');
+  }
+  out.append("]}\n");
+  return out;
+}
+
+std::string EncodeBinaryRecord(const ViolationRecord &record) {
+  ViolationRecordHeader header = {};
+  header.syscall_nr = record.syscall_nr;
+  header.uid = record.uid;
+  header.pid = record.pid;
+  header.timestamp_ns = record.timestamp_ns;
+  header.occurrences = record.occurrences;
+  header.arg_count = std::min<size_t>(record.args.size(), UINT16_MAX);
+  header.path_arg_count = std::min<size_t>(record.path_args.size(), UINT16_MAX);
+  header.frame_count = std::min<size_t>(record.frames.size(), UINT16_MAX);
+  header.reason = static_cast<uint8_t>(record.reason);
+  header.unsafe_path_index =
+      std::min<size_t>(record.unsafe_path_index, UINT8_MAX);
+  header.component_index =
+      std::min<size_t>(record.component_index, UINT32_MAX);
+  header.directory_dev = record.directory_dev;
+  header.directory_ino = record.directory_ino;
+
+  std::string out(sizeof(header), '\0');
+  for (size_t i = 0; i < header.arg_count; i++) {
+    AppendValue(&out, record.args[i]);
+  }
+  for (size_t i = 0; i < header.frame_count; i++) {
+    AppendValue(&out, reinterpret_cast<uint64_t>(record.frames[i]));
+  }
+  AppendString(&out, record.function_name);
+  AppendString(&out, record.cmdline);
+  AppendString(&out, record.component);
+  for (size_t i = 0; i < header.path_arg_count; i++) {
+    AppendString(&out, record.path_args[i]);
+  }
+  for (size_t i = 0; i < header.frame_count; i++) {
+    AppendString(&out, i < record.symbols.size() ? record.symbols[i] : "");
+  }
+  header.size = out.size();
+  memcpy(&out[0], &header, sizeof(header));
+  return out;
+}
+
+absl::StatusOr<size_t> DecodeBinaryRecord(absl::Span<const char> data,
+                                          DecodedViolationRecord *out) {
+  ViolationRecordHeader header;
+  if (data.size() < sizeof(header)) {
+    return absl::InvalidArgumentError("Truncated record header");
+  }
+  memcpy(&header, data.data(), sizeof(header));
+  if (header.size < sizeof(header) || header.size > data.size()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid record size ", header.size));
+  }
+  absl::Span<const char> record = data.subspan(0, header.size);
+  size_t pos = sizeof(header);
+  size_t numbers_size =
+      (header.arg_count + header.frame_count) * sizeof(uint64_t);
+  if (record.size() - pos < numbers_size) {
+    return absl::InvalidArgumentError("Truncated args in a record");
+  }
+
+  out->syscall_nr = header.syscall_nr;
+  out->uid = header.uid;
+  out->pid = header.pid;
+  out->timestamp_ns = header.timestamp_ns;
+  out->occurrences = header.occurrences;
+  if (header.reason > static_cast<uint8_t>(UnsafeReason::kWritableFile)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid unsafe reason ", header.reason));
+  }
+  out->reason = static_cast<UnsafeReason>(header.reason);
+  out->unsafe_path_index = header.unsafe_path_index;
+  out->component_index = header.component_index;
+  out->directory_dev = header.directory_dev;
+  out->directory_ino = header.directory_ino;
+  out->args.resize(header.arg_count);
+  memcpy(out->args.data(), record.data() + pos,
+         header.arg_count * sizeof(uint64_t));
+  pos += header.arg_count * sizeof(uint64_t);
+  out->frames.resize(header.frame_count);
+  memcpy(out->frames.data(), record.data() + pos,
+         header.frame_count * sizeof(uint64_t));
+  pos += header.frame_count * sizeof(uint64_t);
+
+  absl::Status status = DecodeString(record, &pos, &out->function_name);
+  if (status.ok()) {
+    status = DecodeString(record, &pos, &out->cmdline);
+  }
+  if (status.ok()) {
+    status = DecodeString(record, &pos, &out->component);
+  }
+  out->path_args.resize(header.path_arg_count);
+  for (size_t i = 0; status.ok() && i < header.path_arg_count; i++) {
+    status = DecodeString(record, &pos, &out->path_args[i]);
+  }
+  out->symbols.resize(header.frame_count);
+  for (size_t i = 0; status.ok() && i < header.frame_count; i++) {
+    status = DecodeString(record, &pos, &out->symbols[i]);
+  }
+  if (!status.ok()) {
+    return status;
+  }
+  if (pos != record.size()) {
+    return absl::InvalidArgumentError("Trailing bytes in a record");
+  }
+  return header.size;
+}
+
+void BatchWriter::Append(std::string data) {
+  pending_bytes_ += data.size();
+  pending_.push_back(std::move(data));
+  if (pending_bytes_ >= kMaxPendingBytes) {
+    Flush();
+  }
+}
+
+bool BatchWriter::Flush() {
+  if (pending_.empty()) {
+    return true;
+  }
+  std::vector<iovec> iov;
+  iov.reserve(pending_.size());
+  for (std::string &data : pending_) {
+    iov.push_back({&data[0], data.size()});
+  }
+  bool ok = fd_ != -1 && WriteAll(fd_, absl::MakeSpan(iov));
+  pending_.clear();
+  pending_bytes_ = 0;
+  return ok;
+}
+
+SyslogSink::SyslogSink() { openlog("pathauditor", LOG_PID, 0); }
+
+void SyslogSink::Write(const ViolationRecord &record) {
+  std::string path_args = absl::StrJoin(record.path_args, ", ");
+  if (record.occurrences > 1) {
+    // The full report was logged the first time, just update the count.
+    syslog(LOG_WARNING,
+           "InsecureAccess: function %s, syscall_nr %d, path args %s seen %llu "
+           "times",
+           std::string(record.function_name).c_str(), record.syscall_nr,
+           path_args.c_str(),
+           static_cast<unsigned long long>(record.occurrences));
+    return;
+  }
+
+  std::vector<std::string> stack_trace_lines;
+  for (size_t i = 0; i < record.frames.size(); i++) {
+    stack_trace_lines.push_back(absl::StrCat(
+        "  ", absl::Hex(record.frames[i], absl::kZeroPad12), " ",
+        i < record.symbols.size() ? record.symbols[i] : "(unknown)"));
+  }
+  std::string unsafe_element;
+  if (record.reason != UnsafeReason::kNone) {
+    unsafe_element = absl::StrFormat(
+        ", unsafe element %d of path %d \"%s\" (%s)", record.component_index,
+        record.unsafe_path_index, record.component,
+        UnsafeReasonName(record.reason));
+  }
+  std::string event_info = absl::StrFormat(
+      "function %s, cmdline %s, syscall_nr %d, args %s, path args %s%s, uid "
+      "%d, stack trace:\n%s",
+      record.function_name, record.cmdline, record.syscall_nr,
+      absl::StrJoin(record.args, ", "), path_args, unsafe_element, record.uid,
+      absl::StrJoin(stack_trace_lines, "\n"));
+
+  syslog(LOG_WARNING, "InsecureAccess: %s", event_info.c_str());
+}
+
+void SyslogSink::Dropped(uint64_t dropped) {
+  syslog(LOG_WARNING, "InsecureAccess: dropped %llu reports",
+         static_cast<unsigned long long>(dropped));
+}
+
+JsonLinesSink::JsonLinesSink(int fd, bool owns_fd)
+    : writer_(fd), owns_fd_(owns_fd) {}
+
+JsonLinesSink::~JsonLinesSink() {
+  writer_.Flush();
+  if (owns_fd_) {
+    close(writer_.fd());
+  }
+}
+
+void JsonLinesSink::Write(const ViolationRecord &record) {
+  writer_.Append(EncodeJsonLine(record));
+}
+
+void JsonLinesSink::Dropped(uint64_t dropped) {
+  writer_.Append(absl::StrCat("{\"dropped\":", dropped, "}\n"));
+}
+
+BinaryStreamSink::BinaryStreamSink(int fd) : writer_(fd) {}
+
+BinaryStreamSink::BinaryStreamSink(int fd, std::string socket_path)
+    : writer_(fd), socket_path_(std::move(socket_path)) {}
+
+std::unique_ptr<BinaryStreamSink> BinaryStreamSink::ForSocket(
+    absl::string_view path) {
+  // Connects on the first flush, not now.
+  return std::unique_ptr<BinaryStreamSink>(
+      new BinaryStreamSink(-1, std::string(path)));
+}
+
+BinaryStreamSink::~BinaryStreamSink() {
+  Flush();
+  if (!socket_path_.empty() && writer_.fd() != -1) {
+    close(writer_.fd());
+  }
+}
+
+bool BinaryStreamSink::Connect() {
+  if (socket_path_.empty()) {
+    return true;
+  }
+  pid_t pid = syscall(SYS_getpid);
+  if (writer_.fd() != -1 && connected_pid_ == pid) {
+    return true;
+  }
+  if (writer_.fd() != -1) {
+    // Inherited from the parent, which keeps using it.
+    close(writer_.fd());
+    writer_.set_fd(-1);
+  }
+
+  struct sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (socket_path_.size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  memcpy(addr.sun_path, socket_path_.data(), socket_path_.size());
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    return false;
+  }
+  if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) ==
+      -1) {
+    close(fd);
+    return false;
+  }
+  // The records contain cmdlines and paths of privileged processes, so only
+  // send them to a collector run by us or root.
+  struct ucred peer;
+  socklen_t peer_len = sizeof(peer);
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &peer_len) == -1 ||
+      (peer.uid != 0 && peer.uid != geteuid())) {
+    close(fd);
+    return false;
+  }
+  writer_.set_fd(fd);
+  connected_pid_ = pid;
+  header_written_ = false;
+  return true;
+}
+
+void BinaryStreamSink::Write(const ViolationRecord &record) {
+  writer_.Append(EncodeBinaryRecord(record));
+}
+
+void BinaryStreamSink::Dropped(uint64_t dropped) {
+  ViolationRecord record;
+  record.syscall_nr = -1;
+  record.uid = syscall(SYS_getuid);
+  record.pid = syscall(SYS_getpid);
+  record.timestamp_ns = RealtimeNanos();
+  record.occurrences = dropped;
+  writer_.Append(EncodeBinaryRecord(record));
+}
+
+void BinaryStreamSink::Flush() {
+  if (writer_.pending_bytes() == 0) {
+    return;
+  }
+  if (!Connect()) {
+    // Nobody is listening, drop the batch.
+    writer_.Flush();
+    return;
+  }
+  if (!header_written_) {
+    ViolationStreamHeader header = {kViolationStreamMagic,
+                                    kViolationStreamVersion};
+    iovec iov = {&header, sizeof(header)};
+    header_written_ = WriteAll(writer_.fd(), absl::MakeSpan(&iov, 1));
+  }
+  if (!header_written_ || !writer_.Flush()) {
+    if (!socket_path_.empty()) {
+      close(writer_.fd());
+      writer_.set_fd(-1);
+    }
+  }
+}
+
+absl::StatusOr<std::unique_ptr<ReportSink>> OpenReportSink(
+    absl::string_view spec) {
+  std::pair<absl::string_view, absl::string_view> format_target =
+      absl::StrSplit(spec, absl::MaxSplits(':', 1));
+  absl::string_view format = format_target.first;
+  absl::string_view target = format_target.second;
+  bool is_fd = absl::ConsumePrefix(&target, "fd:");
+
+  if (format == "syslog" && target.empty()) {
+    return std::unique_ptr<ReportSink>(new SyslogSink());
+  }
+  if (target.empty()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("invalid report sink \"", spec, "\""));
+  }
+  if (format == "json") {
+    if (is_fd) {
+      absl::StatusOr<int> fd = ParseFd(target);
+      if (!fd.ok()) {
+        return fd.status();
+      }
+      return std::unique_ptr<ReportSink>(new JsonLinesSink(*fd, false));
+    }
+    std::string path(target);
+    // Privileged processes append to this file, so nobody else may be able to
+    // redirect it.
+    absl::StatusOr<bool> user_controlled =
+        PathIsUserControlled(SameProcessInformation(), path);
+    if (!user_controlled.ok()) {
+      return user_controlled.status();
+    }
+    if (*user_controlled) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("ignoring user controlled report file ", target));
+    }
+    int fd = syscall(SYS_open, path.c_str(),
+                     O_WRONLY | O_APPEND | O_CREAT | O_NOFOLLOW | O_CLOEXEC,
+                     0600);
+    if (fd == -1) {
+      return absl::NotFoundError(
+          absl::StrCat("cannot open report file ", target));
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) == -1 || !S_ISREG(sb.st_mode) ||
+        (sb.st_uid != geteuid() && sb.st_uid != 0) ||
+        sb.st_mode & (S_IWGRP | S_IWOTH)) {
+      close(fd);
+      return absl::PermissionDeniedError(absl::StrCat(
+          "report file ", target,
+          " must be a regular file that only we or root can write"));
+    }
+    return std::unique_ptr<ReportSink>(new JsonLinesSink(fd, true));
+  }
+  if (format == "binary") {
+    if (is_fd) {
+      absl::StatusOr<int> fd = ParseFd(target);
+      if (!fd.ok()) {
+        return fd.status();
+      }
+      return std::unique_ptr<ReportSink>(new BinaryStreamSink(*fd));
+    }
+    if (target.size() >= sizeof(sockaddr_un::sun_path)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("report socket path too long: ", target));
+    }
+    // Same as for the report file, nobody else may be able to bind a socket
+    // in its place.
+    absl::StatusOr<bool> user_controlled =
+        PathIsUserControlled(SameProcessInformation(), target);
+    if (!user_controlled.ok()) {
+      return user_controlled.status();
+    }
+    if (*user_controlled) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("ignoring user controlled report socket ", target));
+    }
+    return std::unique_ptr<ReportSink>(BinaryStreamSink::ForSocket(target));
+  }
+  return absl::InvalidArgumentError(
+      absl::StrCat("invalid report sink \"", spec, "\""));
+}
+
+std::vector<std::unique_ptr<ReportSink>> OpenReportSinks(
+    absl::string_view specs, std::vector<absl::Status> *errors) {
+  std::vector<std::unique_ptr<ReportSink>> sinks;
+  for (absl::string_view spec : absl::StrSplit(specs, ',', absl::SkipEmpty())) {
+    absl::StatusOr<std::unique_ptr<ReportSink>> sink = OpenReportSink(spec);
+    if (!sink.ok()) {
+      errors->push_back(sink.status());
+      continue;
+    }
+    sinks.push_back(*std::move(sink));
+  }
+  return sinks;
+}
+
+}  // namespace pathauditor
@@ -0,0 +1,246 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Where the reporter thread delivers insecure access reports: syslog, a file
+// with one JSON object per line or a binary stream, e.g. to a collector
+// listening on a Unix socket.
+//
+// The binary stream starts with a ViolationStreamHeader, followed by length
+// prefixed records. A record is a ViolationRecordHeader, the args, the stack
+// frame addresses and then the strings, each as a uint32_t length and the
+// bytes: function name, cmdline, the unsafe component, path args and the
+// symbols of the frames.
+// Like the capture logs, everything is in host byte order, the stream is
+// meant to be read on the same machine.
+
+#ifndef PATHAUDITOR_LIBC_REPORT_SINK_H_
+#define PATHAUDITOR_LIBC_REPORT_SINK_H_
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "pathauditor/path_audit_result.h"
+
+namespace pathauditor {
+
+// An insecure access, formatted and symbolized.
+struct ViolationRecord {
+  absl::string_view function_name;
+  int syscall_nr = 0;
+  uid_t uid = 0;
+  pid_t pid = 0;
+  // CLOCK_REALTIME of the call.
+  uint64_t timestamp_ns = 0;
+  absl::Span<const uint64_t> args;
+  absl::Span<const absl::string_view> path_args;
+  absl::string_view cmdline;
+  // The stack trace and the symbol of every frame, "(unknown)" if there is
+  // none.
+  absl::Span<void *const> frames;
+  absl::Span<const std::string> symbols;
+  // See InsecureAccessReport.
+  uint64_t occurrences = 0;
+  // The element that made the access insecure, see PathAuditResult. Left out
+  // of the JSON and syslog output if the reason is kNone.
+  UnsafeReason reason = UnsafeReason::kNone;
+  size_t unsafe_path_index = 0;
+  size_t component_index = 0;
+  absl::string_view component;
+  dev_t directory_dev = 0;
+  ino_t directory_ino = 0;
+};
+
+constexpr uint32_t kViolationStreamMagic = 0x50415652;  // "PAVR"
+// Version 2 added the unsafe element.
+constexpr uint32_t kViolationStreamVersion = 2;
+
+struct ViolationStreamHeader {
+  uint32_t magic;
+  uint32_t version;
+};
+
+struct ViolationRecordHeader {
+  // Of the whole record, including this header.
+  uint32_t size;
+  int32_t syscall_nr;
+  uint32_t uid;
+  int32_t pid;
+  uint64_t timestamp_ns;
+  uint64_t occurrences;
+  uint16_t arg_count;
+  uint16_t path_arg_count;
+  uint16_t frame_count;
+  // The UnsafeReason.
+  uint8_t reason;
+  uint8_t unsafe_path_index;
+  uint32_t component_index;
+  uint32_t reserved;
+  uint64_t directory_dev;
+  uint64_t directory_ino;
+};
+
+// The JSON object for the record, with a trailing newline. Strings are
+// escaped as JSON requires, other bytes are passed through, i.e. paths that
+// aren't UTF-8 aren't either in the output.
+std::string EncodeJsonLine(const ViolationRecord &record);
+
+// The binary record, see above.
+std::string EncodeBinaryRecord(const ViolationRecord &record);
+
+// A decoded binary record.
+struct DecodedViolationRecord {
+  std::string function_name;
+  int syscall_nr = 0;
+  uid_t uid = 0;
+  pid_t pid = 0;
+  uint64_t timestamp_ns = 0;
+  std::vector<uint64_t> args;
+  std::vector<std::string> path_args;
+  std::string cmdline;
+  std::vector<uint64_t> frames;
+  std::vector<std::string> symbols;
+  uint64_t occurrences = 0;
+  UnsafeReason reason = UnsafeReason::kNone;
+  size_t unsafe_path_index = 0;
+  size_t component_index = 0;
+  std::string component;
+  uint64_t directory_dev = 0;
+  uint64_t directory_ino = 0;
+};
+
+// Decodes the record at the start of data into out and returns its size.
+// Fails if data doesn't start with a complete, well-formed record.
+absl::StatusOr<size_t> DecodeBinaryRecord(absl::Span<const char> data,
+                                          DecodedViolationRecord *out);
+
+// Collects the encoded records of a batch and writes them to the fd with one
+// writev, or as few as the iovec limit allows. Not thread safe.
+class BatchWriter {
+ public:
+  // Pending data is flushed early once it reaches this size.
+  static constexpr size_t kMaxPendingBytes = 64 * 1024;
+
+  explicit BatchWriter(int fd) : fd_(fd) {}
+
+  void Append(std::string data);
+  // Writes everything appended since the last flush. Returns false if that
+  // failed, the data is dropped either way. A closed pipe or socket doesn't
+  // raise SIGPIPE.
+  bool Flush();
+
+  int fd() const { return fd_; }
+  void set_fd(int fd) { fd_ = fd; }
+  size_t pending_bytes() const { return pending_bytes_; }
+
+ private:
+  int fd_;
+  std::vector<std::string> pending_;
+  size_t pending_bytes_ = 0;
+};
+
+// Gets the reports from the reporter thread or from a flush, one call at a
+// time.
+class ReportSink {
+ public:
+  virtual ~ReportSink() = default;
+
+  virtual void Write(const ViolationRecord &record) = 0;
+  // Called with the number of reports that were dropped since the last call.
+  virtual void Dropped(uint64_t dropped) = 0;
+  // Called after a batch of reports.
+  virtual void Flush() {}
+};
+
+// The free-form messages that pathauditor has always written to syslog.
+class SyslogSink : public ReportSink {
+ public:
+  SyslogSink();
+
+  void Write(const ViolationRecord &record) override;
+  void Dropped(uint64_t dropped) override;
+};
+
+// One JSON object per report and line, see EncodeJsonLine. Drops are
+// reported as {"dropped":N}.
+class JsonLinesSink : public ReportSink {
+ public:
+  // Takes ownership of fd if owns_fd.
+  JsonLinesSink(int fd, bool owns_fd);
+  ~JsonLinesSink() override;
+
+  void Write(const ViolationRecord &record) override;
+  void Dropped(uint64_t dropped) override;
+  void Flush() override { writer_.Flush(); }
+
+ private:
+  BatchWriter writer_;
+  bool owns_fd_;
+};
+
+// The binary stream, see above. Drops are sent as records without strings,
+// with syscall_nr -1 and the number of drops as occurrences.
+class BinaryStreamSink : public ReportSink {
+ public:
+  // Writes to an fd that the caller passed in, doesn't close it.
+  explicit BinaryStreamSink(int fd);
+  // Connects to a stream socket. A failed write closes the connection, the
+  // next batch connects again. So does a forked child, where the connection
+  // would otherwise be shared with the parent.
+  static std::unique_ptr<BinaryStreamSink> ForSocket(absl::string_view path);
+  ~BinaryStreamSink() override;
+
+  void Write(const ViolationRecord &record) override;
+  void Dropped(uint64_t dropped) override;
+  void Flush() override;
+
+ private:
+  BinaryStreamSink(int fd, std::string socket_path);
+
+  // Connects if needed. Returns false if there is no connection.
+  bool Connect();
+
+  BatchWriter writer_;
+  // Empty for an fd that was passed in.
+  std::string socket_path_;
+  // The process that made the connection.
+  pid_t connected_pid_ = 0;
+  bool header_written_ = false;
+};
+
+// Creates a sink from its description:
+//   syslog
+//   json:<file>        Appends to the file, creating it if needed.
+//   json:fd:<n>
+//   binary:<socket>    Connects to the Unix stream socket.
+//   binary:fd:<n>
+absl::StatusOr<std::unique_ptr<ReportSink>> OpenReportSink(
+    absl::string_view spec);
+
+// Creates the sinks in a comma separated list of descriptions. Sinks that
+// can't be created are left out, with their errors in errors.
+std::vector<std::unique_ptr<ReportSink>> OpenReportSinks(
+    absl::string_view specs, std::vector<absl::Status> *errors);
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_LIBC_REPORT_SINK_H_
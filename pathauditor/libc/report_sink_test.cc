@@ -0,0 +1,319 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/libc/report_sink.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+#include "pathauditor/util/status_matchers.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::HasSubstr;
+using ::testing::Ne;
+using ::testing::Not;
+using ::testing::StartsWith;
+
+class ReportSinkTest : public ::testing::Test {
+ protected:
+  ReportSinkTest() {
+    record_.function_name = "open";
+    record_.syscall_nr = SYS_open;
+    record_.uid = 1000;
+    record_.pid = 42;
+    record_.timestamp_ns = 1234;
+    record_.args = args_;
+    record_.path_args = path_args_;
+    record_.cmdline = "cat \"quoted\"";
+    record_.frames = frames_;
+    record_.symbols = symbols_;
+    record_.occurrences = 1;
+  }
+
+  std::string ReadAll(int fd) {
+    std::string data;
+    char buf[4096];
+    ssize_t bytes;
+    while ((bytes = read(fd, buf, sizeof(buf))) > 0) {
+      data.append(buf, bytes);
+    }
+    return data;
+  }
+
+  uint64_t args_[3] = {0, 0101, 0644};
+  absl::string_view path_args_[1] = {"/tmp/a\nb"};
+  void *frames_[2] = {reinterpret_cast<void *>(0x1000),
+                      reinterpret_cast<void *>(0x2000)};
+  std::string symbols_[2] = {"main", "(unknown)"};
+  ViolationRecord record_;
+};
+
+TEST_F(ReportSinkTest, EncodesJsonLines) {
+  EXPECT_THAT(
+      EncodeJsonLine(record_),
+      Eq(absl::StrCat(
+          "{\"function\":\"open\",\"syscall_nr\":", SYS_open,
+          ",\"args\":[0,65,420],\"path_args\":[\"/tmp/a\\nb\"],\"uid\":1000,"
+          "\"pid\":42,\"timestamp_ns\":1234,\"cmdline\":\"cat \\\"quoted\\\"\","
+          "\"occurrences\":1,\"stack\":[{\"address\":\"0x1000\",\"symbol\":"
+          "\"main\"},{\"address\":\"0x2000\",\"symbol\":\"(unknown)\"}]}\n")));
+
+  ViolationRecord control = record_;
+  control.cmdline = absl::string_view("\x01\\", 2);
+  EXPECT_THAT(EncodeJsonLine(control),
+              HasSubstr("\"cmdline\":\"\\u0001\\\\\""));
+}
+
+TEST_F(ReportSinkTest, BinaryRecordsRoundTrip) {
+  std::string encoded = EncodeBinaryRecord(record_);
+  DecodedViolationRecord decoded;
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      size_t size, DecodeBinaryRecord(encoded, &decoded));
+  EXPECT_THAT(size, Eq(encoded.size()));
+  EXPECT_THAT(decoded.function_name, Eq("open"));
+  EXPECT_THAT(decoded.syscall_nr, Eq(SYS_open));
+  EXPECT_THAT(decoded.uid, Eq(1000));
+  EXPECT_THAT(decoded.pid, Eq(42));
+  EXPECT_THAT(decoded.timestamp_ns, Eq(1234));
+  EXPECT_THAT(decoded.args, ElementsAre(0, 0101, 0644));
+  EXPECT_THAT(decoded.path_args, ElementsAre("/tmp/a\nb"));
+  EXPECT_THAT(decoded.cmdline, Eq("cat \"quoted\""));
+  EXPECT_THAT(decoded.frames, ElementsAre(0x1000, 0x2000));
+  EXPECT_THAT(decoded.symbols, ElementsAre("main", "(unknown)"));
+  EXPECT_THAT(decoded.occurrences, Eq(1));
+
+  for (size_t len = 0; len < encoded.size(); len++) {
+    EXPECT_THAT(DecodeBinaryRecord(absl::string_view(encoded).substr(0, len),
+                                   &decoded),
+                Not(IsOk()))
+        << len;
+  }
+}
+
+TEST_F(ReportSinkTest, EncodesUnsafeElement) {
+  ViolationRecord unsafe = record_;
+  unsafe.reason = UnsafeReason::kStickyEntryOwner;
+  unsafe.unsafe_path_index = 1;
+  unsafe.component_index = 2;
+  unsafe.component = "a\nb";
+  unsafe.directory_dev = 8;
+  unsafe.directory_ino = 1234;
+  EXPECT_THAT(EncodeJsonLine(unsafe),
+              HasSubstr("],\"unsafe\":{\"path\":1,\"component_index\":2,"
+                        "\"component\":\"a\\nb\",\"reason\":"
+                        "\"sticky_entry_owner\",\"directory\":{\"dev\":8,"
+                        "\"ino\":1234}},\"uid\":"));
+  EXPECT_THAT(EncodeJsonLine(record_), Not(HasSubstr("unsafe")));
+
+  DecodedViolationRecord decoded;
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      size_t size, DecodeBinaryRecord(EncodeBinaryRecord(unsafe), &decoded));
+  EXPECT_THAT(size, Eq(EncodeBinaryRecord(unsafe).size()));
+  EXPECT_THAT(decoded.reason, Eq(UnsafeReason::kStickyEntryOwner));
+  EXPECT_THAT(decoded.unsafe_path_index, Eq(1));
+  EXPECT_THAT(decoded.component_index, Eq(2));
+  EXPECT_THAT(decoded.component, Eq("a\nb"));
+  EXPECT_THAT(decoded.directory_dev, Eq(8));
+  EXPECT_THAT(decoded.directory_ino, Eq(1234));
+  EXPECT_THAT(decoded.path_args, ElementsAre("/tmp/a\nb"));
+}
+
+TEST_F(ReportSinkTest, BatchWriterWritesOnFlush) {
+  int fds[2];
+  ASSERT_THAT(pipe2(fds, O_NONBLOCK), Eq(0));
+  BatchWriter writer(fds[1]);
+  writer.Append("first ");
+  writer.Append("second");
+  EXPECT_THAT(writer.pending_bytes(), Eq(12));
+  char buf[16];
+  EXPECT_THAT(read(fds[0], buf, sizeof(buf)), Eq(-1));
+  EXPECT_TRUE(writer.Flush());
+  EXPECT_THAT(writer.pending_bytes(), Eq(0));
+  EXPECT_THAT(read(fds[0], buf, sizeof(buf)), Eq(12));
+  EXPECT_THAT(std::string(buf, 12), Eq("first second"));
+
+  // Doesn't raise SIGPIPE.
+  close(fds[0]);
+  writer.Append("lost");
+  EXPECT_FALSE(writer.Flush());
+  close(fds[1]);
+}
+
+TEST_F(ReportSinkTest, JsonLinesToFd) {
+  int fds[2];
+  ASSERT_THAT(pipe(fds), Eq(0));
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ReportSink> sink,
+      OpenReportSink(absl::StrCat("json:fd:", fds[1])));
+  sink->Write(record_);
+  sink->Dropped(3);
+  sink->Flush();
+  sink.reset();
+  close(fds[1]);
+  EXPECT_THAT(ReadAll(fds[0]),
+              Eq(absl::StrCat(EncodeJsonLine(record_), "{\"dropped\":3}\n")));
+  close(fds[0]);
+}
+
+TEST_F(ReportSinkTest, BinaryStreamToSocket) {
+  char dir_template[] = "/tmp/report_sink_test.XXXXXX";
+  ASSERT_THAT(mkdtemp(dir_template), Ne(nullptr));
+  std::string path = absl::StrCat(dir_template, "/collector");
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_THAT(listener, Ne(-1));
+  struct sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path.c_str());
+  ASSERT_THAT(
+      bind(listener, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)),
+      Eq(0));
+  ASSERT_THAT(listen(listener, 1), Eq(0));
+
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ReportSink> sink,
+      OpenReportSink(absl::StrCat("binary:", path)));
+  sink->Write(record_);
+  sink->Write(record_);
+  sink->Flush();
+  int conn = accept(listener, nullptr, nullptr);
+  ASSERT_THAT(conn, Ne(-1));
+  sink.reset();
+  std::string stream = ReadAll(conn);
+
+  ViolationStreamHeader header;
+  ASSERT_THAT(stream.size(), testing::Ge(sizeof(header)));
+  memcpy(&header, stream.data(), sizeof(header));
+  EXPECT_THAT(header.magic, Eq(kViolationStreamMagic));
+  EXPECT_THAT(header.version, Eq(kViolationStreamVersion));
+  absl::string_view records = absl::string_view(stream).substr(sizeof(header));
+  std::vector<std::string> functions;
+  while (!records.empty()) {
+    DecodedViolationRecord decoded;
+    PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+        size_t size, DecodeBinaryRecord(records, &decoded));
+    functions.push_back(decoded.function_name);
+    records.remove_prefix(size);
+  }
+  EXPECT_THAT(functions, ElementsAre("open", "open"));
+
+  close(conn);
+  close(listener);
+  unlink(path.c_str());
+  rmdir(dir_template);
+}
+
+TEST_F(ReportSinkTest, ParsesSinkLists) {
+  std::vector<absl::Status> errors;
+  std::vector<std::unique_ptr<ReportSink>> sinks = OpenReportSinks(
+      "syslog,json:fd:1,binary:fd:2,xml:/tmp/x,json:,json:fd:x", &errors);
+  EXPECT_THAT(sinks.size(), Eq(3));
+  EXPECT_THAT(errors.size(), Eq(3));
+  EXPECT_THAT(OpenReportSink("json:/nonexistent/dir/file"), Not(IsOk()));
+  EXPECT_THAT(OpenReportSink("syslog:x"), Not(IsOk()));
+  EXPECT_THAT(std::string(errors[0].message()), StartsWith("invalid"));
+}
+
+TEST_F(ReportSinkTest, RejectsRedirectableReportFiles) {
+  char dir_template[] = "/tmp/report_sink_test.XXXXXX";
+  ASSERT_THAT(mkdtemp(dir_template), Ne(nullptr));
+  std::string dir = dir_template;
+  std::string file = dir + "/reports.ndjson";
+  std::string link = dir + "/link";
+  std::string open_dir = dir + "/open";
+  ASSERT_THAT(symlink(file.c_str(), link.c_str()), Eq(0));
+  ASSERT_THAT(mkdir(open_dir.c_str(), 0777), Eq(0));
+  ASSERT_THAT(chmod(open_dir.c_str(), 0777), Eq(0));
+
+  EXPECT_THAT(OpenReportSink(absl::StrCat("json:", file)), IsOk());
+  EXPECT_THAT(OpenReportSink(absl::StrCat("json:", link)), Not(IsOk()));
+  EXPECT_THAT(OpenReportSink(absl::StrCat("json:", open_dir, "/x")),
+              Not(IsOk()));
+  ASSERT_THAT(chmod(file.c_str(), 0622), Eq(0));
+  EXPECT_THAT(OpenReportSink(absl::StrCat("json:", file)), Not(IsOk()));
+
+  rmdir(open_dir.c_str());
+  unlink(link.c_str());
+  unlink(file.c_str());
+  rmdir(dir.c_str());
+}
+
+TEST_F(ReportSinkTest, RejectsRedirectableReportSockets) {
+  char dir_template[] = "/tmp/report_sink_test.XXXXXX";
+  ASSERT_THAT(mkdtemp(dir_template), Ne(nullptr));
+  std::string dir = dir_template;
+  std::string path = dir + "/collector";
+  std::string link = dir + "/link";
+  std::string open_dir = dir + "/open";
+  ASSERT_THAT(symlink("open/collector", link.c_str()), Eq(0));
+  ASSERT_THAT(mkdir(open_dir.c_str(), 0777), Eq(0));
+  ASSERT_THAT(chmod(open_dir.c_str(), 0777), Eq(0));
+
+  EXPECT_THAT(OpenReportSink(absl::StrCat("binary:", path)), IsOk());
+  EXPECT_THAT(OpenReportSink(absl::StrCat("binary:", link)), Not(IsOk()));
+  EXPECT_THAT(OpenReportSink(absl::StrCat("binary:", open_dir, "/collector")),
+              Not(IsOk()));
+
+  // A collector run by another user doesn't get the records.
+  if (geteuid() == 0) {
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_THAT(listener, Ne(-1));
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    ASSERT_THAT(bind(listener, reinterpret_cast<struct sockaddr *>(&addr),
+                     sizeof(addr)),
+                Eq(0));
+    // The peer credentials are taken when listening.
+    ASSERT_THAT(seteuid(65534), Eq(0));
+    ASSERT_THAT(listen(listener, 1), Eq(0));
+    ASSERT_THAT(seteuid(0), Eq(0));
+
+    PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+        std::unique_ptr<ReportSink> sink,
+        OpenReportSink(absl::StrCat("binary:", path)));
+    sink->Write(record_);
+    sink->Flush();
+    sink.reset();
+    int conn = accept(listener, nullptr, nullptr);
+    ASSERT_THAT(conn, Ne(-1));
+    EXPECT_THAT(ReadAll(conn), Eq(""));
+    close(conn);
+    close(listener);
+    unlink(path.c_str());
+  }
+
+  rmdir(open_dir.c_str());
+  unlink(link.c_str());
+  rmdir(dir.c_str());
+}
+
+}  // namespace
+}  // namespace pathauditor
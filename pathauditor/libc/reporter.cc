@@ -0,0 +1,192 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/libc/reporter.h"
+
+#include <linux/futex.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "absl/debugging/stacktrace.h"
+#include "absl/types/span.h"
+#include "pathauditor/libc/reentrancy_guard.h"
+
+namespace pathauditor {
+
+namespace {
+
+// The instance that the fork handlers operate on.
+std::atomic<AsyncReporter *> fork_handler_reporter = {nullptr};
+
+void FutexWait(std::atomic<uint32_t> *word, uint32_t value) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT_PRIVATE,
+          value, nullptr, nullptr, 0);
+}
+
+void FutexWake(std::atomic<uint32_t> *word) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE_PRIVATE, 1,
+          nullptr, nullptr, 0);
+}
+
+}  // namespace
+
+bool AsyncReporter::Report(const FileEventView &event,
+                           const char *function_name, int skip_frames,
+                           const PathAuditResult *result) {
+  void *frames[InsecureAccessReport::kMaxStackFrames];
+  int frame_count = absl::GetStackTrace(
+      frames, InsecureAccessReport::kMaxStackFrames, skip_frames + 1);
+
+  uint64_t occurrences = dedup_.Record(ViolationDedupTable::Key(
+      absl::MakeConstSpan(frames, frame_count), event.syscall_nr,
+      event.path_args));
+  if (!ViolationDedupTable::ShouldReport(occurrences)) {
+    return true;
+  }
+
+  bool queued = queue_.TryPush([&](InsecureAccessReport &report) {
+    report.function_name = function_name;
+    report.syscall_nr = event.syscall_nr;
+    report.uid = syscall(SYS_getuid);
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    report.timestamp_ns =
+        static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    report.arg_count =
+        std::min(event.args.size(), InsecureAccessReport::kMaxArgs);
+    std::copy_n(event.args.begin(), report.arg_count, report.args);
+    report.path_arg_count =
+        std::min(event.path_args.size(), InsecureAccessReport::kMaxPathArgs);
+    for (size_t i = 0; i < report.path_arg_count; i++) {
+      size_t len = event.path_args[i].copy(report.path_args[i],
+                                           sizeof(report.path_args[i]) - 1);
+      report.path_args[i][len] = 0;
+    }
+    report.frame_count = frame_count;
+    std::copy_n(frames, frame_count, report.frames);
+    report.occurrences = occurrences;
+    if (result != nullptr && result->user_controlled) {
+      report.reason = result->reason;
+      report.unsafe_path_index = result->path_index;
+      report.component_index = result->component_index;
+      size_t len = result->component.copy(report.component,
+                                          sizeof(report.component) - 1);
+      report.component[len] = 0;
+      report.directory_dev = result->directory_dev;
+      report.directory_ino = result->directory_ino;
+    } else {
+      report.reason = UnsafeReason::kNone;
+    }
+  });
+  if (!queued) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  if (!thread_started_.exchange(true, std::memory_order_acq_rel)) {
+    StartThread();
+  }
+  if (pending_.exchange(1, std::memory_order_release) == 0) {
+    FutexWake(&pending_);
+  }
+  return queued;
+}
+
+void AsyncReporter::Flush() { Drain(); }
+
+void AsyncReporter::Drain() {
+  // The sinks make libc calls of their own, and so does absl::Mutex.
+  ReentrancyGuard guard;
+  absl::MutexLock lock(&mu_);
+  bool delivered = false;
+  while (queue_.TryPop(sink_)) {
+    delivered = true;
+  }
+  uint64_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+  if (dropped) {
+    drop_sink_(dropped);
+    delivered = true;
+  }
+  if (delivered && flush_sink_) {
+    flush_sink_();
+  }
+}
+
+void AsyncReporter::StartThread() {
+  AsyncReporter *expected = nullptr;
+  if (fork_handler_reporter.compare_exchange_strong(expected, this)) {
+    pthread_atfork(&AsyncReporter::BeforeFork,
+                   &AsyncReporter::AfterForkInParent,
+                   &AsyncReporter::AfterForkInChild);
+  }
+
+  pthread_t thread;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  // The signals are meant for the application, not for us.
+  sigset_t all_signals, old_signals;
+  sigfillset(&all_signals);
+  pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+  int ret = pthread_create(&thread, &attr, &AsyncReporter::ThreadMain, this);
+  pthread_sigmask(SIG_SETMASK, &old_signals, nullptr);
+  pthread_attr_destroy(&attr);
+  if (ret != 0) {
+    // Try again on the next report and deliver this one synchronously.
+    thread_started_.store(false, std::memory_order_release);
+    Drain();
+  }
+}
+
+void *AsyncReporter::ThreadMain(void *arg) {
+  AsyncReporter *reporter = static_cast<AsyncReporter *>(arg);
+  // Nothing this thread does is the application's.
+  sanitizing = true;
+  while (true) {
+    // Clear the flag before draining. A report that comes in afterwards sets it
+    // again, so the wait below won't miss it.
+    reporter->pending_.store(0, std::memory_order_relaxed);
+    reporter->Drain();
+    FutexWait(&reporter->pending_, 0);
+  }
+  return nullptr;
+}
+
+void AsyncReporter::BeforeFork() {
+  AsyncReporter *reporter = fork_handler_reporter.load();
+  ReentrancyGuard guard;
+  reporter->mu_.Lock();
+}
+
+void AsyncReporter::AfterForkInParent() {
+  AsyncReporter *reporter = fork_handler_reporter.load();
+  reporter->mu_.Unlock();
+}
+
+void AsyncReporter::AfterForkInChild() {
+  // The reporter thread doesn't exist in the child. Other threads might have
+  // been in the middle of queueing a report, so start from scratch.
+  AsyncReporter *reporter = fork_handler_reporter.load();
+  reporter->queue_.Reset();
+  reporter->pending_.store(0, std::memory_order_relaxed);
+  reporter->thread_started_.store(false, std::memory_order_relaxed);
+  reporter->mu_.Unlock();
+}
+
+}  // namespace pathauditor
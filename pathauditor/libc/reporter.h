@@ -0,0 +1,132 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_LIBC_REPORTER_H_
+#define PATHAUDITOR_LIBC_REPORTER_H_
+
+#include <limits.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "pathauditor/file_event.h"
+#include "pathauditor/libc/violation_dedup.h"
+#include "pathauditor/path_audit_result.h"
+#include "pathauditor/util/mpsc_queue.h"
+
+namespace pathauditor {
+
+// The raw data of an insecure access as captured in the audited call. It's
+// formatted and symbolized later by the reporter thread.
+struct InsecureAccessReport {
+  static constexpr size_t kMaxArgs = 6;
+  static constexpr size_t kMaxPathArgs = 2;
+  static constexpr size_t kMaxStackFrames = 20;
+
+  const char *function_name;
+  int syscall_nr;
+  uid_t uid;
+  // CLOCK_REALTIME of the call.
+  uint64_t timestamp_ns;
+  size_t arg_count;
+  uint64_t args[kMaxArgs];
+  size_t path_arg_count;
+  char path_args[kMaxPathArgs][PATH_MAX];
+  int frame_count;
+  void *frames[kMaxStackFrames];
+  // How often this violation has been seen so far. 1 for the first
+  // occurrence, 0 if it couldn't be tracked.
+  uint64_t occurrences;
+  // The element that made the access insecure, see PathAuditResult. kNone if
+  // the caller didn't say.
+  UnsafeReason reason;
+  size_t unsafe_path_index;
+  size_t component_index;
+  char component[NAME_MAX + 1];
+  dev_t directory_dev;
+  ino_t directory_ino;
+};
+
+// Moves reporting off the hot path. Report() copies the event into a lock-free
+// ring buffer and returns. A background thread, started on the first report,
+// drains the buffer in batches and passes the reports to the sink, then calls
+// the flush sink once per batch.
+// If the buffer is full, the report is dropped and counted instead.
+// Repeated violations from the same call stack with the same paths are only
+// passed on the first time and then every time their count reaches a power of
+// two, see ViolationDedupTable.
+// There should only be one instance per process since it registers fork
+// handlers.
+class AsyncReporter {
+ public:
+  using Sink = void (*)(const InsecureAccessReport &report);
+  // Called with the number of reports that were dropped since the last call.
+  using DropSink = void (*)(uint64_t dropped);
+  // Called after a batch, e.g. to write out buffered reports.
+  using FlushSink = void (*)();
+
+  constexpr AsyncReporter(Sink sink, DropSink drop_sink,
+                          FlushSink flush_sink = nullptr)
+      : sink_(sink),
+        drop_sink_(drop_sink),
+        flush_sink_(flush_sink),
+        mu_(absl::kConstInit) {}
+
+  AsyncReporter(const AsyncReporter &) = delete;
+  AsyncReporter &operator=(const AsyncReporter &) = delete;
+
+  // Records the event, the current stack trace and, if given, the result of
+  // the audit. skip_frames is the number of frames to leave out of the stack
+  // trace, not counting Report itself.
+  // Returns false if the report had to be dropped, suppressed duplicates don't
+  // count as dropped.
+  bool Report(const FileEventView &event, const char *function_name,
+              int skip_frames, const PathAuditResult *result = nullptr);
+
+  // Passes all queued reports to the sink on the calling thread, e.g. before
+  // exec or exit.
+  void Flush();
+
+ private:
+  static constexpr size_t kQueueSize = 64;
+
+  static void *ThreadMain(void *arg);
+  static void BeforeFork();
+  static void AfterForkInParent();
+  static void AfterForkInChild();
+
+  void StartThread();
+  void Drain() ABSL_LOCKS_EXCLUDED(mu_);
+
+  Sink sink_;
+  DropSink drop_sink_;
+  FlushSink flush_sink_;
+  ViolationDedupTable dedup_;
+  BoundedMpscQueue<InsecureAccessReport, kQueueSize> queue_;
+  std::atomic<uint64_t> dropped_{0};
+  // Set by producers when there is new work, used as the futex word the
+  // reporter thread sleeps on.
+  std::atomic<uint32_t> pending_{0};
+  std::atomic<bool> thread_started_{false};
+  // Serializes the consumers, i.e. the reporter thread and Flush().
+  absl::Mutex mu_;
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_LIBC_REPORTER_H_
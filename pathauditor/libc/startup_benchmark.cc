@@ -0,0 +1,144 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the time from spawning a process until its main runs, once as is
+// and once with the path auditor preloaded. Short lived processes like true,
+// ls or the compiler processes of a build mostly pay for the library's
+// startup:
+//
+//   startup_benchmark --library=bazel-bin/pathauditor/libc/libpath_auditor.so
+//
+// The process that's spawned is this binary again, it writes the time its
+// main started to a pipe and exits.
+
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+extern char **environ;
+
+namespace {
+
+constexpr const char kChildFlag[] = "--startup_benchmark_child=";
+constexpr const char kLibraryFlag[] = "--library=";
+
+std::string library = "pathauditor/libc/libpath_auditor.so";
+
+int64_t MonotonicNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// The environment of the children, without an LD_PRELOAD that the benchmark
+// itself might run with.
+std::vector<std::string> ChildEnvironment(bool preload) {
+  std::vector<std::string> env;
+  for (char **var = environ; *var; var++) {
+    if (strncmp(*var, "LD_PRELOAD=", strlen("LD_PRELOAD=")) != 0) {
+      env.emplace_back(*var);
+    }
+  }
+  if (preload) {
+    env.push_back("LD_PRELOAD=" + library);
+  }
+  return env;
+}
+
+std::vector<char *> Pointers(std::vector<std::string> &strings) {
+  std::vector<char *> pointers;
+  for (std::string &s : strings) {
+    pointers.push_back(&s[0]);
+  }
+  pointers.push_back(nullptr);
+  return pointers;
+}
+
+// Arg 0 spawns the child as is, arg 1 with the library preloaded.
+void BM_ExecToMain(benchmark::State &state) {
+  bool preload = state.range(0) != 0;
+  state.SetLabel(preload ? "preloaded" : "native");
+  if (preload && access(library.c_str(), R_OK) != 0) {
+    state.SkipWithError("library not found, pass --library");
+    return;
+  }
+
+  std::vector<std::string> env_strings = ChildEnvironment(preload);
+  std::vector<char *> env = Pointers(env_strings);
+
+  int pipe_fds[2];
+  if (pipe(pipe_fds) == -1) {
+    state.SkipWithError("pipe failed");
+    return;
+  }
+  std::vector<std::string> argv_strings = {
+      "startup_benchmark", kChildFlag + std::to_string(pipe_fds[1])};
+  std::vector<char *> argv = Pointers(argv_strings);
+
+  for (auto _ : state) {
+    int64_t start = MonotonicNanos();
+    pid_t pid;
+    if (posix_spawn(&pid, "/proc/self/exe", nullptr, nullptr, argv.data(),
+                    env.data()) != 0) {
+      state.SkipWithError("posix_spawn failed");
+      break;
+    }
+    int64_t main_start;
+    bool ok = read(pipe_fds[0], &main_start, sizeof(main_start)) ==
+              sizeof(main_start);
+    int status;
+    waitpid(pid, &status, 0);
+    if (!ok) {
+      state.SkipWithError("child didn't report");
+      break;
+    }
+    state.SetIterationTime((main_start - start) / 1e9);
+  }
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+}
+BENCHMARK(BM_ExecToMain)->Arg(0)->Arg(1)->UseManualTime();
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  // Report as early as possible, CLOCK_MONOTONIC is the same in the parent.
+  if (argc == 2 && strncmp(argv[1], kChildFlag, strlen(kChildFlag)) == 0) {
+    int64_t now = MonotonicNanos();
+    int fd = atoi(argv[1] + strlen(kChildFlag));
+    _exit(write(fd, &now, sizeof(now)) == sizeof(now) ? 0 : 1);
+  }
+
+  benchmark::Initialize(&argc, argv);
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], kLibraryFlag, strlen(kLibraryFlag)) == 0) {
+      library = argv[i] + strlen(kLibraryFlag);
+    } else {
+      fprintf(stderr, "unknown flag %s\n", argv[i]);
+      return 1;
+    }
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
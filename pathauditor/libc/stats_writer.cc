@@ -0,0 +1,248 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/libc/stats_writer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "absl/base/optimization.h"
+
+namespace pathauditor {
+
+namespace {
+
+// The instance that the fork handler and the thread exit handler operate on.
+std::atomic<StatsWriter *> handler_writer = {nullptr};
+
+uint64_t ClockNs(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+}  // namespace
+
+void HookStats::CountError(absl::StatusCode code) const {
+  if (counters_ == nullptr) {
+    return;
+  }
+  Add(&counters_->errors, 1);
+  size_t index = static_cast<size_t>(code);
+  if (index >= kStatsStatusCodes) {
+    index = static_cast<size_t>(absl::StatusCode::kUnknown);
+  }
+  Add(&thread_->errors_by_code[index], 1);
+}
+
+uint64_t HookStats::Now() const {
+  return counters_ == nullptr ? 0 : ClockNs(CLOCK_MONOTONIC);
+}
+
+void HookStats::RecordLatency(uint64_t start_ns) const {
+  if (counters_ == nullptr) {
+    return;
+  }
+  uint64_t ns = ClockNs(CLOCK_MONOTONIC) - start_ns;
+  Add(&counters_->latency_sum_ns, ns);
+  Add(&counters_->latency[LatencyBucket(ns)], 1);
+  uint64_t max = counters_->latency_max_ns.load(std::memory_order_relaxed);
+  while (ns > max && !counters_->latency_max_ns.compare_exchange_weak(
+                         max, ns, std::memory_order_relaxed)) {
+  }
+}
+
+ABSL_CONST_INIT thread_local StatsWriter::ThreadSlot StatsWriter::thread_slot_ =
+    {nullptr, false, 0};
+
+void StatsWriter::Enable(const char *stats_dir) {
+  absl::MutexLock lock(&mu_);
+  snprintf(stats_dir_, sizeof(stats_dir_), "%s", stats_dir);
+  StatsWriter *expected = nullptr;
+  if (!handler_writer.compare_exchange_strong(expected, this)) {
+    return;
+  }
+  if (pthread_key_create(&slot_key_, &StatsWriter::ReleaseSlot) != 0) {
+    return;
+  }
+  pthread_atfork(&StatsWriter::BeforeFork, &StatsWriter::AfterForkInParent,
+                 &StatsWriter::AfterForkInChild);
+  enabled_.store(true, std::memory_order_release);
+}
+
+void StatsWriter::BeforeFork() { handler_writer.load()->mu_.Lock(); }
+
+void StatsWriter::AfterForkInParent() { handler_writer.load()->mu_.Unlock(); }
+
+void StatsWriter::AfterForkInChild() {
+  // The page is mapped with MADV_DONTFORK, so it's gone in the child. The
+  // child creates its own page on the next call, the generation tells the
+  // forking thread that its slot is gone.
+  StatsWriter *writer = handler_writer.load();
+  writer->page_.store(nullptr, std::memory_order_relaxed);
+  writer->failed_.store(false, std::memory_order_relaxed);
+  writer->generation_.fetch_add(1, std::memory_order_release);
+  writer->mu_.Unlock();
+}
+
+void StatsWriter::ReleaseSlot(void *thread_slot) {
+  ThreadSlot *slot = static_cast<ThreadSlot *>(thread_slot);
+  StatsWriter *writer = handler_writer.load();
+  if (slot->generation == writer->generation_.load(std::memory_order_acquire) &&
+      !slot->shared) {
+    slot->stats->owner.store(0, std::memory_order_release);
+  }
+  slot->stats = nullptr;
+  slot->generation = 0;
+}
+
+HookStats StatsWriter::ForHook(const char *name,
+                               std::atomic<uint32_t> *index) {
+  ThreadSlot *slot = SlotForCurrentThread();
+  if (slot == nullptr) {
+    return HookStats();
+  }
+  uint32_t i = index->load(std::memory_order_acquire);
+  if (ABSL_PREDICT_FALSE(i == 0)) {
+    i = RegisterHook(name, index);
+    if (i == 0) {
+      return HookStats();
+    }
+  }
+  return HookStats(slot->stats, &slot->stats->hooks[i - 1], slot->shared);
+}
+
+StatsWriter::ThreadSlot *StatsWriter::SlotForCurrentThread() {
+  ThreadSlot *slot = &thread_slot_;
+  uint64_t generation = generation_.load(std::memory_order_acquire);
+  if (ABSL_PREDICT_TRUE(slot->generation == generation)) {
+    return slot;
+  }
+  char *page = GetOrCreatePage();
+  if (page == nullptr) {
+    return nullptr;
+  }
+  ThreadStats *slots = StatsPageSlots(page);
+  int32_t tid = syscall(SYS_gettid);
+  slot->stats = &slots[0];
+  slot->shared = true;
+  for (size_t i = 1; i < kStatsThreadSlots; i++) {
+    int32_t expected = 0;
+    if (slots[i].owner.compare_exchange_strong(expected, tid,
+                                               std::memory_order_acq_rel)) {
+      slot->stats = &slots[i];
+      slot->shared = false;
+      break;
+    }
+  }
+  slot->generation = generation;
+  if (!slot->shared) {
+    pthread_setspecific(slot_key_, slot);
+  }
+  return slot;
+}
+
+uint32_t StatsWriter::RegisterHook(const char *name,
+                                   std::atomic<uint32_t> *index) {
+  absl::MutexLock lock(&mu_);
+  uint32_t i = index->load(std::memory_order_relaxed);
+  if (i != 0) {
+    return i;
+  }
+  if (hook_count_ == kStatsMaxHooks) {
+    return 0;
+  }
+  hook_names_[hook_count_] = name;
+  char *page = page_.load(std::memory_order_relaxed);
+  if (page != nullptr) {
+    auto *header = reinterpret_cast<StatsPageHeader *>(page);
+    snprintf(header->hook_names[hook_count_], kStatsHookNameSize, "%s", name);
+    header->hook_count.store(hook_count_ + 1, std::memory_order_release);
+  }
+  i = ++hook_count_;
+  index->store(i, std::memory_order_release);
+  return i;
+}
+
+char *StatsWriter::GetOrCreatePage() {
+  char *page = page_.load(std::memory_order_acquire);
+  if (ABSL_PREDICT_TRUE(page != nullptr)) {
+    return page;
+  }
+  if (failed_.load(std::memory_order_relaxed)) {
+    return nullptr;
+  }
+  absl::MutexLock lock(&mu_);
+  page = page_.load(std::memory_order_relaxed);
+  if (page == nullptr && !failed_.load(std::memory_order_relaxed)) {
+    page = CreatePage();
+    if (page == nullptr) {
+      failed_.store(true, std::memory_order_relaxed);
+    }
+    page_.store(page, std::memory_order_release);
+  }
+  return page;
+}
+
+char *StatsWriter::CreatePage() {
+  int32_t pid = syscall(SYS_getpid);
+  uint64_t start_time_ns = ClockNs(CLOCK_REALTIME);
+  char path[PATH_MAX];
+  if (snprintf(path, sizeof(path), "%s/%d.%llu.pastats", stats_dir_, pid,
+               static_cast<unsigned long long>(start_time_ns)) >=
+      static_cast<int>(sizeof(path))) {
+    return nullptr;
+  }
+  // Raw syscalls throughout, we don't want to audit ourselves.
+  int fd = syscall(SYS_open, path,
+                   O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    return nullptr;
+  }
+  // The file is sparse, a thread only touches the pages of the hooks it calls.
+  void *mem = MAP_FAILED;
+  if (ftruncate(fd, kStatsPageSize) == 0) {
+    mem = mmap(nullptr, kStatsPageSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+               0);
+  }
+  close(fd);
+  if (mem == MAP_FAILED) {
+    return nullptr;
+  }
+  madvise(mem, kStatsPageSize, MADV_DONTFORK);
+
+  auto *header = static_cast<StatsPageHeader *>(mem);
+  header->magic = kStatsPageMagic;
+  header->version = kStatsPageVersion;
+  header->pid = pid;
+  header->thread_slots = kStatsThreadSlots;
+  header->start_time_ns = start_time_ns;
+  ssize_t len = syscall(SYS_readlink, "/proc/self/exe", header->exe,
+                        sizeof(header->exe) - 1);
+  header->exe[std::max<ssize_t>(len, 0)] = '\0';
+  for (uint32_t i = 0; i < hook_count_; i++) {
+    snprintf(header->hook_names[i], kStatsHookNameSize, "%s", hook_names_[i]);
+  }
+  header->hook_count.store(hook_count_, std::memory_order_release);
+  return static_cast<char *>(mem);
+}
+
+}  // namespace pathauditor
@@ -0,0 +1,133 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_LIBC_STATS_WRITER_H_
+#define PATHAUDITOR_LIBC_STATS_WRITER_H_
+
+#include <limits.h>
+#include <pthread.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "pathauditor/stats_page.h"
+
+namespace pathauditor {
+
+// The counters of one hook on the calling thread. Does nothing if stats are
+// disabled.
+class HookStats {
+ public:
+  constexpr HookStats() = default;
+
+  bool active() const { return counters_ != nullptr; }
+
+  void Count(StatsCounter HookCounters::*counter, uint64_t n = 1) const {
+    if (counters_ != nullptr) {
+      Add(&(counters_->*counter), n);
+    }
+  }
+  void CountError(absl::StatusCode code) const;
+
+  // A monotonic timestamp for RecordLatency, 0 if inactive.
+  uint64_t Now() const;
+  // Records the time since start_ns.
+  void RecordLatency(uint64_t start_ns) const;
+
+ private:
+  friend class StatsWriter;
+
+  HookStats(ThreadStats *thread, HookCounters *counters, bool shared)
+      : thread_(thread), counters_(counters), shared_(shared) {}
+
+  void Add(StatsCounter *counter, uint64_t n) const {
+    if (shared_) {
+      counter->fetch_add(n, std::memory_order_relaxed);
+    } else {
+      // We're the only writer.
+      counter->store(counter->load(std::memory_order_relaxed) + n,
+                     std::memory_order_relaxed);
+    }
+  }
+
+  ThreadStats *thread_ = nullptr;
+  HookCounters *counters_ = nullptr;
+  bool shared_ = false;
+};
+
+// Keeps a stats page, see stats_page.h, named <pid>.<start time in ns>.pastats
+// in a directory. The page is created on the first call, and again in the
+// child after a fork. After exec the new image starts a new page, the old one
+// keeps the final counts of the old image. If creating the page fails, stats
+// stay disabled for the rest of the process.
+// There should only be one instance per process since it registers fork
+// handlers.
+class StatsWriter {
+ public:
+  constexpr StatsWriter() : mu_(absl::kConstInit) {}
+
+  StatsWriter(const StatsWriter &) = delete;
+  StatsWriter &operator=(const StatsWriter &) = delete;
+
+  // Call this once at startup, before any stats are recorded.
+  void Enable(const char *stats_dir);
+  bool enabled() const { return enabled_.load(std::memory_order_acquire); }
+
+  // The counters of a hook on the calling thread. index is where the hook
+  // keeps its index on the page plus one, it's 0 until the first call.
+  HookStats ForHook(const char *name, std::atomic<uint32_t> *index);
+
+ private:
+  // What a thread knows about its slot.
+  struct ThreadSlot {
+    ThreadStats *stats;
+    bool shared;
+    // The page generation the slot belongs to.
+    uint64_t generation;
+  };
+
+  static void BeforeFork();
+  static void AfterForkInParent();
+  static void AfterForkInChild();
+  static void ReleaseSlot(void *thread_slot);
+
+  char *GetOrCreatePage();
+  char *CreatePage() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  ThreadSlot *SlotForCurrentThread();
+  uint32_t RegisterHook(const char *name, std::atomic<uint32_t> *index);
+
+  static thread_local ThreadSlot thread_slot_;
+
+  std::atomic<bool> enabled_{false};
+  std::atomic<char *> page_{nullptr};
+  // Bumped whenever the page is replaced, i.e. in the child after a fork.
+  std::atomic<uint64_t> generation_{1};
+  // Set if creating the page failed, so that we don't retry on every call.
+  std::atomic<bool> failed_{false};
+  pthread_key_t slot_key_ = 0;
+  absl::Mutex mu_;
+  // The hook names are kept to write them to the page in the child after a
+  // fork, the indices carry over.
+  const char *hook_names_[kStatsMaxHooks] ABSL_GUARDED_BY(mu_) = {};
+  uint32_t hook_count_ ABSL_GUARDED_BY(mu_) = 0;
+  char stats_dir_[PATH_MAX] = {};
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_LIBC_STATS_WRITER_H_
@@ -0,0 +1,584 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs many threads that create, rename and unlink files at the same time, as
+// is and with the path auditor preloaded, to see how the hooks scale:
+//
+//   stress_benchmark --library=bazel-bin/pathauditor/libc/libpath_auditor.so
+//
+// Every run spawns this binary again with the given number of threads. Each
+// thread calls open(O_CREAT), rename and unlink in a loop, either in a tree of
+// its own, in a tree shared by all threads, or in a shared tree below a world
+// writable directory, where every call is reported. The child measures every
+// call and sends the latency quantiles back through a pipe.
+//
+// The counters are:
+//   calls_per_s              all threads together
+//   scaling                  calls_per_s relative to a single thread
+//   p50_ns, p99_ns, p999_ns  latency of a call
+//   p50_overhead_ns, ...     the same minus the latency without the library
+// and for the preloaded runs, from the stats page and the report sink of the
+// child:
+//   audits, fs_calls_per_audit
+//   verdict_cache_hit_rate, verdict_cache_misses_per_thread: the verdict
+//       caches are per thread, every thread has to fill its own
+//   audit_p99_ns             time spent in the auditor, as the library sees it
+//   reports, dropped_reports what reached the sink and what the reporter had
+//       to drop because its queue was full
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "pathauditor/stats_page.h"
+
+extern char **environ;
+
+namespace {
+
+constexpr const char kChildFlag[] = "--stress_benchmark_child=";
+constexpr const char kLibraryFlag[] = "--library=";
+constexpr const char kCyclesFlag[] = "--cycles=";
+constexpr const char kSharedVerdictCacheFlag[] = "--shared_verdict_cache=";
+
+std::string library = "pathauditor/libc/libpath_auditor.so";
+// open, rename and unlink calls per thread and run.
+int cycles = 200;
+std::string shared_verdict_cache;
+
+enum Tree : int {
+  // Every thread in a directory of its own.
+  kPrivateTree = 0,
+  // All threads in the same directory.
+  kSharedTree = 1,
+  // All threads in the same directory below a world writable one.
+  kInsecureTree = 2,
+};
+
+const char *TreeName(int tree) {
+  switch (tree) {
+    case kPrivateTree:
+      return "private";
+    case kSharedTree:
+      return "shared";
+    case kInsecureTree:
+      return "insecure";
+  }
+  return "unknown";
+}
+
+// What the child sends back.
+struct ChildResult {
+  int64_t wall_ns;
+  int64_t calls;
+  int64_t errors;
+  int64_t p50_ns;
+  int64_t p99_ns;
+  int64_t p999_ns;
+};
+
+int64_t MonotonicNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// The directory the threads of a tree work in, thread is only used for the
+// private tree.
+std::string TreeDir(const std::string &root, int tree, int thread) {
+  switch (tree) {
+    case kPrivateTree:
+      return root + "/private/t" + std::to_string(thread) + "/d1/d2/d3";
+    case kSharedTree:
+      return root + "/shared/d1/d2/d3";
+    default:
+      return root + "/open/d1/d2/d3";
+  }
+}
+
+bool MakeDirs(const std::string &path, mode_t mode) {
+  for (size_t slash = path.find('/', 1);; slash = path.find('/', slash + 1)) {
+    std::string prefix = path.substr(0, slash);
+    if (mkdir(prefix.c_str(), mode) == -1 && errno != EEXIST) {
+      return false;
+    }
+    if (slash == std::string::npos) {
+      return true;
+    }
+  }
+}
+
+// Child side ----------------------------------------------------------------
+
+struct ThreadResult {
+  std::vector<int64_t> latencies;
+  int64_t errors = 0;
+};
+
+void RunThread(const std::string &dir, int thread, int thread_cycles,
+               std::atomic<int> *ready, const std::atomic<bool> *go,
+               ThreadResult *result) {
+  result->latencies.reserve(3 * thread_cycles);
+  std::string prefix = dir + "/f" + std::to_string(thread) + ".";
+  ready->fetch_add(1);
+  while (!go->load(std::memory_order_acquire)) {
+    std::this_thread::yield();
+  }
+
+  for (int i = 0; i < thread_cycles; i++) {
+    std::string from = prefix + std::to_string(i);
+    std::string to = from + ".renamed";
+
+    int64_t start = MonotonicNanos();
+    int fd = open(from.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int64_t end = MonotonicNanos();
+    result->latencies.push_back(end - start);
+    if (fd == -1) {
+      result->errors++;
+      continue;
+    }
+    close(fd);
+
+    start = MonotonicNanos();
+    int ret = rename(from.c_str(), to.c_str());
+    end = MonotonicNanos();
+    result->latencies.push_back(end - start);
+    if (ret == -1) {
+      result->errors++;
+      unlink(from.c_str());
+      continue;
+    }
+
+    start = MonotonicNanos();
+    ret = unlink(to.c_str());
+    end = MonotonicNanos();
+    result->latencies.push_back(end - start);
+    if (ret == -1) {
+      result->errors++;
+    }
+  }
+}
+
+int64_t Quantile(const std::vector<int64_t> &sorted, double quantile) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t index = std::min(sorted.size() - 1,
+                          static_cast<size_t>(quantile * sorted.size()));
+  return sorted[index];
+}
+
+// Runs in the spawned process, possibly with the library preloaded.
+int ChildMain(const char *spec) {
+  int fd, threads, tree, thread_cycles;
+  char root[PATH_MAX];
+  if (sscanf(spec, "%d,%d,%d,%d,%4095s", &fd, &threads, &tree, &thread_cycles,
+             root) != 5) {
+    return 1;
+  }
+
+  std::vector<std::string> dirs(threads);
+  for (int i = 0; i < threads; i++) {
+    dirs[i] = TreeDir(root, tree, i);
+    if (tree == kPrivateTree && !MakeDirs(dirs[i], 0755)) {
+      return 1;
+    }
+  }
+
+  std::vector<ThreadResult> results(threads);
+  std::vector<std::thread> workers;
+  std::atomic<int> ready{0};
+  std::atomic<bool> go{false};
+  for (int i = 0; i < threads; i++) {
+    workers.emplace_back(RunThread, dirs[i], i, thread_cycles, &ready, &go,
+                         &results[i]);
+  }
+  while (ready.load() != threads) {
+    std::this_thread::yield();
+  }
+  int64_t start = MonotonicNanos();
+  go.store(true, std::memory_order_release);
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  int64_t end = MonotonicNanos();
+
+  std::vector<int64_t> latencies;
+  ChildResult result = {};
+  for (const ThreadResult &thread_result : results) {
+    latencies.insert(latencies.end(), thread_result.latencies.begin(),
+                     thread_result.latencies.end());
+    result.errors += thread_result.errors;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  result.wall_ns = end - start;
+  result.calls = latencies.size();
+  result.p50_ns = Quantile(latencies, 0.5);
+  result.p99_ns = Quantile(latencies, 0.99);
+  result.p999_ns = Quantile(latencies, 0.999);
+  return write(fd, &result, sizeof(result)) == sizeof(result) ? 0 : 1;
+}
+
+// Parent side ---------------------------------------------------------------
+
+// The environment of the children, without an LD_PRELOAD or path auditor
+// settings that the benchmark itself might run with.
+std::vector<std::string> ChildEnvironment(bool preload,
+                                          const std::string &root) {
+  std::vector<std::string> env;
+  for (char **var = environ; *var; var++) {
+    if (strncmp(*var, "LD_PRELOAD=", strlen("LD_PRELOAD=")) != 0 &&
+        strncmp(*var, "PATHAUDITOR_", strlen("PATHAUDITOR_")) != 0) {
+      env.emplace_back(*var);
+    }
+  }
+  if (preload) {
+    env.push_back("LD_PRELOAD=" + library);
+    env.push_back("PATHAUDITOR_STATS_DIR=" + root + "/stats");
+    env.push_back("PATHAUDITOR_REPORT_SINKS=json:" + root + "/reports.ndjson");
+    if (!shared_verdict_cache.empty()) {
+      env.push_back("PATHAUDITOR_SHARED_VERDICT_CACHE=" + shared_verdict_cache);
+    }
+  }
+  return env;
+}
+
+std::vector<char *> Pointers(std::vector<std::string> &strings) {
+  std::vector<char *> pointers;
+  for (std::string &s : strings) {
+    pointers.push_back(&s[0]);
+  }
+  pointers.push_back(nullptr);
+  return pointers;
+}
+
+// The directories the children work in. Created once, root owned trees only
+// stay safe if nobody else can write to them.
+class Trees {
+ public:
+  static Trees &Get() {
+    static Trees *trees = new Trees();
+    return *trees;
+  }
+
+  bool ok() const { return ok_; }
+  const std::string &root() const { return root_; }
+
+  // Removes everything, if the trees were created.
+  static void Remove() {
+    const Trees &trees = Get();
+    if (!trees.root_.empty()) {
+      nftw(trees.root_.c_str(), RemoveEntry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+  }
+
+ private:
+  Trees() {
+    char root_template[] = "/tmp/stress_benchmark.XXXXXX";
+    if (mkdtemp(root_template) == nullptr) {
+      return;
+    }
+    root_ = root_template;
+    ok_ = chmod(root_.c_str(), 0755) == 0 &&
+          MakeDirs(root_ + "/stats", 0755) &&
+          MakeDirs(root_ + "/private", 0755) &&
+          MakeDirs(TreeDir(root_, kSharedTree, 0), 0755) &&
+          MakeDirs(root_ + "/open", 0755) &&
+          chmod((root_ + "/open").c_str(), 0777) == 0 &&
+          MakeDirs(TreeDir(root_, kInsecureTree, 0), 0755);
+  }
+
+  static int RemoveEntry(const char *path, const struct stat *, int,
+                         struct FTW *) {
+    remove(path);
+    return 0;
+  }
+
+  std::string root_;
+  bool ok_ = false;
+};
+
+// Spawns a child and waits for its result.
+bool RunChild(bool preload, int threads, int tree, ChildResult *result,
+              pid_t *child_pid) {
+  const std::string &root = Trees::Get().root();
+  std::vector<std::string> env_strings = ChildEnvironment(preload, root);
+  std::vector<char *> env = Pointers(env_strings);
+
+  int pipe_fds[2];
+  if (pipe(pipe_fds) == -1) {
+    return false;
+  }
+  char spec[PATH_MAX + 64];
+  snprintf(spec, sizeof(spec), "%s%d,%d,%d,%d,%s", kChildFlag, pipe_fds[1],
+           threads, tree, cycles, root.c_str());
+  std::vector<std::string> argv_strings = {"stress_benchmark", spec};
+  std::vector<char *> argv = Pointers(argv_strings);
+
+  pid_t pid;
+  bool ok = posix_spawn(&pid, "/proc/self/exe", nullptr, nullptr, argv.data(),
+                        env.data()) == 0;
+  close(pipe_fds[1]);
+  if (ok) {
+    ok = read(pipe_fds[0], result, sizeof(*result)) == sizeof(*result);
+    int status;
+    waitpid(pid, &status, 0);
+    ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    *child_pid = pid;
+  }
+  close(pipe_fds[0]);
+  return ok;
+}
+
+double CallsPerSecond(const ChildResult &result) {
+  return result.wall_ns > 0 ? result.calls * 1e9 / result.wall_ns : 0;
+}
+
+// The results of earlier runs, so that the baselines are measured only once.
+using RunKey = std::tuple<bool, int, int>;
+
+const ChildResult *Baseline(bool preload, int threads, int tree) {
+  static auto *baselines = new std::map<RunKey, ChildResult>();
+  RunKey key(preload, threads, tree);
+  auto it = baselines->find(key);
+  if (it == baselines->end()) {
+    ChildResult result;
+    pid_t pid;
+    if (!RunChild(preload, threads, tree, &result, &pid)) {
+      return nullptr;
+    }
+    it = baselines->emplace(key, result).first;
+  }
+  return &it->second;
+}
+
+// Reads and removes the stats page of the child.
+bool TakeStatsPage(pid_t pid, pathauditor::StatsPageTotals *totals) {
+  std::string dir_path = Trees::Get().root() + "/stats";
+  std::string prefix = std::to_string(pid) + ".";
+  DIR *dir = opendir(dir_path.c_str());
+  if (dir == nullptr) {
+    return false;
+  }
+  bool found = false;
+  while (struct dirent *entry = readdir(dir)) {
+    if (strncmp(entry->d_name, prefix.c_str(), prefix.size()) != 0) {
+      continue;
+    }
+    std::string path = dir_path + "/" + entry->d_name;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat sb;
+    if (fd != -1 && fstat(fd, &sb) == 0 && sb.st_size > 0) {
+      void *mem = mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (mem != MAP_FAILED) {
+        absl::StatusOr<pathauditor::StatsPageTotals> page =
+            pathauditor::SumStatsPage(absl::Span<const char>(
+                static_cast<const char *>(mem), sb.st_size));
+        if (page.ok()) {
+          *totals = *std::move(page);
+          found = true;
+        }
+        munmap(mem, sb.st_size);
+      }
+    }
+    if (fd != -1) {
+      close(fd);
+    }
+    unlink(path.c_str());
+  }
+  closedir(dir);
+  return found;
+}
+
+// Counts and removes the reports the child wrote.
+void TakeReports(uint64_t *reports, uint64_t *dropped) {
+  std::string path = Trees::Get().root() + "/reports.ndjson";
+  *reports = 0;
+  *dropped = 0;
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == nullptr) {
+    return;
+  }
+  char line[4096];
+  while (fgets(line, sizeof(line), f) != nullptr) {
+    unsigned long long count;
+    if (sscanf(line, "{\"dropped\":%llu}", &count) == 1) {
+      *dropped += count;
+    } else if (strncmp(line, "{\"function\":", strlen("{\"function\":")) ==
+               0) {
+      (*reports)++;
+    }
+  }
+  fclose(f);
+  unlink(path.c_str());
+}
+
+// Args: preloaded (0 or 1), threads, Tree.
+void BM_ConcurrentCalls(benchmark::State &state) {
+  bool preload = state.range(0) != 0;
+  int threads = state.range(1);
+  int tree = state.range(2);
+  state.SetLabel(std::string(preload ? "preloaded" : "native") + "/" +
+                 TreeName(tree));
+  if (preload && access(library.c_str(), R_OK) != 0) {
+    state.SkipWithError("library not found, pass --library");
+    return;
+  }
+  if (!Trees::Get().ok()) {
+    state.SkipWithError("could not create the directory trees");
+    return;
+  }
+  const ChildResult *native = Baseline(false, threads, tree);
+  const ChildResult *single = Baseline(preload, 1, tree);
+  if (native == nullptr || single == nullptr) {
+    state.SkipWithError("baseline run failed");
+    return;
+  }
+
+  ChildResult total = {};
+  std::vector<int64_t> p50, p99, p999;
+  pathauditor::HookTotals stats;
+  uint64_t reports = 0, dropped = 0;
+  for (auto _ : state) {
+    ChildResult result;
+    pid_t pid;
+    if (!RunChild(preload, threads, tree, &result, &pid)) {
+      state.SkipWithError("child failed");
+      break;
+    }
+    state.SetIterationTime(result.wall_ns / 1e9);
+    total.wall_ns += result.wall_ns;
+    total.calls += result.calls;
+    total.errors += result.errors;
+    p50.push_back(result.p50_ns);
+    p99.push_back(result.p99_ns);
+    p999.push_back(result.p999_ns);
+
+    if (preload) {
+      pathauditor::StatsPageTotals page;
+      if (TakeStatsPage(pid, &page)) {
+        for (const pathauditor::HookTotals &hook : page.hooks) {
+          stats.audits += hook.audits;
+          stats.file_system_calls += hook.file_system_calls;
+          stats.verdict_cache_hits += hook.verdict_cache_hits;
+          stats.verdict_cache_misses += hook.verdict_cache_misses;
+          for (size_t i = 0; i < pathauditor::kLatencyBuckets; i++) {
+            stats.latency[i] += hook.latency[i];
+          }
+        }
+      }
+      uint64_t run_reports, run_dropped;
+      TakeReports(&run_reports, &run_dropped);
+      reports += run_reports;
+      dropped += run_dropped;
+    }
+  }
+  if (p50.empty()) {
+    return;
+  }
+
+  // The median over the runs.
+  auto median = [](std::vector<int64_t> values) {
+    std::sort(values.begin(), values.end());
+    return static_cast<double>(values[values.size() / 2]);
+  };
+  double runs = p50.size();
+  double calls_per_s = CallsPerSecond(total);
+  state.counters["calls_per_s"] = calls_per_s;
+  state.counters["scaling"] =
+      CallsPerSecond(*single) > 0 ? calls_per_s / CallsPerSecond(*single) : 0;
+  state.counters["errors"] = total.errors / runs;
+  state.counters["p50_ns"] = median(p50);
+  state.counters["p99_ns"] = median(p99);
+  state.counters["p999_ns"] = median(p999);
+  if (!preload) {
+    return;
+  }
+  state.counters["p50_overhead_ns"] = median(p50) - native->p50_ns;
+  state.counters["p99_overhead_ns"] = median(p99) - native->p99_ns;
+  state.counters["p999_overhead_ns"] = median(p999) - native->p999_ns;
+
+  state.counters["audits"] = stats.audits / runs;
+  if (stats.audits > 0) {
+    state.counters["fs_calls_per_audit"] =
+        static_cast<double>(stats.file_system_calls) / stats.audits;
+    state.counters["audit_p99_ns"] = stats.LatencyQuantile(0.99);
+  }
+  uint64_t lookups = stats.verdict_cache_hits + stats.verdict_cache_misses;
+  if (lookups > 0) {
+    state.counters["verdict_cache_hit_rate"] =
+        static_cast<double>(stats.verdict_cache_hits) / lookups;
+  }
+  state.counters["verdict_cache_misses_per_thread"] =
+      stats.verdict_cache_misses / runs / threads;
+  state.counters["reports"] = reports / runs;
+  state.counters["dropped_reports"] = dropped / runs;
+}
+BENCHMARK(BM_ConcurrentCalls)
+    ->ArgsProduct({{0, 1}, {1, 8, 32, 128},
+                   {kPrivateTree, kSharedTree, kInsecureTree}})
+    ->UseManualTime()
+    ->Iterations(3)
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc == 2 && strncmp(argv[1], kChildFlag, strlen(kChildFlag)) == 0) {
+    return ChildMain(argv[1] + strlen(kChildFlag));
+  }
+
+  benchmark::Initialize(&argc, argv);
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], kLibraryFlag, strlen(kLibraryFlag)) == 0) {
+      library = argv[i] + strlen(kLibraryFlag);
+    } else if (strncmp(argv[i], kCyclesFlag, strlen(kCyclesFlag)) == 0) {
+      cycles = atoi(argv[i] + strlen(kCyclesFlag));
+    } else if (strncmp(argv[i], kSharedVerdictCacheFlag,
+                       strlen(kSharedVerdictCacheFlag)) == 0) {
+      shared_verdict_cache = argv[i] + strlen(kSharedVerdictCacheFlag);
+    } else {
+      fprintf(stderr, "unknown flag %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (cycles <= 0) {
+    fprintf(stderr, "--cycles must be positive\n");
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  Trees::Remove();
+  return 0;
+}
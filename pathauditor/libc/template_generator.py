@@ -61,20 +61,59 @@ def typedef(func):
           f'({", ".join(args(func))});')
 
 
-def dlsym_call(func):
-  """Produce a string with a dlsym call and the original function call."""
+ORIGINAL_FUNCTION_TEMPLATE = """
+template <typename F>
+class OriginalFunction {
+ public:
+  constexpr explicit OriginalFunction(const char *name)
+      : name_(name), fn_(nullptr) {}
+
+  void Resolve() {
+    fn_.store(reinterpret_cast<F>(dlsym(RTLD_NEXT, name_)),
+              std::memory_order_release);
+  }
+
+  F Get() {
+    F fn = fn_.load(std::memory_order_acquire);
+    if (ABSL_PREDICT_FALSE(fn == nullptr)) {
+      Resolve();
+      fn = fn_.load(std::memory_order_acquire);
+    }
+    return fn;
+  }
+
+ private:
+  const char *name_;
+  std::atomic<F> fn_;
+};
+"""
+
+
+def originals_table(func_info):
+  """Produce the table of original function pointers.
+
+  They are resolved on first use, not when the library is loaded.
+  """
+  members = ''.join(
+      f'  OriginalFunction<orig_{func.name}_type> {func.name}{{"{func.name}"}};\n'
+      for func in func_info)
+  return ('struct OriginalFunctions {\n'
+          f'{members}'
+          '};\n\n'
+          'ABSL_CONST_INIT OriginalFunctions originals;\n')
+
+
+def original_call(func):
+  """Produce a string with the call of the original function."""
   fun_args = ', '.join(argname(arg) for arg in func.args)
-  return (f'  orig_{func.name}_type orig_{func.name};\n'
-          f'  orig_{func.name} = reinterpret_cast<orig_{func.name}_type>'
-          f'(dlsym(RTLD_NEXT, \"{func.name}\"));\n'
-          f'  return orig_{func.name}({fun_args});')
+  return f'  return originals.{func.name}.Get()({fun_args});'
 
 
 def signature(func):
   """Produce a string with the function's signature and body."""
   return (f'{func.type}{"*"*func.derefcnt} {func.name}({", ".join(args(func))})'
           ' {\n'
-          f'{dlsym_call(func)}\n'
+          f'{original_call(func)}\n'
           '}')
 
 
@@ -124,6 +163,13 @@ def main():
       'mkdirat',
       'fchmodat',
       'fchownat',
+      'stat',
+      'lstat',
+      'access',
+      'faccessat',
+      'readlink',
+      'opendir',
+      'renameat2',
   ]
 
   func_info = [functions[name] for name in func_names]
@@ -133,11 +179,19 @@ def main():
     f.write('#define _GNU_SOURCE\n'
             '#include <sys/types.h>\n'
             '#include <stdio.h>\n'
-            '#include <dlfcn.h>\n\n')
+            '#include <dlfcn.h>\n\n'
+            '#include <atomic>\n\n'
+            '#include "absl/base/attributes.h"\n'
+            '#include "absl/base/optimization.h"\n\n')
 
     for func in func_info:
       f.write(typedef(func) + '\n')
 
+    f.write('\nnamespace {\n')
+    f.write(ORIGINAL_FUNCTION_TEMPLATE + '\n')
+    f.write(originals_table(func_info))
+    f.write('\n}  // namespace\n')
+
     f.write('\nextern \"C\" {\n')
     for func in func_info:
       f.write(signature(func) + '\n\n')
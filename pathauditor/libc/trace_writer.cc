@@ -0,0 +1,195 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/libc/trace_writer.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "absl/strings/string_view.h"
+
+namespace pathauditor {
+
+namespace {
+
+// The log grows in steps of this size. Every step costs an ftruncate and an
+// mremap.
+constexpr size_t kGrowStep = 4 << 20;
+
+// The instance that the fork handler operates on.
+std::atomic<TraceWriter *> fork_handler_writer = {nullptr};
+
+uint64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+}  // namespace
+
+void TraceWriter::Enable(const char *log_dir) {
+  absl::MutexLock lock(&mu_);
+  snprintf(log_dir_, sizeof(log_dir_), "%s", log_dir);
+  TraceWriter *expected = nullptr;
+  if (fork_handler_writer.compare_exchange_strong(expected, this)) {
+    pthread_atfork(&TraceWriter::BeforeFork, &TraceWriter::AfterForkInParent,
+                   &TraceWriter::AfterForkInChild);
+  }
+  enabled_.store(true, std::memory_order_release);
+}
+
+void TraceWriter::BeforeFork() {
+  fork_handler_writer.load()->mu_.Lock();
+}
+
+void TraceWriter::AfterForkInParent() {
+  fork_handler_writer.load()->mu_.Unlock();
+}
+
+void TraceWriter::AfterForkInChild() {
+  // The log is mapped with MADV_DONTFORK, so it's gone in the child. The child
+  // starts its own log on the next event.
+  TraceWriter *writer = fork_handler_writer.load();
+  if (writer->fd_ != -1) {
+    close(writer->fd_);
+  }
+  writer->fd_ = -1;
+  writer->map_ = nullptr;
+  writer->mapped_size_ = 0;
+  writer->used_ = 0;
+  writer->stopped_ = false;
+  writer->encoder_.Reset();
+  writer->mu_.Unlock();
+}
+
+void TraceWriter::Append(const FileEventView &event) {
+  TraceContext context = {static_cast<pid_t>(syscall(SYS_getpid)), NowNs(),
+                          absl::string_view(), 0, 0};
+  char cwd[PATH_MAX];
+  for (absl::string_view path : event.path_args) {
+    if (path.empty() || path[0] == '/') {
+      continue;
+    }
+    // The raw getcwd syscall, since the libc wrapper might allocate.
+    struct stat sb;
+    if (syscall(SYS_getcwd, cwd, sizeof(cwd)) > 0 && stat(".", &sb) == 0) {
+      context.cwd = absl::string_view(cwd, strnlen(cwd, sizeof(cwd)));
+      context.cwd_dev = sb.st_dev;
+      context.cwd_ino = sb.st_ino;
+    }
+    break;
+  }
+
+  absl::MutexLock lock(&mu_);
+  if (stopped_) {
+    return;
+  }
+  if (fd_ == -1 && !OpenLog()) {
+    stopped_ = true;
+    return;
+  }
+  // Keep room for the size field of the next record, which stays 0 and
+  // terminates the log.
+  size_t max_size =
+      TraceRecordEncoder::MaxEncodedSize(event, context.cwd) + sizeof(uint32_t);
+  if (used_ + max_size > mapped_size_ && !Grow(used_ + max_size)) {
+    stopped_ = true;
+    return;
+  }
+  used_ += encoder_.Encode(event, context, map_ + used_);
+}
+
+void TraceWriter::Trim() {
+  absl::MutexLock lock(&mu_);
+  TrimLocked();
+}
+
+void TraceWriter::Close() {
+  absl::MutexLock lock(&mu_);
+  TrimLocked();
+  if (fd_ != -1) {
+    close(fd_);
+    fd_ = -1;
+  }
+  stopped_ = true;
+}
+
+bool TraceWriter::OpenLog() {
+  TraceLogHeader header = {kTraceLogMagic, kTraceLogVersion,
+                           static_cast<int32_t>(syscall(SYS_getpid)), 0,
+                           NowNs()};
+  char path[PATH_MAX];
+  if (snprintf(path, sizeof(path), "%s/%d.%llu.palog", log_dir_, header.pid,
+               static_cast<unsigned long long>(header.start_time_ns)) >=
+      static_cast<int>(sizeof(path))) {
+    return false;
+  }
+  // Raw syscalls throughout, we don't want to audit ourselves.
+  fd_ = syscall(SYS_open, path,
+                O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+  if (fd_ == -1) {
+    return false;
+  }
+  if (!Grow(sizeof(header))) {
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  memcpy(map_, &header, sizeof(header));
+  used_ = sizeof(header);
+  encoder_.Reset();
+  return true;
+}
+
+bool TraceWriter::Grow(size_t min_size) {
+  size_t size = mapped_size_;
+  while (size < min_size) {
+    size += kGrowStep;
+  }
+  // The new part of the file reads as zeros, which ends the log.
+  if (ftruncate(fd_, size) == -1) {
+    return false;
+  }
+  void *mem = map_ == nullptr
+                  ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                         fd_, 0)
+                  : mremap(map_, mapped_size_, size, MREMAP_MAYMOVE);
+  if (mem == MAP_FAILED) {
+    return false;
+  }
+  madvise(mem, size, MADV_DONTFORK);
+  map_ = static_cast<char *>(mem);
+  mapped_size_ = size;
+  return true;
+}
+
+void TraceWriter::TrimLocked() {
+  if (map_ == nullptr) {
+    return;
+  }
+  munmap(map_, mapped_size_);
+  map_ = nullptr;
+  mapped_size_ = 0;
+  ftruncate(fd_, used_);
+}
+
+}  // namespace pathauditor
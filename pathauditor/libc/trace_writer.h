@@ -0,0 +1,80 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_LIBC_TRACE_WRITER_H_
+#define PATHAUDITOR_LIBC_TRACE_WRITER_H_
+
+#include <limits.h>
+
+#include <atomic>
+#include <cstddef>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "pathauditor/file_event.h"
+#include "pathauditor/trace_log.h"
+
+namespace pathauditor {
+
+// Appends events to a capture log instead of auditing them, see trace_log.h.
+// Every process writes its own log, named <pid>.<start time in ns>.palog, to
+// a memory mapped file. The log is created on the first event, and again in
+// the child after a fork. After exec the new image starts a new log. If
+// creating or growing the log fails, the writer drops all later events.
+// There should only be one instance per process since it registers fork
+// handlers.
+class TraceWriter {
+ public:
+  constexpr TraceWriter() : mu_(absl::kConstInit) {}
+
+  TraceWriter(const TraceWriter &) = delete;
+  TraceWriter &operator=(const TraceWriter &) = delete;
+
+  // Call this once at startup, before any events are appended.
+  void Enable(const char *log_dir);
+  bool enabled() const { return enabled_.load(std::memory_order_acquire); }
+
+  void Append(const FileEventView &event);
+
+  // Trims the unused tail of the log. The next Append grows it again. Call
+  // this before exec, which discards the mapping.
+  void Trim();
+
+  // Trims the log and drops all events appended afterwards.
+  void Close();
+
+ private:
+  static void BeforeFork();
+  static void AfterForkInParent();
+  static void AfterForkInChild();
+
+  bool OpenLog() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  bool Grow(size_t min_size) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  void TrimLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  std::atomic<bool> enabled_{false};
+  absl::Mutex mu_;
+  // Set once the log couldn't be created or grown, or got closed.
+  bool stopped_ ABSL_GUARDED_BY(mu_) = false;
+  int fd_ ABSL_GUARDED_BY(mu_) = -1;
+  char *map_ ABSL_GUARDED_BY(mu_) = nullptr;
+  size_t mapped_size_ ABSL_GUARDED_BY(mu_) = 0;
+  size_t used_ ABSL_GUARDED_BY(mu_) = 0;
+  TraceRecordEncoder encoder_ ABSL_GUARDED_BY(mu_);
+  char log_dir_[PATH_MAX] = {};
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_LIBC_TRACE_WRITER_H_
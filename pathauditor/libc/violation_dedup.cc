@@ -0,0 +1,95 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/libc/violation_dedup.h"
+
+namespace pathauditor {
+
+namespace {
+
+// FNV-1a. It doesn't need to be strong, just cheap and stable.
+constexpr uint64_t kFnvOffset = 14695981039346656037ull;
+constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+uint64_t HashBytes(uint64_t hash, const void *data, size_t len) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ bytes[i]) * kFnvPrime;
+  }
+  return hash;
+}
+
+uint64_t HashNormalizedPath(uint64_t hash, absl::string_view path) {
+  if (!path.empty() && path[0] == '/') {
+    hash = HashBytes(hash, "/", 1);
+  }
+  while (!path.empty()) {
+    size_t end = path.find('/');
+    absl::string_view component = path.substr(0, end);
+    path.remove_prefix(end == absl::string_view::npos ? path.size() : end + 1);
+    if (component.empty() || component == ".") {
+      continue;
+    }
+    hash = HashBytes(hash, component.data(), component.size());
+    hash = HashBytes(hash, "/", 1);
+  }
+  // Separates this path from the next one.
+  return HashBytes(hash, "", 1);
+}
+
+}  // namespace
+
+uint64_t ViolationDedupTable::Key(absl::Span<void *const> frames,
+                                  int syscall_nr,
+                                  absl::Span<const absl::string_view> paths) {
+  uint64_t hash = kFnvOffset;
+  hash = HashBytes(hash, frames.data(), frames.size() * sizeof(frames[0]));
+  hash = HashBytes(hash, &syscall_nr, sizeof(syscall_nr));
+  for (absl::string_view path : paths) {
+    hash = HashNormalizedPath(hash, path);
+  }
+  return hash == 0 ? 1 : hash;
+}
+
+uint64_t ViolationDedupTable::Record(uint64_t key) {
+  for (size_t i = 0; i < kMaxProbes; i++) {
+    Slot &slot = slots_[(key + i) & (kSlots - 1)];
+    uint64_t slot_key = slot.key.load(std::memory_order_acquire);
+    if (slot_key == 0 &&
+        slot.key.compare_exchange_strong(slot_key, key,
+                                         std::memory_order_acq_rel)) {
+      slot_key = key;
+    }
+    if (slot_key == key) {
+      return slot.count.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+  }
+  return 0;
+}
+
+uint64_t ViolationDedupTable::Count(uint64_t key) const {
+  for (size_t i = 0; i < kMaxProbes; i++) {
+    const Slot &slot = slots_[(key + i) & (kSlots - 1)];
+    uint64_t slot_key = slot.key.load(std::memory_order_acquire);
+    if (slot_key == key) {
+      return slot.count.load(std::memory_order_relaxed);
+    }
+    if (slot_key == 0) {
+      return 0;
+    }
+  }
+  return 0;
+}
+
+}  // namespace pathauditor
@@ -0,0 +1,76 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_LIBC_VIOLATION_DEDUP_H_
+#define PATHAUDITOR_LIBC_VIOLATION_DEDUP_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+
+namespace pathauditor {
+
+// Counts how often the same violation occurred, identified by a 64 bit key
+// over the call stack, the syscall and the paths.
+//
+// The table has a fixed number of slots and uses open addressing with a
+// bounded probe sequence. Slots are claimed with a CAS and never freed, all
+// operations are lock-free. Like BoundedMpscQueue, the all-zero state is
+// valid, so the table can be constant initialized.
+class ViolationDedupTable {
+ public:
+  static constexpr size_t kSlots = 1024;
+  static constexpr size_t kMaxProbes = 8;
+
+  constexpr ViolationDedupTable() = default;
+
+  ViolationDedupTable(const ViolationDedupTable &) = delete;
+  ViolationDedupTable &operator=(const ViolationDedupTable &) = delete;
+
+  // Redundant path separators and "." components are ignored when hashing the
+  // paths, i.e. "/tmp//./foo" and "/tmp/foo" are the same violation.
+  static uint64_t Key(absl::Span<void *const> frames, int syscall_nr,
+                      absl::Span<const absl::string_view> paths);
+
+  // Increments the counter for key and returns the new count. Returns 0 if the
+  // key is not in the table and there is no free slot left for it.
+  uint64_t Record(uint64_t key);
+
+  // Returns the current count for key, 0 if it was never recorded.
+  uint64_t Count(uint64_t key) const;
+
+  // Whether a violation that has been seen occurrences times should be
+  // reported. That's the first one and then every power of two, so that the
+  // log volume grows logarithmically. Untracked violations are always
+  // reported.
+  static bool ShouldReport(uint64_t occurrences) {
+    return (occurrences & (occurrences - 1)) == 0;
+  }
+
+ private:
+  struct Slot {
+    // 0 marks a free slot, Key() never returns 0.
+    std::atomic<uint64_t> key{0};
+    std::atomic<uint64_t> count{0};
+  };
+
+  Slot slots_[kSlots];
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_LIBC_VIOLATION_DEDUP_H_
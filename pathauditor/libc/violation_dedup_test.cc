@@ -0,0 +1,73 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/libc/violation_dedup.h"
+
+#include <sys/syscall.h>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Ne;
+
+uint64_t KeyForPath(absl::string_view path, int syscall_nr = SYS_open) {
+  void *frames[] = {reinterpret_cast<void *>(0x1000),
+                    reinterpret_cast<void *>(0x2000)};
+  absl::string_view paths[] = {path};
+  return ViolationDedupTable::Key(frames, syscall_nr, paths);
+}
+
+TEST(ViolationDedupTableTest, KeyNormalizesPaths) {
+  EXPECT_THAT(KeyForPath("/tmp//./foo"), Eq(KeyForPath("/tmp/foo")));
+  EXPECT_THAT(KeyForPath("/tmp/foo/"), Eq(KeyForPath("/tmp/foo")));
+  EXPECT_THAT(KeyForPath("tmp/foo"), Ne(KeyForPath("/tmp/foo")));
+  EXPECT_THAT(KeyForPath("/tmp/../foo"), Ne(KeyForPath("/foo")));
+  EXPECT_THAT(KeyForPath("/tmp/foo", SYS_openat),
+              Ne(KeyForPath("/tmp/foo", SYS_open)));
+}
+
+TEST(ViolationDedupTableTest, CountsOccurrences) {
+  static ViolationDedupTable table;
+  uint64_t key = KeyForPath("/tmp/foo");
+  EXPECT_THAT(table.Count(key), Eq(0));
+  EXPECT_THAT(table.Record(key), Eq(1));
+  EXPECT_THAT(table.Record(key), Eq(2));
+  EXPECT_THAT(table.Record(KeyForPath("/tmp/bar")), Eq(1));
+  EXPECT_THAT(table.Count(key), Eq(2));
+}
+
+TEST(ViolationDedupTableTest, FullTableStopsTracking) {
+  static ViolationDedupTable table;
+  // All of these keys map to the same probe sequence.
+  for (uint64_t i = 1; i <= ViolationDedupTable::kMaxProbes; i++) {
+    EXPECT_THAT(table.Record(i * ViolationDedupTable::kSlots), Eq(1));
+  }
+  EXPECT_THAT(table.Record(17 * ViolationDedupTable::kSlots), Eq(0));
+}
+
+TEST(ViolationDedupTableTest, ReportsPowersOfTwo) {
+  EXPECT_TRUE(ViolationDedupTable::ShouldReport(0));
+  EXPECT_TRUE(ViolationDedupTable::ShouldReport(1));
+  EXPECT_TRUE(ViolationDedupTable::ShouldReport(2));
+  EXPECT_FALSE(ViolationDedupTable::ShouldReport(3));
+  EXPECT_TRUE(ViolationDedupTable::ShouldReport(1024));
+  EXPECT_FALSE(ViolationDedupTable::ShouldReport(1025));
+}
+
+}  // namespace
+}  // namespace pathauditor
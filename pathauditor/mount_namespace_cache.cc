@@ -0,0 +1,148 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/mount_namespace_cache.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+
+namespace pathauditor {
+
+namespace {
+
+constexpr int kPathFlags = O_PATH | O_DIRECTORY | O_CLOEXEC;
+
+absl::optional<MountNamespaceId> OwnMountNamespaceIdOrNull() {
+  absl::StatusOr<MountNamespaceId> id = GetOwnMountNamespaceId();
+  if (!id.ok()) {
+    return absl::nullopt;
+  }
+  return *id;
+}
+
+}  // namespace
+
+absl::StatusOr<MountNamespaceId> GetMountNamespaceId(int proc_fd) {
+  struct stat sb;
+  if (fstatat(proc_fd, "ns/mnt", &sb, 0) == -1) {
+    return absl::FailedPreconditionError(
+        "Could not look up the mount namespace of the process");
+  }
+  return MountNamespaceId{sb.st_dev, sb.st_ino};
+}
+
+absl::StatusOr<MountNamespaceId> GetOwnMountNamespaceId() {
+  struct stat sb;
+  if (stat("/proc/self/ns/mnt", &sb) == -1) {
+    return absl::FailedPreconditionError(
+        "Could not look up our mount namespace");
+  }
+  return MountNamespaceId{sb.st_dev, sb.st_ino};
+}
+
+MountNamespace::~MountNamespace() { close(root_fd_); }
+
+absl::StatusOr<int> MountNamespace::Open(absl::string_view path,
+                                         int open_flags) const {
+  while (!path.empty() && path.front() == '/') {
+    path.remove_prefix(1);
+  }
+  std::string relative = path.empty() ? "." : std::string(path);
+  int fd = openat(root_fd_, relative.c_str(), open_flags);
+  if (fd == -1) {
+    return absl::FailedPreconditionError(absl::StrCat(
+        "Could not open \"/", relative, "\" in the mount namespace"));
+  }
+  return fd;
+}
+
+MountNamespaceCache::MountNamespaceCache(bool watch_prefixes,
+                                         size_t max_prefixes)
+    : watch_prefixes_(watch_prefixes),
+      max_prefixes_(max_prefixes),
+      own_id_(OwnMountNamespaceIdOrNull()) {}
+
+absl::StatusOr<std::shared_ptr<MountNamespace>> MountNamespaceCache::ForProcess(
+    int proc_fd) {
+  absl::StatusOr<MountNamespaceId> id = GetMountNamespaceId(proc_fd);
+  if (!id.ok()) {
+    return id.status();
+  }
+  {
+    absl::MutexLock lock(&mu_);
+    auto it = namespaces_.find(*id);
+    if (it != namespaces_.end()) {
+      return it->second;
+    }
+  }
+
+  // Set up the namespace without holding the lock. If another thread beats us
+  // to it, we use its namespace instead.
+  int root_fd = openat(proc_fd, "root", kPathFlags);
+  if (root_fd == -1) {
+    return absl::FailedPreconditionError(
+        "Could not open the root of the process");
+  }
+  // The process could have switched namespaces between the two lookups.
+  absl::StatusOr<MountNamespaceId> root_id = GetMountNamespaceId(proc_fd);
+  if (!root_id.ok() || *root_id != *id) {
+    close(root_fd);
+    return absl::FailedPreconditionError(
+        "The process changed its mount namespace");
+  }
+  bool is_own = own_id_ == *id;
+  std::unique_ptr<WatchedPrefixCache> watched_prefixes;
+  // Our own namespace has the global prefix cache.
+  if (watch_prefixes_ && !is_own) {
+    absl::StatusOr<std::unique_ptr<WatchedPrefixCache>> cache =
+        WatchedPrefixCache::CreateForProcess(proc_fd, max_prefixes_);
+    if (cache.ok()) {
+      watched_prefixes = std::move(*cache);
+    }
+  }
+  std::shared_ptr<MountNamespace> created(
+      new MountNamespace(*id, is_own, root_fd, std::move(watched_prefixes)));
+
+  absl::MutexLock lock(&mu_);
+  auto it = namespaces_.find(*id);
+  if (it != namespaces_.end()) {
+    return it->second;
+  }
+  DropUnused();
+  namespaces_.emplace(*id, created);
+  return created;
+}
+
+size_t MountNamespaceCache::size() const {
+  absl::MutexLock lock(&mu_);
+  return namespaces_.size();
+}
+
+void MountNamespaceCache::DropUnused() {
+  for (auto it = namespaces_.begin(); it != namespaces_.end();) {
+    if (it->second.use_count() == 1) {
+      namespaces_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+}  // namespace pathauditor
@@ -0,0 +1,136 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_MOUNT_NAMESPACE_CACHE_H_
+#define PATHAUDITOR_MOUNT_NAMESPACE_CACHE_H_
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+#include "pathauditor/watched_prefix_cache.h"
+
+namespace pathauditor {
+
+// Identifies a mount namespace by the inode of /proc/<pid>/ns/mnt.
+struct MountNamespaceId {
+  dev_t dev = 0;
+  ino_t ino = 0;
+
+  bool operator==(const MountNamespaceId &other) const {
+    return dev == other.dev && ino == other.ino;
+  }
+  bool operator!=(const MountNamespaceId &other) const {
+    return !(*this == other);
+  }
+
+  template <typename H>
+  friend H AbslHashValue(H h, const MountNamespaceId &id) {
+    return H::combine(std::move(h), id.dev, id.ino);
+  }
+};
+
+// The mount namespace of the process whose /proc directory is proc_fd.
+absl::StatusOr<MountNamespaceId> GetMountNamespaceId(int proc_fd);
+// Our mount namespace.
+absl::StatusOr<MountNamespaceId> GetOwnMountNamespaceId();
+
+// What the processes in one mount namespace, e.g. all processes of a
+// container, share: the root they resolve paths from and the symlink free
+// prefixes that walks found in it.
+class MountNamespace {
+ public:
+  ~MountNamespace();
+
+  MountNamespace(const MountNamespace &) = delete;
+  MountNamespace &operator=(const MountNamespace &) = delete;
+
+  const MountNamespaceId &id() const { return id_; }
+  // Whether this is the mount namespace we're in ourselves.
+  bool is_own() const { return is_own_; }
+
+  // Opens path relative to the root of the first process that was seen in the
+  // namespace. The root stays open after all processes in the namespace have
+  // exited, but the mounts below it are detached by then.
+  absl::StatusOr<int> Open(absl::string_view path, int open_flags) const;
+
+  // The prefix cache for paths in this namespace. nullptr for our own
+  // namespace, if prefixes aren't watched or if the cache couldn't be created,
+  // e.g. because of the inotify instance limit.
+  WatchedPrefixCache *watched_prefixes() const {
+    return watched_prefixes_.get();
+  }
+
+ private:
+  friend class MountNamespaceCache;
+
+  MountNamespace(MountNamespaceId id, bool is_own, int root_fd,
+                 std::unique_ptr<WatchedPrefixCache> watched_prefixes)
+      : id_(id),
+        is_own_(is_own),
+        root_fd_(root_fd),
+        watched_prefixes_(std::move(watched_prefixes)) {}
+
+  const MountNamespaceId id_;
+  const bool is_own_;
+  // An O_PATH fd.
+  const int root_fd_;
+  const std::unique_ptr<WatchedPrefixCache> watched_prefixes_;
+};
+
+// Hands out one MountNamespace per namespace, so that the processes in it
+// share them instead of each starting from scratch. Namespaces are kept while
+// a caller holds on to them and dropped when a new one comes along after that.
+// Thread-safe.
+class MountNamespaceCache {
+ public:
+  // With watch_prefixes, every namespace other than ours gets a
+  // WatchedPrefixCache with up to max_prefixes entries.
+  explicit MountNamespaceCache(
+      bool watch_prefixes,
+      size_t max_prefixes = WatchedPrefixCache::kDefaultMaxEntries);
+
+  MountNamespaceCache(const MountNamespaceCache &) = delete;
+  MountNamespaceCache &operator=(const MountNamespaceCache &) = delete;
+
+  // Returns the namespace of the process whose /proc directory is proc_fd.
+  // Fails if the process is gone before its namespace could be looked up.
+  absl::StatusOr<std::shared_ptr<MountNamespace>> ForProcess(int proc_fd);
+
+  size_t size() const;
+
+ private:
+  // Drops the namespaces that nobody else refers to anymore.
+  void DropUnused() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const bool watch_prefixes_;
+  const size_t max_prefixes_;
+  const absl::optional<MountNamespaceId> own_id_;
+
+  mutable absl::Mutex mu_;
+  absl::flat_hash_map<MountNamespaceId, std::shared_ptr<MountNamespace>>
+      namespaces_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_MOUNT_NAMESPACE_CACHE_H_
@@ -0,0 +1,179 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/mount_namespace_cache.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "pathauditor/proc_fd_cache.h"
+#include "pathauditor/process_information.h"
+#include "pathauditor/util/status_matchers.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Ne;
+
+ino_t InodeOf(int fd) {
+  struct stat sb;
+  EXPECT_THAT(fstat(fd, &sb), Eq(0));
+  close(fd);
+  return sb.st_ino;
+}
+
+ino_t InodeOf(const std::string &path) {
+  struct stat sb;
+  EXPECT_THAT(stat(path.c_str(), &sb), Eq(0));
+  return sb.st_ino;
+}
+
+// A child that waits until it's killed, optionally in a mount namespace of
+// its own. pid is -1 if the namespace couldn't be created.
+class Child {
+ public:
+  explicit Child(bool new_namespace) {
+    int fds[2];
+    EXPECT_THAT(pipe(fds), Eq(0));
+    pid_ = fork();
+    EXPECT_THAT(pid_, Ne(-1));
+    if (pid_ == 0) {
+      close(fds[0]);
+      char ok = !new_namespace || unshare(CLONE_NEWNS) == 0;
+      if (write(fds[1], &ok, 1) != 1) {
+        _exit(1);
+      }
+      pause();
+      _exit(0);
+    }
+    close(fds[1]);
+    char ok = 0;
+    EXPECT_THAT(read(fds[0], &ok, 1), Eq(1));
+    close(fds[0]);
+    if (!ok) {
+      Kill();
+    }
+  }
+
+  ~Child() { Kill(); }
+
+  void Kill() {
+    if (pid_ > 0) {
+      kill(pid_, SIGKILL);
+      waitpid(pid_, nullptr, 0);
+    }
+    pid_ = -1;
+  }
+
+  pid_t pid() const { return pid_; }
+
+ private:
+  pid_t pid_;
+};
+
+TEST(MountNamespaceCacheTest, SharesNamespaceBetweenProcesses) {
+  MountNamespaceCache namespaces(/*watch_prefixes=*/true);
+  Child child(/*new_namespace=*/false);
+  ASSERT_THAT(child.pid(), Ne(-1));
+
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ProcFdCache> ours,
+      ProcFdCache::Open(getpid(), &namespaces));
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ProcFdCache> theirs,
+      ProcFdCache::Open(child.pid(), &namespaces));
+  ASSERT_THAT(ours->mount_namespace(), Ne(nullptr));
+  EXPECT_THAT(theirs->mount_namespace(), Eq(ours->mount_namespace()));
+  EXPECT_THAT(namespaces.size(), Eq(1));
+  EXPECT_TRUE(theirs->InMountNamespace());
+  EXPECT_TRUE(ours->mount_namespace()->is_own());
+  RemoteProcessInformation remote(theirs.get(), "/");
+  EXPECT_TRUE(remote.SharesMountNamespace());
+  // Our namespace has the global prefix cache.
+  EXPECT_THAT(ours->mount_namespace()->watched_prefixes(), Eq(nullptr));
+
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      int fd, ours->mount_namespace()->Open("/tmp", O_RDONLY));
+  EXPECT_THAT(InodeOf(fd), Eq(InodeOf("/tmp")));
+}
+
+TEST(MountNamespaceCacheTest, WatchesPrefixesInOtherNamespaces) {
+  MountNamespaceCache namespaces(/*watch_prefixes=*/true);
+  Child child(/*new_namespace=*/true);
+  if (child.pid() == -1) {
+    GTEST_SKIP() << "Can't create mount namespaces";
+  }
+
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ProcFdCache> ours,
+      ProcFdCache::Open(getpid(), &namespaces));
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ProcFdCache> theirs,
+      ProcFdCache::Open(child.pid(), &namespaces));
+  ASSERT_THAT(theirs->mount_namespace(), Ne(nullptr));
+  EXPECT_THAT(theirs->mount_namespace(), Ne(ours->mount_namespace()));
+  EXPECT_THAT(namespaces.size(), Eq(2));
+  EXPECT_THAT(theirs->mount_namespace()->watched_prefixes(), Ne(nullptr));
+  EXPECT_FALSE(theirs->mount_namespace()->is_own());
+  RemoteProcessInformation remote(theirs.get(), "/");
+  EXPECT_FALSE(remote.SharesMountNamespace());
+  EXPECT_THAT(remote.WatchedPrefixes(),
+              Eq(theirs->mount_namespace()->watched_prefixes()));
+
+  // Dropped with the next namespace once nobody uses it anymore.
+  theirs.reset();
+  child.Kill();
+  Child other(/*new_namespace=*/true);
+  ASSERT_THAT(other.pid(), Ne(-1));
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      theirs, ProcFdCache::Open(other.pid(), &namespaces));
+  EXPECT_THAT(namespaces.size(), Eq(2));
+}
+
+TEST(MountNamespaceCacheTest, FallsBackToNamespaceRoot) {
+  MountNamespaceCache namespaces(/*watch_prefixes=*/false);
+  Child child(/*new_namespace=*/false);
+  ASSERT_THAT(child.pid(), Ne(-1));
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ProcFdCache> cache,
+      ProcFdCache::Open(child.pid(), &namespaces));
+  child.Kill();
+  // Only noticed once the namespace is looked up again.
+  EXPECT_TRUE(cache->InMountNamespace());
+  cache->RefreshMountNamespace();
+  EXPECT_FALSE(cache->InMountNamespace());
+
+  RemoteProcessInformation remote(cache.get(), "/tmp", absl::nullopt,
+                                  /*fallback=*/true);
+  EXPECT_THAT(remote.WatchedPrefixes(), Eq(nullptr));
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      int root, remote.RootFileDescriptor(O_RDONLY));
+  EXPECT_THAT(InodeOf(root), Eq(InodeOf("/")));
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      int cwd, remote.CwdFileDescriptor(O_RDONLY));
+  EXPECT_THAT(InodeOf(cwd), Eq(InodeOf("/tmp")));
+}
+
+}  // namespace
+}  // namespace pathauditor
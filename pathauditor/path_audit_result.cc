@@ -0,0 +1,82 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/path_audit_result.h"
+
+#include <sys/sysmacros.h>
+
+#include "absl/strings/str_format.h"
+
+namespace pathauditor {
+
+namespace {
+
+absl::string_view UnsafeReasonDescription(UnsafeReason reason) {
+  switch (reason) {
+    case UnsafeReason::kNone:
+      return "not user controlled";
+    case UnsafeReason::kDirectoryOwner:
+      return "directory owned by another user";
+    case UnsafeReason::kDirectoryWritable:
+      return "directory writable by other users";
+    case UnsafeReason::kStickyEntryOwner:
+      return "owned by another user in a sticky directory";
+    case UnsafeReason::kMissingEntry:
+      return "doesn't exist and can be created by other users";
+    case UnsafeReason::kWritableFile:
+      return "file writable by other users";
+  }
+  return "unknown";
+}
+
+}  // namespace
+
+absl::string_view UnsafeReasonName(UnsafeReason reason) {
+  switch (reason) {
+    case UnsafeReason::kNone:
+      return "none";
+    case UnsafeReason::kDirectoryOwner:
+      return "directory_owner";
+    case UnsafeReason::kDirectoryWritable:
+      return "directory_writable";
+    case UnsafeReason::kStickyEntryOwner:
+      return "sticky_entry_owner";
+    case UnsafeReason::kMissingEntry:
+      return "missing_entry";
+    case UnsafeReason::kWritableFile:
+      return "writable_file";
+  }
+  return "unknown";
+}
+
+std::string DescribePathAuditResult(const PathAuditResult &result) {
+  if (!result.user_controlled) {
+    return std::string(UnsafeReasonDescription(UnsafeReason::kNone));
+  }
+  if (result.reason == UnsafeReason::kWritableFile) {
+    return absl::StrFormat("path %d \"%s\": %s", result.path_index,
+                           result.component,
+                           UnsafeReasonDescription(result.reason));
+  }
+  return absl::StrFormat(
+      "path %d component %d%s \"%s\" in directory %d:%d/%d (uid %d, mode "
+      "%o): %s",
+      result.path_index, result.component_index,
+      result.followed_symlink ? " after a symlink" : "", result.component,
+      major(result.directory_dev), minor(result.directory_dev),
+      result.directory_ino, result.directory_uid, result.directory_mode,
+      UnsafeReasonDescription(result.reason));
+}
+
+}  // namespace pathauditor
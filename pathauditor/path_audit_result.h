@@ -0,0 +1,82 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_PATH_AUDIT_RESULT_H_
+#define PATHAUDITOR_PATH_AUDIT_RESULT_H_
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "absl/strings/string_view.h"
+
+namespace pathauditor {
+
+// Why an element of a path could be replaced by an unprivileged user.
+enum class UnsafeReason : uint8_t {
+  kNone,
+  // The directory holding the element is owned by another user.
+  kDirectoryOwner,
+  // The directory is writable by other users and not sticky.
+  kDirectoryWritable,
+  // The directory is writable but sticky, and the element is owned by another
+  // user.
+  kStickyEntryOwner,
+  // The element doesn't exist, and other users could create it.
+  kMissingEntry,
+  // The file that gets executed is writable by other users.
+  kWritableFile,
+};
+
+// The outcome of an audit, i.e. whether a path or a FileEvent is user
+// controlled and, if it is, the first element of the walk that made it so.
+struct PathAuditResult {
+  bool user_controlled = false;
+  UnsafeReason reason = UnsafeReason::kNone;
+
+  // The rest is only set if user_controlled.
+
+  // The path argument of the event, 0 for the first one.
+  size_t path_index = 0;
+  // The position of the element among the ones the walk went through,
+  // starting at 0. If the walk didn't follow a symlink before, that's its
+  // index among the components of the path as ScanPath finds them.
+  size_t component_index = 0;
+  bool followed_symlink = false;
+  // The name of the element, the last one of the path for kWritableFile.
+  std::string component;
+  // The directory holding the element.
+  dev_t directory_dev = 0;
+  ino_t directory_ino = 0;
+  uid_t directory_uid = 0;
+  mode_t directory_mode = 0;
+  // The element itself, if it exists.
+  dev_t dev = 0;
+  ino_t ino = 0;
+  uid_t uid = 0;
+};
+
+// A short name for the reason, e.g. "directory_owner".
+absl::string_view UnsafeReasonName(UnsafeReason reason);
+
+// Describes the offending element for logs, e.g.
+// "path 0 component 2 "tmp" in directory 8:1/1234 (uid 1000, mode 40755):
+// directory owned by another user".
+std::string DescribePathAuditResult(const PathAuditResult &result);
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_PATH_AUDIT_RESULT_H_
@@ -22,23 +22,36 @@
 #include <sys/mount.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
+#include <sys/sysmacros.h>
 #include <sys/types.h>
 #include <sys/vfs.h>
 #include <unistd.h>
 // include fs.h last since it clashes with mount.h
 #include <linux/fs.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
-#include <deque>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include <tuple>
+#include <vector>
 
-#include <glog/logging.h>
+#include "absl/base/attributes.h"
+#include "pathauditor/audit_context.h"
+#include "pathauditor/directory_verdict_cache.h"
+#include "pathauditor/path_audit_result.h"
 #include "pathauditor/util/path.h"
 #include "pathauditor/util/cleanup.h"
-#include "absl/container/fixed_array.h"
+#include "pathauditor/util/path_scanner.h"
+#include "pathauditor/util/path_tokenizer.h"
+#include "pathauditor/watched_prefix_cache.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
-#include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
+#include "pathauditor/syscall_policy.h"
 #include "pathauditor/util/status_macros.h"
 
 #ifndef FS_IOC_GETFLAGS
@@ -57,6 +70,22 @@
 #define CGROUP2_SUPER_MAGIC 0x63677270
 #endif
 
+#ifndef SYS_openat2
+#define SYS_openat2 437
+#endif
+
+#if __has_include(<linux/openat2.h>)
+#include <linux/openat2.h>
+#else
+struct open_how {
+  uint64_t flags;
+  uint64_t mode;
+  uint64_t resolve;
+};
+#define RESOLVE_NO_MAGICLINKS 0x02
+#define RESOLVE_NO_SYMLINKS 0x04
+#endif
+
 namespace pathauditor {
 
 namespace {
@@ -65,12 +94,19 @@ namespace {
 // fails with an O_PATH file descriptor.
 constexpr int kDirOpenFlags = O_RDONLY;
 
-static int GetEuid() {
+static uid_t GetEuid() {
   return syscall(SYS_geteuid);
 }
 
+const SafePrefixTrie *safe_path_prefixes = nullptr;
+WatchedPrefixCache *watched_prefix_cache = nullptr;
+SharedVerdictCache *shared_verdict_cache = nullptr;
+
+ABSL_CONST_INIT thread_local uint64_t file_system_calls = 0;
+
 absl::StatusOr<bool> FdIsImmutable(int fd) {
   int32_t flags;
+  file_system_calls++;
   if (ioctl(fd, FS_IOC_GETFLAGS, &flags) < 0) {
     if (errno == ENOTTY) {
       // ENOTTY is returned if the filesystem doesn't support this option
@@ -85,6 +121,7 @@ absl::StatusOr<int> ResolveDirFd(const ProcessInformation &proc_info,
                                  absl::string_view path,
                                  absl::optional<int> at_fd) {
   int dir_fd;
+  file_system_calls++;
   if (IsAbsolutePath(path)) {
     PATHAUDITOR_ASSIGN_OR_RETURN(dir_fd, proc_info.RootFileDescriptor(kDirOpenFlags));
   } else if (!at_fd.has_value() || at_fd == AT_FDCWD) {
@@ -103,8 +140,12 @@ absl::StatusOr<bool> FileIsUserWritable(
   PATHAUDITOR_ASSIGN_OR_RETURN(int dir_fd, ResolveDirFd(proc_info, file, at_fd));
   auto close_dir_fd = MakeCleanup([&dir_fd]() { close(dir_fd); });
 
+  AuditContext::Scope scope;
+  PATHAUDITOR_ASSIGN_OR_RETURN(const char *file_str,
+                               scope.context().CStr(file));
   struct stat sb;
-  if (fstatat(dir_fd, std::string(file).c_str(), &sb, 0) == -1) {
+  file_system_calls++;
+  if (fstatat(dir_fd, file_str, &sb, 0) == -1) {
     if (errno != ENOENT) {
       return absl::FailedPreconditionError(
           absl::StrCat("Couldn't fstatat ", file));
@@ -130,86 +171,612 @@ absl::StatusOr<bool> FileIsUserWritable(
   return false;
 }
 
-absl::StatusOr<bool> FileIsUserControlled(int dir_fd, absl::string_view file) {
-  // Filter out special files
-  if (file == "." || file == "..") {
-    return false;
+// Set once we know that statx is not available. We fall back to fstatat then.
+std::atomic<bool> statx_unsupported = {false};
+
+// The result of a stat on a path element. The immutable flag is filled in from
+// statx if the filesystem reports it.
+struct ElementStat {
+  struct stat sb;
+  absl::optional<bool> immutable;
+};
+
+// What we know about the directory we're in. It's carried forward from the
+// stat of the path element when changing into a directory, so that we don't
+// need to look at the directory again.
+struct DirectoryRecord {
+  ElementStat stat;
+  // f_type from fstatfs, looked up lazily.
+  absl::optional<decltype(statfs::f_type)> fs_type;
+};
+
+void StatFromStatx(const struct statx &stx, ElementStat *out) {
+  struct stat &sb = out->sb;
+  sb = {};
+  sb.st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+  sb.st_ino = stx.stx_ino;
+  sb.st_mode = stx.stx_mode;
+  sb.st_nlink = stx.stx_nlink;
+  sb.st_uid = stx.stx_uid;
+  sb.st_gid = stx.stx_gid;
+  sb.st_rdev = makedev(stx.stx_rdev_major, stx.stx_rdev_minor);
+  sb.st_size = stx.stx_size;
+  sb.st_ctim.tv_sec = stx.stx_ctime.tv_sec;
+  sb.st_ctim.tv_nsec = stx.stx_ctime.tv_nsec;
+  if (stx.stx_attributes_mask & STATX_ATTR_IMMUTABLE) {
+    out->immutable = (stx.stx_attributes & STATX_ATTR_IMMUTABLE) != 0;
+  } else {
+    out->immutable = absl::nullopt;
   }
+}
 
-  // if either the dir or the file are immutable the access is safe
-  PATHAUDITOR_ASSIGN_OR_RETURN(bool dir_is_immutable, FdIsImmutable(dir_fd));
-  if (dir_is_immutable) {
-    return false;
+// Behaves like fstatat, but also tells us if the file is immutable if
+// possible.
+int StatElement(int dir_fd, const char *name, int flags, ElementStat *out) {
+  file_system_calls++;
+  if (!statx_unsupported.load(std::memory_order_relaxed)) {
+    struct statx stx;
+    if (statx(dir_fd, name, flags,
+              STATX_TYPE | STATX_MODE | STATX_UID | STATX_GID | STATX_INO |
+                  STATX_CTIME,
+              &stx) == 0) {
+      StatFromStatx(stx, out);
+      return 0;
+    }
+    if (errno != ENOSYS) {
+      return -1;
+    }
+    statx_unsupported.store(true, std::memory_order_relaxed);
   }
+  out->immutable = absl::nullopt;
+  return fstatat(dir_fd, name, &out->sb, flags);
+}
 
-  int file_fd = openat(dir_fd, std::string(file).c_str(), O_RDONLY);
-  if (file_fd == -1) {
-    if (errno != ENOENT) {
-      return absl::FailedPreconditionError(
-          absl::StrCat("Couldn't open file for immutable check ", file));
+int StatDirectory(int dir_fd, DirectoryRecord *out) {
+  out->fs_type = absl::nullopt;
+  return StatElement(dir_fd, "", AT_EMPTY_PATH, &out->stat);
+}
+
+absl::StatusOr<decltype(statfs::f_type)> FsType(int dir_fd,
+                                                DirectoryRecord *dir) {
+  if (!dir->fs_type.has_value()) {
+    struct statfs fs_buf;
+    file_system_calls++;
+    if (fstatfs(dir_fd, &fs_buf) == -1) {
+      return absl::FailedPreconditionError("fstatfs(dir_fd) failed");
     }
-  } else {
-    PATHAUDITOR_ASSIGN_OR_RETURN(bool file_is_immutable, FdIsImmutable(file_fd));
-    close(file_fd);
-    if (file_is_immutable) {
-      return false;
+    dir->fs_type = fs_buf.f_type;
+  }
+  return *dir->fs_type;
+}
+
+// Looks the directory up in the cache of the thread, and in the shared cache if
+// it's not there.
+absl::optional<DirectoryVerdict> LookupVerdict(DirectoryVerdictCache *cache,
+                                               const struct stat &sb) {
+  absl::optional<DirectoryVerdict> verdict = cache->Lookup(sb);
+  if (!verdict.has_value() && shared_verdict_cache != nullptr) {
+    verdict = shared_verdict_cache->Lookup(sb, GetEuid());
+    if (verdict.has_value()) {
+      cache->Insert(sb, *verdict);
     }
   }
+  return verdict;
+}
+
+void InsertVerdict(DirectoryVerdictCache *cache, const struct stat &sb,
+                   DirectoryVerdict verdict) {
+  cache->Insert(sb, verdict);
+  if (shared_verdict_cache != nullptr) {
+    shared_verdict_cache->Insert(sb, verdict, GetEuid());
+  }
+}
+
+// Checks the properties of the directory that apply to all entries in it.
+absl::StatusOr<DirectoryVerdict> ClassifyDirectory(int dir_fd,
+                                                   DirectoryRecord *dir) {
+  const struct stat &dir_sb = dir->stat.sb;
+  DirectoryVerdict verdict = DirectoryVerdict::kSafe;
+  if (dir_sb.st_uid != 0 && dir_sb.st_uid != GetEuid()) {
+    // non-root owner or owner != user
+    verdict = DirectoryVerdict::kUserControlled;
+  } else if ((dir_sb.st_gid != 0 && dir_sb.st_mode & S_IWGRP) ||
+             dir_sb.st_mode & S_IWOTH) {
+    // root owned dir that is writable by a user
+    // if not sticky the file is controlled
+    verdict = dir_sb.st_mode & S_ISVTX ? DirectoryVerdict::kSticky
+                                       : DirectoryVerdict::kUserControlled;
+  }
+  if (verdict == DirectoryVerdict::kSafe) {
+    return verdict;
+  }
 
-  struct statfs fs_buf;
-  if (fstatfs(dir_fd, &fs_buf) == -1) {
-    return absl::FailedPreconditionError("fstatfs(dir_fd) failed");
+  // if the dir is immutable the access is safe
+  bool dir_is_immutable;
+  if (dir->stat.immutable.has_value()) {
+    dir_is_immutable = *dir->stat.immutable;
+  } else {
+    PATHAUDITOR_ASSIGN_OR_RETURN(dir_is_immutable, FdIsImmutable(dir_fd));
+  }
+  if (dir_is_immutable) {
+    return DirectoryVerdict::kSafe;
   }
 
   // ignore proc and cgroup filesystems
-  if (fs_buf.f_type == PROC_SUPER_MAGIC ||
-      fs_buf.f_type == CGROUP_SUPER_MAGIC ||
-      fs_buf.f_type == CGROUP2_SUPER_MAGIC) {
-    return false;
+  PATHAUDITOR_ASSIGN_OR_RETURN(auto fs_type, FsType(dir_fd, dir));
+  if (fs_type == PROC_SUPER_MAGIC || fs_type == CGROUP_SUPER_MAGIC ||
+      fs_type == CGROUP2_SUPER_MAGIC) {
+    return DirectoryVerdict::kSafe;
   }
 
-  struct stat sb;
-  if (fstat(dir_fd, &sb) == -1) {
-    return absl::FailedPreconditionError("fstat(dir_fd) failed");
+  return verdict;
+}
+
+// Why the entries of a user controlled directory are user controlled.
+UnsafeReason DirectoryReason(const struct stat &dir_sb) {
+  return dir_sb.st_uid != 0 && dir_sb.st_uid != GetEuid()
+             ? UnsafeReason::kDirectoryOwner
+             : UnsafeReason::kDirectoryWritable;
+}
+
+// Returns why the file is user controlled, or kNone if it isn't.
+// file_stat is the stat of the file without following symlinks or nullptr if
+// it doesn't exist. file has to be NUL terminated.
+absl::StatusOr<UnsafeReason> FileIsUserControlled(
+    int dir_fd, DirectoryRecord *dir, absl::string_view file,
+    const ElementStat *file_stat) {
+  // Filter out special files
+  if (file == "." || file == "..") {
+    return UnsafeReason::kNone;
   }
 
-  // non-root owner or owner != user
-  if (sb.st_uid != 0 && sb.st_uid != GetEuid()) {
-    return true;
+  DirectoryVerdictCache &cache = DirectoryVerdictCache::ForCurrentThread();
+  absl::optional<DirectoryVerdict> verdict =
+      LookupVerdict(&cache, dir->stat.sb);
+  if (!verdict.has_value()) {
+    PATHAUDITOR_ASSIGN_OR_RETURN(verdict, ClassifyDirectory(dir_fd, dir));
+    InsertVerdict(&cache, dir->stat.sb, *verdict);
   }
 
-  // root owned dir that is writable by a user
-  if ((sb.st_gid != 0 && sb.st_mode & S_IWGRP) || sb.st_mode & S_IWOTH) {
-    // if not sticky the file is controlled
-    if (!(sb.st_mode & S_ISVTX)) {
-      return true;
-    }
+  if (*verdict == DirectoryVerdict::kSafe) {
+    return UnsafeReason::kNone;
+  }
 
-    // For sticky dirs you can only replace a file if you're the directory owner
-    // or the owner of the file.
-    // We already checked above if the directory is user owned.
-    // This leaves the cases where the file is user owned or non-existent.
+  if (file_stat == nullptr) {
+    // The file doesn't exist but it could be created by a user
+    return UnsafeReason::kMissingEntry;
+  }
 
-    // check if the file is owned by non-root
-    struct stat next_sb;
-    if (fstatat(dir_fd, std::string(file).c_str(), &next_sb, AT_SYMLINK_NOFOLLOW) ==
-        -1) {
+  // if the file is immutable the access is safe
+  bool file_is_immutable;
+  if (file_stat->immutable.has_value()) {
+    file_is_immutable = *file_stat->immutable;
+  } else {
+    file_system_calls++;
+    int file_fd = openat(dir_fd, file.data(), O_RDONLY);
+    if (file_fd == -1) {
       if (errno != ENOENT) {
         return absl::FailedPreconditionError(
-            absl::StrCat("Couldn't fstatat ", file));
+            absl::StrCat("Couldn't open file for immutable check ", file));
       }
-      // The file doesn't exist but it could be created by a user
-      return true;
+      file_is_immutable = false;
+    } else {
+      auto close_file_fd = MakeCleanup([file_fd]() { close(file_fd); });
+      PATHAUDITOR_ASSIGN_OR_RETURN(file_is_immutable, FdIsImmutable(file_fd));
     }
-    if (next_sb.st_uid != 0 && next_sb.st_uid != GetEuid()) {
-      return true;
+  }
+  if (file_is_immutable) {
+    return UnsafeReason::kNone;
+  }
+
+  if (*verdict == DirectoryVerdict::kUserControlled) {
+    return DirectoryReason(dir->stat.sb);
+  }
+
+  // For sticky dirs you can only replace a file if you're the directory owner
+  // or the owner of the file.
+  // We already checked above if the directory is user owned.
+  // This leaves the cases where the file is user owned or non-existent.
+
+  // check if the file is owned by non-root
+  const struct stat &next_sb = file_stat->sb;
+  if (next_sb.st_uid != 0 && next_sb.st_uid != GetEuid()) {
+    return UnsafeReason::kStickyEntryOwner;
+  }
+
+  return UnsafeReason::kNone;
+}
+
+// Set once we know that openat2 is not available, e.g. on kernels < 5.6.
+std::atomic<bool> openat2_unsupported = {false};
+
+// The first count of the components of remaining, if none of them is "." or
+// "..".
+absl::optional<absl::string_view> LiteralPrefix(
+    absl::string_view remaining, absl::Span<const PathComponent> components,
+    size_t count) {
+  if (count == 0 || count > components.size()) {
+    return absl::nullopt;
+  }
+  for (const PathComponent &component : components.first(count)) {
+    if (component.kind != PathComponent::Kind::kName) {
+      return absl::nullopt;
     }
   }
+  const PathComponent &last = components[count - 1];
+  return remaining.substr(0, last.offset + last.size);
+}
 
-  return false;
+// Tries to change into the directory that prefix, the literal prefix
+// consisting of count elements, leads to with a single openat2 call. RESOLVE_NO_SYMLINKS makes the call
+// fail if any of them is a symlink, so if it succeeds we only need to check
+// that none of the directories on the way is user controlled. We can do that
+// based on their stat without holding fds to them. If any of them needs more
+// detailed checks, we fall back to the normal walk.
+// Returns the fd of the directory and fills in its record on success.
+absl::optional<int> OpenSymlinkFreePrefix(int dir_fd,
+                                          const DirectoryRecord &dir,
+                                          absl::string_view literal_prefix,
+                                          size_t count,
+                                          DirectoryRecord *prefix_dir) {
+  if (openat2_unsupported.load(std::memory_order_relaxed)) {
+    return absl::nullopt;
+  }
+
+  // NUL terminated copy that we can cut at the components.
+  char prefix[PATH_MAX];
+  size_t prefix_len = literal_prefix.size();
+  if (prefix_len >= sizeof(prefix)) {
+    return absl::nullopt;
+  }
+  literal_prefix.copy(prefix, prefix_len);
+  prefix[prefix_len] = '\0';
+
+  struct open_how how = {};
+  how.flags = kDirOpenFlags | O_DIRECTORY;
+  how.resolve = RESOLVE_NO_SYMLINKS | RESOLVE_NO_MAGICLINKS;
+  file_system_calls++;
+  int prefix_fd = syscall(SYS_openat2, dir_fd, prefix, &how, sizeof(how));
+  if (prefix_fd == -1) {
+    if (errno == ENOSYS || errno == EPERM || errno == E2BIG) {
+      openat2_unsupported.store(true, std::memory_order_relaxed);
+    }
+    return absl::nullopt;
+  }
+  auto close_prefix_fd = MakeCleanup([prefix_fd]() { close(prefix_fd); });
+
+  DirectoryVerdictCache &cache = DirectoryVerdictCache::ForCurrentThread();
+  struct stat sb = dir.stat.sb;
+  size_t end = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (i > 0) {
+      // Cut the prefix after the component before this one.
+      while (prefix[end] == '/') {
+        end++;
+      }
+      while (end < prefix_len && prefix[end] != '/') {
+        end++;
+      }
+      char separator = prefix[end];
+      prefix[end] = '\0';
+      file_system_calls++;
+      int ret = fstatat(dir_fd, prefix, &sb, AT_SYMLINK_NOFOLLOW);
+      prefix[end] = separator;
+      if (ret == -1) {
+        return absl::nullopt;
+      }
+    }
+
+    absl::optional<DirectoryVerdict> verdict = LookupVerdict(&cache, sb);
+    if (!verdict.has_value()) {
+      if ((sb.st_uid != 0 && sb.st_uid != GetEuid()) ||
+          (sb.st_gid != 0 && sb.st_mode & S_IWGRP) || sb.st_mode & S_IWOTH) {
+        // might still be safe, e.g. if immutable or in proc
+        return absl::nullopt;
+      }
+      verdict = DirectoryVerdict::kSafe;
+      InsertVerdict(&cache, sb, *verdict);
+    }
+    if (*verdict != DirectoryVerdict::kSafe) {
+      return absl::nullopt;
+    }
+  }
+
+  if (StatDirectory(prefix_fd, prefix_dir) == -1) {
+    return absl::nullopt;
+  }
+  close_prefix_fd.release();
+  return prefix_fd;
 }
 
-}  // namespace
+// Same as OpenSymlinkFreePrefix, but served from the watched prefix cache if
+// possible. Prefixes that aren't in it yet are checked a second time after
+// the watches are in place and only inserted if both checks agree, so a
+// change during the first check can't slip through.
+absl::optional<int> OpenWatchedPrefix(WatchedPrefixCache *cache, int dir_fd,
+                                      const DirectoryRecord &dir,
+                                      absl::string_view prefix, size_t count,
+                                      DirectoryRecord *prefix_dir) {
+  uid_t euid = GetEuid();
+  struct stat sb;
+  file_system_calls++;
+  int fd = cache->Lookup(dir.stat.sb, prefix, euid, &sb);
+  if (fd != -1) {
+    prefix_dir->stat.sb = sb;
+    // Changing the immutable flag doesn't cause an inotify event, so look it
+    // up again if it's needed.
+    prefix_dir->stat.immutable = absl::nullopt;
+    prefix_dir->fs_type = absl::nullopt;
+    return fd;
+  }
+
+  absl::optional<int> prefix_fd =
+      OpenSymlinkFreePrefix(dir_fd, dir, prefix, count, prefix_dir);
+  if (!prefix_fd.has_value()) {
+    return absl::nullopt;
+  }
+  absl::optional<WatchedPrefixCache::Ticket> ticket =
+      cache->Watch(dir_fd, prefix);
+  if (!ticket.has_value()) {
+    return prefix_fd;
+  }
+  DirectoryRecord checked_dir;
+  absl::optional<int> checked_fd =
+      OpenSymlinkFreePrefix(dir_fd, dir, prefix, count, &checked_dir);
+  if (checked_fd.has_value() &&
+      checked_dir.stat.sb.st_dev == prefix_dir->stat.sb.st_dev &&
+      checked_dir.stat.sb.st_ino == prefix_dir->stat.sb.st_ino) {
+    cache->Insert(*ticket, dir.stat.sb, prefix, euid, *checked_fd,
+                  checked_dir.stat.sb);
+  } else {
+    cache->Abandon(*ticket);
+  }
+  if (checked_fd.has_value()) {
+    close(*checked_fd);
+  }
+  return prefix_fd;
+}
+
+// Directories that the walks of a batch changed into, so that later paths of
+// the batch with the same prefix can continue from there. Only states that a
+// walk reaches by consuming a prefix of its path literally, i.e. without
+// following symlinks, are recorded. Starting from them is then exactly what
+// the walk of the later path would have done up to that point.
+// The same goes for the elements that walks found to be user controlled: the
+// walk of every later path that starts with the same literal prefix would stop
+// at the same element, so its result can be returned right away.
+class WalkCache {
+ public:
+  struct Entry {
+    int fd;
+    DirectoryRecord dir;
+    // The loop iterations the walk had used when it got there.
+    unsigned int iterations;
+  };
+
+  // Bounds the number of fds we keep open.
+  static constexpr size_t kMaxEntries = 256;
+
+  WalkCache() = default;
+  ~WalkCache() { Clear(); }
+
+  WalkCache(const WalkCache &) = delete;
+  WalkCache &operator=(const WalkCache &) = delete;
+
+  // Returns the entry for the longest prefix of path that was reached from the
+  // directory start, and its length in path elements. If a prefix of path
+  // ends in an element that was found to be user controlled, returns nullptr
+  // and sets unsafe to the result of the walk that found it instead.
+  const Entry *FindLongestPrefix(const struct stat &start,
+                                 absl::string_view path, size_t *prefix_count,
+                                 const PathAuditResult **unsafe) const {
+    *unsafe = nullptr;
+    AuditContext::Scope scope;
+    KeyBuilder key(&scope.context().arena(), start, path);
+    if (!key.ok()) {
+      return nullptr;
+    }
+    const Entry *found = nullptr;
+    size_t count = 0;
+    for (const PathComponent &component : key.components()) {
+      key.Append(component.Name(path));
+      count++;
+      if (!unsafe_.empty()) {
+        auto unsafe_it = unsafe_.find(key.key());
+        if (unsafe_it != unsafe_.end()) {
+          *unsafe = &unsafe_it->second;
+          return nullptr;
+        }
+      }
+      auto it = entries_.find(key.key());
+      if (it != entries_.end()) {
+        found = &it->second;
+        *prefix_count = count;
+      }
+    }
+    return found;
+  }
+
+  // Records that the walk from start got into dir_fd after the first
+  // prefix_count elements of path. Doesn't take ownership of dir_fd.
+  void Insert(const struct stat &start, absl::string_view path,
+              size_t prefix_count, int dir_fd, const DirectoryRecord &dir,
+              unsigned int iterations) {
+    AuditContext::Scope scope;
+    KeyBuilder key(&scope.context().arena(), start, path);
+    if (!key.ok()) {
+      return;
+    }
+    absl::Span<const PathComponent> components = key.components();
+    if (prefix_count > components.size()) {
+      return;
+    }
+    for (const PathComponent &component : components.first(prefix_count)) {
+      key.Append(component.Name(path));
+    }
+    if (entries_.contains(key.key())) {
+      return;
+    }
+    if (entries_.size() >= kMaxEntries) {
+      Clear();
+    }
+    int fd = fcntl(dir_fd, F_DUPFD_CLOEXEC, 0);
+    if (fd == -1) {
+      return;
+    }
+    entries_.emplace(key.key(), Entry{fd, dir, iterations});
+  }
+
+  // Records that the walk from start found the last of the first prefix_count
+  // elements of path to be user controlled.
+  void InsertUnsafe(const struct stat &start, absl::string_view path,
+                    size_t prefix_count, const PathAuditResult &result) {
+    AuditContext::Scope scope;
+    KeyBuilder key(&scope.context().arena(), start, path);
+    if (!key.ok()) {
+      return;
+    }
+    absl::Span<const PathComponent> components = key.components();
+    if (prefix_count == 0 || prefix_count > components.size()) {
+      return;
+    }
+    for (const PathComponent &component : components.first(prefix_count)) {
+      key.Append(component.Name(path));
+    }
+    if (unsafe_.size() >= kMaxEntries) {
+      unsafe_.clear();
+    }
+    unsafe_.emplace(key.key(), result);
+  }
+
+ private:
+  // Builds the keys for the prefixes of a path in arena memory, so that
+  // lookups don't allocate. A key is the inode of the start directory followed
+  // by "/elem" for every element of the prefix.
+  class KeyBuilder {
+   public:
+    KeyBuilder(Arena *arena, const struct stat &start, absl::string_view path)
+        : buf_(arena->AllocateArray<char>(kStartSize + path.size() + 1)),
+          components_(
+              arena->AllocateArray<PathComponent>(MaxPathComponents(path))) {
+      ok_ = !buf_.empty() && !components_.empty();
+      if (ok_) {
+        memcpy(buf_.data(), &start.st_dev, sizeof(start.st_dev));
+        memcpy(buf_.data() + sizeof(start.st_dev), &start.st_ino,
+               sizeof(start.st_ino));
+        len_ = kStartSize;
+        components_ =
+            components_.first(ScanPath(path, components_).component_count);
+      }
+    }
+
+    bool ok() const { return ok_; }
+
+    // The components of the path.
+    absl::Span<const PathComponent> components() const { return components_; }
+
+    // Fits since the elements of the path are separated by at least one '/'.
+    void Append(absl::string_view elem) {
+      buf_[len_++] = '/';
+      elem.copy(buf_.data() + len_, elem.size());
+      len_ += elem.size();
+    }
+
+    absl::string_view key() const {
+      return absl::string_view(buf_.data(), len_);
+    }
+
+   private:
+    static constexpr size_t kStartSize = sizeof(dev_t) + sizeof(ino_t);
+
+    absl::Span<char> buf_;
+    absl::Span<PathComponent> components_;
+    bool ok_;
+    size_t len_ = 0;
+  };
+
+  void Clear() {
+    for (const auto &entry : entries_) {
+      close(entry.second.fd);
+    }
+    entries_.clear();
+  }
+
+  absl::flat_hash_map<std::string, Entry> entries_;
+  absl::flat_hash_map<std::string, PathAuditResult> unsafe_;
+};
+
+// Opens the root and the cwd of the process once for the whole batch and
+// hands out duplicates of them.
+class BatchProcessInformation : public ProcessInformation {
+ public:
+  explicit BatchProcessInformation(const ProcessInformation &proc_info)
+      : proc_info_(proc_info) {}
+  ~BatchProcessInformation() override {
+    for (int fd : {root_fd_, cwd_fd_}) {
+      if (fd != -1) {
+        close(fd);
+      }
+    }
+  }
+
+  BatchProcessInformation(const BatchProcessInformation &) = delete;
+  BatchProcessInformation &operator=(const BatchProcessInformation &) = delete;
+
+  absl::StatusOr<int> DupDirFileDescriptor(int fd,
+                                           int open_flags) const override {
+    return proc_info_.DupDirFileDescriptor(fd, open_flags);
+  }
+  absl::StatusOr<int> CwdFileDescriptor(int open_flags) const override {
+    if (open_flags != kDirOpenFlags) {
+      return proc_info_.CwdFileDescriptor(open_flags);
+    }
+    return Dup(&cwd_fd_, [this]() {
+      return proc_info_.CwdFileDescriptor(kDirOpenFlags);
+    });
+  }
+  absl::StatusOr<int> RootFileDescriptor(int open_flags) const override {
+    if (open_flags != kDirOpenFlags) {
+      return proc_info_.RootFileDescriptor(open_flags);
+    }
+    return Dup(&root_fd_, [this]() {
+      return proc_info_.RootFileDescriptor(kDirOpenFlags);
+    });
+  }
+  bool SharesMountNamespace() const override {
+    if (!shares_mount_namespace_.has_value()) {
+      shares_mount_namespace_ = proc_info_.SharesMountNamespace();
+    }
+    return *shares_mount_namespace_;
+  }
+  WatchedPrefixCache *WatchedPrefixes() const override {
+    if (!watched_prefixes_.has_value()) {
+      watched_prefixes_ = proc_info_.WatchedPrefixes();
+    }
+    return *watched_prefixes_;
+  }
+
+ private:
+  template <typename OpenFn>
+  static absl::StatusOr<int> Dup(int *cached_fd, OpenFn open_fd) {
+    if (*cached_fd == -1) {
+      PATHAUDITOR_ASSIGN_OR_RETURN(*cached_fd, open_fd());
+    }
+    int fd = fcntl(*cached_fd, F_DUPFD_CLOEXEC, 0);
+    if (fd == -1) {
+      return absl::FailedPreconditionError("Could not dup the directory fd");
+    }
+    return fd;
+  }
+
+  const ProcessInformation &proc_info_;
+  mutable int root_fd_ = -1;
+  mutable int cwd_fd_ = -1;
+  mutable absl::optional<bool> shares_mount_namespace_;
+  mutable absl::optional<WatchedPrefixCache *> watched_prefixes_;
+};
+
+constexpr unsigned int kDefaultMaxIterationCount = 40;
 
 // The algorithm is roughly:
 // * keep a fd open to the current directory we're in
@@ -219,110 +786,250 @@ absl::StatusOr<bool> FileIsUserControlled(int dir_fd, absl::string_view file) {
 //  * dir => check perms and enter
 //  * relative link => prepend to remaining path
 //  * absolute link => prepend to remaining path and start at /
-absl::StatusOr<bool> PathIsUserControlled(const ProcessInformation &proc_info,
-                                          absl::string_view path,
-                                          absl::optional<int> at_fd,
-                                          unsigned int max_iteration_count) {
+// If walk_cache is set, the walk starts from the longest prefix of the path
+// that an earlier walk already got through and records the directories it
+// enters itself, as well as the element it stops at if that's user controlled.
+absl::StatusOr<PathAuditResult> WalkPath(const ProcessInformation &proc_info,
+                                         absl::string_view path,
+                                         absl::optional<int> at_fd,
+                                         unsigned int max_iteration_count,
+                                         WalkCache *walk_cache) {
+  if (safe_path_prefixes && safe_path_prefixes->Contains(path)) {
+    return PathAuditResult();
+  }
+
   PATHAUDITOR_ASSIGN_OR_RETURN(int dir_fd, ResolveDirFd(proc_info, path, at_fd));
   auto close_dir_fd = MakeCleanup([&dir_fd]() { close(dir_fd); });
 
-  std::deque<std::string> path_queue = absl::StrSplit(path, '/', absl::SkipEmpty());
+  DirectoryVerdictCache::ForCurrentThread().SetEuid(GetEuid());
 
-  for (size_t i = 0; i < max_iteration_count; i++) {
-    if (path_queue.empty()) {
-      return false;
+  // The directory we're in. When changing into a directory we already have its
+  // stat from the path element.
+  DirectoryRecord dir;
+  bool dir_valid = false;
+
+  PathTokenizer tokens;
+  PATHAUDITOR_RETURN_IF_ERROR(tokens.Reset(path));
+
+  // While we haven't followed a symlink, the walk is in the directory after
+  // the first consumed elements of the path.
+  struct stat start_sb;
+  size_t consumed = 0;
+  bool literal = walk_cache != nullptr;
+  unsigned int first_iteration = 0;
+  // The position of the next element in the walk, including the ones that
+  // symlink targets added.
+  size_t element_index = 0;
+  bool followed_symlink = false;
+  if (walk_cache != nullptr) {
+    if (StatDirectory(dir_fd, &dir) == -1) {
+      return absl::FailedPreconditionError("fstat(dir_fd) failed");
     }
+    dir_valid = true;
+    start_sb = dir.stat.sb;
+    const PathAuditResult *unsafe;
+    const WalkCache::Entry *entry =
+        walk_cache->FindLongestPrefix(start_sb, path, &consumed, &unsafe);
+    if (unsafe != nullptr) {
+      return *unsafe;
+    }
+    if (entry != nullptr) {
+      int fd = fcntl(entry->fd, F_DUPFD_CLOEXEC, 0);
+      if (fd == -1) {
+        return absl::FailedPreconditionError("Could not dup the directory fd");
+      }
+      close(dir_fd);
+      dir_fd = fd;
+      dir = entry->dir;
+      first_iteration = entry->iterations;
+      tokens.Skip(consumed);
+      element_index = consumed;
+    }
+  }
 
-    std::string elem = path_queue.front();
-    path_queue.pop_front();
+  // Try to skip over the directories in the path in one go if they don't
+  // contain symlinks.
+  AuditContext::Scope scope;
+  absl::string_view remaining = tokens.Remaining();
+  absl::Span<PathComponent> components =
+      scope.context().arena().AllocateArray<PathComponent>(
+          MaxPathComponents(remaining));
+  size_t component_count = ScanPath(remaining, components).component_count;
+  if (component_count > 2) {
+    if (!dir_valid) {
+      if (StatDirectory(dir_fd, &dir) == -1) {
+        return absl::FailedPreconditionError("fstat(dir_fd) failed");
+      }
+      dir_valid = true;
+    }
+    size_t prefix_count = component_count - 1;
+    absl::optional<absl::string_view> prefix =
+        LiteralPrefix(remaining, components, prefix_count);
+    DirectoryRecord prefix_dir;
+    absl::optional<int> prefix_fd;
+    if (prefix.has_value()) {
+      // A watched cache only sees the mount changes of its own namespace.
+      WatchedPrefixCache *prefix_cache = proc_info.SharesMountNamespace()
+                                             ? watched_prefix_cache
+                                             : proc_info.WatchedPrefixes();
+      prefix_fd = prefix_cache != nullptr
+                      ? OpenWatchedPrefix(prefix_cache, dir_fd, dir, *prefix,
+                                          prefix_count, &prefix_dir)
+                      : OpenSymlinkFreePrefix(dir_fd, dir, *prefix,
+                                              prefix_count, &prefix_dir);
+    }
+    if (prefix_fd.has_value()) {
+      close(dir_fd);
+      dir_fd = *prefix_fd;
+      dir = prefix_dir;
+      tokens.Skip(prefix_count);
+      element_index += prefix_count;
+      // The skipped elements count toward the limit like in the walk below,
+      // so that the verdict doesn't depend on whether the skip worked.
+      first_iteration += prefix_count;
+      if (literal) {
+        consumed += prefix_count;
+        walk_cache->Insert(start_sb, path, consumed, dir_fd, dir,
+                           first_iteration);
+      }
+    }
+  }
+
+  for (unsigned int i = first_iteration; i < max_iteration_count; i++) {
+    if (tokens.empty()) {
+      return PathAuditResult();
+    }
+
+    // NUL terminated, valid until we prepend a symlink target.
+    absl::string_view elem = tokens.Next();
+    size_t elem_index = element_index++;
 
     if (elem == ".") {
+      consumed++;
       continue;
     }
 
-    // Check if the next path element is user controlled
-    PATHAUDITOR_ASSIGN_OR_RETURN(bool access_is_unsafe, FileIsUserControlled(dir_fd, elem));
-    if (access_is_unsafe) {
-      return true;
+    if (!dir_valid) {
+      if (StatDirectory(dir_fd, &dir) == -1) {
+        return absl::FailedPreconditionError("fstat(dir_fd) failed");
+      }
+      dir_valid = true;
     }
 
-    // Check if the element actually exists. We need to check after
-    // FileIsUserControlled since a non-existent file could still be created
-    // by a user if the directory is writable.
-    struct stat sb;
-    if (fstatat(dir_fd, elem.c_str(), &sb, AT_SYMLINK_NOFOLLOW) == -1) {
+    // Stat the element once. The result is used for the ownership checks and
+    // to decide how to continue the walk.
+    ElementStat elem_stat;
+    bool elem_exists = true;
+    if (StatElement(dir_fd, elem.data(), AT_SYMLINK_NOFOLLOW, &elem_stat) ==
+        -1) {
       if (errno != ENOENT) {
         return absl::FailedPreconditionError(
             absl::StrCat("Could not stat path element ", elem));
-      } else {
-        return false;
       }
+      elem_exists = false;
+    }
+
+    // Check if the next path element is user controlled. We need to check
+    // this before checking if the element exists since a non-existent file
+    // could still be created by a user if the directory is writable.
+    PATHAUDITOR_ASSIGN_OR_RETURN(
+        UnsafeReason reason,
+        FileIsUserControlled(dir_fd, &dir, elem,
+                             elem_exists ? &elem_stat : nullptr));
+    if (reason != UnsafeReason::kNone) {
+      PathAuditResult result;
+      result.user_controlled = true;
+      result.reason = reason;
+      result.component_index = elem_index;
+      result.followed_symlink = followed_symlink;
+      result.component = std::string(elem);
+      result.directory_dev = dir.stat.sb.st_dev;
+      result.directory_ino = dir.stat.sb.st_ino;
+      result.directory_uid = dir.stat.sb.st_uid;
+      result.directory_mode = dir.stat.sb.st_mode;
+      if (elem_exists) {
+        result.dev = elem_stat.sb.st_dev;
+        result.ino = elem_stat.sb.st_ino;
+        result.uid = elem_stat.sb.st_uid;
+      }
+      if (literal) {
+        walk_cache->InsertUnsafe(start_sb, path, consumed + 1, result);
+      }
+      return result;
+    }
+
+    if (!elem_exists) {
+      return PathAuditResult();
     }
 
     // Symlinks in /proc are magic. We can just follow them in the stat call.
     // If the file is a symlink and the current directory is in proc, just
     // follow the symlink instead.
-    if ((sb.st_mode & S_IFMT) == S_IFLNK) {
-      struct statfs fs_buf;
-      if (fstatfs(dir_fd, &fs_buf) == -1) {
-        return absl::FailedPreconditionError("fstatfs(dir_fd) failed");
-      }
-
-      if (fs_buf.f_type == PROC_SUPER_MAGIC) {
-        if (fstatat(dir_fd, elem.c_str(), &sb, 0) == -1) {
+    if ((elem_stat.sb.st_mode & S_IFMT) == S_IFLNK) {
+      PATHAUDITOR_ASSIGN_OR_RETURN(auto fs_type, FsType(dir_fd, &dir));
+      if (fs_type == PROC_SUPER_MAGIC) {
+        if (StatElement(dir_fd, elem.data(), 0, &elem_stat) == -1) {
           return absl::FailedPreconditionError(absl::StrCat(
               "Could not stat path element without nofollow", elem));
         }
       }
     }
 
-    switch (sb.st_mode & S_IFMT) {
+    switch (elem_stat.sb.st_mode & S_IFMT) {
       case S_IFDIR: {
         // Change into the directory
-        int new_fd = openat(dir_fd, elem.c_str(), kDirOpenFlags);
+        file_system_calls++;
+        int new_fd = openat(dir_fd, elem.data(), kDirOpenFlags);
         if (new_fd == -1) {
           return absl::FailedPreconditionError(
               absl::StrCat("Couldn't openat next elem ", elem));
         }
         close(dir_fd);
         dir_fd = new_fd;
+        dir.stat = elem_stat;
+        dir.fs_type = absl::nullopt;
+        if (literal) {
+          consumed++;
+          walk_cache->Insert(start_sb, path, consumed, dir_fd, dir, i + 1);
+        }
         break;
       }
       case S_IFLNK: {
-        // Read the link and prepend the result to our path queue
-        absl::FixedArray<char> link_buf(PATH_MAX);
-        ssize_t link_len = readlinkat(dir_fd, elem.c_str(), link_buf.data(),
-                                      link_buf.memsize());
+        literal = false;
+        followed_symlink = true;
+        // Read the link into the tokenizer and prepend it to the rest of the
+        // path.
+        size_t link_capacity;
+        char *link_buf = tokens.PrependBuffer(&link_capacity);
+        file_system_calls++;
+        ssize_t link_len =
+            readlinkat(dir_fd, elem.data(), link_buf, link_capacity);
         if (link_len == -1) {
           return absl::FailedPreconditionError(
               absl::StrCat("Could not read link for path element ", elem));
         }
-        if ((size_t)link_len >= link_buf.memsize()) {
+        if ((size_t)link_len >= link_capacity) {
           return absl::FailedPreconditionError(
-              absl::StrCat("Link is larger than PATH_MAX ",
-                           std::string(link_buf.data(), link_buf.memsize())));
+              absl::StrCat("Link target of ", elem, " is too long"));
         }
-        link_buf[link_len] = 0;
         // If the path is absolute, change to /
-        if (IsAbsolutePath(link_buf.data())) {
+        if (link_len > 0 && link_buf[0] == '/') {
+          file_system_calls++;
           PATHAUDITOR_ASSIGN_OR_RETURN(int new_fd,
                            proc_info.RootFileDescriptor(kDirOpenFlags));
           close(dir_fd);
           dir_fd = new_fd;
+          dir_valid = false;
         }
-        // prepend the link elements to our path queue
-        std::deque<std::string> link_queue =
-            absl::StrSplit(link_buf.data(), '/', absl::SkipEmpty());
-        path_queue.insert(path_queue.begin(), link_queue.begin(),
-                          link_queue.end());
+        tokens.Prepend(link_len);
         break;
       }
       default:
-        if (!path_queue.empty()) {
+        if (!tokens.empty()) {
           return absl::FailedPreconditionError(
               "Non-directory in middle of path.");
         }
-        return false;
+        return PathAuditResult();
     }
   }
 
@@ -330,214 +1037,319 @@ absl::StatusOr<bool> PathIsUserControlled(const ProcessInformation &proc_info,
       absl::StrCat("Ran into max iteration count ", max_iteration_count));
 }
 
-absl::StatusOr<bool> FileEventIsUserControlled(
-    const ProcessInformation &proc_info, const FileEvent &event) {
-  PATHAUDITOR_ASSIGN_OR_RETURN(std::string path, event.PathArg(0));
-
-  absl::optional<uint64_t> fd_arg;
-  bool skip_last_element = false;
-
-  switch (event.syscall_nr) {
-    case SYS_chmod:
-    case SYS_chown:
-    case SYS_chdir:
-    case SYS_rmdir:
-    case SYS_uselib:
-    case SYS_swapon:
-    case SYS_chroot:
-    case SYS_creat:  // creat == open(O_CREAT|O_WRONLY|O_TRUNC)
-    case SYS_truncate:
-      break;
-    case SYS_unlink:
-    case SYS_mknod:
-    case SYS_mkdir:
-    case SYS_lchown:
-      // These syscalls don't follow symlinks
-      skip_last_element = true;
-      break;
-    case SYS_unlinkat:
-    case SYS_mknodat:
-    case SYS_mkdirat: {
-      PATHAUDITOR_ASSIGN_OR_RETURN(fd_arg, event.Arg(0));
-      skip_last_element = true;
-      break;
-    }
-    case SYS_open: {
-      PATHAUDITOR_ASSIGN_OR_RETURN(int flags, event.Arg(1));
-      if (flags & O_NOFOLLOW || flags & O_EXCL) {
-        skip_last_element = true;
-      }
-      break;
-    }
-    case SYS_openat: {
-      PATHAUDITOR_ASSIGN_OR_RETURN(fd_arg, event.Arg(0));
-      PATHAUDITOR_ASSIGN_OR_RETURN(int flags, event.Arg(2));
-      if (flags & O_NOFOLLOW || flags & O_EXCL) {
-        skip_last_element = true;
-      }
-      break;
-    }
-    case SYS_fchmodat: {
-      PATHAUDITOR_ASSIGN_OR_RETURN(fd_arg, event.Arg(0));
-      // fchmodat has a no follow flag, but it's not used
-      break;
-    }
-    case SYS_fchownat: {
-      PATHAUDITOR_ASSIGN_OR_RETURN(fd_arg, event.Arg(0));
-      PATHAUDITOR_ASSIGN_OR_RETURN(int flags, event.Arg(4));
-      if (flags & AT_EMPTY_PATH && path.empty()) {
-        return false;
-      }
-      if (flags & AT_SYMLINK_NOFOLLOW) {
-        skip_last_element = true;
-      }
-      break;
-    }
-#ifdef SYS_execveat
-    case SYS_execveat: {
-      PATHAUDITOR_ASSIGN_OR_RETURN(fd_arg, event.Arg(0));
-      PATHAUDITOR_ASSIGN_OR_RETURN(int flags, event.Arg(4));
-      if (flags & AT_EMPTY_PATH && path.empty()) {
-        return false;
-      }
-      absl::StatusOr<bool> result = FileIsUserWritable(proc_info, path, fd_arg);
-      if (result.ok() && *result) {
-        return true;
-      }
-      if (flags & AT_SYMLINK_NOFOLLOW) {
-        skip_last_element = true;
-      }
-      break;
-    }
-#endif
-    case SYS_execve: {
-      absl::StatusOr<bool> result = FileIsUserWritable(proc_info, path);
-      if (result.ok() && *result) {
-        return true;
-      }
-      break;
-    }
-    case SYS_umount2: {
-      PATHAUDITOR_ASSIGN_OR_RETURN(int flags, event.Arg(1));
-      if (flags & UMOUNT_NOFOLLOW) {
-        skip_last_element = true;
-      }
-      break;
-    }
-    case SYS_name_to_handle_at: {
-      PATHAUDITOR_ASSIGN_OR_RETURN(int flags, event.Arg(4));
-      if (flags & AT_EMPTY_PATH && path.empty()) {
-        return false;
-      }
-      if (!(flags & AT_SYMLINK_FOLLOW)) {
-        skip_last_element = true;
-      }
-      break;
-    }
-    case SYS_rename: {
-      skip_last_element = true;
-      PATHAUDITOR_ASSIGN_OR_RETURN(std::string other_path, event.PathArg(1));
-      absl::StatusOr<bool> result =
-          PathIsUserControlled(proc_info, Dirname(other_path));
-      if (result.ok() && *result) {
-        return true;
-      }
-      break;
-    }
-    case SYS_renameat:
-    case SYS_renameat2: {
-      skip_last_element = true;
-      PATHAUDITOR_ASSIGN_OR_RETURN(fd_arg, event.Arg(0));
-      PATHAUDITOR_ASSIGN_OR_RETURN(int new_fd, event.Arg(2));
-      PATHAUDITOR_ASSIGN_OR_RETURN(std::string new_path, event.PathArg(1));
-      absl::StatusOr<bool> result =
-          PathIsUserControlled(proc_info, Dirname(new_path), new_fd);
-      if (result.ok() && *result) {
-        return true;
-      }
+absl::StatusOr<PathAuditResult> CheckPath(const ProcessInformation &proc_info,
+                                          absl::string_view path,
+                                          absl::optional<int> at_fd,
+                                          WalkCache *walk_cache) {
+  return WalkPath(proc_info, path, at_fd, kDefaultMaxIterationCount,
+                  walk_cache);
+}
 
-      break;
-    }
-    case SYS_link: {
-      PATHAUDITOR_ASSIGN_OR_RETURN(std::string newpath, event.PathArg(1));
-      absl::StatusOr<bool> result =
-          PathIsUserControlled(proc_info, Dirname(newpath));
-      if (result.ok() && *result) {
-        return true;
-      }
-      break;
-    }
-    case SYS_symlink: {
-      PATHAUDITOR_ASSIGN_OR_RETURN(std::string newpath, event.PathArg(1));
-      absl::StatusOr<bool> result =
-          PathIsUserControlled(proc_info, Dirname(newpath));
-      if (result.ok() && *result) {
-        return true;
-      }
-      // no checks on link target
+// Looks up the policy of the event and checks that the event has the
+// arguments the policy refers to. Afterwards they can be read directly.
+absl::StatusOr<const SyscallPolicy *> PolicyForEvent(
+    const FileEventView &event) {
+  const SyscallPolicy *policy = event.policy;
+  if (policy == nullptr) {
+    return absl::UnimplementedError(
+        absl::StrCat("No support for syscall ", event.syscall_nr));
+  }
+  if (event.args.size() < policy->arg_count) {
+    return absl::OutOfRangeError(
+        absl::StrCat(policy->name, " needs ", policy->arg_count,
+                     " arguments, got ", event.args.size()));
+  }
+  if (event.path_args.size() < policy->path_arg_count) {
+    return absl::OutOfRangeError(
+        absl::StrCat(policy->name, " needs ", policy->path_arg_count,
+                     " paths, got ", event.path_args.size()));
+  }
+  return policy;
+}
+
+absl::optional<int> DirFdArg(const SyscallPolicy &policy,
+                             const FileEventView &event, size_t path) {
+  size_t arg = policy.path_dirfd_args[path];
+  if (arg == SyscallPolicy::kNoArg) {
+    return absl::nullopt;
+  }
+  return static_cast<int>(event.args[arg]);
+}
+
+uint64_t Flags(const SyscallPolicy &policy, const FileEventView &event) {
+  return policy.flags_arg == SyscallPolicy::kNoArg
+             ? 0
+             : event.args[policy.flags_arg];
+}
+
+bool SkipsLastElement(const SyscallPolicy &policy, uint64_t flags) {
+  switch (policy.last_element) {
+    case SyscallPolicy::LastElement::kFollow:
       return false;
-    }
-    case SYS_linkat: {
-      PATHAUDITOR_ASSIGN_OR_RETURN(fd_arg, event.Arg(0));
-      PATHAUDITOR_ASSIGN_OR_RETURN(std::string newpath, event.PathArg(1));
-      PATHAUDITOR_ASSIGN_OR_RETURN(int newdirfd, event.Arg(2));
-      PATHAUDITOR_ASSIGN_OR_RETURN(int flags, event.Arg(4));
+    case SyscallPolicy::LastElement::kSkip:
+      return true;
+    case SyscallPolicy::LastElement::kSkipIfFlags:
+      return flags & policy.last_element_flags;
+    case SyscallPolicy::LastElement::kSkipUnlessFlags:
+      return !(flags & policy.last_element_flags);
+  }
+  return false;
+}
 
-      absl::StatusOr<bool> result =
-          PathIsUserControlled(proc_info, Dirname(newpath), newdirfd);
-      if (result.ok() && *result) {
-        return true;
-      }
+// Whether the first path can be left alone, see SyscallPolicy.
+bool SkipsFirstPath(const SyscallPolicy &policy, absl::string_view path,
+                    uint64_t flags) {
+  return !policy.audit_path ||
+         (flags & policy.empty_path_flags && path.empty()) ||
+         (policy.audit_path_flags != 0 && !(flags & policy.audit_path_flags));
+}
 
-      if (flags & AT_EMPTY_PATH && path.empty()) {
-        return false;
-      }
+absl::StatusOr<PathAuditResult> CheckEvent(const ProcessInformation &proc_info,
+                                           const FileEventView &event,
+                                           WalkCache *walk_cache) {
+  absl::StatusOr<const SyscallPolicy *> found = PolicyForEvent(event);
+  if (!found.ok()) {
+    return found.status();
+  }
+  const SyscallPolicy &policy = **found;
+  uint64_t flags = Flags(policy, event);
+  absl::string_view path = event.path_args[0];
 
-      if (!(flags & AT_SYMLINK_FOLLOW)) {
-        skip_last_element = true;
-      }
+  // Errors in the second path don't fail the audit, the syscall would fail
+  // as well.
+  if (policy.path_arg_count > 1) {
+    absl::string_view other_path = event.path_args[1];
+    absl::StatusOr<PathAuditResult> result = CheckPath(
+        proc_info,
+        policy.follow_second_path ? other_path : Dirname(other_path),
+        DirFdArg(policy, event, 1), walk_cache);
+    if (result.ok() && result->user_controlled) {
+      result->path_index = 1;
+      return result;
+    }
+  }
 
-      break;
+  if (SkipsFirstPath(policy, path, flags)) {
+    return PathAuditResult();
+  }
+  absl::optional<int> fd_arg = DirFdArg(policy, event, 0);
+  if (policy.executable) {
+    absl::StatusOr<bool> result = FileIsUserWritable(proc_info, path, fd_arg);
+    if (result.ok() && *result) {
+      PathAuditResult writable;
+      writable.user_controlled = true;
+      writable.reason = UnsafeReason::kWritableFile;
+      writable.component = std::string(Basename(path));
+      return writable;
     }
-    case SYS_symlinkat: {
-      PATHAUDITOR_ASSIGN_OR_RETURN(std::string newpath, event.PathArg(1));
-      PATHAUDITOR_ASSIGN_OR_RETURN(int newdirfd, event.Arg(1));
-      absl::StatusOr<bool> result =
-          PathIsUserControlled(proc_info, Dirname(newpath), newdirfd);
-      if (result.ok() && *result) {
-        return true;
-      }
-      // no checks on link target
-      return false;
+  }
+  if (SkipsLastElement(policy, flags)) {
+    path = Dirname(path);
+  }
+
+  return CheckPath(proc_info, path, fd_arg, walk_cache);
+}
+
+// Whether walking path only resolves the start directory, i.e. the path
+// consists of nothing but "." elements. The walk doesn't check anything in
+// that case.
+bool WalkIsTrivial(absl::string_view path) {
+  if (path.size() > PATH_MAX) {
+    // The walk fails for these.
+    return false;
+  }
+  PathScan scan = ScanPath(path, {});
+  return scan.component_count == scan.dot_count;
+}
+
+// Mirrors CheckEvent, without looking at the file system.
+absl::StatusOr<FileEventClass> ClassifyEvent(const FileEventView &event) {
+  PATHAUDITOR_ASSIGN_OR_RETURN(const SyscallPolicy *policy,
+                               PolicyForEvent(event));
+  uint64_t flags = Flags(*policy, event);
+  absl::string_view path = event.path_args[0];
+
+  if (policy->path_arg_count > 1) {
+    absl::string_view other_path = event.path_args[1];
+    if (!WalkIsTrivial(policy->follow_second_path ? other_path
+                                                  : Dirname(other_path))) {
+      return FileEventClass::kNeedsAudit;
     }
-    case SYS_mount: {
-      std::string source = path;
-      PATHAUDITOR_ASSIGN_OR_RETURN(std::string target, event.PathArg(1));
-      PATHAUDITOR_ASSIGN_OR_RETURN(int flags, event.Arg(3));
+  }
+  if (SkipsFirstPath(*policy, path, flags)) {
+    return FileEventClass::kSafe;
+  }
+  // The file itself is checked too.
+  if (policy->executable) {
+    return FileEventClass::kNeedsAudit;
+  }
+  return WalkIsTrivial(SkipsLastElement(*policy, flags) ? Dirname(path) : path)
+             ? FileEventClass::kSafe
+             : FileEventClass::kNeedsAudit;
+}
 
-      absl::StatusOr<bool> result = PathIsUserControlled(proc_info, target);
-      if (result.ok() && *result) {
-        return true;
-      }
+// Views of the paths of a FileEvent, allocated in arena.
+absl::StatusOr<absl::Span<const absl::string_view>> PathArgViews(
+    Arena *arena, const std::vector<std::string> &paths) {
+  absl::Span<absl::string_view> views =
+      arena->AllocateArray<absl::string_view>(paths.size());
+  if (views.size() != paths.size()) {
+    return absl::ResourceExhaustedError("Audit context is out of memory");
+  }
+  std::copy(paths.begin(), paths.end(), views.begin());
+  return views;
+}
 
-      if (!(flags & (MS_BIND | MS_MOVE))) {
-        // only check the source if MS_BIND or MS_MOVE is set
-        return false;
-      }
+absl::StatusOr<bool> UserControlled(
+    const absl::StatusOr<PathAuditResult> &result) {
+  if (!result.ok()) {
+    return result.status();
+  }
+  return result->user_controlled;
+}
+
+std::vector<absl::StatusOr<bool>> UserControlled(
+    const std::vector<absl::StatusOr<PathAuditResult>> &results) {
+  std::vector<absl::StatusOr<bool>> user_controlled;
+  user_controlled.reserve(results.size());
+  for (const absl::StatusOr<PathAuditResult> &result : results) {
+    user_controlled.push_back(UserControlled(result));
+  }
+  return user_controlled;
+}
+
+}  // namespace
 
-      break;
+void SetSafePathPrefixes(const SafePrefixTrie *prefixes) {
+  safe_path_prefixes = prefixes;
+}
+
+void SetWatchedPrefixCache(WatchedPrefixCache *cache) {
+  watched_prefix_cache = cache;
+}
+
+void SetSharedVerdictCache(SharedVerdictCache *cache) {
+  shared_verdict_cache = cache;
+}
+
+uint64_t ThreadFileSystemCallCount() { return file_system_calls; }
+
+absl::StatusOr<PathAuditResult> ExplainPathIsUserControlled(
+    const ProcessInformation &proc_info, absl::string_view path,
+    absl::optional<int> at_fd, unsigned int max_iteration_count) {
+  return WalkPath(proc_info, path, at_fd, max_iteration_count, nullptr);
+}
+
+absl::StatusOr<bool> PathIsUserControlled(const ProcessInformation &proc_info,
+                                          absl::string_view path,
+                                          absl::optional<int> at_fd,
+                                          unsigned int max_iteration_count) {
+  return UserControlled(ExplainPathIsUserControlled(proc_info, path, at_fd,
+                                                    max_iteration_count));
+}
+
+absl::StatusOr<PathAuditResult> ExplainFileEventIsUserControlled(
+    const ProcessInformation &proc_info, const FileEventView &event) {
+  return CheckEvent(proc_info, event, nullptr);
+}
+
+absl::StatusOr<PathAuditResult> ExplainFileEventIsUserControlled(
+    const ProcessInformation &proc_info, const FileEvent &event) {
+  AuditContext::Scope scope;
+  PATHAUDITOR_ASSIGN_OR_RETURN(
+      absl::Span<const absl::string_view> path_args,
+      PathArgViews(&scope.context().arena(), event.path_args));
+  return ExplainFileEventIsUserControlled(
+      proc_info, FileEventView(event.syscall_nr, event.args, path_args));
+}
+
+absl::StatusOr<bool> FileEventIsUserControlled(
+    const ProcessInformation &proc_info, const FileEventView &event) {
+  return UserControlled(ExplainFileEventIsUserControlled(proc_info, event));
+}
+
+absl::StatusOr<bool> FileEventIsUserControlled(
+    const ProcessInformation &proc_info, const FileEvent &event) {
+  return UserControlled(ExplainFileEventIsUserControlled(proc_info, event));
+}
+
+FileEventClass ClassifyFileEvent(const FileEventView &event) {
+  absl::StatusOr<FileEventClass> result = ClassifyEvent(event);
+  // Missing arguments make the audit fail.
+  return result.ok() ? *result : FileEventClass::kUnsupported;
+}
+
+FileEventClass ClassifyFileEvent(const FileEvent &event) {
+  AuditContext::Scope scope;
+  absl::StatusOr<absl::Span<const absl::string_view>> path_args =
+      PathArgViews(&scope.context().arena(), event.path_args);
+  if (!path_args.ok()) {
+    return FileEventClass::kNeedsAudit;
+  }
+  return ClassifyFileEvent(
+      FileEventView(event.syscall_nr, event.args, *path_args));
+}
+
+std::vector<absl::StatusOr<PathAuditResult>>
+ExplainFileEventsAreUserControlled(
+    const ProcessInformation &proc_info,
+    absl::Span<const FileEventView> events) {
+  // Audit the events in the order of their paths, so that paths sharing a
+  // prefix come one after another even if the cache has to be cleared. Equal
+  // events end up next to each other and are only audited once.
+  std::vector<size_t> order(events.size());
+  std::iota(order.begin(), order.end(), 0);
+  auto key = [&events](size_t i) {
+    const FileEventView &event = events[i];
+    absl::string_view path =
+        event.path_args.empty() ? absl::string_view() : event.path_args[0];
+    return std::make_tuple(path, event.syscall_nr, event.args,
+                           event.path_args);
+  };
+  std::sort(order.begin(), order.end(),
+            [&](size_t a, size_t b) { return key(a) < key(b); });
+
+  BatchProcessInformation batch_proc_info(proc_info);
+  WalkCache walk_cache;
+  std::vector<absl::StatusOr<PathAuditResult>> results(events.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    if (i > 0 && key(order[i]) == key(order[i - 1])) {
+      results[order[i]] = results[order[i - 1]];
+      continue;
     }
-    default:
-      LOG(ERROR) << "Unexpected syscall nr: " << event.syscall_nr;
-      return absl::UnimplementedError(
-          absl::StrCat("No support for syscall ", event.syscall_nr));
+    results[order[i]] =
+        CheckEvent(batch_proc_info, events[order[i]], &walk_cache);
   }
+  return results;
+}
 
-  if (skip_last_element) {
-    path = std::string(Dirname(path));
+std::vector<absl::StatusOr<PathAuditResult>>
+ExplainFileEventsAreUserControlled(
+    const ProcessInformation &proc_info, absl::Span<const FileEvent> events) {
+  AuditContext::Scope scope;
+  std::vector<FileEventView> views;
+  views.reserve(events.size());
+  for (const FileEvent &event : events) {
+    absl::StatusOr<absl::Span<const absl::string_view>> path_args =
+        PathArgViews(&scope.context().arena(), event.path_args);
+    if (!path_args.ok()) {
+      return std::vector<absl::StatusOr<PathAuditResult>>(events.size(),
+                                                          path_args.status());
+    }
+    views.emplace_back(event.syscall_nr, event.args, *path_args);
   }
+  return ExplainFileEventsAreUserControlled(proc_info, views);
+}
+
+std::vector<absl::StatusOr<bool>> FileEventsAreUserControlled(
+    const ProcessInformation &proc_info,
+    absl::Span<const FileEventView> events) {
+  return UserControlled(ExplainFileEventsAreUserControlled(proc_info, events));
+}
 
-  return PathIsUserControlled(proc_info, path, fd_arg);
+std::vector<absl::StatusOr<bool>> FileEventsAreUserControlled(
+    const ProcessInformation &proc_info, absl::Span<const FileEvent> events) {
+  return UserControlled(ExplainFileEventsAreUserControlled(proc_info, events));
 }
 
 }  // namespace pathauditor
@@ -17,14 +17,45 @@
 
 #include <sys/types.h>
 
+#include <vector>
+
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
+#include "absl/types/span.h"
 #include "pathauditor/file_event.h"
+#include "pathauditor/path_audit_result.h"
 #include "pathauditor/process_information.h"
+#include "pathauditor/safe_prefix_trie.h"
+#include "pathauditor/shared_verdict_cache.h"
+#include "pathauditor/watched_prefix_cache.h"
 
 namespace pathauditor {
 
+// Installs a set of prefixes under which absolute paths are never considered
+// user controlled, without looking at the file system. The prefixes are
+// interpreted relative to our own root, so don't install them when auditing
+// processes with a different root. Pass nullptr to remove them again.
+// The trie is not owned and needs to outlive all audits. Installing it is not
+// synchronized with audits running on other threads.
+void SetSafePathPrefixes(const SafePrefixTrie *prefixes);
+
+// Installs a cache that lets walks skip over directories they already went
+// through, see WatchedPrefixCache. It's only used for processes that share our
+// mount namespace, the others use ProcessInformation::WatchedPrefixes. Pass
+// nullptr to remove it again.
+// The cache is not owned and needs to outlive all audits. Installing it is not
+// synchronized with audits running on other threads.
+void SetWatchedPrefixCache(WatchedPrefixCache *cache);
+
+// Installs a verdict cache shared with other processes, see
+// SharedVerdictCache. Directories missing from the cache of the thread are
+// looked up in it, and the verdicts computed by the walks are stored in it.
+// Pass nullptr to remove it again.
+// The cache is not owned and needs to outlive all audits. Installing it is not
+// synchronized with audits running on other threads.
+void SetSharedVerdictCache(SharedVerdictCache *cache);
+
 // Checks if any element in the path could have been replaced with a symlink by
 // an unprivileged user.
 // If the path is relative, at_fd needs to be a valid file descriptor.
@@ -34,13 +65,74 @@ absl::StatusOr<bool> PathIsUserControlled(
     absl::optional<int> at_fd = absl::optional<int>(),
     unsigned int max_iteration_count = 40);
 
+// Same as PathIsUserControlled, but also tells which element made the path
+// user controlled and why.
+absl::StatusOr<PathAuditResult> ExplainPathIsUserControlled(
+    const ProcessInformation &proc_info, absl::string_view path,
+    absl::optional<int> at_fd = absl::optional<int>(),
+    unsigned int max_iteration_count = 40);
+
 // Perform checks on the paths in the FileEvent based on the syscall and its
 // arguments.
 // For example, if open is called with the O_NOFOLLOW flag, we can skip the last
 // element in the path.
 absl::StatusOr<bool> FileEventIsUserControlled(
+    const ProcessInformation &proc_info, const FileEventView &event);
+absl::StatusOr<bool> FileEventIsUserControlled(
+    const ProcessInformation &proc_info, const FileEvent &event);
+
+// Same as FileEventIsUserControlled, with the offending element of the first
+// path that is user controlled.
+absl::StatusOr<PathAuditResult> ExplainFileEventIsUserControlled(
+    const ProcessInformation &proc_info, const FileEventView &event);
+absl::StatusOr<PathAuditResult> ExplainFileEventIsUserControlled(
     const ProcessInformation &proc_info, const FileEvent &event);
 
+// What can be said about an event without looking at the file system.
+enum class FileEventClass {
+  // FileEventIsUserControlled returns false for the event, or fails because
+  // a file descriptor in it is invalid.
+  kSafe,
+  kNeedsAudit,
+  // FileEventIsUserControlled fails for the event, e.g. because the syscall
+  // isn't supported or arguments are missing.
+  kUnsupported,
+};
+
+// Classifies the event by its arguments alone, so that callers can skip the
+// audit, or handing the event to the daemon, for calls like
+// unlinkat(dirfd, name, 0) or openat(dirfd, name, O_NOFOLLOW) that don't
+// resolve any path element other than the one they operate on.
+FileEventClass ClassifyFileEvent(const FileEventView &event);
+FileEventClass ClassifyFileEvent(const FileEvent &event);
+
+// Audits a batch of events of the same process. Returns the same results, in
+// the same order, as calling FileEventIsUserControlled on every event, as long
+// as the process and the file system don't change during the call. The root
+// and the cwd are only opened once and directories that the paths have in
+// common are only walked once. Once a walk found an element to be user
+// controlled, the paths that lead through the same element are reported with
+// the same result without walking them.
+std::vector<absl::StatusOr<bool>> FileEventsAreUserControlled(
+    const ProcessInformation &proc_info,
+    absl::Span<const FileEventView> events);
+std::vector<absl::StatusOr<bool>> FileEventsAreUserControlled(
+    const ProcessInformation &proc_info, absl::Span<const FileEvent> events);
+
+// Same as FileEventsAreUserControlled, with the results of
+// ExplainFileEventIsUserControlled.
+std::vector<absl::StatusOr<PathAuditResult>>
+ExplainFileEventsAreUserControlled(const ProcessInformation &proc_info,
+                                   absl::Span<const FileEventView> events);
+std::vector<absl::StatusOr<PathAuditResult>>
+ExplainFileEventsAreUserControlled(const ProcessInformation &proc_info,
+                                   absl::Span<const FileEvent> events);
+
+// The number of file system lookups, i.e. stat, open, readlink, statfs and
+// ioctl calls, that the audits on the calling thread made so far. Meant for
+// statistics, take the difference around an audit.
+uint64_t ThreadFileSystemCallCount();
+
 }  // namespace pathauditor
 
 #endif  // PATHAUDITOR_PATHAUDITOR_H_
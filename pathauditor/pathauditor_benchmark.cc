@@ -0,0 +1,299 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks for the path walk. The fixture is created in a fresh directory
+// below /tmp. The verdicts depend on who owns it, so run this as root to get
+// numbers that are representative for privileged processes. As a normal user
+// most walks stop at the first user owned directory.
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/types/span.h"
+#include "pathauditor/directory_verdict_cache.h"
+#include "pathauditor/file_event.h"
+#include "pathauditor/pathauditor.h"
+#include "pathauditor/proc_fd_cache.h"
+#include "pathauditor/process_information.h"
+#include "pathauditor/util/path.h"
+#include "pathauditor/util/path_scanner.h"
+
+namespace pathauditor {
+namespace {
+
+constexpr int kMaxDepth = 32;
+// Every symlink restarts the walk at the fixture root, which already takes a
+// few iterations. Longer chains run into the max_iteration_count of the walk.
+constexpr int kMaxSymlinkChain = 8;
+
+// Layout below the fixture root:
+//   deep/d/d/.../file  kMaxDepth nested directories
+//   file               a regular file
+//   link0 -> link1 -> ... -> file
+//   sticky/file        in a world writable, sticky directory
+class Fixture {
+ public:
+  static const Fixture &Get() {
+    static const Fixture *fixture = new Fixture();
+    return *fixture;
+  }
+
+  const std::string &root() const { return root_; }
+
+  std::string DeepPath(int depth) const {
+    std::string path = JoinPath(root_, "deep");
+    for (int i = 1; i < depth; i++) {
+      absl::StrAppend(&path, "/d");
+    }
+    return JoinPath(path, "file");
+  }
+
+  std::string SymlinkChain(int length) const {
+    return JoinPath(root_, absl::StrCat("link", kMaxSymlinkChain - length));
+  }
+
+ private:
+  Fixture() {
+    char root_template[] = "/tmp/pathauditor_benchmark.XXXXXX";
+    root_ = mkdtemp(root_template);
+    chmod(root_.c_str(), 0755);
+
+    std::string dir = JoinPath(root_, "deep");
+    mkdir(dir.c_str(), 0755);
+    for (int i = 1; i < kMaxDepth; i++) {
+      dir = JoinPath(dir, "d");
+      mkdir(dir.c_str(), 0755);
+    }
+    for (int depth = 1; depth <= kMaxDepth; depth++) {
+      CreateFile(DeepPath(depth));
+    }
+
+    CreateFile(JoinPath(root_, "file"));
+    for (int i = 0; i < kMaxSymlinkChain; i++) {
+      std::string target =
+          i + 1 == kMaxSymlinkChain ? "file" : absl::StrCat("link", i + 1);
+      symlink(JoinPath(root_, target).c_str(),
+              JoinPath(root_, absl::StrCat("link", i)).c_str());
+    }
+
+    std::string sticky = JoinPath(root_, "sticky");
+    mkdir(sticky.c_str(), 0755);
+    chmod(sticky.c_str(), 01777);
+    CreateFile(JoinPath(sticky, "file"));
+  }
+
+  static void CreateFile(const std::string &path) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+
+  std::string root_;
+};
+
+void CheckPath(benchmark::State &state, const std::string &path,
+               bool cold_cache) {
+  SameProcessInformation proc_info;
+  for (auto _ : state) {
+    if (cold_cache) {
+      DirectoryVerdictCache::ForCurrentThread().Clear();
+    }
+    absl::StatusOr<bool> result = PathIsUserControlled(proc_info, path);
+    if (!result.ok()) {
+      state.SkipWithError(std::string(result.status().message()).c_str());
+      return;
+    }
+    benchmark::DoNotOptimize(*result);
+  }
+}
+
+void BM_PathDepth(benchmark::State &state) {
+  CheckPath(state, Fixture::Get().DeepPath(state.range(0)), false);
+}
+BENCHMARK(BM_PathDepth)->RangeMultiplier(2)->Range(1, kMaxDepth);
+
+void BM_PathDepthColdCache(benchmark::State &state) {
+  CheckPath(state, Fixture::Get().DeepPath(state.range(0)), true);
+}
+BENCHMARK(BM_PathDepthColdCache)->RangeMultiplier(2)->Range(1, kMaxDepth);
+
+void BM_SymlinkChain(benchmark::State &state) {
+  CheckPath(state, Fixture::Get().SymlinkChain(state.range(0)), false);
+}
+BENCHMARK(BM_SymlinkChain)->RangeMultiplier(2)->Range(1, kMaxSymlinkChain);
+
+void BM_StickyDirectory(benchmark::State &state) {
+  CheckPath(state, JoinPath(Fixture::Get().root(), "sticky", "file"), false);
+}
+BENCHMARK(BM_StickyDirectory);
+
+void BM_SystemTmp(benchmark::State &state) {
+  CheckPath(state, JoinPath(Fixture::Get().root(), "file"), false);
+}
+BENCHMARK(BM_SystemTmp);
+
+void BM_ProcSelfFd(benchmark::State &state) {
+  std::string file = JoinPath(Fixture::Get().root(), "file");
+  int fd = open(file.c_str(), O_RDONLY);
+  CheckPath(state, absl::StrCat("/proc/self/fd/", fd), false);
+  close(fd);
+}
+BENCHMARK(BM_ProcSelfFd);
+
+void BM_ProcSelfCwd(benchmark::State &state) {
+  CheckPath(state, "/proc/self/cwd/.", false);
+}
+BENCHMARK(BM_ProcSelfCwd);
+
+// Looks up a path relative to the cwd of a "remote" process, as the daemon
+// does, with and without a ProcFdCache.
+void BM_RemoteProcess(benchmark::State &state) {
+  const std::string &root = Fixture::Get().root();
+  std::string path = Fixture::Get().DeepPath(8).substr(root.size() + 1);
+  std::unique_ptr<ProcFdCache> cache = ProcFdCache::Open(getpid()).value();
+  state.SetLabel(state.range(0) ? "cached" : "uncached");
+  for (auto _ : state) {
+    absl::StatusOr<bool> result =
+        state.range(0) ? PathIsUserControlled(
+                             RemoteProcessInformation(cache.get(), root), path)
+                       : PathIsUserControlled(
+                             RemoteProcessInformation(getpid(), root), path);
+    if (!result.ok()) {
+      state.SkipWithError(std::string(result.status().message()).c_str());
+      return;
+    }
+    benchmark::DoNotOptimize(*result);
+  }
+}
+BENCHMARK(BM_RemoteProcess)->Arg(0)->Arg(1);
+
+// One event per group of syscalls that FileEventIsUserControlled handles
+// differently.
+struct SyscallCase {
+  const char *name;
+  int syscall_nr;
+  std::vector<uint64_t> args;
+  std::vector<std::string> path_args;
+};
+
+std::vector<SyscallCase> SyscallCases() {
+  const std::string &root = Fixture::Get().root();
+  std::string file = JoinPath(root, "file");
+  std::string deep = Fixture::Get().DeepPath(8);
+  uint64_t at_fdcwd = static_cast<uint64_t>(AT_FDCWD);
+  return {
+      {"open", SYS_open, {0, O_RDONLY, 0}, {deep}},
+      {"open_nofollow", SYS_open, {0, O_RDONLY | O_NOFOLLOW, 0}, {deep}},
+      {"openat", SYS_openat, {at_fdcwd, 0, O_RDONLY, 0}, {deep}},
+      {"chmod", SYS_chmod, {0, 0644}, {file}},
+      {"unlinkat", SYS_unlinkat, {at_fdcwd, 0, 0}, {file}},
+      {"execve", SYS_execve, {0, 0, 0}, {"/bin/true"}},
+      {"rename", SYS_rename, {}, {file, JoinPath(root, "other")}},
+      {"symlink", SYS_symlink, {}, {file, JoinPath(root, "other")}},
+      {"linkat",
+       SYS_linkat,
+       {at_fdcwd, 0, at_fdcwd, 0, 0},
+       {file, JoinPath(root, "other")}},
+  };
+}
+
+void BM_FileEvent(benchmark::State &state) {
+  static const std::vector<SyscallCase> *cases =
+      new std::vector<SyscallCase>(SyscallCases());
+  const SyscallCase &c = (*cases)[state.range(0)];
+  state.SetLabel(c.name);
+
+  FileEvent event(c.syscall_nr, c.args, c.path_args);
+  SameProcessInformation proc_info;
+  for (auto _ : state) {
+    absl::StatusOr<bool> result = FileEventIsUserControlled(proc_info, event);
+    if (!result.ok()) {
+      state.SkipWithError(std::string(result.status().message()).c_str());
+      return;
+    }
+    benchmark::DoNotOptimize(*result);
+  }
+}
+BENCHMARK(BM_FileEvent)->DenseRange(0, 8);
+
+// Opens the file at every depth of the deep directory, one event at a time or
+// as a single batch.
+void BM_EventBatch(benchmark::State &state) {
+  std::vector<FileEvent> events;
+  for (int depth = 1; depth <= kMaxDepth; depth++) {
+    events.push_back(FileEvent(SYS_open, {0, O_RDONLY, 0},
+                               {Fixture::Get().DeepPath(depth)}));
+  }
+  state.SetLabel(state.range(0) ? "batch" : "loop");
+  SameProcessInformation proc_info;
+  for (auto _ : state) {
+    if (state.range(0)) {
+      benchmark::DoNotOptimize(FileEventsAreUserControlled(proc_info, events));
+    } else {
+      for (const FileEvent &event : events) {
+        benchmark::DoNotOptimize(FileEventIsUserControlled(proc_info, event));
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * events.size());
+}
+BENCHMARK(BM_EventBatch)->Arg(0)->Arg(1);
+
+// Splits a path of the given depth with each ScanPath implementation and with
+// absl::StrSplit for comparison.
+void BM_ScanPath(benchmark::State &state) {
+  using ScanFn = PathScan (*)(absl::string_view, absl::Span<PathComponent>);
+  static constexpr struct {
+    const char *name;
+    ScanFn scan;
+  } kImplementations[] = {
+      {"scalar", &internal::ScanPathScalar},
+      {"sse2", &internal::ScanPathSse2},
+      {"avx2", &internal::ScanPathAvx2},
+      {"StrSplit", nullptr},
+  };
+  const auto &impl = kImplementations[state.range(0)];
+  state.SetLabel(impl.name);
+  std::string path;
+  for (int i = 0; i < state.range(1); i++) {
+    absl::StrAppend(&path, "/component", i);
+  }
+  std::vector<PathComponent> components(MaxPathComponents(path));
+  for (auto _ : state) {
+    if (impl.scan != nullptr) {
+      benchmark::DoNotOptimize(impl.scan(path, absl::MakeSpan(components)));
+    } else {
+      std::vector<absl::string_view> split =
+          absl::StrSplit(path, '/', absl::SkipEmpty());
+      benchmark::DoNotOptimize(split);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * path.size());
+}
+BENCHMARK(BM_ScanPath)->ArgsProduct({{0, 1, 2, 3}, {4, 16}});
+
+}  // namespace
+}  // namespace pathauditor
@@ -0,0 +1,414 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/pathauditor.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Le;
+using ::testing::Lt;
+using ::testing::Ne;
+using ::testing::SizeIs;
+
+// Counts how often the root is opened.
+class CountingProcessInformation : public SameProcessInformation {
+ public:
+  absl::StatusOr<int> RootFileDescriptor(int open_flags) const override {
+    root_opens++;
+    return SameProcessInformation::RootFileDescriptor(open_flags);
+  }
+
+  mutable int root_opens = 0;
+};
+
+class FileEventsAreUserControlledTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir_template[] = "/tmp/pathauditor_test.XXXXXX";
+    ASSERT_THAT(mkdtemp(dir_template), Ne(nullptr));
+    dir_ = dir_template;
+    ASSERT_THAT(chmod(dir_.c_str(), 0755), Eq(0));
+    for (const char *sub : {"/a", "/a/b", "/a/b/c", "/open"}) {
+      ASSERT_THAT(mkdir((dir_ + sub).c_str(), 0755), Eq(0));
+    }
+    // Writable by everyone and not sticky, so anything in it is user
+    // controlled.
+    ASSERT_THAT(chmod((dir_ + "/open").c_str(), 0777), Eq(0));
+    ASSERT_THAT(symlink("a/b", (dir_ + "/to_b").c_str()), Eq(0));
+    ASSERT_THAT(symlink("open", (dir_ + "/to_open").c_str()), Eq(0));
+    ASSERT_THAT(symlink("loop", (dir_ + "/loop").c_str()), Eq(0));
+  }
+
+  void TearDown() override {
+    for (const char *link : {"/to_b", "/to_open", "/loop"}) {
+      unlink((dir_ + link).c_str());
+    }
+    for (const char *sub : {"/a/b/c", "/a/b", "/a", "/open"}) {
+      rmdir((dir_ + sub).c_str());
+    }
+    rmdir(dir_.c_str());
+  }
+
+  FileEvent Open(const std::string &path) {
+    return FileEvent(SYS_open, {0, O_RDONLY}, {dir_ + path});
+  }
+
+  // The index of an element of path among the elements of dir_ + path.
+  size_t ComponentIndex(size_t index_in_path) const {
+    return std::count(dir_.begin(), dir_.end(), '/') + index_in_path;
+  }
+
+  struct stat Stat(const std::string &path) const {
+    struct stat sb = {};
+    EXPECT_THAT(lstat((dir_ + path).c_str(), &sb), Eq(0)) << path;
+    return sb;
+  }
+
+  std::string dir_;
+};
+
+TEST_F(FileEventsAreUserControlledTest, MatchesSingleEvents) {
+  int dir_fd = open(dir_.c_str(), O_RDONLY | O_DIRECTORY);
+  ASSERT_THAT(dir_fd, Ne(-1));
+  std::vector<FileEvent> events = {
+      Open("/a/b/c/file"),
+      Open("/open/file"),
+      Open("/a/b/file"),
+      Open("/to_b/c/file"),
+      Open("/a/b/c/file"),
+      Open("/to_open/file"),
+      Open("/a/./b/../b/c"),
+      Open("/loop/file"),
+      Open("/a/b/c/file/more"),
+      FileEvent(SYS_openat, {static_cast<uint64_t>(dir_fd), 0, O_RDONLY},
+                {"a/b/c/file"}),
+      FileEvent(SYS_openat, {static_cast<uint64_t>(dir_fd), 0, O_RDONLY},
+                {"open/file"}),
+      FileEvent(SYS_rename, {0, 0}, {dir_ + "/a/b/file", dir_ + "/open/file"}),
+      FileEvent(SYS_mkdir, {0, 0755}, {dir_ + "/a/b/c/new"}),
+  };
+
+  SameProcessInformation proc_info;
+  std::vector<absl::StatusOr<bool>> results =
+      FileEventsAreUserControlled(proc_info, events);
+  ASSERT_THAT(results, SizeIs(events.size()));
+  for (size_t i = 0; i < events.size(); i++) {
+    absl::StatusOr<bool> expected =
+        FileEventIsUserControlled(proc_info, events[i]);
+    EXPECT_THAT(results[i].status().code(), Eq(expected.status().code()))
+        << events[i];
+    if (expected.ok() && results[i].ok()) {
+      EXPECT_THAT(*results[i], Eq(*expected)) << events[i];
+    }
+  }
+  close(dir_fd);
+
+  // Make sure the batch saw both kinds of paths.
+  EXPECT_THAT(results[0].value_or(true), Eq(false));
+  EXPECT_THAT(results[1].value_or(false), Eq(true));
+}
+
+TEST_F(FileEventsAreUserControlledTest, ExplainsUnsafeElement) {
+  SameProcessInformation proc_info;
+  struct stat open_sb = Stat("/open");
+
+  absl::StatusOr<PathAuditResult> result =
+      ExplainFileEventIsUserControlled(proc_info, Open("/open/file"));
+  ASSERT_TRUE(result.ok()) << result.status();
+  EXPECT_TRUE(result->user_controlled);
+  EXPECT_THAT(result->reason, Eq(UnsafeReason::kMissingEntry));
+  EXPECT_THAT(result->path_index, Eq(0));
+  EXPECT_THAT(result->component_index, Eq(ComponentIndex(1)));
+  EXPECT_FALSE(result->followed_symlink);
+  EXPECT_THAT(result->component, Eq("file"));
+  EXPECT_THAT(result->directory_dev, Eq(open_sb.st_dev));
+  EXPECT_THAT(result->directory_ino, Eq(open_sb.st_ino));
+  EXPECT_THAT(result->directory_mode & 07777, Eq(0777));
+
+  // The symlink adds an element.
+  result = ExplainFileEventIsUserControlled(proc_info, Open("/to_open/file"));
+  ASSERT_TRUE(result.ok()) << result.status();
+  EXPECT_THAT(result->reason, Eq(UnsafeReason::kMissingEntry));
+  EXPECT_THAT(result->component_index, Eq(ComponentIndex(2)));
+  EXPECT_TRUE(result->followed_symlink);
+  EXPECT_THAT(result->directory_ino, Eq(open_sb.st_ino));
+
+  // An existing directory in it.
+  ASSERT_THAT(mkdir((dir_ + "/open/sub").c_str(), 0755), Eq(0));
+  struct stat sub_sb = Stat("/open/sub");
+  result = ExplainFileEventIsUserControlled(proc_info, Open("/open/sub/file"));
+  rmdir((dir_ + "/open/sub").c_str());
+  ASSERT_TRUE(result.ok()) << result.status();
+  EXPECT_THAT(result->reason, Eq(UnsafeReason::kDirectoryWritable));
+  EXPECT_THAT(result->component, Eq("sub"));
+  EXPECT_THAT(result->ino, Eq(sub_sb.st_ino));
+
+  // The second path of a rename.
+  result = ExplainFileEventIsUserControlled(
+      proc_info, FileEvent(SYS_rename, {0, 0},
+                           {dir_ + "/a/b/file", dir_ + "/open/x/file"}));
+  ASSERT_TRUE(result.ok()) << result.status();
+  EXPECT_THAT(result->path_index, Eq(1));
+  EXPECT_THAT(result->component, Eq("x"));
+
+  result = ExplainFileEventIsUserControlled(proc_info, Open("/a/b/c/file"));
+  ASSERT_TRUE(result.ok()) << result.status();
+  EXPECT_FALSE(result->user_controlled);
+  EXPECT_THAT(result->reason, Eq(UnsafeReason::kNone));
+}
+
+TEST_F(FileEventsAreUserControlledTest, ExplainsOwners) {
+  if (geteuid() != 0) {
+    GTEST_SKIP() << "needs to chown files";
+  }
+  SameProcessInformation proc_info;
+  ASSERT_THAT(chown((dir_ + "/a/b").c_str(), 1234, 1234), Eq(0));
+  absl::StatusOr<PathAuditResult> result =
+      ExplainFileEventIsUserControlled(proc_info, Open("/a/b/c/file"));
+  ASSERT_TRUE(result.ok()) << result.status();
+  EXPECT_THAT(result->reason, Eq(UnsafeReason::kDirectoryOwner));
+  EXPECT_THAT(result->component, Eq("c"));
+  EXPECT_THAT(result->component_index, Eq(ComponentIndex(2)));
+  EXPECT_THAT(result->directory_ino, Eq(Stat("/a/b").st_ino));
+  EXPECT_THAT(result->directory_uid, Eq(1234));
+  ASSERT_THAT(chown((dir_ + "/a/b").c_str(), 0, 0), Eq(0));
+
+  ASSERT_THAT(chmod((dir_ + "/open").c_str(), 01777), Eq(0));
+  ASSERT_THAT(mkdir((dir_ + "/open/mine").c_str(), 0755), Eq(0));
+  ASSERT_THAT(mkdir((dir_ + "/open/theirs").c_str(), 0755), Eq(0));
+  ASSERT_THAT(chown((dir_ + "/open/theirs").c_str(), 1234, 1234), Eq(0));
+  absl::StatusOr<PathAuditResult> mine =
+      ExplainFileEventIsUserControlled(proc_info, Open("/open/mine/file"));
+  result =
+      ExplainFileEventIsUserControlled(proc_info, Open("/open/theirs/file"));
+  rmdir((dir_ + "/open/mine").c_str());
+  rmdir((dir_ + "/open/theirs").c_str());
+  ASSERT_TRUE(mine.ok()) << mine.status();
+  // Entries of a sticky directory that belong to us or root are safe.
+  EXPECT_FALSE(mine->user_controlled);
+  ASSERT_TRUE(result.ok()) << result.status();
+  EXPECT_THAT(result->reason, Eq(UnsafeReason::kStickyEntryOwner));
+  EXPECT_THAT(result->component, Eq("theirs"));
+  EXPECT_THAT(result->uid, Eq(1234));
+}
+
+TEST_F(FileEventsAreUserControlledTest, BatchReusesUnsafeElements) {
+  std::vector<FileEvent> events;
+  for (int i = 0; i < 10; i++) {
+    events.push_back(Open(absl::StrCat("/open/x/", i)));
+  }
+  events.push_back(Open("/to_open/x/1"));
+  events.push_back(Open("/a/b/c/file"));
+
+  SameProcessInformation proc_info;
+  std::vector<absl::StatusOr<PathAuditResult>> results =
+      ExplainFileEventsAreUserControlled(proc_info, events);
+  ASSERT_THAT(results, SizeIs(events.size()));
+  for (size_t i = 0; i < events.size(); i++) {
+    absl::StatusOr<PathAuditResult> expected =
+        ExplainFileEventIsUserControlled(proc_info, events[i]);
+    ASSERT_TRUE(expected.ok()) << expected.status();
+    ASSERT_TRUE(results[i].ok()) << results[i].status();
+    EXPECT_THAT(results[i]->user_controlled, Eq(expected->user_controlled))
+        << events[i];
+    EXPECT_THAT(results[i]->reason, Eq(expected->reason)) << events[i];
+    EXPECT_THAT(results[i]->component_index, Eq(expected->component_index))
+        << events[i];
+    EXPECT_THAT(results[i]->followed_symlink, Eq(expected->followed_symlink))
+        << events[i];
+    EXPECT_THAT(results[i]->component, Eq(expected->component)) << events[i];
+    EXPECT_THAT(results[i]->directory_ino, Eq(expected->directory_ino))
+        << events[i];
+  }
+  EXPECT_THAT(results[0]->component, Eq("x"));
+
+  // After the first path, the siblings only cost opening and looking at the
+  // start directory.
+  uint64_t calls = ThreadFileSystemCallCount();
+  ExplainFileEventsAreUserControlled(proc_info,
+                                     absl::MakeConstSpan(events).first(1));
+  uint64_t first_calls = ThreadFileSystemCallCount() - calls;
+  calls = ThreadFileSystemCallCount();
+  ExplainFileEventsAreUserControlled(proc_info,
+                                     absl::MakeConstSpan(events).first(10));
+  EXPECT_THAT(ThreadFileSystemCallCount() - calls, Le(first_calls + 9 * 2));
+}
+
+TEST_F(FileEventsAreUserControlledTest, OpensRootOnce) {
+  std::vector<FileEvent> events = {
+      Open("/a/b/c/file"), Open("/a/b/file"), Open("/to_b/c/file"),
+      Open("/a/file")};
+
+  CountingProcessInformation proc_info;
+  for (const absl::StatusOr<bool> &result :
+       FileEventsAreUserControlled(proc_info, events)) {
+    EXPECT_TRUE(result.ok()) << result.status();
+  }
+  EXPECT_THAT(proc_info.root_opens, Eq(1));
+}
+
+TEST_F(FileEventsAreUserControlledTest, ClassifiesWithoutFileSystem) {
+  int open_fd = open((dir_ + "/open").c_str(), O_RDONLY | O_DIRECTORY);
+  ASSERT_THAT(open_fd, Ne(-1));
+  uint64_t fd = open_fd;
+  struct Case {
+    FileEvent event;
+    FileEventClass expected;
+  };
+  std::vector<Case> cases = {
+      {FileEvent(SYS_unlinkat, {fd, 0, 0}, {"file"}), FileEventClass::kSafe},
+      {FileEvent(SYS_openat, {fd, 0, O_RDONLY | O_NOFOLLOW}, {"file"}),
+       FileEventClass::kSafe},
+      {FileEvent(SYS_mkdirat, {fd, 0, 0755}, {"./new"}), FileEventClass::kSafe},
+      {FileEvent(SYS_fchownat, {fd, 0, 0, 0, AT_EMPTY_PATH}, {""}),
+       FileEventClass::kSafe},
+      {FileEvent(SYS_renameat, {fd, 0, fd, 0}, {"a", "b"}),
+       FileEventClass::kSafe},
+      {FileEvent(SYS_chdir, {0}, {"/"}), FileEventClass::kSafe},
+      {FileEvent(SYS_lstat, {0, 0}, {"file"}), FileEventClass::kSafe},
+      {FileEvent(SYS_faccessat2, {fd, 0, R_OK, AT_EMPTY_PATH}, {""}),
+       FileEventClass::kSafe},
+      // Follows file, which anyone can replace.
+      {FileEvent(SYS_openat, {fd, 0, O_RDONLY}, {"file"}),
+       FileEventClass::kNeedsAudit},
+      {FileEvent(SYS_faccessat, {fd, 0, X_OK}, {"file"}),
+       FileEventClass::kNeedsAudit},
+      {FileEvent(SYS_unlinkat, {fd, 0, 0}, {"../open/file"}),
+       FileEventClass::kNeedsAudit},
+      {FileEvent(SYS_renameat, {fd, 0, fd, 0}, {"a", "sub/b"}),
+       FileEventClass::kNeedsAudit},
+      {Open("/open/file"), FileEventClass::kNeedsAudit},
+      {FileEvent(SYS_execve, {0, 0}, {"true"}), FileEventClass::kNeedsAudit},
+      {FileEvent(SYS_read, {0, 0, 0}, {"file"}), FileEventClass::kUnsupported},
+      {FileEvent(SYS_openat, {fd, 0}, {"file"}), FileEventClass::kUnsupported},
+  };
+
+  SameProcessInformation proc_info;
+  for (const Case &c : cases) {
+    EXPECT_THAT(ClassifyFileEvent(c.event), Eq(c.expected)) << c.event;
+    absl::StatusOr<bool> result = FileEventIsUserControlled(proc_info, c.event);
+    if (c.expected == FileEventClass::kSafe) {
+      EXPECT_THAT(result.value_or(true), Eq(false)) << c.event;
+    } else if (c.expected == FileEventClass::kUnsupported) {
+      EXPECT_FALSE(result.ok()) << c.event;
+    }
+  }
+  close(open_fd);
+}
+
+TEST_F(FileEventsAreUserControlledTest, SkippedPrefixMatchesWalk) {
+  ASSERT_THAT(mkdir((dir_ + "/sticky").c_str(), 0755), Eq(0));
+  ASSERT_THAT(chmod((dir_ + "/sticky").c_str(), 01777), Eq(0));
+  ASSERT_THAT(mkdir((dir_ + "/sticky/d").c_str(), 0755), Eq(0));
+  int dir_fd = open(dir_.c_str(), O_RDONLY | O_DIRECTORY);
+  ASSERT_THAT(dir_fd, Ne(-1));
+
+  // The literal paths can skip their prefix in one go, going through ".."
+  // makes the walk look at every element.
+  SameProcessInformation proc_info;
+  for (const char *path : {"a/b/c/file", "to_b/c/file", "open/x/file",
+                           "sticky/d/file", "a/b/c/file/more"}) {
+    std::string walked = absl::StrCat("a/../", path);
+    absl::StatusOr<PathAuditResult> skipped =
+        ExplainPathIsUserControlled(proc_info, path, dir_fd);
+    absl::StatusOr<PathAuditResult> expected =
+        ExplainPathIsUserControlled(proc_info, walked, dir_fd);
+    ASSERT_THAT(skipped.ok(), Eq(expected.ok())) << path;
+    if (!expected.ok()) {
+      EXPECT_THAT(skipped.status().code(), Eq(expected.status().code()))
+          << path;
+      continue;
+    }
+    EXPECT_THAT(skipped->user_controlled, Eq(expected->user_controlled))
+        << path;
+    EXPECT_THAT(skipped->reason, Eq(expected->reason)) << path;
+    EXPECT_THAT(skipped->followed_symlink, Eq(expected->followed_symlink))
+        << path;
+    EXPECT_THAT(skipped->component, Eq(expected->component)) << path;
+  }
+
+  // Every element counts toward the limit, skipped or not.
+  for (unsigned int max_iterations = 1; max_iterations < 8; max_iterations++) {
+    for (const char *path : {"a/b/c/file", "a/./b/c/file", "a/../a/b/c/file"}) {
+      size_t elements = std::count(path, path + strlen(path), '/') + 1;
+      absl::StatusOr<bool> result =
+          PathIsUserControlled(proc_info, path, dir_fd, max_iterations);
+      if (max_iterations >= elements) {
+        EXPECT_THAT(result.value_or(true), Eq(false))
+            << path << " with " << max_iterations;
+      } else {
+        EXPECT_TRUE(absl::IsResourceExhausted(result.status()))
+            << path << " with " << max_iterations;
+      }
+    }
+  }
+
+  close(dir_fd);
+  rmdir((dir_ + "/sticky/d").c_str());
+  rmdir((dir_ + "/sticky").c_str());
+}
+
+TEST_F(FileEventsAreUserControlledTest, WatchedPrefixesFollowChanges) {
+  absl::StatusOr<std::unique_ptr<WatchedPrefixCache>> cache =
+      WatchedPrefixCache::Create();
+  ASSERT_TRUE(cache.ok()) << cache.status();
+  SetWatchedPrefixCache(cache->get());
+  int dir_fd = open(dir_.c_str(), O_RDONLY | O_DIRECTORY);
+  ASSERT_THAT(dir_fd, Ne(-1));
+  FileEvent event(SYS_openat, {static_cast<uint64_t>(dir_fd), 0, O_RDONLY},
+                  {"a/b/c/file"});
+
+  SameProcessInformation proc_info;
+  EXPECT_THAT(FileEventIsUserControlled(proc_info, event).value_or(true),
+              Eq(false));
+  EXPECT_THAT((*cache)->size(), Eq(1));
+  uint64_t calls = ThreadFileSystemCallCount();
+  EXPECT_THAT(FileEventIsUserControlled(proc_info, event).value_or(true),
+              Eq(false));
+  // Only the start directory, the cached prefix and the file itself.
+  EXPECT_THAT(ThreadFileSystemCallCount() - calls, Lt(5));
+
+  ASSERT_THAT(chmod((dir_ + "/a/b").c_str(), 0777), Eq(0));
+  (*cache)->Poll();
+  EXPECT_THAT(FileEventIsUserControlled(proc_info, event).value_or(false),
+              Eq(true));
+  ASSERT_THAT(chmod((dir_ + "/a/b").c_str(), 0755), Eq(0));
+  (*cache)->Poll();
+  EXPECT_THAT(FileEventIsUserControlled(proc_info, event).value_or(true),
+              Eq(false));
+
+  SetWatchedPrefixCache(nullptr);
+  close(dir_fd);
+}
+
+}  // namespace
+}  // namespace pathauditor
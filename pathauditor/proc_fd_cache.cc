@@ -0,0 +1,164 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/proc_fd_cache.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "absl/strings/str_cat.h"
+#include "pathauditor/util/status_macros.h"
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+namespace pathauditor {
+
+namespace {
+
+constexpr int kPathFlags = O_PATH | O_DIRECTORY | O_CLOEXEC;
+
+// Reopens one of our O_PATH fds with the flags the caller asked for.
+absl::StatusOr<int> Reopen(int fd, int open_flags, absl::string_view what) {
+  int new_fd = openat(fd, ".", open_flags);
+  if (new_fd == -1) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Could not reopen ", what));
+  }
+  return new_fd;
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<ProcFdCache>> ProcFdCache::Open(
+    pid_t pid, MountNamespaceCache *namespaces) {
+  int proc_fd = open(absl::StrCat("/proc/", pid).c_str(), kPathFlags);
+  if (proc_fd == -1) {
+    return absl::NotFoundError(absl::StrCat("Process ", pid, " is gone"));
+  }
+  int pidfd = syscall(SYS_pidfd_open, pid, 0);
+  // The pidfd could belong to a new process if the pid was reused after we
+  // opened the proc directory. If the process is still alive now, it didn't.
+  struct stat sb;
+  if (fstatat(proc_fd, "stat", &sb, 0) == -1) {
+    if (pidfd != -1) close(pidfd);
+    close(proc_fd);
+    return absl::NotFoundError(absl::StrCat("Process ", pid, " is gone"));
+  }
+  // Without the namespace we just don't share anything with other processes.
+  std::shared_ptr<MountNamespace> mount_namespace;
+  if (namespaces != nullptr) {
+    absl::StatusOr<std::shared_ptr<MountNamespace>> found =
+        namespaces->ForProcess(proc_fd);
+    if (found.ok()) {
+      mount_namespace = std::move(*found);
+    }
+  }
+  return std::unique_ptr<ProcFdCache>(
+      new ProcFdCache(pid, proc_fd, pidfd, std::move(mount_namespace)));
+}
+
+ProcFdCache::~ProcFdCache() {
+  InvalidateRoot();
+  if (pidfd_ != -1) close(pidfd_);
+  close(proc_fd_);
+}
+
+absl::StatusOr<int> ProcFdCache::OpenFd(int fd, int open_flags) const {
+  int new_fd = openat(proc_fd_, absl::StrCat("fd/", fd).c_str(), open_flags);
+  if (new_fd == -1) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Could not open fd ", fd, " of pid ", pid_));
+  }
+  return new_fd;
+}
+
+absl::Status ProcFdCache::CacheRoot() {
+  if (root_fd_ == -1) {
+    root_fd_ = openat(proc_fd_, "root", kPathFlags);
+    if (root_fd_ == -1) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("Could not open the root of pid ", pid_));
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<int> ProcFdCache::OpenRoot(int open_flags) {
+  PATHAUDITOR_RETURN_IF_ERROR(CacheRoot());
+  return Reopen(root_fd_, open_flags, "root");
+}
+
+absl::StatusOr<int> ProcFdCache::OpenCwd(absl::string_view cwd,
+                                         int open_flags) {
+  if (cwd_fd_ != -1 && cwd != cwd_) {
+    InvalidateCwd();
+  }
+  if (cwd_fd_ == -1) {
+    PATHAUDITOR_RETURN_IF_ERROR(CacheRoot());
+    absl::string_view relative = cwd;
+    while (!relative.empty() && relative.front() == '/') {
+      relative.remove_prefix(1);
+    }
+    std::string relative_cwd = relative.empty() ? "." : std::string(relative);
+    cwd_fd_ = openat(root_fd_, relative_cwd.c_str(), kPathFlags);
+    if (cwd_fd_ == -1) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("Could not open the cwd \"", cwd, "\" of pid ", pid_));
+    }
+    cwd_ = std::string(cwd);
+  }
+  return Reopen(cwd_fd_, open_flags, "cwd");
+}
+
+void ProcFdCache::InvalidateRoot() {
+  // The cwd was looked up relative to the root.
+  InvalidateCwd();
+  if (root_fd_ != -1) {
+    close(root_fd_);
+    root_fd_ = -1;
+  }
+}
+
+void ProcFdCache::InvalidateCwd() {
+  if (cwd_fd_ != -1) {
+    close(cwd_fd_);
+    cwd_fd_ = -1;
+  }
+  cwd_.clear();
+}
+
+bool ProcFdCache::ProcessAlive() const {
+  if (pidfd_ != -1) {
+    // A pidfd becomes readable when the process exits.
+    struct pollfd pfd = {pidfd_, POLLIN, 0};
+    return poll(&pfd, 1, 0) == 0;
+  }
+  struct stat sb;
+  return fstatat(proc_fd_, "stat", &sb, 0) == 0;
+}
+
+void ProcFdCache::RefreshMountNamespace() {
+  if (mount_namespace_ == nullptr) {
+    return;
+  }
+  absl::StatusOr<MountNamespaceId> id = GetMountNamespaceId(proc_fd_);
+  in_mount_namespace_ = id.ok() && *id == mount_namespace_->id();
+}
+
+}  // namespace pathauditor
@@ -0,0 +1,105 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_PROC_FD_CACHE_H_
+#define PATHAUDITOR_PROC_FD_CACHE_H_
+
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "pathauditor/mount_namespace_cache.h"
+
+namespace pathauditor {
+
+// Keeps O_PATH fds to the proc directory, the root and the cwd of another
+// process, so that looking them up again is a single openat instead of a
+// path walk through /proc/<pid>/root/...
+// The proc directory fd and the pidfd pin the process: once it exits, all
+// lookups fail even if the pid gets reused.
+// Root and cwd are resolved on first use. They need to be invalidated when the
+// process calls chroot or chdir; exec doesn't change them but callers will
+// usually want a new cache per exec anyway.
+// Not thread-safe.
+class ProcFdCache {
+ public:
+  // If namespaces is set, the cache also holds on to the MountNamespace of the
+  // process, which is shared with the other processes in it. namespaces must
+  // outlive the cache.
+  static absl::StatusOr<std::unique_ptr<ProcFdCache>> Open(
+      pid_t pid, MountNamespaceCache *namespaces = nullptr);
+
+  ~ProcFdCache();
+
+  ProcFdCache(const ProcFdCache &) = delete;
+  ProcFdCache &operator=(const ProcFdCache &) = delete;
+
+  // Opens fd of the process.
+  absl::StatusOr<int> OpenFd(int fd, int open_flags) const;
+  // Opens the root directory of the process.
+  absl::StatusOr<int> OpenRoot(int open_flags);
+  // Opens cwd, looked up relative to the root of the process. The directory is
+  // cached until cwd changes or InvalidateCwd is called.
+  absl::StatusOr<int> OpenCwd(absl::string_view cwd, int open_flags);
+
+  void InvalidateRoot();
+  void InvalidateCwd();
+
+  bool ProcessAlive() const;
+
+  // The mount namespace the process was in when the cache was opened. nullptr
+  // if it wasn't looked up.
+  const MountNamespace *mount_namespace() const {
+    return mount_namespace_.get();
+  }
+  // Whether the process was still in mount_namespace() when the cache was
+  // opened or RefreshMountNamespace was last called. The process can switch
+  // namespaces at any time, so callers re-check before each batch of audits.
+  bool InMountNamespace() const { return in_mount_namespace_; }
+  void RefreshMountNamespace();
+
+  pid_t pid() const { return pid_; }
+  // An O_PATH fd to /proc/<pid>. Owned by the cache.
+  int proc_fd() const { return proc_fd_; }
+
+ private:
+  ProcFdCache(pid_t pid, int proc_fd, int pidfd,
+              std::shared_ptr<MountNamespace> mount_namespace)
+      : pid_(pid),
+        proc_fd_(proc_fd),
+        pidfd_(pidfd),
+        mount_namespace_(std::move(mount_namespace)),
+        in_mount_namespace_(mount_namespace_ != nullptr) {}
+
+  absl::Status CacheRoot();
+
+  const pid_t pid_;
+  const int proc_fd_;
+  // -1 if the kernel doesn't support pidfds.
+  const int pidfd_;
+  const std::shared_ptr<MountNamespace> mount_namespace_;
+  bool in_mount_namespace_;
+  int root_fd_ = -1;
+  int cwd_fd_ = -1;
+  std::string cwd_;
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_PROC_FD_CACHE_H_
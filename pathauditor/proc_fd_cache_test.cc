@@ -0,0 +1,114 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/proc_fd_cache.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "pathauditor/util/status_matchers.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Ne;
+
+ino_t InodeOf(int fd) {
+  struct stat sb;
+  EXPECT_THAT(fstat(fd, &sb), Eq(0));
+  close(fd);
+  return sb.st_ino;
+}
+
+ino_t InodeOf(const std::string &path) {
+  struct stat sb;
+  EXPECT_THAT(stat(path.c_str(), &sb), Eq(0));
+  return sb.st_ino;
+}
+
+TEST(ProcFdCacheTest, OpensRootAndCwd) {
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ProcFdCache> cache, ProcFdCache::Open(getpid()));
+  EXPECT_TRUE(cache->ProcessAlive());
+
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(int root,
+                                               cache->OpenRoot(O_RDONLY));
+  EXPECT_THAT(InodeOf(root), Eq(InodeOf("/")));
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      int cwd, cache->OpenCwd("/tmp", O_RDONLY));
+  EXPECT_THAT(InodeOf(cwd), Eq(InodeOf("/tmp")));
+
+  int tmp_fd = open("/tmp", O_RDONLY | O_DIRECTORY);
+  ASSERT_THAT(tmp_fd, Ne(-1));
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(int fd,
+                                               cache->OpenFd(tmp_fd, O_RDONLY));
+  close(tmp_fd);
+  EXPECT_THAT(InodeOf(fd), Eq(InodeOf("/tmp")));
+}
+
+TEST(ProcFdCacheTest, KeepsCwdUntilInvalidated) {
+  char dir_template[] = "/tmp/proc_fd_cache_test.XXXXXX";
+  ASSERT_THAT(mkdtemp(dir_template), Ne(nullptr));
+  std::string dir = dir_template;
+  std::string moved = dir + ".moved";
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ProcFdCache> cache, ProcFdCache::Open(getpid()));
+
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(int fd,
+                                               cache->OpenCwd(dir, O_RDONLY));
+  ino_t old_ino = InodeOf(fd);
+  ASSERT_THAT(rename(dir.c_str(), moved.c_str()), Eq(0));
+  ASSERT_THAT(mkdir(dir.c_str(), 0700), Eq(0));
+
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(fd,
+                                               cache->OpenCwd(dir, O_RDONLY));
+  EXPECT_THAT(InodeOf(fd), Eq(old_ino));
+  cache->InvalidateCwd();
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(fd,
+                                               cache->OpenCwd(dir, O_RDONLY));
+  EXPECT_THAT(InodeOf(fd), Eq(InodeOf(dir)));
+
+  rmdir(dir.c_str());
+  rmdir(moved.c_str());
+}
+
+TEST(ProcFdCacheTest, NoticesExit) {
+  pid_t child = fork();
+  ASSERT_THAT(child, Ne(-1));
+  if (child == 0) {
+    pause();
+    _exit(0);
+  }
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<ProcFdCache> cache, ProcFdCache::Open(child));
+  EXPECT_TRUE(cache->ProcessAlive());
+
+  kill(child, SIGKILL);
+  waitpid(child, nullptr, 0);
+  EXPECT_FALSE(cache->ProcessAlive());
+  EXPECT_FALSE(cache->OpenRoot(O_RDONLY).ok());
+  EXPECT_FALSE(ProcFdCache::Open(child).ok());
+}
+
+}  // namespace
+}  // namespace pathauditor
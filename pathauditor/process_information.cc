@@ -21,6 +21,7 @@
 #include "pathauditor/util/path.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "pathauditor/mount_namespace_cache.h"
 #include "pathauditor/util/status_macros.h"
 
 namespace pathauditor {
@@ -43,14 +44,34 @@ RemoteProcessInformation::RemoteProcessInformation(
     bool fallback)
     : pid_(pid), cwd_(cwd), cmdline_(std::move(cmdline)), fallback_(fallback) {}
 
+RemoteProcessInformation::RemoteProcessInformation(
+    ProcFdCache *cache, absl::string_view cwd,
+    absl::optional<std::string> cmdline, bool fallback)
+    : pid_(cache->pid()),
+      cache_(cache),
+      cwd_(cwd),
+      cmdline_(std::move(cmdline)),
+      fallback_(fallback) {}
+
 absl::StatusOr<int> RemoteProcessInformation::OpenFileInProc(
     absl::string_view path, int open_flags) const {
   return OpenFile(JoinPath("/proc", absl::StrCat(pid_), path),
                   open_flags);
 }
 
+absl::StatusOr<int> RemoteProcessInformation::OpenFallback(
+    absl::string_view path, int open_flags) const {
+  if (cache_ != nullptr && cache_->mount_namespace() != nullptr) {
+    return cache_->mount_namespace()->Open(path, open_flags);
+  }
+  return OpenFile(path, open_flags);
+}
+
 absl::StatusOr<int> RemoteProcessInformation::DupDirFileDescriptor(
     int fd, int open_flags) const {
+  if (cache_ != nullptr) {
+    return cache_->OpenFd(fd, open_flags);
+  }
   return OpenFileInProc(JoinPath("fd", absl::StrCat(fd)), open_flags);
 }
 
@@ -59,22 +80,57 @@ absl::StatusOr<int> RemoteProcessInformation::CwdFileDescriptor(
   // The root of the target process might not be the same as ours. Try to
   // resolve it relative to /proc/<pid>/root
   absl::StatusOr<int> maybe_fd =
-      OpenFileInProc(JoinPath("root", cwd_), open_flags);
+      cache_ != nullptr ? cache_->OpenCwd(cwd_, open_flags)
+                        : OpenFileInProc(JoinPath("root", cwd_), open_flags);
   if (maybe_fd.ok() || !fallback_) {
     return maybe_fd;
   }
   // Fallback if the process doesn't exist anymore.
-  return OpenFile(cwd_, open_flags);
+  return OpenFallback(cwd_, open_flags);
 }
 
 absl::StatusOr<int> RemoteProcessInformation::RootFileDescriptor(
     int open_flags) const {
-  absl::StatusOr<int> maybe_fd = OpenFileInProc("root", open_flags);
+  absl::StatusOr<int> maybe_fd = cache_ != nullptr
+                                     ? cache_->OpenRoot(open_flags)
+                                     : OpenFileInProc("root", open_flags);
   if (maybe_fd.ok() || !fallback_) {
     return maybe_fd;
   }
   // Fallback if the process doesn't exist anymore.
-  return OpenFile("/", open_flags);
+  return OpenFallback("/", open_flags);
+}
+
+bool RemoteProcessInformation::SharesMountNamespace() const {
+  if (cache_ != nullptr && cache_->mount_namespace() != nullptr) {
+    return cache_->InMountNamespace() && cache_->mount_namespace()->is_own();
+  }
+  // We don't switch namespaces, so ours only needs to be looked up once.
+  static const absl::optional<MountNamespaceId> ours =
+      []() -> absl::optional<MountNamespaceId> {
+    absl::StatusOr<MountNamespaceId> id = GetOwnMountNamespaceId();
+    if (!id.ok()) {
+      return absl::nullopt;
+    }
+    return *id;
+  }();
+  if (!ours.has_value()) {
+    return false;
+  }
+  struct stat theirs;
+  int ret = cache_ != nullptr
+                ? fstatat(cache_->proc_fd(), "ns/mnt", &theirs, 0)
+                : stat(absl::StrCat("/proc/", pid_, "/ns/mnt").c_str(), &theirs);
+  return ret == 0 && ours->dev == theirs.st_dev && ours->ino == theirs.st_ino;
+}
+
+WatchedPrefixCache *RemoteProcessInformation::WatchedPrefixes() const {
+  if (cache_ == nullptr || cache_->mount_namespace() == nullptr ||
+      cache_->mount_namespace()->watched_prefixes() == nullptr ||
+      !cache_->InMountNamespace()) {
+    return nullptr;
+  }
+  return cache_->mount_namespace()->watched_prefixes();
 }
 
 pid_t RemoteProcessInformation::Pid() const { return pid_; }
@@ -20,6 +20,8 @@
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
+#include "pathauditor/proc_fd_cache.h"
+#include "pathauditor/watched_prefix_cache.h"
 
 namespace pathauditor {
 
@@ -33,6 +35,13 @@ class ProcessInformation {
                                                    int open_flags) const = 0;
   virtual absl::StatusOr<int> CwdFileDescriptor(int open_flags) const = 0;
   virtual absl::StatusOr<int> RootFileDescriptor(int open_flags) const = 0;
+  // Whether the process resolves paths in our mount namespace, i.e. sees the
+  // same mounts as we do.
+  virtual bool SharesMountNamespace() const { return false; }
+  // If the process is in another mount namespace, a WatchedPrefixCache for
+  // the paths in it, shared with the other processes there. nullptr if there
+  // is none.
+  virtual WatchedPrefixCache *WatchedPrefixes() const { return nullptr; }
 };
 
 // Represents the current process. CwdFileDescriptor will simply open(".") etc.
@@ -42,6 +51,7 @@ class SameProcessInformation : public ProcessInformation {
                                            int open_flags) const override;
   absl::StatusOr<int> CwdFileDescriptor(int open_flags) const override;
   absl::StatusOr<int> RootFileDescriptor(int open_flags) const override;
+  bool SharesMountNamespace() const override { return true; }
 };
 
 // Represents a remote process. File descriptors are looked up using the proc
@@ -52,16 +62,30 @@ class RemoteProcessInformation : public ProcessInformation {
   // cmdline is optional as it's only used for logging.
   // fallback controls what to do if the process doesn't exist anymore. If it's
   // set to true, it will fall back to the root of the current mount namespace
-  // for file lookups.
+  // for file lookups, or to the root of the mount namespace of the process if
+  // the cache knows it.
   RemoteProcessInformation(
       pid_t pid, absl::string_view cwd,
       absl::optional<std::string> cmdline = absl::optional<std::string>(),
       bool fallback = false);
+  // Same as above but the lookups are served from the fds in cache instead of
+  // going through /proc. cache is not owned and must outlive this object.
+  RemoteProcessInformation(
+      ProcFdCache *cache, absl::string_view cwd,
+      absl::optional<std::string> cmdline = absl::optional<std::string>(),
+      bool fallback = false);
 
   absl::StatusOr<int> DupDirFileDescriptor(int fd,
                                            int open_flags) const override;
   absl::StatusOr<int> CwdFileDescriptor(int open_flags) const override;
   absl::StatusOr<int> RootFileDescriptor(int open_flags) const override;
+  // With a cache that knows the namespace of the process, as of the last
+  // ProcFdCache::RefreshMountNamespace. Otherwise the namespaces are compared
+  // on every call since the process can switch namespaces at any time.
+  bool SharesMountNamespace() const override;
+  // The one of the MountNamespace of the cache, as long as the process is
+  // still in it.
+  WatchedPrefixCache *WatchedPrefixes() const override;
 
   pid_t Pid() const;
   std::string Cwd() const;
@@ -70,7 +94,11 @@ class RemoteProcessInformation : public ProcessInformation {
  private:
   absl::StatusOr<int> OpenFileInProc(absl::string_view path,
                                      int open_flags) const;
+  // Opens path in the mount namespace of the process after it's gone.
+  absl::StatusOr<int> OpenFallback(absl::string_view path,
+                                   int open_flags) const;
   pid_t pid_;
+  ProcFdCache *cache_ = nullptr;
   std::string cwd_;
   absl::optional<std::string> cmdline_;
   bool fallback_;
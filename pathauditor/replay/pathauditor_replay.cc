@@ -0,0 +1,328 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Audits the capture logs that libpath_auditor.so writes with
+// PATHAUDITOR_CAPTURE_DIR, see trace_log.h:
+//
+//   pathauditor-replay [--workers=N] [--safe_prefixes=/usr:/etc] log...
+//
+// The paths are audited against the file system as it is now, from our own
+// root. Relative paths are resolved against the recorded cwd if it's still the
+// same directory. Events relative to a directory fd other than the cwd can't
+// be audited since the fd only existed in the captured process.
+// Insecure accesses are printed to stdout, a summary to stderr.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+#include "absl/base/thread_annotations.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "pathauditor/file_event.h"
+#include "pathauditor/path_audit_result.h"
+#include "pathauditor/pathauditor.h"
+#include "pathauditor/process_information.h"
+#include "pathauditor/safe_prefix_trie.h"
+#include "pathauditor/trace_log.h"
+#include "pathauditor/util/cleanup.h"
+#include "pathauditor/util/flag.h"
+#include "pathauditor/util/status_macros.h"
+
+ABSL_FLAG(int32_t, workers, 0,
+          "Number of threads auditing events. 0 means one per CPU.");
+ABSL_FLAG(int32_t, batch_size, 4096,
+          "Number of events handed to a worker at once.");
+ABSL_FLAG(string, safe_prefixes, "",
+          "Prefixes separated by ':' under which paths are never considered "
+          "user controlled, see SetSafePathPrefixes.");
+
+namespace pathauditor {
+namespace {
+
+// A process that doesn't exist anymore, see the comment at the top.
+class ReplayProcessInformation : public ProcessInformation {
+ public:
+  explicit ReplayProcessInformation(const TraceRecord &record)
+      : record_(record) {}
+
+  absl::StatusOr<int> DupDirFileDescriptor(int fd,
+                                           int open_flags) const override {
+    return absl::FailedPreconditionError(
+        absl::StrCat("fd ", fd, " only existed in the captured process"));
+  }
+  absl::StatusOr<int> CwdFileDescriptor(int open_flags) const override {
+    if (!record_.has_cwd) {
+      return absl::FailedPreconditionError("No cwd was recorded");
+    }
+    int fd = open(record_.cwd.c_str(), open_flags);
+    if (fd == -1) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("Could not open the cwd ", record_.cwd));
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) == -1 || sb.st_dev != record_.cwd_dev ||
+        sb.st_ino != record_.cwd_ino) {
+      close(fd);
+      return absl::FailedPreconditionError(
+          absl::StrCat("The cwd ", record_.cwd, " changed since the capture"));
+    }
+    return fd;
+  }
+  absl::StatusOr<int> RootFileDescriptor(int open_flags) const override {
+    int fd = open("/", open_flags);
+    if (fd == -1) {
+      return absl::FailedPreconditionError("Could not open /");
+    }
+    return fd;
+  }
+  // Everything is looked up in our own mount namespace.
+  bool SharesMountNamespace() const override { return true; }
+
+ private:
+  const TraceRecord &record_;
+};
+
+struct Counters {
+  std::atomic<uint64_t> events{0};
+  std::atomic<uint64_t> insecure{0};
+  std::atomic<uint64_t> errors{0};
+};
+
+// Hands batches of decoded records from the reader to the workers.
+class BatchQueue {
+ public:
+  explicit BatchQueue(size_t capacity) : capacity_(capacity) {}
+
+  void Push(std::vector<TraceRecord> batch) {
+    absl::MutexLock lock(&mu_);
+    mu_.Await(absl::Condition(
+        +[](BatchQueue *q) ABSL_EXCLUSIVE_LOCKS_REQUIRED(q->mu_) {
+          return q->batches_.size() < q->capacity_;
+        },
+        this));
+    batches_.push_back(std::move(batch));
+  }
+
+  // Returns false once the queue is closed and empty.
+  bool Pop(std::vector<TraceRecord> *batch) {
+    absl::MutexLock lock(&mu_);
+    mu_.Await(absl::Condition(
+        +[](BatchQueue *q) ABSL_EXCLUSIVE_LOCKS_REQUIRED(q->mu_) {
+          return q->closed_ || !q->batches_.empty();
+        },
+        this));
+    if (batches_.empty()) {
+      return false;
+    }
+    *batch = std::move(batches_.front());
+    batches_.pop_front();
+    return true;
+  }
+
+  void Close() {
+    absl::MutexLock lock(&mu_);
+    closed_ = true;
+  }
+
+ private:
+  const size_t capacity_;
+  absl::Mutex mu_;
+  std::deque<std::vector<TraceRecord>> batches_ ABSL_GUARDED_BY(mu_);
+  bool closed_ ABSL_GUARDED_BY(mu_) = false;
+};
+
+void PrintInsecureAccess(const TraceRecord &record,
+                         const PathAuditResult &result) {
+  static absl::Mutex *mu = new absl::Mutex();
+  std::string line = absl::StrCat(
+      "InsecureAccess: pid ", record.pid, ", time_ns ", record.timestamp_ns,
+      ", syscall_nr ", record.event.syscall_nr, ", args ",
+      absl::StrJoin(record.event.args, ", "), ", path args ",
+      absl::StrJoin(record.event.path_args, ", "), ", unsafe element ",
+      DescribePathAuditResult(result), "\n");
+  absl::MutexLock lock(mu);
+  fwrite(line.data(), 1, line.size(), stdout);
+}
+
+// Audits runs of records with the same cwd as one batch, so that they share
+// the directories they have in common.
+void Audit(const std::vector<TraceRecord> &batch, Counters *counters) {
+  std::vector<FileEvent> events;
+  for (size_t begin = 0; begin < batch.size();) {
+    size_t end = begin + 1;
+    while (end < batch.size() && batch[end].has_cwd == batch[begin].has_cwd &&
+           batch[end].cwd_ino == batch[begin].cwd_ino &&
+           batch[end].cwd == batch[begin].cwd) {
+      end++;
+    }
+    events.clear();
+    for (size_t i = begin; i < end; i++) {
+      events.push_back(batch[i].event);
+    }
+    std::vector<absl::StatusOr<PathAuditResult>> results =
+        ExplainFileEventsAreUserControlled(
+            ReplayProcessInformation(batch[begin]), events);
+    for (size_t i = 0; i < results.size(); i++) {
+      if (!results[i].ok()) {
+        counters->errors.fetch_add(1, std::memory_order_relaxed);
+      } else if (results[i]->user_controlled) {
+        counters->insecure.fetch_add(1, std::memory_order_relaxed);
+        PrintInsecureAccess(batch[begin + i], *results[i]);
+      }
+    }
+    counters->events.fetch_add(results.size(), std::memory_order_relaxed);
+    begin = end;
+  }
+}
+
+// Decodes the log into batches. The decoding is sequential because of the
+// prefix compression, the audits aren't.
+absl::Status ReadLog(const char *path, size_t batch_size, BatchQueue *queue) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return absl::NotFoundError(
+        absl::StrCat("Could not open ", path, ": ", strerror(errno)));
+  }
+  auto close_fd = MakeCleanup([fd]() { close(fd); });
+  struct stat sb;
+  if (fstat(fd, &sb) == -1) {
+    return absl::FailedPreconditionError(absl::StrCat("Could not stat ", path));
+  }
+  if (sb.st_size == 0) {
+    return absl::InvalidArgumentError(absl::StrCat(path, " is empty"));
+  }
+  void *mem = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mem == MAP_FAILED) {
+    return absl::FailedPreconditionError(absl::StrCat("Could not map ", path));
+  }
+  auto unmap = MakeCleanup([mem, &sb]() { munmap(mem, sb.st_size); });
+  madvise(mem, sb.st_size, MADV_SEQUENTIAL);
+  absl::Span<const char> data(static_cast<const char *>(mem), sb.st_size);
+
+  TraceLogHeader header;
+  PATHAUDITOR_ASSIGN_OR_RETURN(size_t pos,
+                               TraceRecordDecoder::DecodeHeader(data, &header));
+  TraceRecordDecoder decoder;
+  std::vector<TraceRecord> batch(batch_size);
+  size_t count = 0;
+  while (true) {
+    absl::StatusOr<size_t> size =
+        decoder.Decode(data.subspan(pos), &batch[count]);
+    if (!size.ok()) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          path, " is corrupt at offset ", pos, ": ", size.status().message()));
+    }
+    if (*size == 0) {
+      break;
+    }
+    pos += *size;
+    if (++count == batch.size()) {
+      queue->Push(std::move(batch));
+      batch = std::vector<TraceRecord>(batch_size);
+      count = 0;
+    }
+  }
+  if (count > 0) {
+    batch.resize(count);
+    queue->Push(std::move(batch));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+}  // namespace pathauditor
+
+int main(int argc, char **argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s [flags] log...\n", argv[0]);
+    return 2;
+  }
+
+  // Leaked on purpose, it's used until the end.
+  pathauditor::SafePrefixTrie *safe_prefixes = new pathauditor::SafePrefixTrie();
+  for (absl::string_view prefix : pathauditor::SafePrefixTrie::SplitPrefixList(
+           absl::GetFlag(FLAGS_safe_prefixes))) {
+    absl::Status status = safe_prefixes->Insert(prefix);
+    if (!status.ok()) {
+      LOG(ERROR) << status.message();
+      return 2;
+    }
+  }
+  if (!safe_prefixes->empty()) {
+    pathauditor::SetSafePathPrefixes(safe_prefixes);
+  }
+
+  unsigned int workers = absl::GetFlag(FLAGS_workers);
+  if (workers == 0) {
+    workers = std::max(1u, std::thread::hardware_concurrency());
+  }
+  size_t batch_size = std::max(1, absl::GetFlag(FLAGS_batch_size));
+  pathauditor::BatchQueue queue(2 * workers);
+  pathauditor::Counters counters;
+  std::vector<std::thread> threads;
+  for (unsigned int i = 0; i < workers; i++) {
+    threads.emplace_back([&queue, &counters]() {
+      std::vector<pathauditor::TraceRecord> batch;
+      while (queue.Pop(&batch)) {
+        pathauditor::Audit(batch, &counters);
+      }
+    });
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  int exit_code = 0;
+  for (int i = 1; i < argc; i++) {
+    absl::Status status = pathauditor::ReadLog(argv[i], batch_size, &queue);
+    if (!status.ok()) {
+      // Whatever was decoded before the error still gets audited.
+      LOG(ERROR) << status.message();
+      exit_code = 1;
+    }
+  }
+  queue.Close();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  uint64_t events = counters.events.load();
+  fprintf(stderr,
+          "Replayed %llu events in %.3fs (%.0f events/s): %llu insecure, "
+          "%llu errors\n",
+          static_cast<unsigned long long>(events), elapsed.count(),
+          events / std::max(elapsed.count(), 1e-9),
+          static_cast<unsigned long long>(counters.insecure.load()),
+          static_cast<unsigned long long>(counters.errors.load()));
+  return exit_code;
+}
@@ -0,0 +1,145 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/safe_prefix_trie.h"
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
+#include "absl/types/span.h"
+#include "pathauditor/audit_context.h"
+#include "pathauditor/util/path_scanner.h"
+
+namespace pathauditor {
+
+namespace {
+
+// Calls fn on every path component that isn't ".", until it returns false.
+// Returns false without calling fn if there is a ".." component, or if there
+// is no memory for the components.
+template <typename F>
+bool ForEachComponent(absl::string_view path, F fn) {
+  AuditContext::Scope scope;
+  absl::Span<PathComponent> components =
+      scope.context().arena().AllocateArray<PathComponent>(
+          MaxPathComponents(path));
+  PathScan scan = ScanPath(path, components);
+  if (scan.dot_dot_count > 0 || scan.component_count > components.size()) {
+    return false;
+  }
+  for (const PathComponent &component :
+       components.first(scan.component_count)) {
+    if (component.kind == PathComponent::Kind::kDot) {
+      continue;
+    }
+    if (!fn(component.Name(path), component.hash)) {
+      break;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+SafePrefixTrie::SafePrefixTrie() {
+  // The root node, i.e. "/".
+  nodes_.push_back({0, 0, 0, kNoNode, kNoNode, false});
+}
+
+uint32_t SafePrefixTrie::FindChild(uint32_t node, absl::string_view name,
+                                   uint64_t name_hash) const {
+  for (uint32_t child = nodes_[node].first_child; child != kNoNode;
+       child = nodes_[child].next_sibling) {
+    if (nodes_[child].name_hash == name_hash && Name(nodes_[child]) == name) {
+      return child;
+    }
+  }
+  return kNoNode;
+}
+
+absl::Status SafePrefixTrie::Insert(absl::string_view prefix) {
+  if (!absl::StartsWith(prefix, "/")) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("safe prefix is not absolute: ", prefix));
+  }
+  if (ScanPath(prefix, {}).dot_dot_count > 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("safe prefix contains \"..\": ", prefix));
+  }
+
+  uint32_t node = 0;
+  bool scanned = ForEachComponent(
+      prefix, [this, &node](absl::string_view component, uint64_t hash) {
+        uint32_t child = FindChild(node, component, hash);
+        if (child == kNoNode) {
+          child = nodes_.size();
+          nodes_.push_back({static_cast<uint32_t>(names_.size()),
+                            static_cast<uint32_t>(component.size()), hash,
+                            kNoNode, nodes_[node].first_child, false});
+          names_.append(component.data(), component.size());
+          nodes_[node].first_child = child;
+        }
+        node = child;
+        return true;
+      });
+  if (!scanned) {
+    return absl::ResourceExhaustedError(
+        absl::StrCat("no memory to split safe prefix ", prefix));
+  }
+
+  if (!nodes_[node].terminal) {
+    nodes_[node].terminal = true;
+    prefix_count_++;
+  }
+  return absl::OkStatus();
+}
+
+bool SafePrefixTrie::Contains(absl::string_view path) const {
+  if (empty() || !absl::StartsWith(path, "/")) {
+    return false;
+  }
+
+  uint32_t node = 0;
+  bool matched = nodes_[node].terminal;
+  bool scanned = ForEachComponent(
+      path, [this, &node, &matched](absl::string_view component,
+                                    uint64_t hash) {
+        if (matched) {
+          return false;
+        }
+        node = FindChild(node, component, hash);
+        if (node == kNoNode) {
+          return false;
+        }
+        matched = nodes_[node].terminal;
+        return true;
+      });
+  return scanned && matched;
+}
+
+std::vector<absl::string_view> SafePrefixTrie::SplitPrefixList(
+    absl::string_view list) {
+  std::vector<absl::string_view> prefixes;
+  for (absl::string_view line : absl::StrSplit(list, absl::ByAnyChar(":\n"))) {
+    line = absl::StripAsciiWhitespace(line);
+    if (line.empty() || absl::StartsWith(line, "#")) {
+      continue;
+    }
+    prefixes.push_back(line);
+  }
+  return prefixes;
+}
+
+}  // namespace pathauditor
@@ -0,0 +1,84 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_SAFE_PREFIX_TRIE_H_
+#define PATHAUDITOR_SAFE_PREFIX_TRIE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+
+namespace pathauditor {
+
+// A set of absolute directory prefixes under which no path is considered user
+// controlled, e.g. /usr or /etc. Paths are matched by whole components, so
+// /usr matches /usr/lib but not /usrlocal.
+//
+// Matching is purely lexical and doesn't touch the file system. Empty and "."
+// components are ignored. Paths containing ".." never match since we can't
+// tell where they end up without resolving symlinks. Note that this trusts
+// everything below a prefix, including symlinks that point out of it, so only
+// add trees that are owned and maintained by root.
+//
+// The trie is stored in two flat arrays: the nodes, one per component, and the
+// concatenated component names.
+class SafePrefixTrie {
+ public:
+  SafePrefixTrie();
+
+  // Adds an absolute prefix. Returns an InvalidArgument error if it's relative
+  // or contains "..".
+  absl::Status Insert(absl::string_view prefix);
+
+  // Whether path is one of the prefixes or inside of one.
+  bool Contains(absl::string_view path) const;
+
+  bool empty() const { return prefix_count_ == 0; }
+  size_t prefix_count() const { return prefix_count_; }
+
+  // Splits a list of prefixes separated by ':' or newlines. Empty entries and
+  // lines starting with '#' are skipped.
+  static std::vector<absl::string_view> SplitPrefixList(absl::string_view list);
+
+ private:
+  static constexpr uint32_t kNoNode = UINT32_MAX;
+
+  struct Node {
+    uint32_t name_offset;
+    uint32_t name_len;
+    // ComponentHash of the name, compared before the name itself.
+    uint64_t name_hash;
+    uint32_t first_child;
+    uint32_t next_sibling;
+    // A prefix ends at this node.
+    bool terminal;
+  };
+
+  absl::string_view Name(const Node &node) const {
+    return absl::string_view(names_).substr(node.name_offset, node.name_len);
+  }
+  uint32_t FindChild(uint32_t node, absl::string_view name,
+                     uint64_t name_hash) const;
+
+  std::vector<Node> nodes_;
+  std::string names_;
+  size_t prefix_count_ = 0;
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_SAFE_PREFIX_TRIE_H_
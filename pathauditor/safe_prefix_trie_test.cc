@@ -0,0 +1,70 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/safe_prefix_trie.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+
+TEST(SafePrefixTrieTest, MatchesWholeComponents) {
+  SafePrefixTrie trie;
+  ASSERT_TRUE(trie.Insert("/usr").ok());
+  ASSERT_TRUE(trie.Insert("/proc/self/").ok());
+
+  EXPECT_TRUE(trie.Contains("/usr"));
+  EXPECT_TRUE(trie.Contains("/usr/lib/libc.so.6"));
+  EXPECT_TRUE(trie.Contains("//usr/./lib"));
+  EXPECT_TRUE(trie.Contains("/proc/self/status"));
+  EXPECT_FALSE(trie.Contains("/usrlocal/bin"));
+  EXPECT_FALSE(trie.Contains("/proc"));
+  EXPECT_FALSE(trie.Contains("/proc/1/status"));
+  EXPECT_FALSE(trie.Contains("/"));
+  EXPECT_FALSE(trie.Contains("usr/lib"));
+  EXPECT_THAT(trie.prefix_count(), Eq(2));
+}
+
+TEST(SafePrefixTrieTest, DotDotNeverMatches) {
+  SafePrefixTrie trie;
+  ASSERT_TRUE(trie.Insert("/usr").ok());
+  EXPECT_FALSE(trie.Contains("/usr/../tmp/foo"));
+  EXPECT_FALSE(trie.Contains("/usr/lib/.."));
+}
+
+TEST(SafePrefixTrieTest, RejectsInvalidPrefixes) {
+  SafePrefixTrie trie;
+  EXPECT_THAT(trie.Insert("usr").code(),
+              Eq(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(trie.Insert("/usr/../tmp").code(),
+              Eq(absl::StatusCode::kInvalidArgument));
+  EXPECT_TRUE(trie.empty());
+  EXPECT_FALSE(trie.Contains("/tmp"));
+}
+
+TEST(SafePrefixTrieTest, SplitsPrefixLists) {
+  EXPECT_THAT(SafePrefixTrie::SplitPrefixList("/usr:/etc::/lib"),
+              ElementsAre("/usr", "/etc", "/lib"));
+  EXPECT_THAT(
+      SafePrefixTrie::SplitPrefixList("# trusted trees\n/usr\n  /etc  \n\n"),
+      ElementsAre("/usr", "/etc"));
+}
+
+}  // namespace
+}  // namespace pathauditor
@@ -0,0 +1,205 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Runs a command and audits the file system syscalls of it and all of its
+// descendants with a seccomp filter, see seccomp_notify.h:
+//
+//   pathauditor-seccomp [--workers=N] -- command [args...]
+//
+// The audited syscalls are stopped until the audit is done. If this process
+// dies, the remaining processes of the tree will fail them with ENOSYS.
+
+#include <errno.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+#include "absl/status/statusor.h"
+#include "absl/strings/str_join.h"
+#include "pathauditor/path_audit_result.h"
+#include "pathauditor/pathauditor.h"
+#include "pathauditor/process_information.h"
+#include "pathauditor/seccomp/seccomp_notify.h"
+#include "pathauditor/util/flag.h"
+
+ABSL_FLAG(int32_t, workers, 2,
+          "Number of threads auditing syscalls. A thread of the command is "
+          "stopped while its syscall is audited.");
+ABSL_FLAG(bool, log_to_stderr, false,
+          "Also log insecure accesses to stderr.");
+
+namespace pathauditor {
+namespace {
+
+void Audit(const SyscallNotification &notification) {
+  if (ClassifyFileEvent(notification.event) == FileEventClass::kSafe) {
+    return;
+  }
+  RemoteProcessInformation proc_info(notification.pid, notification.cwd);
+  absl::StatusOr<PathAuditResult> result =
+      ExplainFileEventIsUserControlled(proc_info, notification.event);
+  if (!result.ok()) {
+    syslog(LOG_WARNING, "Cannot audit pid %d: %s", notification.pid,
+           std::string(result.status().message()).c_str());
+  } else if (result->user_controlled) {
+    syslog(LOG_WARNING,
+           "InsecureAccess: function %s, pid %d, syscall_nr %d, args %s, "
+           "path args %s, unsafe element %s",
+           notification.syscall->name, notification.pid,
+           notification.event.syscall_nr,
+           absl::StrJoin(notification.event.args, ", ").c_str(),
+           absl::StrJoin(notification.event.path_args, ", ").c_str(),
+           DescribePathAuditResult(*result).c_str());
+  }
+}
+
+void Serve(const NotifyListener &listener) {
+  while (true) {
+    absl::StatusOr<SyscallNotification> notification = listener.Receive();
+    if (absl::IsUnavailable(notification.status())) {
+      return;
+    }
+    if (notification.ok()) {
+      Audit(*notification);
+      listener.Continue(*notification);
+    }
+  }
+}
+
+bool SendFd(int socket, int fd) {
+  char data = 0;
+  struct iovec iov = {&data, sizeof(data)};
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  return sendmsg(socket, &msg, 0) == sizeof(data);
+}
+
+int ReceiveFd(int socket) {
+  char data;
+  struct iovec iov = {&data, sizeof(data)};
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  if (recvmsg(socket, &msg, MSG_CMSG_CLOEXEC) != sizeof(data)) {
+    return -1;
+  }
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS) {
+    return -1;
+  }
+  int fd;
+  memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+  return fd;
+}
+
+// Installs the filter in the child, hands the listener to the parent and
+// runs the command. Only returns on error.
+int RunCommand(int socket, char **argv) {
+  // Without CAP_SYS_ADMIN, seccomp requires no_new_privs, which means that
+  // setuid binaries won't gain privileges.
+  if (geteuid() != 0 && prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == -1) {
+    perror("prctl(PR_SET_NO_NEW_PRIVS)");
+    return 127;
+  }
+  absl::StatusOr<int> listener = InstallNotifyFilter();
+  if (!listener.ok()) {
+    fprintf(stderr, "%s\n", std::string(listener.status().message()).c_str());
+    return 127;
+  }
+  if (!SendFd(socket, *listener)) {
+    perror("sendmsg");
+    return 127;
+  }
+  close(*listener);
+  close(socket);
+  execvp(argv[0], argv);
+  perror(argv[0]);
+  return 127;
+}
+
+}  // namespace
+}  // namespace pathauditor
+
+int main(int argc, char **argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s [flags] -- command [args...]\n", argv[0]);
+    return 2;
+  }
+  openlog("pathauditor-seccomp",
+          LOG_PID | (absl::GetFlag(FLAGS_log_to_stderr) ? LOG_PERROR : 0),
+          LOG_USER);
+
+  int sockets[2];
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) == -1) {
+    LOG(ERROR) << "socketpair failed: " << strerror(errno);
+    return 1;
+  }
+  pid_t child = fork();
+  if (child == -1) {
+    LOG(ERROR) << "fork failed: " << strerror(errno);
+    return 1;
+  }
+  if (child == 0) {
+    close(sockets[0]);
+    _exit(pathauditor::RunCommand(sockets[1], argv + 1));
+  }
+  close(sockets[1]);
+  int listener_fd = pathauditor::ReceiveFd(sockets[0]);
+  close(sockets[0]);
+  if (listener_fd == -1) {
+    // The child already printed why.
+    int status;
+    waitpid(child, &status, 0);
+    return 127;
+  }
+
+  pathauditor::NotifyListener listener(listener_fd);
+  std::vector<std::thread> workers;
+  for (int i = 0; i < std::max(1, absl::GetFlag(FLAGS_workers)); i++) {
+    workers.emplace_back(pathauditor::Serve, std::cref(listener));
+  }
+
+  // The filter only counts as unused once its processes have been reaped.
+  int status;
+  while (waitpid(child, &status, 0) == -1 && errno == EINTR) {
+  }
+  // Daemonized descendants might still be running.
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
@@ -0,0 +1,244 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/seccomp/seccomp_notify.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "pathauditor/event_ring.h"
+#include "pathauditor/util/path.h"
+
+#if !defined(__x86_64__)
+#error "The seccomp filter only knows the x86_64 syscall numbers"
+#endif
+
+namespace pathauditor {
+
+namespace {
+
+// The lookups are at the end of the policy table, so the audited syscalls
+// are a prefix of it. Returns 0 if a lookup comes earlier.
+constexpr size_t CountAuditedSyscalls() {
+  absl::Span<const SyscallPolicy> policies = SyscallPolicies();
+  size_t count = 0;
+  while (count < policies.size() && !policies[count].lookup) {
+    count++;
+  }
+  for (size_t i = count; i < policies.size(); i++) {
+    if (!policies[i].lookup) {
+      return 0;
+    }
+  }
+  return count;
+}
+
+constexpr size_t kAuditedSyscallCount = CountAuditedSyscalls();
+static_assert(kAuditedSyscallCount > 0,
+              "The lookups must be at the end of kSyscallPolicies");
+
+constexpr size_t kSyscallArgs = 6;
+
+// Reads a NUL terminated string from the memory of pid. Reads page by page
+// since process_vm_readv fails completely if any part of the range is not
+// mapped.
+absl::StatusOr<std::string> ReadString(pid_t pid, uint64_t addr) {
+  if (addr == 0) {
+    return std::string();
+  }
+  static const size_t kPageSize = sysconf(_SC_PAGESIZE);
+  char buf[PATH_MAX];
+  size_t len = 0;
+  while (len < sizeof(buf)) {
+    uint64_t pos = addr + len;
+    size_t chunk = std::min(sizeof(buf) - len, kPageSize - pos % kPageSize);
+    struct iovec local = {buf + len, chunk};
+    struct iovec remote = {reinterpret_cast<void *>(pos), chunk};
+    ssize_t bytes = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+    if (bytes <= 0) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("Could not read the memory of pid ", pid));
+    }
+    const char *end =
+        static_cast<const char *>(memchr(buf + len, '\0', bytes));
+    if (end != nullptr) {
+      return std::string(buf, end - buf);
+    }
+    len += bytes;
+  }
+  return absl::FailedPreconditionError("Path is longer than PATH_MAX");
+}
+
+absl::StatusOr<std::string> ReadCwd(pid_t pid) {
+  char buf[PATH_MAX];
+  ssize_t len = readlink(absl::StrCat("/proc/", pid, "/cwd").c_str(), buf,
+                         sizeof(buf));
+  if (len == -1 || static_cast<size_t>(len) == sizeof(buf)) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Could not read the cwd of pid ", pid));
+  }
+  return std::string(buf, len);
+}
+
+}  // namespace
+
+absl::Span<const AuditedSyscall> AuditedSyscalls() {
+  return SyscallPolicies().subspan(0, kAuditedSyscallCount);
+}
+
+const AuditedSyscall *FindAuditedSyscall(int nr) {
+  const SyscallPolicy *policy = FindSyscallPolicy(nr);
+  return policy != nullptr && !policy->lookup ? policy : nullptr;
+}
+
+absl::StatusOr<int> InstallNotifyFilter() {
+  constexpr size_t kCount = kAuditedSyscallCount;
+  // Every JEQ jumps forward over the remaining comparisons, the offsets have
+  // to fit into a byte.
+  static_assert(kCount < 255, "Too many syscalls for a single jump");
+
+  std::vector<struct sock_filter> program = {
+      BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch)),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 1, 0),
+      BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+      BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr)),
+  };
+  for (size_t i = 0; i < kCount; i++) {
+    // On a match, skip the other comparisons and the RET_ALLOW.
+    program.push_back(
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+                 static_cast<__u32>(AuditedSyscalls()[i].nr),
+                 static_cast<__u8>(kCount - i), 0));
+  }
+  program.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+  program.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_USER_NOTIF));
+
+  struct sock_fprog prog = {static_cast<unsigned short>(program.size()),
+                            program.data()};
+  int fd = syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER,
+                   SECCOMP_FILTER_FLAG_NEW_LISTENER, &prog);
+  if (fd == -1) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Could not install the seccomp filter: ",
+                     strerror(errno)));
+  }
+  return fd;
+}
+
+NotifyListener::~NotifyListener() { close(fd_); }
+
+absl::StatusOr<SyscallNotification> NotifyListener::Receive() const {
+  struct pollfd pfd = {fd_, POLLIN, 0};
+  while (true) {
+    if (poll(&pfd, 1, -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return absl::UnavailableError("poll on the seccomp listener failed");
+    }
+    if (pfd.revents & POLLIN) {
+      break;
+    }
+    if (pfd.revents & (POLLHUP | POLLERR)) {
+      return absl::UnavailableError("No process is using the filter anymore");
+    }
+  }
+
+  struct seccomp_notif notif;
+  memset(&notif, 0, sizeof(notif));
+  if (ioctl(fd_, SECCOMP_IOCTL_NOTIF_RECV, &notif) == -1) {
+    // Another thread got it first or the caller is gone.
+    return absl::FailedPreconditionError(
+        absl::StrCat("Could not receive a notification: ", strerror(errno)));
+  }
+
+  SyscallNotification notification = {
+      notif.id, static_cast<pid_t>(notif.pid),
+      FindAuditedSyscall(notif.data.nr),
+      FileEvent(notif.data.nr,
+                std::vector<uint64_t>(notif.data.args,
+                                      notif.data.args + kSyscallArgs),
+                {}),
+      ""};
+  // The upper half of the registers is undefined for int arguments. Sign
+  // extend the dirfds like the libc hooks do, so that AT_FDCWD compares equal.
+  for (size_t i : DirFdArgs(notif.data.nr)) {
+    notification.event.args[i] = static_cast<uint64_t>(
+        static_cast<int64_t>(static_cast<int32_t>(notif.data.args[i])));
+  }
+  absl::Status status;
+  if (notification.syscall == nullptr) {
+    status = absl::InternalError(
+        absl::StrCat("Unexpected syscall ", notif.data.nr));
+  }
+  bool relative = false;
+  for (size_t i = 0; status.ok() && i < notification.syscall->path_arg_count;
+       i++) {
+    absl::StatusOr<std::string> path = ReadString(
+        notification.pid, notif.data.args[notification.syscall->path_args[i]]);
+    if (!path.ok()) {
+      status = path.status();
+      break;
+    }
+    relative |= !path->empty() && !IsAbsolutePath(*path);
+    notification.event.path_args.push_back(*std::move(path));
+  }
+  if (status.ok() && relative) {
+    absl::StatusOr<std::string> cwd = ReadCwd(notification.pid);
+    if (cwd.ok()) {
+      notification.cwd = *std::move(cwd);
+    } else {
+      status = cwd.status();
+    }
+  }
+  // Checked last, after this the pid could belong to a different process.
+  if (status.ok() && !IsValid(notification.id)) {
+    status = absl::FailedPreconditionError(
+        absl::StrCat("pid ", notification.pid, " is gone"));
+  }
+  if (!status.ok()) {
+    Continue(notification);
+    return status;
+  }
+  return notification;
+}
+
+void NotifyListener::Continue(const SyscallNotification &notification) const {
+  struct seccomp_notif_resp resp;
+  memset(&resp, 0, sizeof(resp));
+  resp.id = notification.id;
+  resp.flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+  // Fails if the caller is gone, which is fine.
+  ioctl(fd_, SECCOMP_IOCTL_NOTIF_SEND, &resp);
+}
+
+bool NotifyListener::IsValid(uint64_t id) const {
+  return ioctl(fd_, SECCOMP_IOCTL_NOTIF_ID_VALID, &id) == 0;
+}
+
+}  // namespace pathauditor
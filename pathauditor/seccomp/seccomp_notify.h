@@ -0,0 +1,94 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Collects FileEvents with a seccomp filter that returns SECCOMP_RET_USER_NOTIF
+// for the audited syscalls. Unlike the libc hooks this also sees raw syscalls
+// and static binaries, and it covers the whole process tree below the process
+// that installed the filter.
+
+#ifndef PATHAUDITOR_SECCOMP_SECCOMP_NOTIFY_H_
+#define PATHAUDITOR_SECCOMP_SECCOMP_NOTIFY_H_
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "pathauditor/file_event.h"
+#include "pathauditor/syscall_policy.h"
+
+namespace pathauditor {
+
+// The filter stops for every syscall in kSyscallPolicies, except for the
+// lookups like stat.
+using AuditedSyscall = SyscallPolicy;
+
+absl::Span<const AuditedSyscall> AuditedSyscalls();
+
+// Returns nullptr if nr is not audited.
+const AuditedSyscall *FindAuditedSyscall(int nr);
+
+// Installs a filter that stops the calling thread, and all processes it
+// creates later, in every audited syscall until the listener lets the syscall
+// continue. Returns the listener fd.
+// Requires no_new_privs or CAP_SYS_ADMIN and Linux 5.5.
+absl::StatusOr<int> InstallNotifyFilter();
+
+// A syscall waiting for the listener.
+struct SyscallNotification {
+  uint64_t id;
+  // The thread id in our pid namespace.
+  pid_t pid;
+  const AuditedSyscall *syscall;
+  FileEvent event;
+  // The cwd of the thread, only looked up if one of the paths is relative.
+  std::string cwd;
+};
+
+// The supervisor side of the filter. Receive and Continue can be called from
+// multiple threads at the same time.
+class NotifyListener {
+ public:
+  // Takes ownership of fd.
+  explicit NotifyListener(int fd) : fd_(fd) {}
+  ~NotifyListener();
+
+  NotifyListener(const NotifyListener &) = delete;
+  NotifyListener &operator=(const NotifyListener &) = delete;
+
+  // Waits for the next syscall and reads its path arguments from the memory of
+  // the caller. The caller stays stopped until Continue is called.
+  // Returns an UnavailableError once no process uses the filter anymore. Other
+  // errors only concern a single notification, e.g. if the caller got killed,
+  // and the syscall has already been continued.
+  absl::StatusOr<SyscallNotification> Receive() const;
+
+  // Lets the syscall run as if there was no filter.
+  void Continue(const SyscallNotification &notification) const;
+
+ private:
+  // Whether the notification is still pending. If it is, the pid still
+  // belongs to the caller and what we read from /proc is about the right
+  // process.
+  bool IsValid(uint64_t id) const;
+
+  const int fd_;
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_SECCOMP_SECCOMP_NOTIFY_H_
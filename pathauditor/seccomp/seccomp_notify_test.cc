@@ -0,0 +1,109 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/seccomp/seccomp_notify.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "pathauditor/pathauditor.h"
+#include "pathauditor/process_information.h"
+#include "pathauditor/util/status_matchers.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::Ne;
+using ::testing::NotNull;
+
+TEST(AuditedSyscallsTest, AllAreHandledByFileEventIsUserControlled) {
+  SameProcessInformation proc_info;
+  for (const AuditedSyscall &syscall : AuditedSyscalls()) {
+    std::vector<std::string> path_args(syscall.path_arg_count, "/");
+    FileEvent event(syscall.nr, std::vector<uint64_t>(6, 0), path_args);
+    absl::StatusOr<bool> result = FileEventIsUserControlled(proc_info, event);
+    EXPECT_THAT(result.status().code(),
+                Ne(absl::StatusCode::kUnimplemented))
+        << syscall.name;
+    EXPECT_THAT(FindAuditedSyscall(syscall.nr), Eq(&syscall));
+  }
+  EXPECT_THAT(FindAuditedSyscall(SYS_read), Eq(nullptr));
+}
+
+TEST(NotifyListenerTest, ReceivesSyscallsOfChild) {
+  int pipe_fds[2];
+  ASSERT_THAT(pipe(pipe_fds), Eq(0));
+  pid_t child = fork();
+  ASSERT_THAT(child, Ne(-1));
+  if (child == 0) {
+    // The listener fd has the same number in the parent after the fork, so
+    // just tell it which one it is.
+    close(pipe_fds[0]);
+    prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0);
+    absl::StatusOr<int> listener = InstallNotifyFilter();
+    int fd = listener.ok() ? *listener : -1;
+    if (write(pipe_fds[1], &fd, sizeof(fd)) != sizeof(fd) || fd == -1) {
+      _exit(1);
+    }
+    syscall(SYS_openat, AT_FDCWD, "some/relative/path", O_RDONLY);
+    syscall(SYS_renameat, AT_FDCWD, "/from", AT_FDCWD, "/to");
+    _exit(0);
+  }
+  close(pipe_fds[1]);
+  int child_fd;
+  ASSERT_THAT(read(pipe_fds[0], &child_fd, sizeof(child_fd)),
+              Eq(sizeof(child_fd)));
+  ASSERT_THAT(child_fd, Ne(-1));
+  int fd = syscall(SYS_pidfd_getfd, syscall(SYS_pidfd_open, child, 0),
+                   child_fd, 0);
+  ASSERT_THAT(fd, Ne(-1));
+  NotifyListener listener(fd);
+
+  char cwd[PATH_MAX];
+  ASSERT_THAT(getcwd(cwd, sizeof(cwd)), NotNull());
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(SyscallNotification open,
+                                               listener.Receive());
+  EXPECT_THAT(open.pid, Eq(child));
+  EXPECT_THAT(open.event.syscall_nr, Eq(SYS_openat));
+  EXPECT_THAT(open.event.path_args, ElementsAre("some/relative/path"));
+  EXPECT_THAT(open.cwd, Eq(cwd));
+  listener.Continue(open);
+
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(SyscallNotification rename,
+                                               listener.Receive());
+  EXPECT_THAT(rename.event.syscall_nr, Eq(SYS_renameat));
+  EXPECT_THAT(rename.event.path_args, ElementsAre("/from", "/to"));
+  EXPECT_THAT(rename.cwd, Eq(""));
+  listener.Continue(rename);
+
+  int status;
+  ASSERT_THAT(waitpid(child, &status, 0), Eq(child));
+  EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  EXPECT_TRUE(absl::IsUnavailable(listener.Receive().status()));
+}
+
+}  // namespace
+}  // namespace pathauditor
@@ -0,0 +1,270 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/shared_verdict_cache.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "absl/strings/str_cat.h"
+#include "pathauditor/util/cleanup.h"
+
+namespace pathauditor {
+
+namespace {
+
+constexpr uint32_t kMagic = 0x50415643;  // "PAVC"
+constexpr uint32_t kVersion = 1;
+
+uid_t GetEuid() { return syscall(SYS_geteuid); }
+
+size_t RoundUpToPowerOfTwo(size_t n) {
+  size_t result = 1;
+  while (result < n) {
+    result <<= 1;
+  }
+  return result;
+}
+
+uint64_t Mix(uint64_t x) {
+  x *= 0xff51afd7ed558ccdULL;
+  return x ^ (x >> 32);
+}
+
+}  // namespace
+
+struct SharedVerdictCache::Header {
+  // Written last when the file is created.
+  std::atomic<uint32_t> magic;
+  uint32_t version;
+  uint64_t capacity;
+  uint64_t slot_size;
+  char reserved[40];
+};
+
+struct alignas(64) SharedVerdictCache::Slot {
+  // Odd while a writer updates the slot.
+  std::atomic<uint32_t> sequence;
+  // 0 if the slot is empty, the DirectoryVerdict + 1 otherwise.
+  std::atomic<uint32_t> verdict;
+  std::atomic<uint64_t> dev;
+  std::atomic<uint64_t> ino;
+  std::atomic<int64_t> ctime_sec;
+  std::atomic<uint32_t> ctime_nsec;
+  std::atomic<uint32_t> mode;
+  std::atomic<uint32_t> uid;
+  std::atomic<uint32_t> gid;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "the slots are shared with other processes");
+
+absl::StatusOr<std::unique_ptr<SharedVerdictCache>> SharedVerdictCache::Open(
+    const char *path, size_t capacity) {
+  static_assert(sizeof(Header) == 64 && sizeof(Slot) == 64,
+                "the layout is shared with other processes");
+  bool writable = GetEuid() == 0;
+  int fd = open(path,
+                (writable ? O_RDWR | O_CREAT : O_RDONLY) | O_NOFOLLOW |
+                    O_CLOEXEC,
+                0644);
+  if (fd == -1) {
+    return absl::NotFoundError(
+        absl::StrCat("Could not open shared verdict cache ", path));
+  }
+  auto close_fd = MakeCleanup([fd]() { close(fd); });
+
+  // Serializes the creation among the processes that could create it. The
+  // mapping keeps the lock alive after the fd is closed, so unlock explicitly.
+  if (writable && flock(fd, LOCK_EX) == -1) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Could not lock shared verdict cache ", path));
+  }
+  auto unlock = MakeCleanup([fd, writable]() {
+    if (writable) {
+      flock(fd, LOCK_UN);
+    }
+  });
+
+  struct stat sb;
+  if (fstat(fd, &sb) == -1) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Could not stat shared verdict cache ", path));
+  }
+  if (!S_ISREG(sb.st_mode) || sb.st_uid != 0 ||
+      sb.st_mode & (S_IWGRP | S_IWOTH)) {
+    return absl::PermissionDeniedError(absl::StrCat(
+        "Shared verdict cache ", path, " is writable by others than root"));
+  }
+
+  // A file that a creator didn't finish, e.g. because it crashed, is created
+  // again.
+  size_t mapping_size = sb.st_size;
+  void *mapping = MAP_FAILED;
+  if (mapping_size >= sizeof(Header)) {
+    mapping = mmap(nullptr, mapping_size,
+                   writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED,
+                   fd, 0);
+    if (mapping == MAP_FAILED) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("Could not map shared verdict cache ", path));
+    }
+  }
+  auto unmap = MakeCleanup([&mapping, &mapping_size]() {
+    if (mapping != MAP_FAILED) {
+      munmap(mapping, mapping_size);
+    }
+  });
+  const Header *header = static_cast<const Header *>(mapping);
+  if (mapping == MAP_FAILED ||
+      header->magic.load(std::memory_order_acquire) != kMagic) {
+    if (!writable) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("Shared verdict cache ", path, " is not initialized"));
+    }
+    if (mapping != MAP_FAILED) {
+      munmap(mapping, mapping_size);
+      mapping = MAP_FAILED;
+    }
+    capacity = RoundUpToPowerOfTwo(capacity);
+    mapping_size = sizeof(Header) + capacity * sizeof(Slot);
+    // Truncating first zeroes the old contents, i.e. every slot is empty.
+    if (ftruncate(fd, 0) == -1 || ftruncate(fd, mapping_size) == -1) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("Could not resize shared verdict cache ", path));
+    }
+    mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+    if (mapping == MAP_FAILED) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("Could not map shared verdict cache ", path));
+    }
+    Header *new_header = static_cast<Header *>(mapping);
+    new_header->version = kVersion;
+    new_header->capacity = capacity;
+    new_header->slot_size = sizeof(Slot);
+    new_header->magic.store(kMagic, std::memory_order_release);
+    header = new_header;
+  }
+
+  if (header->version != kVersion || header->slot_size != sizeof(Slot) ||
+      header->capacity == 0 ||
+      (header->capacity & (header->capacity - 1)) != 0 ||
+      header->capacity > (mapping_size - sizeof(Header)) / sizeof(Slot)) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Not a shared verdict cache: ", path));
+  }
+  unmap.release();
+  return std::unique_ptr<SharedVerdictCache>(
+      new SharedVerdictCache(mapping, mapping_size, writable));
+}
+
+SharedVerdictCache::SharedVerdictCache(void *mapping, size_t mapping_size,
+                                       bool writable)
+    : mapping_(mapping),
+      mapping_size_(mapping_size),
+      slots_(reinterpret_cast<Slot *>(static_cast<char *>(mapping) +
+                                      sizeof(Header))),
+      capacity_(static_cast<Header *>(mapping)->capacity),
+      writable_(writable) {}
+
+SharedVerdictCache::~SharedVerdictCache() { munmap(mapping_, mapping_size_); }
+
+size_t SharedVerdictCache::Home(const struct stat &sb) const {
+  return Mix(Mix(sb.st_dev) ^ sb.st_ino) & (capacity_ - 1);
+}
+
+absl::optional<DirectoryVerdict> SharedVerdictCache::Lookup(
+    const struct stat &sb, uid_t euid) const {
+  size_t home = Home(sb);
+  for (size_t probe = 0; probe < kMaxProbes; probe++) {
+    const Slot &slot = slots_[(home + probe) & (capacity_ - 1)];
+    uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence & 1) {
+      continue;
+    }
+    uint32_t verdict = slot.verdict.load(std::memory_order_relaxed);
+    bool matches =
+        slot.dev.load(std::memory_order_relaxed) == sb.st_dev &&
+        slot.ino.load(std::memory_order_relaxed) == sb.st_ino &&
+        slot.ctime_sec.load(std::memory_order_relaxed) == sb.st_ctim.tv_sec &&
+        slot.ctime_nsec.load(std::memory_order_relaxed) ==
+            static_cast<uint32_t>(sb.st_ctim.tv_nsec) &&
+        slot.mode.load(std::memory_order_relaxed) == sb.st_mode &&
+        slot.uid.load(std::memory_order_relaxed) == sb.st_uid &&
+        slot.gid.load(std::memory_order_relaxed) == sb.st_gid;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != sequence) {
+      continue;
+    }
+    if (verdict == 0) {
+      // Entries are never removed, so the probe sequence ends here.
+      return absl::nullopt;
+    }
+    if (!matches) {
+      continue;
+    }
+    DirectoryVerdict found = static_cast<DirectoryVerdict>(verdict - 1);
+    if (euid != 0 && found != DirectoryVerdict::kSafe) {
+      return absl::nullopt;
+    }
+    return found;
+  }
+  return absl::nullopt;
+}
+
+void SharedVerdictCache::Insert(const struct stat &sb, DirectoryVerdict verdict,
+                                uid_t euid) {
+  if (!writable_ || euid != 0) {
+    return;
+  }
+  // Take the slot that has the directory or the first empty one. If there is
+  // neither, the home slot is overwritten.
+  size_t home = Home(sb);
+  Slot *target = &slots_[home];
+  for (size_t probe = 0; probe < kMaxProbes; probe++) {
+    Slot &slot = slots_[(home + probe) & (capacity_ - 1)];
+    if (slot.verdict.load(std::memory_order_relaxed) == 0 ||
+        (slot.dev.load(std::memory_order_relaxed) == sb.st_dev &&
+         slot.ino.load(std::memory_order_relaxed) == sb.st_ino)) {
+      target = &slot;
+      break;
+    }
+  }
+
+  // Skip the insert if another writer has the slot.
+  uint32_t sequence = target->sequence.load(std::memory_order_relaxed);
+  if (sequence & 1 ||
+      !target->sequence.compare_exchange_strong(sequence, sequence + 1,
+                                                std::memory_order_acquire)) {
+    return;
+  }
+  // Readers must not see the new fields before the odd sequence number.
+  std::atomic_thread_fence(std::memory_order_release);
+  target->dev.store(sb.st_dev, std::memory_order_relaxed);
+  target->ino.store(sb.st_ino, std::memory_order_relaxed);
+  target->ctime_sec.store(sb.st_ctim.tv_sec, std::memory_order_relaxed);
+  target->ctime_nsec.store(sb.st_ctim.tv_nsec, std::memory_order_relaxed);
+  target->mode.store(sb.st_mode, std::memory_order_relaxed);
+  target->uid.store(sb.st_uid, std::memory_order_relaxed);
+  target->gid.store(sb.st_gid, std::memory_order_relaxed);
+  target->verdict.store(static_cast<uint32_t>(verdict) + 1,
+                        std::memory_order_relaxed);
+  target->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+}  // namespace pathauditor
@@ -0,0 +1,95 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_SHARED_VERDICT_CACHE_H_
+#define PATHAUDITOR_SHARED_VERDICT_CACHE_H_
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "absl/status/statusor.h"
+#include "absl/types/optional.h"
+#include "pathauditor/directory_verdict_cache.h"
+
+namespace pathauditor {
+
+// A DirectoryVerdictCache that all processes on the machine share, so that a
+// process starts out with the verdicts that earlier processes computed for
+// /usr/bin, /lib and the like.
+//
+// The cache is a memory mapped file holding an open addressing hash table
+// keyed like DirectoryVerdictCache. Every slot is protected by a seqlock:
+// writers make its sequence number odd while they update it, and readers
+// retry the slot if it changed while they read it. A writer that dies in the
+// middle leaves its slot locked, which only costs that slot.
+//
+// Only entries written by root can be trusted. A writer uid stored in the
+// entries could be forged by whoever can write the file, so this is enforced
+// through the file instead: it has to be a regular file owned by root that
+// nobody else can write to. Processes with euid 0 map it writable and create
+// it if needed, all others map it read-only. Verdicts depend on the effective
+// uid, so only verdicts computed for uid 0 are inserted. Of those, kSafe also
+// holds for every other uid, while the others might not: a directory owned by
+// uid 1000 is user controlled for root but not for uid 1000.
+// Thread-safe.
+class SharedVerdictCache {
+ public:
+  static constexpr size_t kDefaultCapacity = 16384;
+  // Slots that are looked at for an entry before giving up.
+  static constexpr size_t kMaxProbes = 8;
+
+  // Maps the cache at path. If it doesn't exist and we're root, it's created
+  // with capacity slots, rounded up to a power of two. Check beforehand that
+  // nobody else could create or replace the file at path.
+  static absl::StatusOr<std::unique_ptr<SharedVerdictCache>> Open(
+      const char *path, size_t capacity = kDefaultCapacity);
+  ~SharedVerdictCache();
+
+  SharedVerdictCache(const SharedVerdictCache &) = delete;
+  SharedVerdictCache &operator=(const SharedVerdictCache &) = delete;
+
+  // Returns the verdict for the directory described by sb that applies to
+  // euid, if any.
+  absl::optional<DirectoryVerdict> Lookup(const struct stat &sb,
+                                          uid_t euid) const;
+  // Stores a verdict that was computed for euid. Does nothing unless euid is
+  // 0 and the cache was mapped writable.
+  void Insert(const struct stat &sb, DirectoryVerdict verdict, uid_t euid);
+
+  size_t capacity() const { return capacity_; }
+  bool writable() const { return writable_; }
+
+ private:
+  struct Header;
+  struct Slot;
+
+  SharedVerdictCache(void *mapping, size_t mapping_size, bool writable);
+
+  size_t Home(const struct stat &sb) const;
+
+  void *mapping_;
+  size_t mapping_size_;
+  Slot *slots_;
+  size_t capacity_;
+  bool writable_;
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_SHARED_VERDICT_CACHE_H_
@@ -0,0 +1,179 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/shared_verdict_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "pathauditor/util/status_matchers.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Ne;
+using ::testing::Not;
+using ::testing::Optional;
+
+struct stat DirStat(ino_t ino) {
+  struct stat sb = {};
+  sb.st_dev = 1;
+  sb.st_ino = ino;
+  sb.st_mode = S_IFDIR | 0755;
+  sb.st_ctim.tv_sec = 1000;
+  return sb;
+}
+
+class SharedVerdictCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    if (geteuid() != 0) {
+      GTEST_SKIP() << "only root can create the cache";
+    }
+    char dir_template[] = "/tmp/shared_verdict_cache_test.XXXXXX";
+    ASSERT_THAT(mkdtemp(dir_template), Ne(nullptr));
+    dir_ = dir_template;
+    path_ = dir_ + "/cache";
+  }
+
+  void TearDown() override {
+    unlink(path_.c_str());
+    rmdir(dir_.c_str());
+  }
+
+  std::string dir_;
+  std::string path_;
+};
+
+TEST_F(SharedVerdictCacheTest, VerdictsAreShared) {
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<SharedVerdictCache> writer,
+      SharedVerdictCache::Open(path_.c_str(), 100));
+  EXPECT_THAT(writer->capacity(), Eq(128));
+  EXPECT_TRUE(writer->writable());
+
+  struct stat sb = DirStat(2);
+  EXPECT_THAT(writer->Lookup(sb, 0), Eq(absl::nullopt));
+  writer->Insert(sb, DirectoryVerdict::kSticky, 0);
+
+  // Another mapping of the same file, the capacity comes from the file.
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<SharedVerdictCache> reader,
+      SharedVerdictCache::Open(path_.c_str(), 4));
+  EXPECT_THAT(reader->capacity(), Eq(128));
+  EXPECT_THAT(reader->Lookup(sb, 0), Optional(DirectoryVerdict::kSticky));
+
+  struct stat chmodded = sb;
+  chmodded.st_mode |= S_IWOTH;
+  chmodded.st_ctim.tv_nsec = 1;
+  EXPECT_THAT(reader->Lookup(chmodded, 0), Eq(absl::nullopt));
+}
+
+TEST_F(SharedVerdictCacheTest, OnlyRootVerdicts) {
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<SharedVerdictCache> cache,
+      SharedVerdictCache::Open(path_.c_str()));
+  struct stat safe = DirStat(2);
+  struct stat user_controlled = DirStat(3);
+  cache->Insert(safe, DirectoryVerdict::kSafe, 0);
+  cache->Insert(user_controlled, DirectoryVerdict::kUserControlled, 0);
+  cache->Insert(DirStat(4), DirectoryVerdict::kSafe, 1000);
+
+  EXPECT_THAT(cache->Lookup(DirStat(4), 0), Eq(absl::nullopt));
+  EXPECT_THAT(cache->Lookup(safe, 1000), Optional(DirectoryVerdict::kSafe));
+  // Might be owned by uid 1000.
+  EXPECT_THAT(cache->Lookup(user_controlled, 1000), Eq(absl::nullopt));
+  EXPECT_THAT(cache->Lookup(user_controlled, 0),
+              Optional(DirectoryVerdict::kUserControlled));
+}
+
+TEST_F(SharedVerdictCacheTest, FullTable) {
+  constexpr size_t kCapacity = SharedVerdictCache::kMaxProbes;
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<SharedVerdictCache> cache,
+      SharedVerdictCache::Open(path_.c_str(), kCapacity));
+  // Every probe sequence covers the whole table.
+  for (ino_t ino = 1; ino <= kCapacity; ino++) {
+    cache->Insert(DirStat(ino), DirectoryVerdict::kSticky, 0);
+  }
+  for (ino_t ino = 1; ino <= kCapacity; ino++) {
+    EXPECT_THAT(cache->Lookup(DirStat(ino), 0),
+                Optional(DirectoryVerdict::kSticky))
+        << ino;
+  }
+
+  // Evicts one of them.
+  struct stat sb = DirStat(kCapacity + 1);
+  cache->Insert(sb, DirectoryVerdict::kSafe, 0);
+  EXPECT_THAT(cache->Lookup(sb, 0), Optional(DirectoryVerdict::kSafe));
+  size_t found = 0;
+  for (ino_t ino = 1; ino <= kCapacity; ino++) {
+    found += cache->Lookup(DirStat(ino), 0).has_value();
+  }
+  EXPECT_THAT(found, Eq(kCapacity - 1));
+
+  // Updating an entry doesn't evict another one.
+  cache->Insert(sb, DirectoryVerdict::kUserControlled, 0);
+  EXPECT_THAT(cache->Lookup(sb, 0),
+              Optional(DirectoryVerdict::kUserControlled));
+  found = 0;
+  for (ino_t ino = 1; ino <= kCapacity; ino++) {
+    found += cache->Lookup(DirStat(ino), 0).has_value();
+  }
+  EXPECT_THAT(found, Eq(kCapacity - 1));
+}
+
+TEST_F(SharedVerdictCacheTest, RejectsFilesOthersCanWrite) {
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<SharedVerdictCache> cache,
+      SharedVerdictCache::Open(path_.c_str()));
+  ASSERT_THAT(chmod(path_.c_str(), 0666), Eq(0));
+  EXPECT_THAT(SharedVerdictCache::Open(path_.c_str()), Not(IsOk()));
+  ASSERT_THAT(chmod(path_.c_str(), 0644), Eq(0));
+  ASSERT_THAT(chown(path_.c_str(), 1000, 0), Eq(0));
+  EXPECT_THAT(SharedVerdictCache::Open(path_.c_str()), Not(IsOk()));
+
+  std::string link = dir_ + "/link";
+  ASSERT_THAT(chown(path_.c_str(), 0, 0), Eq(0));
+  ASSERT_THAT(symlink(path_.c_str(), link.c_str()), Eq(0));
+  EXPECT_THAT(SharedVerdictCache::Open(link.c_str()), Not(IsOk()));
+  unlink(link.c_str());
+}
+
+TEST_F(SharedVerdictCacheTest, RecreatesUnfinishedFiles) {
+  FILE *file = fopen(path_.c_str(), "w");
+  ASSERT_THAT(file, Ne(nullptr));
+  fputs("not a cache, but long enough to hold the header of one. It's also "
+        "not all zeros.",
+        file);
+  fclose(file);
+  ASSERT_THAT(chmod(path_.c_str(), 0644), Eq(0));
+  // Treated like a file a creator didn't finish.
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<SharedVerdictCache> cache,
+      SharedVerdictCache::Open(path_.c_str(), 16));
+  EXPECT_THAT(cache->capacity(), Eq(16));
+  EXPECT_THAT(cache->Lookup(DirStat(2), 0), Eq(absl::nullopt));
+}
+
+}  // namespace
+}  // namespace pathauditor
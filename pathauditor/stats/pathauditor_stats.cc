@@ -0,0 +1,293 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Prints the stats pages that libpath_auditor.so keeps with
+// PATHAUDITOR_STATS_DIR, see stats_page.h:
+//
+//   pathauditor-stats [--hooks=false] [--top=N] [--prune] page_or_dir...
+//
+// Pages can be read while their processes are still running. Directories are
+// searched for pages. The processes are listed by the time they spent in the
+// auditor, most expensive first. Nothing removes the pages of processes that
+// exited, --prune deletes them after printing them one last time.
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "pathauditor/stats_page.h"
+#include "pathauditor/util/cleanup.h"
+#include "pathauditor/util/flag.h"
+
+ABSL_FLAG(bool, hooks, true, "Also print the stats of every hook.");
+ABSL_FLAG(int32_t, top, 0,
+          "Only print the N processes that spent the most time in the "
+          "auditor. 0 prints all of them.");
+ABSL_FLAG(bool, prune, false,
+          "Delete the pages of processes that exited after printing them.");
+
+namespace pathauditor {
+namespace {
+
+constexpr char kPageSuffix[] = ".pastats";
+
+absl::StatusOr<StatsPageTotals> ReadPage(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return absl::NotFoundError(
+        absl::StrCat("Could not open ", path, ": ", strerror(errno)));
+  }
+  auto close_fd = MakeCleanup([fd]() { close(fd); });
+  struct stat sb;
+  if (fstat(fd, &sb) == -1) {
+    return absl::FailedPreconditionError(absl::StrCat("Could not stat ", path));
+  }
+  if (sb.st_size == 0) {
+    return absl::InvalidArgumentError(absl::StrCat(path, " is empty"));
+  }
+  // Shared, so that we see the counters as the process writes them.
+  void *mem = mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (mem == MAP_FAILED) {
+    return absl::FailedPreconditionError(absl::StrCat("Could not map ", path));
+  }
+  auto unmap = MakeCleanup([mem, &sb]() { munmap(mem, sb.st_size); });
+  absl::StatusOr<StatsPageTotals> totals = SumStatsPage(
+      absl::Span<const char>(static_cast<const char *>(mem), sb.st_size));
+  if (!totals.ok()) {
+    return absl::Status(totals.status().code(),
+                        absl::StrCat(path, ": ", totals.status().message()));
+  }
+  return totals;
+}
+
+// Returns the pages in path if it's a directory, path itself otherwise.
+std::vector<std::string> ListPages(const std::string &path) {
+  DIR *dir = opendir(path.c_str());
+  if (dir == nullptr) {
+    return {path};
+  }
+  std::vector<std::string> pages;
+  while (struct dirent *entry = readdir(dir)) {
+    if (absl::EndsWith(entry->d_name, kPageSuffix)) {
+      pages.push_back(absl::StrCat(path, "/", entry->d_name));
+    }
+  }
+  closedir(dir);
+  std::sort(pages.begin(), pages.end());
+  return pages;
+}
+
+// Reads a file from /proc into content.
+bool ReadProcFile(const std::string &path, std::string *content) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return false;
+  }
+  auto close_fd = MakeCleanup([fd]() { close(fd); });
+  content->clear();
+  char buf[4096];
+  ssize_t len;
+  while ((len = read(fd, buf, sizeof(buf))) > 0) {
+    content->append(buf, len);
+  }
+  return len == 0 && !content->empty();
+}
+
+// When the process with pid started, in ns since the epoch. Only accurate to
+// the second since that's all the boot time has.
+absl::optional<uint64_t> ProcessStartTimeNs(int32_t pid) {
+  std::string stat;
+  std::string proc_stat;
+  if (!ReadProcFile(absl::StrCat("/proc/", pid, "/stat"), &stat) ||
+      !ReadProcFile("/proc/stat", &proc_stat)) {
+    return absl::nullopt;
+  }
+  // The start time is the 22nd field, the comm before it can contain spaces.
+  size_t comm_end = stat.rfind(')');
+  if (comm_end == std::string::npos) {
+    return absl::nullopt;
+  }
+  std::vector<absl::string_view> fields =
+      absl::StrSplit(absl::string_view(stat).substr(comm_end + 1), ' ',
+                     absl::SkipEmpty());
+  uint64_t start_ticks;
+  // The state is the 3rd field and the first one after the comm.
+  if (fields.size() < 20 || !absl::SimpleAtoi(fields[19], &start_ticks)) {
+    return absl::nullopt;
+  }
+  for (absl::string_view line : absl::StrSplit(proc_stat, '\n')) {
+    uint64_t boot_time_s;
+    if (absl::ConsumePrefix(&line, "btime ") &&
+        absl::SimpleAtoi(line, &boot_time_s)) {
+      uint64_t ticks_per_s = sysconf(_SC_CLK_TCK);
+      return boot_time_s * 1000000000 +
+             start_ticks * (1000000000 / ticks_per_s);
+    }
+  }
+  return absl::nullopt;
+}
+
+// Whether the process that wrote the page is gone. The pid could have been
+// reused by a process that started after the page was created. If in doubt,
+// e.g. because /proc of the process can't be read, it's treated as running.
+bool ProcessExited(const StatsPageTotals &page) {
+  if (kill(page.pid, 0) == -1 && errno == ESRCH) {
+    return true;
+  }
+  absl::optional<uint64_t> start_time_ns = ProcessStartTimeNs(page.pid);
+  // The page is created after the process started. Allow for the boot time
+  // being rounded.
+  constexpr uint64_t kSlackNs = 2000000000;
+  return start_time_ns.has_value() &&
+         *start_time_ns > page.start_time_ns + kSlackNs;
+}
+
+double Micros(uint64_t ns) { return ns / 1e3; }
+
+double Ratio(uint64_t part, uint64_t whole) {
+  return whole == 0 ? 0 : static_cast<double>(part) / whole;
+}
+
+void PrintPage(const StatsPageTotals &page) {
+  uint64_t calls = 0;
+  uint64_t audits = 0;
+  for (const HookTotals &hook : page.hooks) {
+    calls += hook.calls;
+    audits += hook.audits;
+  }
+  printf("%s (pid %d): %llu calls, %llu audits, %.3fms in the auditor\n",
+         page.exe.empty() ? "?" : page.exe.c_str(), page.pid,
+         static_cast<unsigned long long>(calls),
+         static_cast<unsigned long long>(audits),
+         page.latency_sum_ns() / 1e6);
+
+  std::string errors;
+  for (size_t code = 0; code < kStatsStatusCodes; code++) {
+    if (page.errors_by_code[code] != 0) {
+      absl::StrAppend(
+          &errors, errors.empty() ? "" : ", ",
+          absl::StatusCodeToString(static_cast<absl::StatusCode>(code)), " ",
+          page.errors_by_code[code]);
+    }
+  }
+  if (!errors.empty()) {
+    printf("  errors: %s\n", errors.c_str());
+  }
+
+  if (!absl::GetFlag(FLAGS_hooks) || page.hooks.empty()) {
+    return;
+  }
+  std::vector<const HookTotals *> hooks;
+  for (const HookTotals &hook : page.hooks) {
+    hooks.push_back(&hook);
+  }
+  std::sort(hooks.begin(), hooks.end(),
+            [](const HookTotals *a, const HookTotals *b) {
+              return a->latency_sum_ns > b->latency_sum_ns;
+            });
+  printf("  %-12s %10s %9s %10s %9s %9s %9s %8s %7s %8s %6s %9s %9s %9s %9s\n",
+         "hook", "calls", "skipped", "audits", "captured", "daemon", "inline",
+         "insecure", "errors", "fs/audit", "hit%", "mean_us", "p50_us",
+         "p99_us", "max_us");
+  for (const HookTotals *hook : hooks) {
+    printf(
+        "  %-12s %10llu %9llu %10llu %9llu %9llu %9llu %8llu %7llu %8.1f "
+        "%6.1f %9.1f %9.1f %9.1f %9.1f\n",
+        hook->name.c_str(), static_cast<unsigned long long>(hook->calls),
+        static_cast<unsigned long long>(hook->skipped),
+        static_cast<unsigned long long>(hook->audits),
+        static_cast<unsigned long long>(hook->captured),
+        static_cast<unsigned long long>(hook->sent_to_daemon),
+        static_cast<unsigned long long>(hook->audited_inline),
+        static_cast<unsigned long long>(hook->insecure),
+        static_cast<unsigned long long>(hook->errors),
+        Ratio(hook->file_system_calls, hook->audited_inline),
+        100 * Ratio(hook->verdict_cache_hits,
+                    hook->verdict_cache_hits + hook->verdict_cache_misses),
+        Micros(hook->audits == 0 ? 0 : hook->latency_sum_ns / hook->audits),
+        Micros(hook->LatencyQuantile(0.5)), Micros(hook->LatencyQuantile(0.99)),
+        Micros(hook->latency_max_ns));
+  }
+}
+
+}  // namespace
+}  // namespace pathauditor
+
+int main(int argc, char **argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s [flags] page_or_dir...\n", argv[0]);
+    return 2;
+  }
+
+  int exit_code = 0;
+  std::vector<pathauditor::StatsPageTotals> pages;
+  // Pages that can't be read are left alone, they might not be ours.
+  std::vector<std::string> exited;
+  for (int i = 1; i < argc; i++) {
+    for (const std::string &path : pathauditor::ListPages(argv[i])) {
+      absl::StatusOr<pathauditor::StatsPageTotals> page =
+          pathauditor::ReadPage(path);
+      if (!page.ok()) {
+        LOG(ERROR) << page.status().message();
+        exit_code = 1;
+        continue;
+      }
+      if (absl::GetFlag(FLAGS_prune) && pathauditor::ProcessExited(*page)) {
+        exited.push_back(path);
+      }
+      pages.push_back(*std::move(page));
+    }
+  }
+
+  std::sort(pages.begin(), pages.end(),
+            [](const pathauditor::StatsPageTotals &a,
+               const pathauditor::StatsPageTotals &b) {
+              return a.latency_sum_ns() > b.latency_sum_ns();
+            });
+  size_t count = pages.size();
+  if (absl::GetFlag(FLAGS_top) > 0) {
+    count = std::min<size_t>(count, absl::GetFlag(FLAGS_top));
+  }
+  for (size_t i = 0; i < count; i++) {
+    pathauditor::PrintPage(pages[i]);
+  }
+  for (const std::string &path : exited) {
+    if (unlink(path.c_str()) == -1 && errno != ENOENT) {
+      LOG(ERROR) << "Could not delete " << path << ": " << strerror(errno);
+      exit_code = 1;
+    }
+  }
+  return exit_code;
+}
@@ -0,0 +1,151 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/stats_page.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "absl/strings/str_cat.h"
+
+namespace pathauditor {
+
+namespace {
+
+constexpr uint64_t kSubBuckets = 1 << kLatencySubBucketBits;
+
+uint64_t Load(const StatsCounter &counter) {
+  return counter.load(std::memory_order_relaxed);
+}
+
+}  // namespace
+
+size_t LatencyBucket(uint64_t ns) {
+  if (ns < kSubBuckets) {
+    return ns;
+  }
+  int msb = 63 - __builtin_clzll(ns);
+  size_t octave = msb - kLatencySubBucketBits + 1;
+  size_t sub = (ns >> (msb - kLatencySubBucketBits)) & (kSubBuckets - 1);
+  return std::min((octave << kLatencySubBucketBits) | sub, kLatencyBuckets - 1);
+}
+
+uint64_t LatencyBucketLowerBound(size_t bucket) {
+  if (bucket < kSubBuckets) {
+    return bucket;
+  }
+  size_t octave = bucket >> kLatencySubBucketBits;
+  uint64_t sub = bucket & (kSubBuckets - 1);
+  return (kSubBuckets | sub) << (octave - 1);
+}
+
+uint64_t HookTotals::LatencyQuantile(double quantile) const {
+  uint64_t total = 0;
+  for (uint64_t count : latency) {
+    total += count;
+  }
+  if (total == 0) {
+    return 0;
+  }
+  // The rank of the quantile, counting from 1.
+  uint64_t rank = std::max<uint64_t>(1, quantile * total + 0.5);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kLatencyBuckets; i++) {
+    seen += latency[i];
+    if (seen >= rank) {
+      return LatencyBucketLowerBound(i);
+    }
+  }
+  return LatencyBucketLowerBound(kLatencyBuckets - 1);
+}
+
+uint64_t StatsPageTotals::latency_sum_ns() const {
+  uint64_t sum = 0;
+  for (const HookTotals &hook : hooks) {
+    sum += hook.latency_sum_ns;
+  }
+  return sum;
+}
+
+absl::StatusOr<StatsPageTotals> SumStatsPage(absl::Span<const char> page) {
+  if (page.size() < sizeof(StatsPageHeader)) {
+    return absl::InvalidArgumentError("Stats page is too short");
+  }
+  // The page is mapped, so it's at least page aligned.
+  const auto *header = reinterpret_cast<const StatsPageHeader *>(page.data());
+  if (header->magic != kStatsPageMagic) {
+    return absl::InvalidArgumentError("Not a stats page");
+  }
+  if (header->version != kStatsPageVersion) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Unsupported stats page version ", header->version));
+  }
+  size_t thread_slots = header->thread_slots;
+  if (page.size() <
+      sizeof(StatsPageHeader) + thread_slots * sizeof(ThreadStats)) {
+    return absl::InvalidArgumentError("Stats page is truncated");
+  }
+
+  StatsPageTotals totals;
+  totals.pid = header->pid;
+  totals.start_time_ns = header->start_time_ns;
+  totals.exe.assign(header->exe, strnlen(header->exe, sizeof(header->exe)));
+  size_t hook_count = std::min<size_t>(
+      header->hook_count.load(std::memory_order_acquire), kStatsMaxHooks);
+  std::vector<HookTotals> hooks(hook_count);
+  for (size_t i = 0; i < hook_count; i++) {
+    hooks[i].name.assign(
+        header->hook_names[i],
+        strnlen(header->hook_names[i], sizeof(header->hook_names[i])));
+  }
+
+  const auto *slots =
+      reinterpret_cast<const ThreadStats *>(page.data() + sizeof(*header));
+  for (size_t t = 0; t < thread_slots; t++) {
+    const ThreadStats &slot = slots[t];
+    for (size_t code = 0; code < kStatsStatusCodes; code++) {
+      totals.errors_by_code[code] += Load(slot.errors_by_code[code]);
+    }
+    for (size_t i = 0; i < hook_count; i++) {
+      const HookCounters &counters = slot.hooks[i];
+      HookTotals &hook = hooks[i];
+      hook.calls += Load(counters.calls);
+      hook.skipped += Load(counters.skipped);
+      hook.audits += Load(counters.audits);
+      hook.captured += Load(counters.captured);
+      hook.sent_to_daemon += Load(counters.sent_to_daemon);
+      hook.audited_inline += Load(counters.audited_inline);
+      hook.insecure += Load(counters.insecure);
+      hook.errors += Load(counters.errors);
+      hook.file_system_calls += Load(counters.file_system_calls);
+      hook.verdict_cache_hits += Load(counters.verdict_cache_hits);
+      hook.verdict_cache_misses += Load(counters.verdict_cache_misses);
+      hook.latency_sum_ns += Load(counters.latency_sum_ns);
+      hook.latency_max_ns =
+          std::max(hook.latency_max_ns, Load(counters.latency_max_ns));
+      for (size_t b = 0; b < kLatencyBuckets; b++) {
+        hook.latency[b] += Load(counters.latency[b]);
+      }
+    }
+  }
+
+  for (HookTotals &hook : hooks) {
+    if (hook.calls != 0) {
+      totals.hooks.push_back(std::move(hook));
+    }
+  }
+  return totals;
+}
+
+}  // namespace pathauditor
@@ -0,0 +1,166 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The layout of the stats pages that libpath_auditor.so keeps up to date when
+// PATHAUDITOR_STATS_DIR is set, and that pathauditor-stats reads while the
+// process is running.
+//
+// A page is a memory mapped file with a StatsPageHeader followed by
+// kStatsThreadSlots ThreadStats. A thread takes a slot on its first call and
+// is the only one writing to it until it exits, so its counters are updated
+// without atomic read-modify-writes. Later threads reuse the slot and keep
+// adding to it, only the sum over all slots means something. Threads that
+// find no free slot share slot 0, which is updated with atomic adds.
+// Everything is in host byte order.
+
+#ifndef PATHAUDITOR_STATS_PAGE_H_
+#define PATHAUDITOR_STATS_PAGE_H_
+
+#include <limits.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+
+namespace pathauditor {
+
+constexpr uint32_t kStatsPageMagic = 0x50415354;  // "PAST"
+constexpr uint32_t kStatsPageVersion = 2;
+
+constexpr size_t kStatsMaxHooks = 64;
+constexpr size_t kStatsThreadSlots = 64;
+constexpr size_t kStatsHookNameSize = 32;
+// One more than the largest absl::StatusCode.
+constexpr size_t kStatsStatusCodes = 17;
+
+// The latency histograms have four buckets per power of two, i.e. the bucket
+// boundaries are at most 25% apart. The last bucket holds everything from
+// about 7.5s up.
+constexpr int kLatencySubBucketBits = 2;
+constexpr size_t kLatencyBuckets = 128;
+
+// Returns the bucket of a latency in ns.
+size_t LatencyBucket(uint64_t ns);
+// The smallest latency that falls into bucket.
+uint64_t LatencyBucketLowerBound(size_t bucket);
+
+using StatsCounter = std::atomic<uint64_t>;
+static_assert(sizeof(StatsCounter) == sizeof(uint64_t),
+              "The counters are shared with other processes");
+
+// What one thread counted for one hook.
+struct HookCounters {
+  // Calls of the hook that weren't made by the auditor itself.
+  StatsCounter calls;
+  // Calls that ClassifyFileEvent found safe without an audit.
+  StatsCounter skipped;
+  // Calls that the sampling policy picked. Each of them was either captured,
+  // sent to the daemon or audited in the process.
+  StatsCounter audits;
+  StatsCounter captured;
+  StatsCounter sent_to_daemon;
+  StatsCounter audited_inline;
+  // Results of the audits in the process.
+  StatsCounter insecure;
+  StatsCounter errors;
+  // File system lookups made by the audits in the process, see
+  // ThreadFileSystemCallCount.
+  StatsCounter file_system_calls;
+  StatsCounter verdict_cache_hits;
+  StatsCounter verdict_cache_misses;
+  // Time spent per audit, whichever way it went.
+  StatsCounter latency_sum_ns;
+  StatsCounter latency_max_ns;
+  StatsCounter latency[kLatencyBuckets];
+};
+
+struct ThreadStats {
+  // The tid of the thread that holds the slot, 0 if it's free.
+  std::atomic<int32_t> owner;
+  uint32_t reserved;
+  // Errors of the audits in the process by absl::StatusCode.
+  StatsCounter errors_by_code[kStatsStatusCodes];
+  HookCounters hooks[kStatsMaxHooks];
+};
+
+struct StatsPageHeader {
+  uint32_t magic;
+  uint32_t version;
+  int32_t pid;
+  uint32_t thread_slots;
+  // CLOCK_REALTIME when the page was created.
+  uint64_t start_time_ns;
+  // /proc/self/exe when the page was created, NUL terminated.
+  char exe[PATH_MAX];
+  // The number of hooks that have a name below. A hook's name is written
+  // before the count is raised past it.
+  std::atomic<uint32_t> hook_count;
+  uint32_t reserved;
+  char hook_names[kStatsMaxHooks][kStatsHookNameSize];
+};
+
+constexpr size_t kStatsPageSize =
+    sizeof(StatsPageHeader) + kStatsThreadSlots * sizeof(ThreadStats);
+
+inline ThreadStats *StatsPageSlots(char *page) {
+  return reinterpret_cast<ThreadStats *>(page + sizeof(StatsPageHeader));
+}
+
+// Counters of a hook summed over all threads.
+struct HookTotals {
+  std::string name;
+  uint64_t calls = 0;
+  uint64_t skipped = 0;
+  uint64_t audits = 0;
+  uint64_t captured = 0;
+  uint64_t sent_to_daemon = 0;
+  uint64_t audited_inline = 0;
+  uint64_t insecure = 0;
+  uint64_t errors = 0;
+  uint64_t file_system_calls = 0;
+  uint64_t verdict_cache_hits = 0;
+  uint64_t verdict_cache_misses = 0;
+  uint64_t latency_sum_ns = 0;
+  uint64_t latency_max_ns = 0;
+  uint64_t latency[kLatencyBuckets] = {};
+
+  // The lower bound of the bucket that holds the given quantile, e.g. 0.99.
+  // 0 without audits.
+  uint64_t LatencyQuantile(double quantile) const;
+};
+
+// A page summed over its threads.
+struct StatsPageTotals {
+  int32_t pid = 0;
+  uint64_t start_time_ns = 0;
+  std::string exe;
+  // Only the hooks that were called.
+  std::vector<HookTotals> hooks;
+  uint64_t errors_by_code[kStatsStatusCodes] = {};
+
+  uint64_t latency_sum_ns() const;
+};
+
+// Sums up a page. The page can be written to concurrently, the counters are
+// then read one by one while they keep changing.
+absl::StatusOr<StatsPageTotals> SumStatsPage(absl::Span<const char> page);
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_STATS_PAGE_H_
@@ -0,0 +1,130 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/stats_page.h"
+
+#include <cstring>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "pathauditor/util/status_matchers.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::Field;
+using ::testing::Ge;
+using ::testing::Gt;
+using ::testing::Le;
+using ::testing::Not;
+
+// A zeroed page with two hooks.
+class StatsPageTest : public ::testing::Test {
+ protected:
+  StatsPageTest() : buf_(kStatsPageSize / sizeof(uint64_t) + 1) {
+    header()->magic = kStatsPageMagic;
+    header()->version = kStatsPageVersion;
+    header()->pid = 42;
+    header()->thread_slots = kStatsThreadSlots;
+    strcpy(header()->exe, "/bin/true");
+    strcpy(header()->hook_names[0], "open");
+    strcpy(header()->hook_names[1], "execve");
+    header()->hook_count.store(2);
+  }
+
+  char *page() { return reinterpret_cast<char *>(buf_.data()); }
+  StatsPageHeader *header() {
+    return reinterpret_cast<StatsPageHeader *>(page());
+  }
+  ThreadStats &slot(size_t i) { return StatsPageSlots(page())[i]; }
+  absl::Span<const char> span() {
+    return absl::Span<const char>(page(), kStatsPageSize);
+  }
+
+ private:
+  std::vector<uint64_t> buf_;
+};
+
+TEST(LatencyBucketTest, BoundsAreConsistent) {
+  for (size_t bucket = 0; bucket < kLatencyBuckets; bucket++) {
+    uint64_t lower = LatencyBucketLowerBound(bucket);
+    EXPECT_THAT(LatencyBucket(lower), Eq(bucket));
+    if (bucket > 0) {
+      EXPECT_THAT(LatencyBucket(lower - 1), Eq(bucket - 1));
+    }
+  }
+  EXPECT_THAT(LatencyBucket(~uint64_t{0}), Eq(kLatencyBuckets - 1));
+}
+
+TEST(LatencyBucketTest, IsPrecise) {
+  for (uint64_t ns : {5, 100, 1234, 98765, 123456789}) {
+    uint64_t lower = LatencyBucketLowerBound(LatencyBucket(ns));
+    EXPECT_THAT(lower, Le(ns));
+    EXPECT_THAT(lower, Ge(ns - ns / 4));
+  }
+}
+
+TEST_F(StatsPageTest, SumsThreads) {
+  slot(0).hooks[0].calls = 3;
+  slot(5).hooks[0].calls = 4;
+  slot(5).hooks[0].latency_max_ns = 700;
+  slot(9).hooks[0].latency_max_ns = 900;
+  slot(9).errors_by_code[static_cast<int>(absl::StatusCode::kNotFound)] = 2;
+  slot(kStatsThreadSlots - 1).hooks[0].latency[LatencyBucket(900)] = 1;
+
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(StatsPageTotals totals,
+                                               SumStatsPage(span()));
+  EXPECT_THAT(totals.pid, Eq(42));
+  EXPECT_THAT(totals.exe, Eq("/bin/true"));
+  // execve was never called.
+  ASSERT_THAT(totals.hooks, ElementsAre(Field(&HookTotals::name, "open")));
+  EXPECT_THAT(totals.hooks[0].calls, Eq(7));
+  EXPECT_THAT(totals.hooks[0].latency_max_ns, Eq(900));
+  EXPECT_THAT(totals.hooks[0].latency[LatencyBucket(900)], Eq(1));
+  EXPECT_THAT(
+      totals.errors_by_code[static_cast<int>(absl::StatusCode::kNotFound)],
+      Eq(2));
+}
+
+TEST_F(StatsPageTest, IgnoresHooksWithoutName) {
+  header()->hook_count.store(1);
+  slot(1).hooks[1].calls = 1;
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(StatsPageTotals totals,
+                                               SumStatsPage(span()));
+  EXPECT_TRUE(totals.hooks.empty());
+}
+
+TEST_F(StatsPageTest, RejectsBadPages) {
+  EXPECT_THAT(SumStatsPage(span().subspan(0, kStatsPageSize - 1)),
+              Not(IsOk()));
+  header()->magic = 0;
+  EXPECT_THAT(SumStatsPage(span()), Not(IsOk()));
+}
+
+TEST(HookTotalsTest, Quantiles) {
+  HookTotals hook;
+  EXPECT_THAT(hook.LatencyQuantile(0.5), Eq(0));
+  hook.latency[LatencyBucket(1000)] = 98;
+  hook.latency[LatencyBucket(50000)] = 2;
+  EXPECT_THAT(hook.LatencyQuantile(0.5), Le(1000));
+  EXPECT_THAT(hook.LatencyQuantile(0.98), Le(1000));
+  EXPECT_THAT(hook.LatencyQuantile(0.99), Gt(40000));
+  EXPECT_THAT(hook.LatencyQuantile(1), Le(50000));
+}
+
+}  // namespace
+}  // namespace pathauditor
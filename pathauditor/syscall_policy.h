@@ -0,0 +1,294 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_SYSCALL_POLICY_H_
+#define PATHAUDITOR_SYSCALL_POLICY_H_
+
+#include <fcntl.h>
+#include <sys/mount.h>
+#include <sys/syscall.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/types/span.h"
+
+namespace pathauditor {
+
+// How the paths of a syscall are audited. Argument indices refer to the
+// syscall's arguments, which is also how FileEventView::args is laid out.
+// FileEventView::path_args has the paths in the order of path_args below.
+//
+// The first path is the one the syscall works on. It is walked relative to
+// its dirfd, without the last element if the syscall doesn't follow it. The
+// optional second path is walked as well, usually only its directory since
+// that's where the syscall creates a new entry.
+struct SyscallPolicy {
+  static constexpr size_t kMaxPathArgs = 2;
+  // For paths that are relative to the cwd and for policies without flags.
+  static constexpr size_t kNoArg = ~size_t{0};
+
+  // Whether the last element of the first path is walked.
+  enum class LastElement : uint8_t {
+    kFollow,
+    kSkip,
+    // Skipped if one of the flags is set, e.g. O_NOFOLLOW.
+    kSkipIfFlags,
+    // Skipped unless one of the flags is set, e.g. AT_SYMLINK_FOLLOW.
+    kSkipUnlessFlags,
+  };
+
+  int nr = -1;
+  const char *name = "";
+
+  // Where the paths are among the arguments, for tracers that read them from
+  // the registers.
+  size_t path_arg_count = 0;
+  size_t path_args[kMaxPathArgs] = {};
+  // The dirfd argument of every path, kNoArg if it's relative to the cwd.
+  size_t path_dirfd_args[kMaxPathArgs] = {kNoArg, kNoArg};
+  // The distinct dirfd arguments.
+  size_t dirfd_arg_count = 0;
+  size_t dirfd_args[kMaxPathArgs] = {};
+  // The number of arguments an event needs for the audit.
+  size_t arg_count = 0;
+
+  // The argument the flags below are tested against.
+  size_t flags_arg = kNoArg;
+  LastElement last_element = LastElement::kFollow;
+  uint64_t last_element_flags = 0;
+  // With one of these flags and an empty first path, the syscall works on the
+  // dirfd itself and there is nothing to walk.
+  uint64_t empty_path_flags = 0;
+  // If set, the first path is only walked with one of these flags.
+  uint64_t audit_path_flags = 0;
+  // False if the syscall doesn't resolve the first path, like the target of a
+  // symlink.
+  bool audit_path = true;
+  // The file itself must not be writable either.
+  bool executable = false;
+  // The whole second path is walked, not just its directory.
+  bool follow_second_path = false;
+  // Only looks up the path, e.g. stat. The seccomp mode doesn't stop for
+  // these, they are much more frequent than the rest.
+  bool lookup = false;
+
+  // Builders for the rows of kSyscallPolicies.
+
+  // Adds the path in argument arg, relative to the dirfd in dirfd_arg.
+  constexpr SyscallPolicy Path(size_t arg, size_t dirfd_arg = kNoArg) const {
+    SyscallPolicy policy = *this;
+    policy.path_args[policy.path_arg_count] = arg;
+    policy.path_dirfd_args[policy.path_arg_count] = dirfd_arg;
+    policy.path_arg_count++;
+    if (dirfd_arg != kNoArg) {
+      bool known = false;
+      for (size_t i = 0; i < policy.dirfd_arg_count; i++) {
+        known |= policy.dirfd_args[i] == dirfd_arg;
+      }
+      if (!known) {
+        policy.dirfd_args[policy.dirfd_arg_count++] = dirfd_arg;
+      }
+      policy.arg_count = Max(policy.arg_count, dirfd_arg + 1);
+    }
+    return policy;
+  }
+  // A first path that is passed on as is.
+  constexpr SyscallPolicy Target(size_t arg) const {
+    SyscallPolicy policy = Path(arg);
+    policy.audit_path = false;
+    return policy;
+  }
+  // A second path whose directory gets a new entry.
+  constexpr SyscallPolicy NewEntry(size_t arg,
+                                   size_t dirfd_arg = kNoArg) const {
+    return Path(arg, dirfd_arg);
+  }
+  // A second path that is resolved completely.
+  constexpr SyscallPolicy AlsoPath(size_t arg) const {
+    SyscallPolicy policy = Path(arg);
+    policy.follow_second_path = true;
+    return policy;
+  }
+  constexpr SyscallPolicy SkipLast() const {
+    SyscallPolicy policy = *this;
+    policy.last_element = LastElement::kSkip;
+    return policy;
+  }
+  constexpr SyscallPolicy SkipLastIf(size_t arg, uint64_t flags) const {
+    SyscallPolicy policy = WithFlags(arg);
+    policy.last_element = LastElement::kSkipIfFlags;
+    policy.last_element_flags = flags;
+    return policy;
+  }
+  constexpr SyscallPolicy SkipLastUnless(size_t arg, uint64_t flags) const {
+    SyscallPolicy policy = WithFlags(arg);
+    policy.last_element = LastElement::kSkipUnlessFlags;
+    policy.last_element_flags = flags;
+    return policy;
+  }
+  constexpr SyscallPolicy EmptyPathIf(size_t arg, uint64_t flags) const {
+    SyscallPolicy policy = WithFlags(arg);
+    policy.empty_path_flags = flags;
+    return policy;
+  }
+  constexpr SyscallPolicy OnlyIf(size_t arg, uint64_t flags) const {
+    SyscallPolicy policy = WithFlags(arg);
+    policy.audit_path_flags = flags;
+    return policy;
+  }
+  constexpr SyscallPolicy Executable() const {
+    SyscallPolicy policy = *this;
+    policy.executable = true;
+    return policy;
+  }
+  constexpr SyscallPolicy Lookup() const {
+    SyscallPolicy policy = *this;
+    policy.lookup = true;
+    return policy;
+  }
+
+ private:
+  static constexpr size_t Max(size_t a, size_t b) { return a > b ? a : b; }
+
+  // All flags of a syscall are in the same argument.
+  constexpr SyscallPolicy WithFlags(size_t arg) const {
+    SyscallPolicy policy = *this;
+    policy.flags_arg = arg;
+    policy.arg_count = Max(policy.arg_count, arg + 1);
+    return policy;
+  }
+};
+
+constexpr SyscallPolicy Syscall(int nr, const char *name) {
+  SyscallPolicy policy;
+  policy.nr = nr;
+  policy.name = name;
+  return policy;
+}
+
+// Every syscall the auditor knows. Adding one only takes a row here.
+inline constexpr SyscallPolicy kSyscallPolicies[] = {
+    Syscall(SYS_open, "open").Path(0).SkipLastIf(1, O_NOFOLLOW | O_EXCL),
+    Syscall(SYS_openat, "openat")
+        .Path(1, 0)
+        .SkipLastIf(2, O_NOFOLLOW | O_EXCL),
+    // creat == open(O_CREAT|O_WRONLY|O_TRUNC)
+    Syscall(SYS_creat, "creat").Path(0),
+    Syscall(SYS_chmod, "chmod").Path(0),
+    // fchmodat has a no follow flag, but it's not used
+    Syscall(SYS_fchmodat, "fchmodat").Path(1, 0),
+    Syscall(SYS_chown, "chown").Path(0),
+    Syscall(SYS_lchown, "lchown").Path(0).SkipLast(),
+    Syscall(SYS_fchownat, "fchownat")
+        .Path(1, 0)
+        .SkipLastIf(4, AT_SYMLINK_NOFOLLOW)
+        .EmptyPathIf(4, AT_EMPTY_PATH),
+    Syscall(SYS_chdir, "chdir").Path(0),
+    Syscall(SYS_chroot, "chroot").Path(0),
+    Syscall(SYS_rmdir, "rmdir").Path(0),
+    Syscall(SYS_uselib, "uselib").Path(0),
+    Syscall(SYS_swapon, "swapon").Path(0),
+    Syscall(SYS_truncate, "truncate").Path(0),
+    Syscall(SYS_unlink, "unlink").Path(0).SkipLast(),
+    Syscall(SYS_unlinkat, "unlinkat").Path(1, 0).SkipLast(),
+    Syscall(SYS_mknod, "mknod").Path(0).SkipLast(),
+    Syscall(SYS_mknodat, "mknodat").Path(1, 0).SkipLast(),
+    Syscall(SYS_mkdir, "mkdir").Path(0).SkipLast(),
+    Syscall(SYS_mkdirat, "mkdirat").Path(1, 0).SkipLast(),
+    Syscall(SYS_execve, "execve").Path(0).Executable(),
+#ifdef SYS_execveat
+    Syscall(SYS_execveat, "execveat")
+        .Path(1, 0)
+        .SkipLastIf(4, AT_SYMLINK_NOFOLLOW)
+        .EmptyPathIf(4, AT_EMPTY_PATH)
+        .Executable(),
+#endif
+    Syscall(SYS_umount2, "umount2").Path(0).SkipLastIf(1, UMOUNT_NOFOLLOW),
+    Syscall(SYS_name_to_handle_at, "name_to_handle_at")
+        .Path(1, 0)
+        .SkipLastUnless(4, AT_SYMLINK_FOLLOW)
+        .EmptyPathIf(4, AT_EMPTY_PATH),
+    Syscall(SYS_rename, "rename").Path(0).SkipLast().NewEntry(1),
+    Syscall(SYS_renameat, "renameat").Path(1, 0).SkipLast().NewEntry(3, 2),
+    Syscall(SYS_renameat2, "renameat2").Path(1, 0).SkipLast().NewEntry(3, 2),
+    Syscall(SYS_link, "link").Path(0).NewEntry(1),
+    Syscall(SYS_linkat, "linkat")
+        .Path(1, 0)
+        .SkipLastUnless(4, AT_SYMLINK_FOLLOW)
+        .EmptyPathIf(4, AT_EMPTY_PATH)
+        .NewEntry(3, 2),
+    // no checks on link target
+    Syscall(SYS_symlink, "symlink").Target(0).NewEntry(1),
+    Syscall(SYS_symlinkat, "symlinkat").Target(0).NewEntry(2, 1),
+    // only check the source if MS_BIND or MS_MOVE is set
+    Syscall(SYS_mount, "mount")
+        .Path(0)
+        .OnlyIf(3, MS_BIND | MS_MOVE)
+        .AlsoPath(1),
+    Syscall(SYS_stat, "stat").Path(0).Lookup(),
+    Syscall(SYS_lstat, "lstat").Path(0).SkipLast().Lookup(),
+    Syscall(SYS_access, "access").Path(0).Lookup(),
+    Syscall(SYS_faccessat, "faccessat").Path(1, 0).Lookup(),
+#ifdef SYS_faccessat2
+    Syscall(SYS_faccessat2, "faccessat2")
+        .Path(1, 0)
+        .SkipLastIf(3, AT_SYMLINK_NOFOLLOW)
+        .EmptyPathIf(3, AT_EMPTY_PATH)
+        .Lookup(),
+#endif
+    Syscall(SYS_readlink, "readlink").Path(0).SkipLast().Lookup(),
+};
+
+namespace internal {
+
+// Large enough for every syscall number in the table.
+constexpr size_t kSyscallIndexSize = 512;
+constexpr uint8_t kNoPolicy = 0xff;
+
+constexpr std::array<uint8_t, kSyscallIndexSize> BuildSyscallIndex() {
+  std::array<uint8_t, kSyscallIndexSize> index = {};
+  for (uint8_t &entry : index) {
+    entry = kNoPolicy;
+  }
+  for (size_t i = 0; i < sizeof(kSyscallPolicies) / sizeof(SyscallPolicy);
+       i++) {
+    index[kSyscallPolicies[i].nr] = i;
+  }
+  return index;
+}
+
+inline constexpr std::array<uint8_t, kSyscallIndexSize> kSyscallIndex =
+    BuildSyscallIndex();
+
+}  // namespace internal
+
+// Returns nullptr for syscalls the auditor doesn't know. Folds to a constant
+// for constant syscall numbers, like the ones in the libc hooks.
+constexpr const SyscallPolicy *FindSyscallPolicy(int nr) {
+  if (nr < 0 || static_cast<size_t>(nr) >= internal::kSyscallIndexSize ||
+      internal::kSyscallIndex[nr] == internal::kNoPolicy) {
+    return nullptr;
+  }
+  return &kSyscallPolicies[internal::kSyscallIndex[nr]];
+}
+
+constexpr absl::Span<const SyscallPolicy> SyscallPolicies() {
+  return kSyscallPolicies;
+}
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_SYSCALL_POLICY_H_
@@ -0,0 +1,96 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/syscall_policy.h"
+
+#include <sys/syscall.h>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "pathauditor/event_ring.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::Ge;
+using ::testing::IsNull;
+using ::testing::Le;
+using ::testing::Lt;
+using ::testing::NotNull;
+
+// The lookup works at compile time.
+static_assert(FindSyscallPolicy(SYS_openat)->path_dirfd_args[0] == 0,
+              "openat is relative to its first argument");
+static_assert(FindSyscallPolicy(SYS_read) == nullptr, "read has no paths");
+
+constexpr size_t kSyscallArgs = 6;
+
+TEST(SyscallPolicyTest, EveryRowCanBeFound) {
+  for (const SyscallPolicy &policy : SyscallPolicies()) {
+    EXPECT_THAT(FindSyscallPolicy(policy.nr), Eq(&policy)) << policy.name;
+  }
+  EXPECT_THAT(FindSyscallPolicy(SYS_read), IsNull());
+  EXPECT_THAT(FindSyscallPolicy(-1), IsNull());
+  EXPECT_THAT(FindSyscallPolicy(100000), IsNull());
+}
+
+TEST(SyscallPolicyTest, ArgumentsAreInRange) {
+  for (const SyscallPolicy &policy : SyscallPolicies()) {
+    EXPECT_THAT(policy.path_arg_count, Ge(1)) << policy.name;
+    EXPECT_THAT(policy.path_arg_count, Le(SyscallPolicy::kMaxPathArgs))
+        << policy.name;
+    EXPECT_THAT(policy.arg_count, Le(kSyscallArgs)) << policy.name;
+    for (size_t i = 0; i < policy.path_arg_count; i++) {
+      EXPECT_THAT(policy.path_args[i], Lt(kSyscallArgs)) << policy.name;
+      size_t dirfd = policy.path_dirfd_args[i];
+      if (dirfd == SyscallPolicy::kNoArg) {
+        continue;
+      }
+      EXPECT_THAT(dirfd, Lt(policy.arg_count)) << policy.name;
+      for (size_t j = 0; j < policy.path_arg_count; j++) {
+        EXPECT_NE(dirfd, policy.path_args[j]) << policy.name;
+      }
+    }
+    if (policy.flags_arg != SyscallPolicy::kNoArg) {
+      EXPECT_THAT(policy.flags_arg, Lt(policy.arg_count)) << policy.name;
+    }
+  }
+}
+
+TEST(SyscallPolicyTest, DirFdsFollowTheSyscallArguments) {
+  // symlinkat(target, newdirfd, linkpath)
+  const SyscallPolicy *symlinkat = FindSyscallPolicy(SYS_symlinkat);
+  ASSERT_THAT(symlinkat, NotNull());
+  EXPECT_THAT(symlinkat->path_args[0], Eq(0));
+  EXPECT_THAT(symlinkat->path_args[1], Eq(2));
+  EXPECT_THAT(symlinkat->path_dirfd_args[0], Eq(SyscallPolicy::kNoArg));
+  EXPECT_THAT(symlinkat->path_dirfd_args[1], Eq(1));
+  EXPECT_FALSE(symlinkat->audit_path);
+
+  // name_to_handle_at(dirfd, pathname, handle, mount_id, flags)
+  const SyscallPolicy *name_to_handle_at =
+      FindSyscallPolicy(SYS_name_to_handle_at);
+  ASSERT_THAT(name_to_handle_at, NotNull());
+  EXPECT_THAT(name_to_handle_at->path_dirfd_args[0], Eq(0));
+  EXPECT_THAT(name_to_handle_at->flags_arg, Eq(4));
+
+  EXPECT_THAT(DirFdArgs(SYS_renameat2), ElementsAre(0, 2));
+  EXPECT_THAT(DirFdArgs(SYS_linkat), ElementsAre(0, 2));
+  EXPECT_THAT(DirFdArgs(SYS_faccessat), ElementsAre(0));
+}
+
+}  // namespace
+}  // namespace pathauditor
@@ -0,0 +1,216 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/trace_log.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "absl/strings/str_cat.h"
+
+namespace pathauditor {
+
+namespace {
+
+// The fixed part of a record. It's followed by the args, the cwd if
+// kHasCwd is set and the paths, each string as a StringHeader and the bytes
+// that are not shared with the previous string. Records are padded to
+// kRecordAlignment.
+struct RecordHeader {
+  // Of the whole record including the padding.
+  uint32_t size;
+  int32_t syscall_nr;
+  uint64_t timestamp_ns;
+  int32_t pid;
+  uint8_t arg_count;
+  uint8_t path_arg_count;
+  uint8_t flags;
+  uint8_t reserved;
+  uint64_t cwd_dev;
+  uint64_t cwd_ino;
+};
+static_assert(sizeof(RecordHeader) == 40, "RecordHeader has padding");
+
+struct StringHeader {
+  uint16_t shared;
+  uint16_t suffix_len;
+};
+
+constexpr uint8_t kHasCwd = 1;
+constexpr size_t kRecordAlignment = 8;
+
+size_t AlignUp(size_t size) {
+  return (size + kRecordAlignment - 1) & ~(kRecordAlignment - 1);
+}
+
+}  // namespace
+
+size_t TraceRecordEncoder::MaxEncodedSize(const FileEventView &event,
+                                          absl::string_view cwd) {
+  size_t size = sizeof(RecordHeader) +
+                std::min(event.args.size(), kMaxArgs) * sizeof(uint64_t) +
+                sizeof(StringHeader) + std::min<size_t>(cwd.size(), PATH_MAX);
+  for (size_t i = 0; i < std::min(event.path_args.size(), kMaxPathArgs); i++) {
+    size += sizeof(StringHeader) +
+            std::min<size_t>(event.path_args[i].size(), PATH_MAX);
+  }
+  return AlignUp(size);
+}
+
+char *TraceRecordEncoder::EncodeString(absl::string_view str,
+                                       PreviousString *previous, char *out) {
+  str = str.substr(0, PATH_MAX);
+  size_t shared = 0;
+  size_t max_shared = std::min(str.size(), previous->len);
+  while (shared < max_shared && str[shared] == previous->data[shared]) {
+    shared++;
+  }
+  StringHeader header = {static_cast<uint16_t>(shared),
+                         static_cast<uint16_t>(str.size() - shared)};
+  memcpy(out, &header, sizeof(header));
+  out += sizeof(header);
+  memcpy(out, str.data() + shared, header.suffix_len);
+  out += header.suffix_len;
+
+  memcpy(previous->data + shared, str.data() + shared, header.suffix_len);
+  previous->len = str.size();
+  return out;
+}
+
+size_t TraceRecordEncoder::Encode(const FileEventView &event,
+                                  const TraceContext &context, char *out) {
+  RecordHeader header = {};
+  header.syscall_nr = event.syscall_nr;
+  header.timestamp_ns = context.timestamp_ns;
+  header.pid = context.pid;
+  header.arg_count = std::min(event.args.size(), kMaxArgs);
+  header.path_arg_count = std::min(event.path_args.size(), kMaxPathArgs);
+  if (!context.cwd.empty()) {
+    header.flags |= kHasCwd;
+    header.cwd_dev = context.cwd_dev;
+    header.cwd_ino = context.cwd_ino;
+  }
+
+  char *pos = out + sizeof(header);
+  memcpy(pos, event.args.data(), header.arg_count * sizeof(uint64_t));
+  pos += header.arg_count * sizeof(uint64_t);
+  if (header.flags & kHasCwd) {
+    pos = EncodeString(context.cwd, &previous_cwd_, pos);
+  }
+  for (size_t i = 0; i < header.path_arg_count; i++) {
+    pos = EncodeString(event.path_args[i], &previous_path_, pos);
+  }
+  size_t size = AlignUp(pos - out);
+  memset(pos, 0, out + size - pos);
+
+  header.size = 0;
+  memcpy(out, &header, sizeof(header));
+  // out is aligned since all records are.
+  __atomic_store_n(reinterpret_cast<uint32_t *>(out),
+                   static_cast<uint32_t>(size), __ATOMIC_RELEASE);
+  return size;
+}
+
+absl::StatusOr<size_t> TraceRecordDecoder::DecodeHeader(
+    absl::Span<const char> data, TraceLogHeader *header) {
+  if (data.size() < sizeof(*header)) {
+    return absl::InvalidArgumentError("Log is too short for the header");
+  }
+  memcpy(header, data.data(), sizeof(*header));
+  if (header->magic != kTraceLogMagic) {
+    return absl::InvalidArgumentError("Not a capture log");
+  }
+  if (header->version != kTraceLogVersion) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Unsupported capture log version ", header->version));
+  }
+  return sizeof(*header);
+}
+
+absl::Status TraceRecordDecoder::DecodeString(absl::Span<const char> record,
+                                              size_t *pos,
+                                              std::string *previous) {
+  StringHeader header;
+  if (record.size() - *pos < sizeof(header)) {
+    return absl::InvalidArgumentError("Truncated string in a record");
+  }
+  memcpy(&header, record.data() + *pos, sizeof(header));
+  *pos += sizeof(header);
+  if (header.shared > previous->size() ||
+      record.size() - *pos < header.suffix_len) {
+    return absl::InvalidArgumentError("Malformed string in a record");
+  }
+  previous->resize(header.shared);
+  previous->append(record.data() + *pos, header.suffix_len);
+  *pos += header.suffix_len;
+  return absl::OkStatus();
+}
+
+absl::StatusOr<size_t> TraceRecordDecoder::Decode(absl::Span<const char> data,
+                                                  TraceRecord *out) {
+  RecordHeader header;
+  if (data.size() < sizeof(header.size)) {
+    return 0;
+  }
+  memcpy(&header.size, data.data(), sizeof(header.size));
+  if (header.size == 0) {
+    return 0;
+  }
+  if (header.size < sizeof(header) || header.size > data.size() ||
+      header.size % kRecordAlignment != 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid record size ", header.size));
+  }
+  memcpy(&header, data.data(), sizeof(header));
+  if (header.arg_count > TraceRecordEncoder::kMaxArgs ||
+      header.path_arg_count > TraceRecordEncoder::kMaxPathArgs) {
+    return absl::InvalidArgumentError("Malformed record header");
+  }
+  absl::Span<const char> record = data.subspan(0, header.size);
+  size_t pos = sizeof(header);
+  if (record.size() - pos < header.arg_count * sizeof(uint64_t)) {
+    return absl::InvalidArgumentError("Truncated args in a record");
+  }
+
+  out->event.syscall_nr = header.syscall_nr;
+  out->event.args.resize(header.arg_count);
+  memcpy(out->event.args.data(), record.data() + pos,
+         header.arg_count * sizeof(uint64_t));
+  pos += header.arg_count * sizeof(uint64_t);
+  out->pid = header.pid;
+  out->timestamp_ns = header.timestamp_ns;
+  out->has_cwd = header.flags & kHasCwd;
+  out->cwd_dev = header.cwd_dev;
+  out->cwd_ino = header.cwd_ino;
+  if (out->has_cwd) {
+    absl::Status status = DecodeString(record, &pos, &previous_cwd_);
+    if (!status.ok()) {
+      return status;
+    }
+    out->cwd = previous_cwd_;
+  } else {
+    out->cwd.clear();
+  }
+  out->event.path_args.resize(header.path_arg_count);
+  for (size_t i = 0; i < header.path_arg_count; i++) {
+    absl::Status status = DecodeString(record, &pos, &previous_path_);
+    if (!status.ok()) {
+      return status;
+    }
+    out->event.path_args[i] = previous_path_;
+  }
+  return header.size;
+}
+
+}  // namespace pathauditor
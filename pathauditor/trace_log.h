@@ -0,0 +1,143 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The binary format of the capture logs that libpath_auditor.so writes in
+// capture mode and that pathauditor-replay audits later.
+//
+// A log starts with a TraceLogHeader, followed by length prefixed records. A
+// record holds a FileEvent and the context needed to audit it again. Paths are
+// stored as the length of the prefix they share with the previous path in the
+// log plus the remaining bytes, so a record can only be decoded after all
+// records before it. A record size of 0 marks the end of the log, the writer
+// grows the file ahead of time and the unused tail is zero filled.
+// Everything is in host byte order, logs are meant to be replayed on the
+// machine they were captured on.
+
+#ifndef PATHAUDITOR_TRACE_LOG_H_
+#define PATHAUDITOR_TRACE_LOG_H_
+
+#include <limits.h>
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "pathauditor/file_event.h"
+
+namespace pathauditor {
+
+constexpr uint32_t kTraceLogMagic = 0x5041544c;  // "PATL"
+constexpr uint32_t kTraceLogVersion = 1;
+
+struct TraceLogHeader {
+  uint32_t magic;
+  uint32_t version;
+  int32_t pid;
+  uint32_t reserved;
+  // CLOCK_REALTIME when the log was created.
+  uint64_t start_time_ns;
+};
+
+// What is recorded about a call besides its FileEvent.
+struct TraceContext {
+  pid_t pid;
+  uint64_t timestamp_ns;
+  // The cwd is only recorded if one of the paths is relative. Its inode tells
+  // the replay if the directory got replaced since.
+  absl::string_view cwd;
+  uint64_t cwd_dev;
+  uint64_t cwd_ino;
+};
+
+// A decoded record. The strings are reused between records.
+struct TraceRecord {
+  FileEvent event{0, {}, {}};
+  pid_t pid = 0;
+  uint64_t timestamp_ns = 0;
+  bool has_cwd = false;
+  std::string cwd;
+  uint64_t cwd_dev = 0;
+  uint64_t cwd_ino = 0;
+};
+
+// Writes records, compressing every path against the previous one. Not thread
+// safe, the caller serializes the appends to a log. Keeps no heap state so
+// that it can live in a constant initialized global.
+class TraceRecordEncoder {
+ public:
+  static constexpr size_t kMaxArgs = 6;
+  static constexpr size_t kMaxPathArgs = 2;
+
+  constexpr TraceRecordEncoder() = default;
+
+  // An upper bound for the size of the encoded record.
+  static size_t MaxEncodedSize(const FileEventView &event,
+                               absl::string_view cwd);
+
+  // Writes the record to out, which needs to have room for MaxEncodedSize
+  // bytes, and returns its size. Args and paths beyond the maximum counts are
+  // dropped and paths are truncated to PATH_MAX. out needs to be 8 byte
+  // aligned. The size field is written last, so that a log cut short by a
+  // crash ends before the partial record.
+  size_t Encode(const FileEventView &event, const TraceContext &context,
+                char *out);
+
+  // Forgets the previous strings, e.g. when starting a new log.
+  void Reset() {
+    previous_path_.len = 0;
+    previous_cwd_.len = 0;
+  }
+
+ private:
+  struct PreviousString {
+    char data[PATH_MAX] = {};
+    size_t len = 0;
+  };
+
+  static char *EncodeString(absl::string_view str, PreviousString *previous,
+                            char *out);
+
+  // The cwd is compressed on its own since it rarely changes.
+  PreviousString previous_path_;
+  PreviousString previous_cwd_;
+};
+
+// Reads the records of a log in order.
+class TraceRecordDecoder {
+ public:
+  // Checks the header at the start of the log and returns its size.
+  static absl::StatusOr<size_t> DecodeHeader(absl::Span<const char> data,
+                                             TraceLogHeader *header);
+
+  // Decodes the record at the start of data into out and returns its size.
+  // Returns 0 at the end of the log. Fails if the record is malformed, after
+  // which the decoder is out of sync with the log.
+  absl::StatusOr<size_t> Decode(absl::Span<const char> data, TraceRecord *out);
+
+ private:
+  static absl::Status DecodeString(absl::Span<const char> record, size_t *pos,
+                                   std::string *previous);
+
+  std::string previous_path_;
+  std::string previous_cwd_;
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_TRACE_LOG_H_
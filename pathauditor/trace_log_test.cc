@@ -0,0 +1,157 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/trace_log.h"
+
+#include <fcntl.h>
+#include <sys/syscall.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "pathauditor/util/status_matchers.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::Le;
+using ::testing::Lt;
+
+// Encodes the events into a zero filled buffer, like the writer does.
+class TraceLogTest : public ::testing::Test {
+ protected:
+  void Append(const FileEventView &event, const TraceContext &context) {
+    size_t max_size = TraceRecordEncoder::MaxEncodedSize(event, context.cwd);
+    buf_.resize(used_ + max_size + sizeof(uint32_t));
+    size_t size = encoder_.Encode(event, context, buf_.data() + used_);
+    EXPECT_THAT(size, Le(max_size));
+    used_ += size;
+  }
+
+  absl::Span<const char> Log() const {
+    return absl::Span<const char>(buf_.data(), buf_.size());
+  }
+
+  TraceRecordEncoder encoder_;
+  std::vector<char> buf_;
+  size_t used_ = 0;
+};
+
+TEST_F(TraceLogTest, RoundTrip) {
+  uint64_t open_args[] = {0, O_RDONLY, 0};
+  absl::string_view open_path[] = {"/etc/passwd"};
+  Append(FileEventView(SYS_open, open_args, open_path),
+         {42, 1000, "", 0, 0});
+  uint64_t rename_args[] = {static_cast<uint64_t>(AT_FDCWD), 0,
+                            static_cast<uint64_t>(AT_FDCWD), 0};
+  absl::string_view rename_paths[] = {"/etc/passwd.new", "relative"};
+  Append(FileEventView(SYS_renameat, rename_args, rename_paths),
+         {42, 2000, "/home/user", 1, 2});
+
+  TraceRecordDecoder decoder;
+  TraceRecord record;
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(size_t size,
+                                               decoder.Decode(Log(), &record));
+  EXPECT_THAT(record.event.syscall_nr, Eq(SYS_open));
+  EXPECT_THAT(record.event.args, ElementsAre(0, O_RDONLY, 0));
+  EXPECT_THAT(record.event.path_args, ElementsAre("/etc/passwd"));
+  EXPECT_THAT(record.pid, Eq(42));
+  EXPECT_THAT(record.timestamp_ns, Eq(1000));
+  EXPECT_FALSE(record.has_cwd);
+
+  absl::Span<const char> rest = Log().subspan(size);
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(size,
+                                               decoder.Decode(rest, &record));
+  EXPECT_THAT(record.event.syscall_nr, Eq(SYS_renameat));
+  EXPECT_THAT(record.event.path_args,
+              ElementsAre("/etc/passwd.new", "relative"));
+  EXPECT_TRUE(record.has_cwd);
+  EXPECT_THAT(record.cwd, Eq("/home/user"));
+  EXPECT_THAT(record.cwd_dev, Eq(1));
+  EXPECT_THAT(record.cwd_ino, Eq(2));
+
+  // The zero filled tail ends the log.
+  rest = rest.subspan(size);
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(size,
+                                               decoder.Decode(rest, &record));
+  EXPECT_THAT(size, Eq(0));
+}
+
+TEST_F(TraceLogTest, SharedPrefixesAreNotRepeated) {
+  std::string dir = "/" + std::string(200, 'd');
+  std::string first_path = dir + "/first";
+  std::string second_path = dir + "/second";
+  absl::string_view first[] = {first_path};
+  Append(FileEventView(SYS_open, {}, first), {1, 0, "", 0, 0});
+  size_t first_size = used_;
+  absl::string_view second[] = {second_path};
+  Append(FileEventView(SYS_open, {}, second), {1, 0, "", 0, 0});
+  EXPECT_THAT(used_ - first_size, Lt(dir.size()));
+}
+
+TEST_F(TraceLogTest, RejectsMalformedRecords) {
+  absl::string_view path[] = {"/etc/passwd"};
+  Append(FileEventView(SYS_open, {}, path), {1, 0, "", 0, 0});
+
+  TraceRecord record;
+  std::vector<char> bad(buf_);
+  uint32_t size = 12;
+  memcpy(bad.data(), &size, sizeof(size));
+  EXPECT_THAT(TraceRecordDecoder()
+                  .Decode(absl::Span<const char>(bad.data(), bad.size()),
+                          &record)
+                  .status()
+                  .code(),
+              Eq(absl::StatusCode::kInvalidArgument));
+
+  // The record has no args, so the path follows the 40 bytes of the fixed
+  // part. Claim a shared prefix although there is no previous path.
+  bad = buf_;
+  uint16_t shared = 5;
+  memcpy(bad.data() + 40, &shared, sizeof(shared));
+  EXPECT_THAT(TraceRecordDecoder()
+                  .Decode(absl::Span<const char>(bad.data(), bad.size()),
+                          &record)
+                  .status()
+                  .code(),
+              Eq(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(TraceLogHeaderTest, ChecksMagicAndVersion) {
+  TraceLogHeader header = {kTraceLogMagic, kTraceLogVersion, 1, 0, 0};
+  TraceLogHeader out;
+  PATHAUDITOR_PATHAUDITOR_ASSERT_OK_AND_ASSIGN(
+      size_t size,
+      TraceRecordDecoder::DecodeHeader(
+          absl::Span<const char>(reinterpret_cast<const char *>(&header),
+                                 sizeof(header)),
+          &out));
+  EXPECT_THAT(size, Eq(sizeof(header)));
+
+  header.version++;
+  EXPECT_FALSE(TraceRecordDecoder::DecodeHeader(
+                   absl::Span<const char>(
+                       reinterpret_cast<const char *>(&header), sizeof(header)),
+                   &out)
+                   .ok());
+}
+
+}  // namespace
+}  // namespace pathauditor
@@ -0,0 +1,93 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/util/arena.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace pathauditor {
+
+Arena::~Arena() {
+  Block *block = inline_block_.next;
+  while (block != nullptr) {
+    Block *next = block->next;
+    munmap(block, sizeof(Block) + block->size);
+    block = next;
+  }
+}
+
+Arena::Block *Arena::MapBlock(size_t size) {
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  if (size > SIZE_MAX - sizeof(Block) - page_size) {
+    return nullptr;
+  }
+  size_t mapping_size =
+      (sizeof(Block) + size + page_size - 1) / page_size * page_size;
+  void *mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapping == MAP_FAILED) {
+    return nullptr;
+  }
+  Block *block = static_cast<Block *>(mapping);
+  block->next = nullptr;
+  block->data = reinterpret_cast<char *>(block + 1);
+  block->size = mapping_size - sizeof(Block);
+  return block;
+}
+
+void *Arena::Allocate(size_t size, size_t align) {
+  while (true) {
+    uintptr_t data = reinterpret_cast<uintptr_t>(current_->data);
+    size_t offset = ((data + used_ + align - 1) & ~(align - 1)) - data;
+    if (offset <= current_->size && size <= current_->size - offset) {
+      used_ = offset + size;
+      return current_->data + offset;
+    }
+
+    // Move on to the next block, after mapping one in front of it if it's too
+    // small.
+    Block *next = current_->next;
+    if (next == nullptr || next->size < size + align) {
+      if (size > SIZE_MAX - align) {
+        return nullptr;
+      }
+      Block *block = MapBlock(std::max(kBlockSize, size + align));
+      if (block == nullptr) {
+        return nullptr;
+      }
+      mapped_blocks_++;
+      block->next = next;
+      current_->next = block;
+      next = block;
+    }
+    current_ = next;
+    used_ = 0;
+  }
+}
+
+const char *Arena::CopyString(absl::string_view s) {
+  char *copy = static_cast<char *>(Allocate(s.size() + 1, 1));
+  if (copy == nullptr) {
+    return nullptr;
+  }
+  memcpy(copy, s.data(), s.size());
+  copy[s.size()] = '\0';
+  return copy;
+}
+
+}  // namespace pathauditor
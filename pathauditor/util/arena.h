@@ -0,0 +1,119 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_UTIL_ARENA_H_
+#define PATHAUDITOR_UTIL_ARENA_H_
+
+#include <limits.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+
+namespace pathauditor {
+
+// A bump allocator for scratch memory that is given back all at once.
+//
+// The first kInlineSize bytes come from the arena object itself. If they run
+// out, blocks are mapped from the kernel and kept for reuse until the arena is
+// destroyed. None of it goes through malloc, so the arena can be used from
+// inside the libc hooks, where malloc might be what is being hooked.
+// Not thread-safe.
+class Arena {
+ private:
+  struct Block {
+    Block *next;
+    char *data;
+    size_t size;
+  };
+
+ public:
+  static constexpr size_t kInlineSize = 2 * PATH_MAX;
+  // The minimum size of the mapped blocks.
+  static constexpr size_t kBlockSize = 64 * 1024;
+
+  // A position in the arena. Rewinding to it frees everything that was
+  // allocated after it was taken.
+  class Mark {
+   private:
+    friend class Arena;
+    Mark(Block *block, size_t used) : block_(block), used_(used) {}
+
+    Block *block_;
+    size_t used_;
+  };
+
+  Arena() = default;
+  ~Arena();
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  // Returns size bytes aligned to align, which has to be a power of two.
+  // Returns nullptr if no more memory could be mapped.
+  void *Allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+  // Returns count default initialized elements. Their destructors will never
+  // run, so only trivially destructible types can be allocated. The span is
+  // empty if count is not 0 and the arena ran out of memory.
+  template <typename T>
+  absl::Span<T> AllocateArray(size_t count) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "arena memory is freed without running destructors");
+    if (count > SIZE_MAX / sizeof(T)) {
+      return absl::Span<T>();
+    }
+    void *memory = Allocate(count * sizeof(T), alignof(T));
+    if (memory == nullptr) {
+      return absl::Span<T>();
+    }
+    T *array = static_cast<T *>(memory);
+    for (size_t i = 0; i < count; i++) {
+      new (&array[i]) T;
+    }
+    return absl::Span<T>(array, count);
+  }
+
+  // Returns a NUL terminated copy of s, nullptr if out of memory.
+  const char *CopyString(absl::string_view s);
+
+  Mark GetMark() const { return Mark(current_, used_); }
+  void Rewind(const Mark &mark) {
+    current_ = mark.block_;
+    used_ = mark.used_;
+  }
+  // Frees everything. The mapped blocks stay around for the next allocations.
+  void Reset() { Rewind(Mark(&inline_block_, 0)); }
+
+  // The number of blocks mapped so far.
+  size_t mapped_blocks() const { return mapped_blocks_; }
+
+ private:
+  static Block *MapBlock(size_t size);
+
+  alignas(std::max_align_t) char inline_[kInlineSize];
+  Block inline_block_{nullptr, inline_, kInlineSize};
+  Block *current_ = &inline_block_;
+  // Bytes of current_ handed out.
+  size_t used_ = 0;
+  size_t mapped_blocks_ = 0;
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_UTIL_ARENA_H_
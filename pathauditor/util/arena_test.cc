@@ -0,0 +1,86 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/util/arena.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Ne;
+using ::testing::NotNull;
+using ::testing::SizeIs;
+
+TEST(ArenaTest, AlignsAllocations) {
+  Arena arena;
+  ASSERT_THAT(arena.Allocate(1, 1), NotNull());
+  for (size_t align : {2, 8, 64, 4096}) {
+    void *memory = arena.Allocate(3, align);
+    ASSERT_THAT(memory, NotNull());
+    EXPECT_THAT(reinterpret_cast<uintptr_t>(memory) % align, Eq(0));
+  }
+}
+
+TEST(ArenaTest, CopiesStringsWithTerminator) {
+  Arena arena;
+  absl::string_view path = "/usr/lib/libc.so";
+  const char *copy = arena.CopyString(path.substr(0, 8));
+  ASSERT_THAT(copy, NotNull());
+  EXPECT_THAT(strcmp(copy, "/usr/lib"), Eq(0));
+  EXPECT_THAT(copy, Ne(path.data()));
+}
+
+TEST(ArenaTest, MapsBlocksWhenInlineMemoryRunsOut) {
+  Arena arena;
+  ASSERT_THAT(arena.Allocate(Arena::kInlineSize), NotNull());
+  EXPECT_THAT(arena.mapped_blocks(), Eq(0));
+
+  // Larger than a block.
+  absl::Span<uint64_t> big = arena.AllocateArray<uint64_t>(Arena::kBlockSize);
+  ASSERT_THAT(big, SizeIs(Arena::kBlockSize));
+  big.back() = 1;
+  EXPECT_THAT(arena.mapped_blocks(), Eq(1));
+
+  ASSERT_THAT(arena.Allocate(Arena::kBlockSize), NotNull());
+  EXPECT_THAT(arena.mapped_blocks(), Eq(2));
+}
+
+TEST(ArenaTest, RewindReusesMemory) {
+  Arena arena;
+  void *first = arena.Allocate(16);
+  Arena::Mark mark = arena.GetMark();
+  void *second = arena.Allocate(16);
+  arena.Rewind(mark);
+  EXPECT_THAT(arena.Allocate(16), Eq(second));
+
+  // Mapped blocks are kept around.
+  arena.Allocate(Arena::kInlineSize);
+  arena.Allocate(Arena::kInlineSize);
+  size_t mapped_blocks = arena.mapped_blocks();
+  EXPECT_THAT(mapped_blocks, Ne(0));
+  arena.Reset();
+  EXPECT_THAT(arena.Allocate(16), Eq(first));
+  arena.Allocate(Arena::kInlineSize);
+  arena.Allocate(Arena::kInlineSize);
+  EXPECT_THAT(arena.mapped_blocks(), Eq(mapped_blocks));
+}
+
+}  // namespace
+}  // namespace pathauditor
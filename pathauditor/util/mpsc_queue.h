@@ -0,0 +1,120 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_UTIL_MPSC_QUEUE_H_
+#define PATHAUDITOR_UTIL_MPSC_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace pathauditor {
+
+// A bounded, lock-free queue for multiple producers and a single consumer.
+// Elements are filled in and consumed in place, so T can be large.
+//
+// Every slot has a turn counter that tells if it's ready to be written or read
+// in the current lap around the ring. An all-zero queue is a valid empty
+// queue, so it can live in static storage or in a zero-filled shared memory
+// mapping without running a constructor.
+//
+// Producers never block. TryPush fails if the queue is full. The consumer side
+// must not be called concurrently.
+template <typename T, size_t kCapacity>
+class BoundedMpscQueue {
+  static_assert(kCapacity > 0 && (kCapacity & (kCapacity - 1)) == 0,
+                "kCapacity needs to be a power of two");
+
+ public:
+  constexpr BoundedMpscQueue() = default;
+
+  BoundedMpscQueue(const BoundedMpscQueue &) = delete;
+  BoundedMpscQueue &operator=(const BoundedMpscQueue &) = delete;
+
+  // Calls fill(T &) on a free slot and publishes it. Returns false without
+  // calling fill if the queue is full.
+  template <typename F>
+  bool TryPush(F &&fill) {
+    uint64_t pos = head_.load(std::memory_order_relaxed);
+    while (true) {
+      Slot &slot = slots_[pos & (kCapacity - 1)];
+      if (slot.turn.load(std::memory_order_acquire) == WriteTurn(pos)) {
+        if (head_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          fill(slot.value);
+          slot.turn.store(WriteTurn(pos) + 1, std::memory_order_release);
+          return true;
+        }
+      } else {
+        uint64_t prev_pos = pos;
+        pos = head_.load(std::memory_order_acquire);
+        if (pos == prev_pos) {
+          return false;
+        }
+      }
+    }
+  }
+
+  // Calls consume(const T &) on the oldest element and removes it. Returns
+  // false if there is no published element.
+  template <typename F>
+  bool TryPop(F &&consume) {
+    uint64_t pos = tail_.load(std::memory_order_relaxed);
+    Slot &slot = slots_[pos & (kCapacity - 1)];
+    if (slot.turn.load(std::memory_order_acquire) != WriteTurn(pos) + 1) {
+      return false;
+    }
+    consume(static_cast<const T &>(slot.value));
+    slot.turn.store(WriteTurn(pos) + 2, std::memory_order_release);
+    tail_.store(pos + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // The number of elements that have been pushed but not popped yet. Only
+  // approximate while producers are active.
+  size_t Size() const {
+    return head_.load(std::memory_order_relaxed) -
+           tail_.load(std::memory_order_relaxed);
+  }
+
+  static constexpr size_t Capacity() { return kCapacity; }
+
+  // Drops all elements, including ones that are currently being pushed. Only
+  // safe if no other thread is using the queue, e.g. in the child after fork.
+  void Reset() {
+    for (Slot &slot : slots_) {
+      slot.turn.store(0, std::memory_order_relaxed);
+    }
+    head_.store(0, std::memory_order_relaxed);
+    tail_.store(0, std::memory_order_relaxed);
+  }
+
+ private:
+  struct Slot {
+    std::atomic<uint64_t> turn{0};
+    T value{};
+  };
+
+  static constexpr uint64_t WriteTurn(uint64_t pos) {
+    return (pos / kCapacity) * 2;
+  }
+
+  alignas(64) std::atomic<uint64_t> head_{0};
+  alignas(64) std::atomic<uint64_t> tail_{0};
+  Slot slots_[kCapacity];
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_UTIL_MPSC_QUEUE_H_
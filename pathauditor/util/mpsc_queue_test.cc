@@ -0,0 +1,82 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/util/mpsc_queue.h"
+
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::Eq;
+
+TEST(BoundedMpscQueueTest, PopsInOrder) {
+  BoundedMpscQueue<int, 4> queue;
+  for (int i = 0; i < 3; i++) {
+    EXPECT_TRUE(queue.TryPush([i](int &value) { value = i; }));
+  }
+  EXPECT_THAT(queue.Size(), Eq(3));
+  for (int i = 0; i < 3; i++) {
+    int popped = -1;
+    EXPECT_TRUE(queue.TryPop([&popped](const int &value) { popped = value; }));
+    EXPECT_THAT(popped, Eq(i));
+  }
+  EXPECT_FALSE(queue.TryPop([](const int &) {}));
+}
+
+TEST(BoundedMpscQueueTest, FailsWhenFull) {
+  BoundedMpscQueue<int, 2> queue;
+  EXPECT_TRUE(queue.TryPush([](int &value) { value = 1; }));
+  EXPECT_TRUE(queue.TryPush([](int &value) { value = 2; }));
+  EXPECT_FALSE(queue.TryPush([](int &value) { value = 3; }));
+  EXPECT_TRUE(queue.TryPop([](const int &) {}));
+  EXPECT_TRUE(queue.TryPush([](int &value) { value = 3; }));
+}
+
+TEST(BoundedMpscQueueTest, ConcurrentProducers) {
+  constexpr int kThreads = 4;
+  constexpr int kPerThread = 10000;
+  static BoundedMpscQueue<int, 64> queue;
+
+  std::vector<std::thread> producers;
+  for (int t = 0; t < kThreads; t++) {
+    producers.emplace_back([]() {
+      for (int i = 0; i < kPerThread; i++) {
+        while (!queue.TryPush([i](int &value) { value = i; })) {
+        }
+      }
+    });
+  }
+
+  int64_t sum = 0;
+  int popped = 0;
+  while (popped < kThreads * kPerThread) {
+    if (queue.TryPop([&sum](const int &value) { sum += value; })) {
+      popped++;
+    }
+  }
+  for (std::thread &producer : producers) {
+    producer.join();
+  }
+
+  EXPECT_THAT(sum, Eq(int64_t{kThreads} * kPerThread * (kPerThread - 1) / 2));
+  EXPECT_THAT(queue.Size(), Eq(0));
+}
+
+}  // namespace
+}  // namespace pathauditor
@@ -0,0 +1,225 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/util/path_scanner.h"
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define PATHAUDITOR_HAVE_X86_SIMD 1
+#endif
+
+namespace pathauditor {
+
+namespace {
+
+uint64_t Mix(uint64_t x) {
+  x *= 0xff51afd7ed558ccdULL;
+  return x ^ (x >> 32);
+}
+
+// Records the components in the order the scan finds them.
+class Recorder {
+ public:
+  Recorder(absl::string_view path, absl::Span<PathComponent> out)
+      : path_(path), out_(out) {}
+
+  void Add(size_t begin, size_t end) {
+    size_t size = end - begin;
+    const char *name = path_.data() + begin;
+    PathComponent::Kind kind = PathComponent::Kind::kName;
+    if (size == 1 && name[0] == '.') {
+      kind = PathComponent::Kind::kDot;
+      scan_.dot_count++;
+    } else if (size == 2 && name[0] == '.' && name[1] == '.') {
+      kind = PathComponent::Kind::kDotDot;
+      scan_.dot_dot_count++;
+    }
+    if (scan_.component_count < out_.size()) {
+      out_[scan_.component_count] = {
+          static_cast<uint32_t>(begin), static_cast<uint32_t>(size),
+          ComponentHash(absl::string_view(name, size)), kind};
+    }
+    scan_.component_count++;
+  }
+
+  const PathScan &scan() const { return scan_; }
+
+ private:
+  absl::string_view path_;
+  absl::Span<PathComponent> out_;
+  PathScan scan_;
+};
+
+// The scan loop shared by all implementations. SlashMask returns a bit mask of
+// the '/' bytes in the kWidth bytes it's given. The last chunk is padded with
+// '/', so that it can be loaded like the others.
+template <size_t kWidth, typename SlashMask>
+inline __attribute__((always_inline)) PathScan Scan(
+    absl::string_view path, absl::Span<PathComponent> out,
+    SlashMask slash_mask) {
+  static_assert(kWidth < 64, "the masks are kept in 64 bits");
+  constexpr uint64_t kWidthMask = (uint64_t{1} << kWidth) - 1;
+  Recorder recorder(path, out);
+  // Whether the byte before the chunk is a separator. The path starts like
+  // after one.
+  uint64_t after_slash = 1;
+  size_t begin = 0;
+  for (size_t base = 0; base < path.size(); base += kWidth) {
+    uint64_t slashes;
+    size_t left = path.size() - base;
+    if (left >= kWidth) {
+      slashes = slash_mask(path.data() + base);
+    } else {
+      char tail[kWidth];
+      memset(tail, '/', kWidth);
+      memcpy(tail, path.data() + base, left);
+      slashes = slash_mask(tail);
+    }
+    // Bit i is set if byte i - 1 is a separator.
+    uint64_t follows_slash = ((slashes << 1) | after_slash) & kWidthMask;
+    uint64_t begins = ~slashes & follows_slash & kWidthMask;
+    uint64_t ends = slashes & ~follows_slash & kWidthMask;
+    after_slash = (slashes >> (kWidth - 1)) & 1;
+    // Begins and ends alternate, so they can be handled in order.
+    for (uint64_t events = begins | ends; events != 0; events &= events - 1) {
+      size_t i = __builtin_ctzll(events);
+      if (begins & (uint64_t{1} << i)) {
+        begin = base + i;
+      } else {
+        recorder.Add(begin, base + i);
+      }
+    }
+  }
+  // Only possible if the last chunk wasn't padded.
+  if (!after_slash) {
+    recorder.Add(begin, path.size());
+  }
+  return recorder.scan();
+}
+
+struct ScalarSlashMask {
+  uint64_t operator()(const char *chunk) const {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < 16; i++) {
+      mask |= uint64_t{chunk[i] == '/'} << i;
+    }
+    return mask;
+  }
+};
+
+#ifdef PATHAUDITOR_HAVE_X86_SIMD
+
+struct Sse2SlashMask {
+  uint64_t operator()(const char *chunk) const {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(chunk));
+    return static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('/'))));
+  }
+};
+
+struct Avx2SlashMask {
+  __attribute__((target("avx2"))) uint64_t operator()(
+      const char *chunk) const {
+    __m256i bytes =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(chunk));
+    return static_cast<uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('/'))));
+  }
+};
+
+__attribute__((target("avx2"))) PathScan ScanAvx2(
+    absl::string_view path, absl::Span<PathComponent> out) {
+  return Scan<32>(path, out, Avx2SlashMask());
+}
+
+bool HaveAvx2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+#endif  // PATHAUDITOR_HAVE_X86_SIMD
+
+uint64_t Load64(const char *p) {
+  uint64_t word;
+  memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+uint32_t Load32(const char *p) {
+  uint32_t word;
+  memcpy(&word, p, sizeof(word));
+  return word;
+}
+
+}  // namespace
+
+uint64_t ComponentHash(absl::string_view name) {
+  // Short names, i.e. most of them, take one or two overlapping loads instead
+  // of a loop.
+  const char *p = name.data();
+  size_t size = name.size();
+  uint64_t hash = Mix(0x9e3779b97f4a7c15ULL ^ size);
+  if (size > 8) {
+    for (; size > 8; p += 8, size -= 8) {
+      hash = Mix(hash ^ Load64(p));
+    }
+    return Mix(hash ^ Load64(p + size - 8));
+  }
+  uint64_t word;
+  if (size >= 4) {
+    word = (uint64_t{Load32(p)} << 32) | Load32(p + size - 4);
+  } else if (size > 0) {
+    word = (uint64_t{static_cast<uint8_t>(p[0])} << 16) |
+           (uint64_t{static_cast<uint8_t>(p[size / 2])} << 8) |
+           static_cast<uint8_t>(p[size - 1]);
+  } else {
+    word = 0;
+  }
+  return Mix(hash ^ word);
+}
+
+namespace internal {
+
+PathScan ScanPathScalar(absl::string_view path,
+                        absl::Span<PathComponent> out) {
+  return Scan<16>(path, out, ScalarSlashMask());
+}
+
+PathScan ScanPathSse2(absl::string_view path, absl::Span<PathComponent> out) {
+#ifdef PATHAUDITOR_HAVE_X86_SIMD
+  return Scan<16>(path, out, Sse2SlashMask());
+#else
+  return ScanPathScalar(path, out);
+#endif
+}
+
+PathScan ScanPathAvx2(absl::string_view path, absl::Span<PathComponent> out) {
+#ifdef PATHAUDITOR_HAVE_X86_SIMD
+  static const bool have_avx2 = HaveAvx2();
+  if (have_avx2) {
+    return ScanAvx2(path, out);
+  }
+#endif
+  return ScanPathSse2(path, out);
+}
+
+}  // namespace internal
+
+PathScan ScanPath(absl::string_view path, absl::Span<PathComponent> out) {
+  return internal::ScanPathAvx2(path, out);
+}
+
+}  // namespace pathauditor
@@ -0,0 +1,82 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_UTIL_PATH_SCANNER_H_
+#define PATHAUDITOR_UTIL_PATH_SCANNER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+
+namespace pathauditor {
+
+// A component of a path, i.e. a run of bytes between '/' separators.
+struct PathComponent {
+  enum class Kind : uint8_t { kName, kDot, kDotDot };
+
+  uint32_t offset;
+  uint32_t size;
+  // ComponentHash of the name.
+  uint64_t hash;
+  Kind kind;
+
+  absl::string_view Name(absl::string_view path) const {
+    return path.substr(offset, size);
+  }
+};
+
+// What ScanPath found in a path.
+struct PathScan {
+  // The number of components, including the ones that didn't fit.
+  size_t component_count = 0;
+  // How many of them are "." and "..".
+  size_t dot_count = 0;
+  size_t dot_dot_count = 0;
+};
+
+// Finds the components of path in a single pass, skipping empty ones. The
+// first out.size() components are stored in out, the rest are only counted.
+// "." and ".." are reported like any other component: folding them lexically
+// would be wrong if the path contains symlinks.
+//
+// The separators are found 32 bytes at a time with AVX2 if the CPU has it and
+// 16 bytes at a time with SSE2 otherwise. Other architectures use a scalar
+// loop.
+PathScan ScanPath(absl::string_view path, absl::Span<PathComponent> out);
+
+// An upper bound for the number of components of path.
+inline size_t MaxPathComponents(absl::string_view path) {
+  return path.size() / 2 + 1;
+}
+
+// The hash of a component name that ScanPath stores. Suitable for hash tables
+// and for rejecting unequal names early, not for anything adversarial: equal
+// hashes still need a comparison of the names.
+uint64_t ComponentHash(absl::string_view name);
+
+namespace internal {
+
+// The implementations ScanPath chooses from. All of them return the same for
+// the same input. Unsupported ones fall back to the scalar loop.
+PathScan ScanPathScalar(absl::string_view path, absl::Span<PathComponent> out);
+PathScan ScanPathSse2(absl::string_view path, absl::Span<PathComponent> out);
+PathScan ScanPathAvx2(absl::string_view path, absl::Span<PathComponent> out);
+
+}  // namespace internal
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_UTIL_PATH_SCANNER_H_
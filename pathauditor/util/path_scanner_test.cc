@@ -0,0 +1,112 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/util/path_scanner.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/strings/str_split.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::ElementsAreArray;
+using ::testing::Eq;
+using ::testing::IsEmpty;
+using ::testing::Ne;
+
+using ScanFn = PathScan (*)(absl::string_view, absl::Span<PathComponent>);
+
+std::vector<std::string> Names(ScanFn scan, absl::string_view path) {
+  std::vector<PathComponent> components(MaxPathComponents(path));
+  PathScan result = scan(path, absl::MakeSpan(components));
+  std::vector<std::string> names;
+  for (size_t i = 0; i < result.component_count; i++) {
+    names.emplace_back(components[i].Name(path));
+    EXPECT_THAT(components[i].hash, Eq(ComponentHash(names.back())));
+  }
+  return names;
+}
+
+class PathScannerTest : public ::testing::TestWithParam<ScanFn> {};
+
+TEST_P(PathScannerTest, SkipsEmptyComponents) {
+  EXPECT_THAT(Names(GetParam(), ""), IsEmpty());
+  EXPECT_THAT(Names(GetParam(), "///"), IsEmpty());
+  EXPECT_THAT(Names(GetParam(), "//usr///lib/"), ElementsAre("usr", "lib"));
+  EXPECT_THAT(Names(GetParam(), "a"), ElementsAre("a"));
+}
+
+TEST_P(PathScannerTest, CountsDots) {
+  absl::string_view path = "./a/../b/./..c/.../..";
+  std::vector<PathComponent> components(16);
+  PathScan scan = GetParam()(path, absl::MakeSpan(components));
+  EXPECT_THAT(scan.component_count, Eq(8));
+  EXPECT_THAT(scan.dot_count, Eq(2));
+  EXPECT_THAT(scan.dot_dot_count, Eq(2));
+  EXPECT_THAT(components[0].kind, Eq(PathComponent::Kind::kDot));
+  EXPECT_THAT(components[2].kind, Eq(PathComponent::Kind::kDotDot));
+  EXPECT_THAT(components[5].kind, Eq(PathComponent::Kind::kName));
+}
+
+TEST_P(PathScannerTest, CountsComponentsThatDontFit) {
+  absl::string_view path = "/a/b/c/d";
+  PathComponent components[2];
+  PathScan scan = GetParam()(path, absl::MakeSpan(components));
+  EXPECT_THAT(scan.component_count, Eq(4));
+  EXPECT_THAT(components[1].Name(path), Eq("b"));
+  EXPECT_THAT(GetParam()(path, {}).component_count, Eq(4));
+}
+
+TEST_P(PathScannerTest, ComponentsAcrossChunks) {
+  std::string long_name(40, 'x');
+  std::string path = "/" + long_name + "//" + std::string(31, 'y') + "/z";
+  EXPECT_THAT(Names(GetParam(), path),
+              ElementsAre(long_name, std::string(31, 'y'), "z"));
+}
+
+TEST_P(PathScannerTest, MatchesStrSplit) {
+  std::mt19937 rng(1);
+  const char alphabet[] = "/./ab";
+  for (int i = 0; i < 2000; i++) {
+    std::string path(rng() % 100, '\0');
+    for (char &c : path) {
+      c = alphabet[rng() % (sizeof(alphabet) - 1)];
+    }
+    std::vector<std::string> expected =
+        absl::StrSplit(path, '/', absl::SkipEmpty());
+    EXPECT_THAT(Names(GetParam(), path), ElementsAreArray(expected)) << path;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Implementations, PathScannerTest,
+                         ::testing::Values(&internal::ScanPathScalar,
+                                           &internal::ScanPathSse2,
+                                           &internal::ScanPathAvx2));
+
+TEST(ComponentHashTest, DependsOnEveryByte) {
+  EXPECT_THAT(ComponentHash("lib"), Eq(ComponentHash("lib")));
+  EXPECT_THAT(ComponentHash("lib"), Ne(ComponentHash("lib64")));
+  EXPECT_THAT(ComponentHash("abcdefgh1"), Ne(ComponentHash("abcdefgh2")));
+  EXPECT_THAT(ComponentHash("a"),
+              Ne(ComponentHash(absl::string_view("a\0", 2))));
+}
+
+}  // namespace
+}  // namespace pathauditor
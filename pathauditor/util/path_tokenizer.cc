@@ -0,0 +1,73 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/util/path_tokenizer.h"
+
+#include <cstring>
+
+#include "pathauditor/util/path_scanner.h"
+
+namespace pathauditor {
+
+absl::Status PathTokenizer::Reset(absl::string_view path) {
+  if (path.size() > PATH_MAX) {
+    return absl::FailedPreconditionError("Path is longer than PATH_MAX");
+  }
+  end_ = kCapacity;
+  begin_ = end_ - path.size();
+  memcpy(buf_ + begin_, path.data(), path.size());
+  buf_[end_] = '\0';
+  last_begin_ = 0;
+  SkipSeparators();
+  return absl::OkStatus();
+}
+
+void PathTokenizer::SkipSeparators() {
+  while (begin_ < end_ && buf_[begin_] == '/') {
+    begin_++;
+  }
+}
+
+size_t PathTokenizer::ComponentCount() const {
+  return ScanPath(Remaining(), {}).component_count;
+}
+
+absl::string_view PathTokenizer::Next() {
+  last_begin_ = begin_;
+  const char *slash = static_cast<const char *>(
+      memchr(buf_ + begin_, '/', end_ - begin_));
+  size_t component_end = slash ? slash - buf_ : end_;
+  buf_[component_end] = '\0';
+  begin_ = component_end == end_ ? end_ : component_end + 1;
+  SkipSeparators();
+  return absl::string_view(buf_ + last_begin_, component_end - last_begin_);
+}
+
+void PathTokenizer::Skip(size_t count) {
+  for (size_t i = 0; i < count && !empty(); i++) {
+    Next();
+  }
+}
+
+void PathTokenizer::Prepend(size_t len) {
+  // The separator goes where the NUL after the consumed component is, or
+  // right before the end if nothing is left.
+  size_t new_begin = begin_ - 1 - len;
+  memmove(buf_ + new_begin, buf_, len);
+  buf_[begin_ - 1] = '/';
+  begin_ = new_begin;
+  SkipSeparators();
+}
+
+}  // namespace pathauditor
@@ -0,0 +1,89 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_UTIL_PATH_TOKENIZER_H_
+#define PATHAUDITOR_UTIL_PATH_TOKENIZER_H_
+
+#include <limits.h>
+
+#include <cstddef>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+
+namespace pathauditor {
+
+// Hands out the components of a path one by one and lets the caller replace
+// the component it just got with the target of a symlink, without allocating.
+//
+// The remaining path is kept at the end of a fixed buffer. Consumed components
+// free up room in front of it, which is where symlink targets are read to and
+// then moved right before the remaining path. Empty components are skipped,
+// "." and ".." are returned like any other component.
+class PathTokenizer {
+ public:
+  static constexpr size_t kCapacity = 2 * PATH_MAX;
+
+  PathTokenizer() = default;
+
+  PathTokenizer(const PathTokenizer &) = delete;
+  PathTokenizer &operator=(const PathTokenizer &) = delete;
+
+  // Starts over with path. Fails if it's longer than PATH_MAX.
+  absl::Status Reset(absl::string_view path);
+
+  bool empty() const { return begin_ == end_; }
+
+  // The remaining components, separated by one or more '/'.
+  absl::string_view Remaining() const {
+    return absl::string_view(buf_ + begin_, end_ - begin_);
+  }
+
+  // The number of remaining components, see ScanPath.
+  size_t ComponentCount() const;
+
+  // Returns the next component and NUL terminates it in place, so that it can
+  // be passed to syscalls. It stays valid until the next call to Reset or
+  // Prepend. Must not be called if empty().
+  absl::string_view Next();
+
+  // Drops the next count components.
+  void Skip(size_t count);
+
+  // Where a symlink target can be written to, before it replaces the
+  // component returned by the last call to Next. Has room for *capacity bytes.
+  // The component itself stays intact until Prepend.
+  char *PrependBuffer(size_t *capacity) {
+    *capacity = last_begin_;
+    return buf_;
+  }
+
+  // Puts the len bytes written to the PrependBuffer in front of the remaining
+  // path. len has to be less than the capacity.
+  void Prepend(size_t len);
+
+ private:
+  void SkipSeparators();
+
+  // Remaining() is buf_[begin_, end_), buf_[end_] is always NUL.
+  char buf_[kCapacity + 1];
+  size_t begin_ = kCapacity;
+  size_t end_ = kCapacity;
+  // Where the component returned by the last call to Next starts.
+  size_t last_begin_ = 0;
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_UTIL_PATH_TOKENIZER_H_
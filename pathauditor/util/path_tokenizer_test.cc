@@ -0,0 +1,131 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/util/path_tokenizer.h"
+
+#include <limits.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "pathauditor/util/status_matchers.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::IsEmpty;
+using ::testing::Not;
+
+std::vector<std::string> Drain(PathTokenizer *tokens) {
+  std::vector<std::string> components;
+  while (!tokens->empty()) {
+    components.emplace_back(tokens->Next());
+  }
+  return components;
+}
+
+// Replaces the component that was just returned by Next with target.
+void PrependLink(PathTokenizer *tokens, absl::string_view target) {
+  size_t capacity;
+  char *buf = tokens->PrependBuffer(&capacity);
+  ASSERT_LT(target.size(), capacity);
+  memcpy(buf, target.data(), target.size());
+  tokens->Prepend(target.size());
+}
+
+TEST(PathTokenizerTest, SkipsEmptyComponents) {
+  PathTokenizer tokens;
+  ASSERT_THAT(tokens.Reset("//usr///lib/"), IsOk());
+  EXPECT_THAT(tokens.ComponentCount(), Eq(2));
+  EXPECT_THAT(Drain(&tokens), ElementsAre("usr", "lib"));
+
+  ASSERT_THAT(tokens.Reset("/"), IsOk());
+  EXPECT_TRUE(tokens.empty());
+  ASSERT_THAT(tokens.Reset(""), IsOk());
+  EXPECT_TRUE(tokens.empty());
+}
+
+TEST(PathTokenizerTest, KeepsDotComponents) {
+  PathTokenizer tokens;
+  ASSERT_THAT(tokens.Reset("./a/../b/."), IsOk());
+  EXPECT_THAT(Drain(&tokens), ElementsAre(".", "a", "..", "b", "."));
+}
+
+TEST(PathTokenizerTest, TerminatesComponents) {
+  PathTokenizer tokens;
+  ASSERT_THAT(tokens.Reset("foo/bar"), IsOk());
+  absl::string_view foo = tokens.Next();
+  EXPECT_THAT(foo.data()[foo.size()], Eq('\0'));
+  EXPECT_THAT(tokens.Remaining(), Eq("bar"));
+  absl::string_view bar = tokens.Next();
+  EXPECT_THAT(bar.data()[bar.size()], Eq('\0'));
+  // Still valid after the next component.
+  EXPECT_THAT(foo, Eq("foo"));
+}
+
+TEST(PathTokenizerTest, PrependsRelativeLink) {
+  PathTokenizer tokens;
+  ASSERT_THAT(tokens.Reset("/a/link/c"), IsOk());
+  EXPECT_THAT(tokens.Next(), Eq("a"));
+  EXPECT_THAT(tokens.Next(), Eq("link"));
+  PrependLink(&tokens, "x//y/");
+  EXPECT_THAT(tokens.ComponentCount(), Eq(3));
+  EXPECT_THAT(Drain(&tokens), ElementsAre("x", "y", "c"));
+}
+
+TEST(PathTokenizerTest, PrependsAbsoluteLinkAtTheEnd) {
+  PathTokenizer tokens;
+  ASSERT_THAT(tokens.Reset("a/link"), IsOk());
+  tokens.Skip(1);
+  EXPECT_THAT(tokens.Next(), Eq("link"));
+  EXPECT_TRUE(tokens.empty());
+  PrependLink(&tokens, "/etc/passwd");
+  EXPECT_THAT(Drain(&tokens), ElementsAre("etc", "passwd"));
+}
+
+TEST(PathTokenizerTest, PrependsLinksRepeatedly) {
+  PathTokenizer tokens;
+  ASSERT_THAT(tokens.Reset("link/end"), IsOk());
+  std::string target(PATH_MAX / 4, 'x');
+  for (int i = 0; i < 3; i++) {
+    EXPECT_THAT(tokens.Next(), Eq(i == 0 ? "link" : "next"));
+    PrependLink(&tokens, target + "/next");
+    EXPECT_THAT(tokens.Next(), Eq(target));
+  }
+  EXPECT_THAT(Drain(&tokens), ElementsAre("next", "end"));
+}
+
+TEST(PathTokenizerTest, Skips) {
+  PathTokenizer tokens;
+  ASSERT_THAT(tokens.Reset("a/b/c/d"), IsOk());
+  tokens.Skip(3);
+  EXPECT_THAT(tokens.Remaining(), Eq("d"));
+  tokens.Skip(2);
+  EXPECT_TRUE(tokens.empty());
+  EXPECT_THAT(Drain(&tokens), IsEmpty());
+}
+
+TEST(PathTokenizerTest, RejectsLongPaths) {
+  PathTokenizer tokens;
+  EXPECT_THAT(tokens.Reset(std::string(PATH_MAX, 'a')), IsOk());
+  EXPECT_THAT(tokens.Reset(std::string(PATH_MAX + 1, 'a')), Not(IsOk()));
+}
+
+}  // namespace
+}  // namespace pathauditor
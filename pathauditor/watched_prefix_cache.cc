@@ -0,0 +1,418 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/watched_prefix_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "pathauditor/util/cleanup.h"
+
+namespace pathauditor {
+
+namespace {
+
+// Everything that can change the verdict of a directory or where a name in it
+// leads. Opening the directories through /proc/self/fd needs the magic link to
+// be followed, so no IN_DONT_FOLLOW.
+constexpr uint32_t kWatchMask = IN_ATTRIB | IN_CREATE | IN_DELETE |
+                                IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF |
+                                IN_MOVE_SELF | IN_ONLYDIR;
+
+// Room for the euid, the start directory and the prefix.
+constexpr size_t kMaxKeySize = PATH_MAX + 64;
+
+// Writes the key of an entry to key, returns its size or 0 if it doesn't fit.
+size_t MakeKey(const struct stat &start, absl::string_view prefix, uid_t euid,
+               char (&key)[kMaxKeySize]) {
+  int len = snprintf(key, sizeof(key), "%u:%llu:%llu:", euid,
+                     static_cast<unsigned long long>(start.st_dev),
+                     static_cast<unsigned long long>(start.st_ino));
+  if (len < 0 || len + prefix.size() > sizeof(key)) {
+    return 0;
+  }
+  prefix.copy(key + len, prefix.size());
+  return len + prefix.size();
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<WatchedPrefixCache>> WatchedPrefixCache::Create(
+    size_t max_entries) {
+  // Polling mountinfo reports changes to the mount table of our namespace.
+  int mounts_fd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+  if (mounts_fd == -1) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Could not open /proc/self/mountinfo: ", strerror(errno)));
+  }
+  return CreateWithMountTable(mounts_fd, max_entries);
+}
+
+absl::StatusOr<std::unique_ptr<WatchedPrefixCache>>
+WatchedPrefixCache::CreateForProcess(int proc_fd, size_t max_entries) {
+  // The mountinfo of another process reports the changes in its namespace,
+  // and it keeps reporting them after the process has exited.
+  int mounts_fd = openat(proc_fd, "mountinfo", O_RDONLY | O_CLOEXEC);
+  if (mounts_fd == -1) {
+    return absl::FailedPreconditionError(absl::StrCat(
+        "Could not open the mountinfo of the process: ", strerror(errno)));
+  }
+  return CreateWithMountTable(mounts_fd, max_entries);
+}
+
+absl::StatusOr<std::unique_ptr<WatchedPrefixCache>>
+WatchedPrefixCache::CreateWithMountTable(int mounts_fd, size_t max_entries) {
+  auto close_mounts_fd = MakeCleanup([mounts_fd]() { close(mounts_fd); });
+
+  int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd == -1) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("inotify_init1 failed: ", strerror(errno)));
+  }
+  auto close_inotify_fd = MakeCleanup([inotify_fd]() { close(inotify_fd); });
+
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd == -1) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("epoll_create1 failed: ", strerror(errno)));
+  }
+  auto close_epoll_fd = MakeCleanup([epoll_fd]() { close(epoll_fd); });
+
+  struct epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = inotify_fd;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, inotify_fd, &event) == -1) {
+    return absl::FailedPreconditionError("Could not poll the inotify fd");
+  }
+  event.events = EPOLLPRI;
+  event.data.fd = mounts_fd;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, mounts_fd, &event) == -1) {
+    return absl::FailedPreconditionError("Could not poll the mount table");
+  }
+
+  close_inotify_fd.release();
+  close_mounts_fd.release();
+  close_epoll_fd.release();
+  return std::unique_ptr<WatchedPrefixCache>(
+      new WatchedPrefixCache(inotify_fd, mounts_fd, epoll_fd, max_entries));
+}
+
+WatchedPrefixCache::~WatchedPrefixCache() {
+  {
+    absl::MutexLock lock(&mu_);
+    for (auto &entry : entries_) {
+      close(entry.second.fd);
+    }
+  }
+  // Closing the inotify fd drops the watches.
+  close(epoll_fd_);
+  close(mounts_fd_);
+  close(inotify_fd_);
+}
+
+int WatchedPrefixCache::Lookup(const struct stat &start,
+                               absl::string_view prefix, uid_t euid,
+                               struct stat *dir) {
+  char key[kMaxKeySize];
+  size_t key_len = MakeKey(start, prefix, euid, key);
+  if (key_len == 0) {
+    return -1;
+  }
+  absl::ReaderMutexLock lock(&mu_);
+  auto it = entries_.find(absl::string_view(key, key_len));
+  if (it == entries_.end()) {
+    return -1;
+  }
+  int fd = fcntl(it->second.fd, F_DUPFD_CLOEXEC, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  *dir = it->second.dir;
+  return fd;
+}
+
+absl::optional<WatchedPrefixCache::Ticket> WatchedPrefixCache::Watch(
+    int start_fd, absl::string_view prefix) {
+  Ticket ticket;
+  int fd = start_fd;
+  auto close_fd = MakeCleanup([&fd, start_fd]() {
+    if (fd != start_fd) {
+      close(fd);
+    }
+  });
+
+  absl::MutexLock lock(&mu_);
+  PollLocked();
+  auto drop_watches = MakeCleanup([this, &ticket]() {
+    mu_.AssertHeld();
+    DropUnusedWatches(ticket);
+  });
+  // Watch the start directory and every directory on the way, including the
+  // one the prefix leads to.
+  size_t pos = 0;
+  while (true) {
+    char proc_path[32];
+    snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", fd);
+    int wd = inotify_add_watch(inotify_fd_, proc_path, kWatchMask);
+    if (wd == -1) {
+      return absl::nullopt;
+    }
+    ticket.generations.emplace_back(wd, watches_[wd].generation);
+
+    size_t begin = prefix.find_first_not_of('/', pos);
+    if (begin == absl::string_view::npos) {
+      break;
+    }
+    size_t end = std::min(prefix.find('/', begin), prefix.size());
+    char name[NAME_MAX + 1];
+    if (end - begin >= sizeof(name)) {
+      return absl::nullopt;
+    }
+    prefix.copy(name, end - begin, begin);
+    name[end - begin] = '\0';
+    int next = openat(fd, name, O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (next == -1) {
+      return absl::nullopt;
+    }
+    if (fd != start_fd) {
+      close(fd);
+    }
+    fd = next;
+    pos = end;
+  }
+  drop_watches.release();
+  return ticket;
+}
+
+void WatchedPrefixCache::Insert(const Ticket &ticket, const struct stat &start,
+                                absl::string_view prefix, uid_t euid, int fd,
+                                const struct stat &dir) {
+  char key_buf[kMaxKeySize];
+  size_t key_len = MakeKey(start, prefix, euid, key_buf);
+
+  // Unlike lookups, this needs to see every change that happened while the
+  // prefix was checked.
+  absl::MutexLock lock(&mu_);
+  PollLocked();
+  auto drop_watches = MakeCleanup([this, &ticket]() {
+    mu_.AssertHeld();
+    DropUnusedWatches(ticket);
+  });
+  if (key_len == 0) {
+    return;
+  }
+  for (const auto &watch : ticket.generations) {
+    auto it = watches_.find(watch.first);
+    if (it == watches_.end() || it->second.generation != watch.second) {
+      // Something changed while the prefix was checked.
+      return;
+    }
+  }
+  if (entries_.size() >= max_entries_) {
+    // Like the verdicts, the entries are cheap to recreate. Starting over is
+    // simpler than tracking which ones are still in use.
+    drop_watches.release();
+    ClearLocked();
+    return;
+  }
+  std::string key(key_buf, key_len);
+  if (entries_.contains(key)) {
+    return;
+  }
+  int dup_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  if (dup_fd == -1) {
+    return;
+  }
+
+  Entry &entry = entries_[key];
+  entry.fd = dup_fd;
+  entry.dir = dir;
+  // The i-th watch depends on the i-th component of the prefix, the last one
+  // only on the directory itself.
+  size_t pos = 0;
+  for (const auto &watch : ticket.generations) {
+    std::string name;
+    size_t begin = prefix.find_first_not_of('/', pos);
+    if (begin != absl::string_view::npos) {
+      size_t end = std::min(prefix.find('/', begin), prefix.size());
+      name = std::string(prefix.substr(begin, end - begin));
+      pos = end;
+    }
+    entry.wds.push_back(watch.first);
+    watches_[watch.first].dependents.emplace_back(std::move(name), key);
+  }
+  drop_watches.release();
+}
+
+void WatchedPrefixCache::Abandon(const Ticket &ticket) {
+  absl::MutexLock lock(&mu_);
+  DropUnusedWatches(ticket);
+}
+
+void WatchedPrefixCache::Clear() {
+  absl::MutexLock lock(&mu_);
+  ClearLocked();
+}
+
+size_t WatchedPrefixCache::size() const {
+  absl::ReaderMutexLock lock(&mu_);
+  return entries_.size();
+}
+
+void WatchedPrefixCache::Poll() {
+  // Only take the lock if there is something to apply. If two threads see the
+  // same events, the second one finds nothing left to read.
+  struct epoll_event events[2];
+  int count = epoll_wait(epoll_fd_, events, 2, 0);
+  if (count <= 0) {
+    return;
+  }
+  absl::MutexLock lock(&mu_);
+  ApplyEvents(events, count);
+}
+
+void WatchedPrefixCache::PollLocked() {
+  struct epoll_event events[2];
+  int count = epoll_wait(epoll_fd_, events, 2, 0);
+  ApplyEvents(events, count);
+}
+
+void WatchedPrefixCache::ApplyEvents(const struct epoll_event *events,
+                                     int count) {
+  for (int i = 0; i < count; i++) {
+    if (events[i].data.fd == mounts_fd_) {
+      // Something was mounted or unmounted. We don't know where, any prefix
+      // could lead somewhere else now.
+      ClearLocked();
+    } else {
+      ReadEvents();
+    }
+  }
+}
+
+void WatchedPrefixCache::ReadEvents() {
+  alignas(struct inotify_event) char buf[4096];
+  while (true) {
+    ssize_t len = read(inotify_fd_, buf, sizeof(buf));
+    if (len <= 0) {
+      return;
+    }
+    for (ssize_t off = 0; off < len;) {
+      const auto *event = reinterpret_cast<const struct inotify_event *>(buf + off);
+      off += sizeof(struct inotify_event) + event->len;
+      if (event->mask & IN_Q_OVERFLOW) {
+        // We lost track, start over.
+        ClearLocked();
+        continue;
+      }
+      auto it = watches_.find(event->wd);
+      if (it == watches_.end()) {
+        continue;
+      }
+      it->second.generation++;
+      // The name is NUL padded.
+      absl::string_view name =
+          event->len == 0 ? absl::string_view() : absl::string_view(event->name);
+      if (event->mask & IN_IGNORED) {
+        // The kernel dropped the watch, e.g. because the directory was
+        // deleted or unmounted.
+        std::vector<std::pair<std::string, std::string>> dependents =
+            std::move(it->second.dependents);
+        watches_.erase(it);
+        for (const auto &dependent : dependents) {
+          Erase(dependent.second);
+        }
+        continue;
+      }
+      Invalidate(event->wd, name);
+    }
+  }
+}
+
+void WatchedPrefixCache::Invalidate(int wd, absl::string_view name) {
+  auto it = watches_.find(wd);
+  if (it == watches_.end()) {
+    return;
+  }
+  // An event on the directory itself affects everything that goes through it,
+  // an event on a name only what goes through that name.
+  std::vector<std::string> keys;
+  for (const auto &dependent : it->second.dependents) {
+    if (name.empty() || dependent.first == name) {
+      keys.push_back(dependent.second);
+    }
+  }
+  for (const std::string &key : keys) {
+    Erase(key);
+  }
+}
+
+void WatchedPrefixCache::Erase(const std::string &key) {
+  auto entry = entries_.find(key);
+  if (entry == entries_.end()) {
+    return;
+  }
+  close(entry->second.fd);
+  for (int wd : entry->second.wds) {
+    auto watch = watches_.find(wd);
+    if (watch == watches_.end()) {
+      continue;
+    }
+    auto &dependents = watch->second.dependents;
+    dependents.erase(
+        std::remove_if(dependents.begin(), dependents.end(),
+                       [&key](const std::pair<std::string, std::string> &d) {
+                         return d.second == key;
+                       }),
+        dependents.end());
+    if (dependents.empty()) {
+      inotify_rm_watch(inotify_fd_, wd);
+      watches_.erase(watch);
+    }
+  }
+  entries_.erase(entry);
+}
+
+void WatchedPrefixCache::DropUnusedWatches(const Ticket &ticket) {
+  for (const auto &watch : ticket.generations) {
+    auto it = watches_.find(watch.first);
+    if (it != watches_.end() && it->second.dependents.empty()) {
+      inotify_rm_watch(inotify_fd_, watch.first);
+      watches_.erase(it);
+    }
+  }
+}
+
+void WatchedPrefixCache::ClearLocked() {
+  for (auto &entry : entries_) {
+    close(entry.second.fd);
+  }
+  for (auto &watch : watches_) {
+    inotify_rm_watch(inotify_fd_, watch.first);
+  }
+  entries_.clear();
+  watches_.clear();
+}
+
+}  // namespace pathauditor
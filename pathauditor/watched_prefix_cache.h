@@ -0,0 +1,152 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PATHAUDITOR_WATCHED_PREFIX_CACHE_H_
+#define PATHAUDITOR_WATCHED_PREFIX_CACHE_H_
+
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
+
+namespace pathauditor {
+
+// Remembers which directory a symlink free path prefix led to, for prefixes
+// that the walk found to be free of user controlled directories. Instead of
+// expiring, entries are kept until inotify reports a change that could affect
+// them: the attributes of a directory on the way changing, or one of the
+// names on the way being created, deleted or renamed. Other changes in the
+// same directories leave the entries alone. Any change to the mount table
+// drops everything, so the cache must only be used for paths that resolve in
+// the mount namespace it was created for.
+// Lookups don't look for changes themselves, so that they don't cost a
+// syscall and can run in parallel. Call Poll before each batch of audits.
+// Thread-safe.
+class WatchedPrefixCache {
+ public:
+  static constexpr size_t kDefaultMaxEntries = 4096;
+
+  // A cache for paths in our mount namespace.
+  static absl::StatusOr<std::unique_ptr<WatchedPrefixCache>> Create(
+      size_t max_entries = kDefaultMaxEntries);
+  // A cache for paths in the mount namespace of the process whose /proc
+  // directory is proc_fd. Doesn't take ownership of proc_fd.
+  static absl::StatusOr<std::unique_ptr<WatchedPrefixCache>> CreateForProcess(
+      int proc_fd, size_t max_entries = kDefaultMaxEntries);
+  ~WatchedPrefixCache();
+
+  WatchedPrefixCache(const WatchedPrefixCache &) = delete;
+  WatchedPrefixCache &operator=(const WatchedPrefixCache &) = delete;
+
+  // The state of the watches at some point, see Watch.
+  struct Ticket {
+    std::vector<std::pair<int, uint64_t>> generations;
+  };
+
+  // Applies the changes that inotify and the mount table reported since the
+  // last call. Lookups only see changes once they were applied. Costs a single
+  // epoll_wait if nothing changed.
+  void Poll();
+
+  // Returns a new fd for the directory that prefix led to from the directory
+  // start, and its stat from when it was inserted. Returns -1 on a miss.
+  // Entries are specific to the effective uid.
+  int Lookup(const struct stat &start, absl::string_view prefix, uid_t euid,
+             struct stat *dir);
+
+  // Starts watching the directories on the way from start_fd through prefix.
+  // Check the prefix after this and insert it with the returned ticket. Fails
+  // if a directory couldn't be watched, e.g. because of the inotify limits.
+  absl::optional<Ticket> Watch(int start_fd, absl::string_view prefix);
+
+  // Inserts the directory that prefix led to, unless a watched directory
+  // changed since Watch returned the ticket. Doesn't take ownership of fd.
+  void Insert(const Ticket &ticket, const struct stat &start,
+              absl::string_view prefix, uid_t euid, int fd,
+              const struct stat &dir);
+
+  // Drops the watches of a ticket that won't be inserted.
+  void Abandon(const Ticket &ticket);
+
+  // Drops all entries and watches.
+  void Clear();
+
+  size_t size() const;
+
+ private:
+  struct Entry {
+    int fd;
+    struct stat dir;
+    // The watches the entry depends on.
+    std::vector<int> wds;
+  };
+
+  struct WatchRecord {
+    // Bumped on every event.
+    uint64_t generation = 0;
+    // The entries that depend on a name in the directory, keyed by entry. An
+    // empty name means the entry only depends on the directory itself.
+    std::vector<std::pair<std::string, std::string>> dependents;
+  };
+
+  // Takes ownership of mounts_fd, an open mountinfo file.
+  static absl::StatusOr<std::unique_ptr<WatchedPrefixCache>>
+  CreateWithMountTable(int mounts_fd, size_t max_entries);
+
+  WatchedPrefixCache(int inotify_fd, int mounts_fd, int epoll_fd,
+                     size_t max_entries)
+      : inotify_fd_(inotify_fd),
+        mounts_fd_(mounts_fd),
+        epoll_fd_(epoll_fd),
+        max_entries_(max_entries) {}
+
+  // Applies the pending events.
+  void PollLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  void ApplyEvents(const struct epoll_event *events, int count)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  void ReadEvents() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  void Invalidate(int wd, absl::string_view name)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  void Erase(const std::string &key) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  // Removes the watches of the ticket that no entry depends on.
+  void DropUnusedWatches(const Ticket &ticket)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  void ClearLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const int inotify_fd_;
+  const int mounts_fd_;
+  const int epoll_fd_;
+  const size_t max_entries_;
+
+  mutable absl::Mutex mu_;
+  absl::flat_hash_map<std::string, Entry> entries_ ABSL_GUARDED_BY(mu_);
+  absl::flat_hash_map<int, WatchRecord> watches_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace pathauditor
+
+#endif  // PATHAUDITOR_WATCHED_PREFIX_CACHE_H_
@@ -0,0 +1,182 @@
+// Copyright 2019 Google LLC. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pathauditor/watched_prefix_cache.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace pathauditor {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Ne;
+
+class WatchedPrefixCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir_template[] = "/tmp/watched_prefix_cache_test.XXXXXX";
+    ASSERT_THAT(mkdtemp(dir_template), Ne(nullptr));
+    dir_ = dir_template;
+    for (const char *sub : {"/a", "/a/b", "/a/b/c", "/a/x", "/a/x/y"}) {
+      ASSERT_THAT(mkdir((dir_ + sub).c_str(), 0755), Eq(0));
+    }
+    start_fd_ = open(dir_.c_str(), O_RDONLY | O_DIRECTORY);
+    ASSERT_THAT(start_fd_, Ne(-1));
+    ASSERT_THAT(fstat(start_fd_, &start_), Eq(0));
+    absl::StatusOr<std::unique_ptr<WatchedPrefixCache>> cache =
+        WatchedPrefixCache::Create();
+    ASSERT_TRUE(cache.ok()) << cache.status();
+    cache_ = *std::move(cache);
+  }
+
+  void TearDown() override {
+    cache_.reset();
+    close(start_fd_);
+    for (const char *sub : {"/a/x/y", "/a/x", "/a/b/c", "/a/b", "/a/moved/c",
+                            "/a/moved", "/a"}) {
+      rmdir((dir_ + sub).c_str());
+    }
+    rmdir(dir_.c_str());
+  }
+
+  // Watches and inserts prefix like a walk would.
+  void Insert(const std::string &prefix) {
+    absl::optional<WatchedPrefixCache::Ticket> ticket =
+        cache_->Watch(start_fd_, prefix);
+    ASSERT_TRUE(ticket.has_value());
+    int fd = openat(start_fd_, prefix.c_str(), O_RDONLY | O_DIRECTORY);
+    ASSERT_THAT(fd, Ne(-1));
+    struct stat sb;
+    ASSERT_THAT(fstat(fd, &sb), Eq(0));
+    cache_->Insert(*ticket, start_, prefix, geteuid(), fd, sb);
+    close(fd);
+  }
+
+  // Polls first, like the daemon does before each batch.
+  bool Hits(const std::string &prefix) {
+    cache_->Poll();
+    struct stat sb;
+    int fd = cache_->Lookup(start_, prefix, geteuid(), &sb);
+    if (fd == -1) {
+      return false;
+    }
+    close(fd);
+    return true;
+  }
+
+  std::string dir_;
+  int start_fd_ = -1;
+  struct stat start_;
+  std::unique_ptr<WatchedPrefixCache> cache_;
+};
+
+TEST_F(WatchedPrefixCacheTest, ReturnsInsertedDirectory) {
+  EXPECT_FALSE(Hits("a/b/c"));
+  Insert("a/b/c");
+  struct stat sb;
+  int fd = cache_->Lookup(start_, "a/b/c", geteuid(), &sb);
+  ASSERT_THAT(fd, Ne(-1));
+  struct stat expected;
+  ASSERT_THAT(stat((dir_ + "/a/b/c").c_str(), &expected), Eq(0));
+  struct stat actual;
+  ASSERT_THAT(fstat(fd, &actual), Eq(0));
+  EXPECT_THAT(actual.st_ino, Eq(expected.st_ino));
+  EXPECT_THAT(sb.st_ino, Eq(expected.st_ino));
+  close(fd);
+  // Entries are per euid.
+  EXPECT_THAT(cache_->Lookup(start_, "a/b/c", geteuid() + 1, &sb), Eq(-1));
+}
+
+TEST_F(WatchedPrefixCacheTest, AttributeChangeInvalidates) {
+  Insert("a/b/c");
+  Insert("a/x/y");
+  ASSERT_THAT(chmod((dir_ + "/a/b").c_str(), 0777), Eq(0));
+  EXPECT_FALSE(Hits("a/b/c"));
+  // The name b doesn't appear in the other prefix.
+  EXPECT_TRUE(Hits("a/x/y"));
+}
+
+TEST_F(WatchedPrefixCacheTest, AttributeChangeOfTargetInvalidates) {
+  Insert("a/b/c");
+  ASSERT_THAT(chmod((dir_ + "/a/b/c").c_str(), 0700), Eq(0));
+  EXPECT_FALSE(Hits("a/b/c"));
+}
+
+TEST_F(WatchedPrefixCacheTest, RenameInvalidates) {
+  Insert("a/b/c");
+  Insert("a/x/y");
+  ASSERT_THAT(rename((dir_ + "/a/b").c_str(), (dir_ + "/a/moved").c_str()),
+              Eq(0));
+  EXPECT_FALSE(Hits("a/b/c"));
+  EXPECT_TRUE(Hits("a/x/y"));
+}
+
+TEST_F(WatchedPrefixCacheTest, LookupsSeeChangesAfterPoll) {
+  Insert("a/b/c");
+  ASSERT_THAT(chmod((dir_ + "/a/b").c_str(), 0777), Eq(0));
+  struct stat sb;
+  int fd = cache_->Lookup(start_, "a/b/c", geteuid(), &sb);
+  EXPECT_THAT(fd, Ne(-1));
+  close(fd);
+  cache_->Poll();
+  EXPECT_THAT(cache_->Lookup(start_, "a/b/c", geteuid(), &sb), Eq(-1));
+}
+
+TEST_F(WatchedPrefixCacheTest, UnrelatedChangesKeepEntries) {
+  Insert("a/b/c");
+  ASSERT_THAT(mkdir((dir_ + "/a/b/other").c_str(), 0755), Eq(0));
+  ASSERT_THAT(rmdir((dir_ + "/a/b/other").c_str()), Eq(0));
+  EXPECT_TRUE(Hits("a/b/c"));
+}
+
+TEST_F(WatchedPrefixCacheTest, ChangeDuringCheckIsNotInserted) {
+  absl::optional<WatchedPrefixCache::Ticket> ticket =
+      cache_->Watch(start_fd_, "a/b/c");
+  ASSERT_TRUE(ticket.has_value());
+  int fd = openat(start_fd_, "a/b/c", O_RDONLY | O_DIRECTORY);
+  ASSERT_THAT(fd, Ne(-1));
+  struct stat sb;
+  ASSERT_THAT(fstat(fd, &sb), Eq(0));
+  ASSERT_THAT(chmod((dir_ + "/a").c_str(), 0777), Eq(0));
+  cache_->Insert(*ticket, start_, "a/b/c", geteuid(), fd, sb);
+  close(fd);
+  EXPECT_FALSE(Hits("a/b/c"));
+  EXPECT_THAT(cache_->size(), Eq(0));
+}
+
+TEST_F(WatchedPrefixCacheTest, ClearsWhenFull) {
+  absl::StatusOr<std::unique_ptr<WatchedPrefixCache>> cache =
+      WatchedPrefixCache::Create(/*max_entries=*/1);
+  ASSERT_TRUE(cache.ok()) << cache.status();
+  cache_ = *std::move(cache);
+  Insert("a/b/c");
+  Insert("a/x/y");
+  EXPECT_THAT(cache_->size(), Eq(0));
+  Insert("a/x/y");
+  EXPECT_TRUE(Hits("a/x/y"));
+}
+
+}  // namespace
+}  // namespace pathauditor